@@ -0,0 +1,363 @@
+﻿#include "AsyncIO.h"
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+	// Largest single ReadFile/WriteFile; bigger requests are issued in pieces.
+	constexpr size_t MaxTransfer = 1u << 30;
+	constexpr uint64_t AppendOffset = UINT64_MAX;
+
+	// Completion keys. Overlapped transfers complete with TransferKey, the
+	// rest are posted by the engine itself.
+	constexpr ULONG_PTR TransferKey = 0;
+	constexpr ULONG_PTR WorkKey = 1;
+	constexpr ULONG_PTR BlockingKey = 2;
+	constexpr ULONG_PTR FinishKey = 3;
+	constexpr ULONG_PTR StopKey = 4;
+
+	bool has(FileOptions options, FileOptions flag) {
+		return ((int)options & (int)flag) != 0;
+	}
+
+	void set_offset(OVERLAPPED& overlapped, uint64_t offset) {
+		overlapped = OVERLAPPED{};
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	}
+
+	// ThreadPool backend. The handle is still overlapped so that workers do
+	// not queue on its file lock; each waits on an event of its own.
+	bool transfer(HANDLE file, bool write, void* data, DWORD size, uint64_t offset, DWORD& done) {
+		struct Event {
+			HANDLE handle = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+			~Event() { if (handle) CloseHandle(handle); }
+		};
+		thread_local Event event;
+		OVERLAPPED overlapped;
+		set_offset(overlapped, offset);
+		overlapped.hEvent = event.handle;
+		done = 0;
+		BOOL ok = write ? WriteFile(file, data, size, nullptr, &overlapped) : ReadFile(file, data, size, nullptr, &overlapped);
+		if (ok || GetLastError() == ERROR_IO_PENDING)
+			ok = GetOverlappedResult(file, &overlapped, &done, TRUE);
+		if (!ok && !write && GetLastError() == ERROR_HANDLE_EOF) {
+			done = 0;
+			return true;
+		}
+		return ok != FALSE;
+	}
+}
+
+struct AsyncIO::Operation {
+	// First, so the OVERLAPPED* dequeued from the port is the operation.
+	OVERLAPPED overlapped{};
+	HANDLE file = INVALID_HANDLE_VALUE;
+	uint8_t* buffer = nullptr;
+	size_t size = 0;
+	uint64_t offset = 0;
+	// Bytes transferred by earlier pieces.
+	size_t done = 0;
+	bool write = false;
+	bool append = false;
+	long long result = 0;
+	AsyncCallback callback;
+	std::function<void()> work;
+};
+
+AsyncFile::~AsyncFile() {
+	Close();
+}
+AsyncFile::AsyncFile(AsyncFile&& other) noexcept {
+	*this = std::move(other);
+}
+AsyncFile& AsyncFile::operator=(AsyncFile&& other) noexcept {
+	if (this != &other) {
+		Close();
+		std::swap(handle, other.handle);
+		std::swap(append, other.append);
+	}
+	return *this;
+}
+uint64_t AsyncFile::Length() const {
+	LARGE_INTEGER length;
+	if (!IsOpen() || !GetFileSizeEx(handle, &length))
+		return 0;
+	return (uint64_t)length.QuadPart;
+}
+void AsyncFile::Close() {
+	if (!IsOpen())
+		return;
+	CloseHandle(handle);
+	handle = INVALID_HANDLE_VALUE;
+}
+
+AsyncIO::AsyncIO(unsigned threads, AsyncBackend backend) : backend(backend) {
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, threads);
+	if (!port)
+		throw std::runtime_error("Failed to create completion port");
+	workers.reserve(threads);
+	for (unsigned i = 0; i < threads; i++)
+		workers.emplace_back(&AsyncIO::Worker, this);
+}
+AsyncIO::~AsyncIO() {
+	Wait();
+	for (size_t i = 0; i < workers.size(); i++)
+		PostQueuedCompletionStatus(port, 0, StopKey, nullptr);
+	for (std::thread& worker : workers)
+		worker.join();
+	CloseHandle(port);
+}
+
+AsyncFile AsyncIO::Open(const std::string& path, FileMode mode, FileOptions options) {
+	DWORD access;
+	DWORD disposition;
+	switch (mode) {
+	case FileMode::Read:
+		access = GENERIC_READ;
+		disposition = OPEN_EXISTING;
+		break;
+	case FileMode::Write:
+		access = GENERIC_WRITE;
+		disposition = CREATE_ALWAYS;
+		break;
+	case FileMode::Append:
+		access = GENERIC_WRITE;
+		disposition = OPEN_ALWAYS;
+		break;
+	case FileMode::ReadWrite:
+		access = GENERIC_READ | GENERIC_WRITE;
+		disposition = OPEN_EXISTING;
+		break;
+	default:
+		throw std::invalid_argument("Invalid mode");
+	}
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED;
+	if (has(options, FileOptions::Direct))
+		flags |= FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH;
+	if (has(options, FileOptions::Sequential))
+		flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+	if (has(options, FileOptions::RandomAccess))
+		flags |= FILE_FLAG_RANDOM_ACCESS;
+	if (has(options, FileOptions::WriteThrough))
+		flags |= FILE_FLAG_WRITE_THROUGH;
+	AsyncFile file;
+	file.handle = CreateFileA(path.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, disposition, flags, nullptr);
+	if (!file.IsOpen())
+		throw std::runtime_error("Failed to open file");
+	file.append = mode == FileMode::Append;
+	if (backend == AsyncBackend::CompletionPort && CreateIoCompletionPort(file.handle, port, TransferKey, 0) != port)
+		throw std::runtime_error("Failed to attach file to completion port");
+	return file;
+}
+
+void AsyncIO::Submit(Span<const AsyncRequest> requests) {
+	// Checked up front so that a bad request leaves nothing half submitted.
+	for (const AsyncRequest& request : requests) {
+		if (!request.File || !request.File->IsOpen())
+			throw std::invalid_argument("File is not open");
+	}
+	for (const AsyncRequest& request : requests) {
+		Operation* op = new Operation;
+		op->file = request.File->handle;
+		op->buffer = static_cast<uint8_t*>(request.Buffer);
+		op->size = request.Size;
+		op->offset = request.Offset;
+		op->write = request.Write;
+		op->append = request.Write && request.File->append;
+		op->callback = request.Done;
+		pending++;
+		if (op->size == 0)
+			Post(op, FinishKey);
+		else
+			Issue(op);
+	}
+}
+void AsyncIO::Read(const AsyncFile& file, void* buffer, size_t size, uint64_t offset, AsyncCallback done) {
+	AsyncRequest request{ &file, buffer, size, offset, false, std::move(done) };
+	Submit(Span<const AsyncRequest>(&request, 1));
+}
+void AsyncIO::Write(const AsyncFile& file, const void* buffer, size_t size, uint64_t offset, AsyncCallback done) {
+	AsyncRequest request{ &file, const_cast<void*>(buffer), size, offset, true, std::move(done) };
+	Submit(Span<const AsyncRequest>(&request, 1));
+}
+std::future<long long> AsyncIO::Read(const AsyncFile& file, void* buffer, size_t size, uint64_t offset) {
+	auto promise = std::make_shared<std::promise<long long>>();
+	std::future<long long> result = promise->get_future();
+	Read(file, buffer, size, offset, [promise](long long bytes) { promise->set_value(bytes); });
+	return result;
+}
+std::future<long long> AsyncIO::Write(const AsyncFile& file, const void* buffer, size_t size, uint64_t offset) {
+	auto promise = std::make_shared<std::promise<long long>>();
+	std::future<long long> result = promise->get_future();
+	Write(file, buffer, size, offset, [promise](long long bytes) { promise->set_value(bytes); });
+	return result;
+}
+
+void AsyncIO::ReadAllBytes(const std::string& path, std::function<void(bool ok, std::vector<uint8_t>& data)> done) {
+	Run([this, path, done]() {
+		struct Whole {
+			AsyncFile file;
+			std::vector<uint8_t> data;
+		};
+		auto whole = std::make_shared<Whole>();
+		try {
+			whole->file = Open(path, FileMode::Read, FileOptions::Sequential);
+		}
+		catch (const std::runtime_error&) {
+			done(false, whole->data);
+			return;
+		}
+		whole->data.resize((size_t)whole->file.Length());
+		if (whole->data.empty()) {
+			whole->file.Close();
+			done(true, whole->data);
+			return;
+		}
+		Read(whole->file, whole->data.data(), whole->data.size(), 0, [whole, done](long long bytes) {
+			whole->file.Close();
+			if (bytes < 0) {
+				whole->data.clear();
+				done(false, whole->data);
+				return;
+			}
+			// The file may have shrunk since its length was taken.
+			whole->data.resize((size_t)bytes);
+			done(true, whole->data);
+		});
+	});
+}
+std::future<std::vector<uint8_t>> AsyncIO::ReadAllBytes(const std::string& path) {
+	auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+	std::future<std::vector<uint8_t>> result = promise->get_future();
+	ReadAllBytes(path, [promise](bool ok, std::vector<uint8_t>& data) {
+		if (ok)
+			promise->set_value(std::move(data));
+		else
+			promise->set_exception(std::make_exception_ptr(std::runtime_error("Failed to read file")));
+	});
+	return result;
+}
+
+void AsyncIO::Run(std::function<void()> work) {
+	Operation* op = new Operation;
+	op->work = std::move(work);
+	pending++;
+	Post(op, WorkKey);
+}
+
+void AsyncIO::Wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [this] { return pending.load() == 0; });
+}
+
+void AsyncIO::Worker() {
+	OVERLAPPED_ENTRY entries[CompletionBatch];
+	for (;;) {
+		ULONG count = 0;
+		if (!GetQueuedCompletionStatusEx(port, entries, (ULONG)CompletionBatch, &count, INFINITE, FALSE))
+			continue;
+		size_t stops = 0;
+		for (ULONG i = 0; i < count; i++) {
+			if (entries[i].lpCompletionKey == StopKey)
+				stops++;
+			else
+				Dispatch(reinterpret_cast<Operation*>(entries[i].lpOverlapped), entries[i].lpCompletionKey);
+		}
+		if (stops > 0) {
+			// Each worker takes one stop; hand back any extra dequeued here.
+			for (size_t i = 1; i < stops; i++)
+				PostQueuedCompletionStatus(port, 0, StopKey, nullptr);
+			return;
+		}
+	}
+}
+
+void AsyncIO::Dispatch(Operation* op, ULONG_PTR key) {
+	switch (key) {
+	case TransferKey: {
+		DWORD bytes = 0;
+		if (!GetOverlappedResult(op->file, &op->overlapped, &bytes, FALSE)) {
+			if (op->write || GetLastError() != ERROR_HANDLE_EOF) {
+				Finish(op, -1);
+				return;
+			}
+			bytes = 0;
+		}
+		op->done += bytes;
+		if (bytes > 0 && op->done < op->size)
+			Issue(op);
+		else
+			Finish(op, op->write && op->done < op->size ? -1 : (long long)op->done);
+		return;
+	}
+	case BlockingKey: {
+		while (op->done < op->size) {
+			DWORD bytes;
+			const uint64_t at = op->append ? AppendOffset : op->offset + op->done;
+			if (!transfer(op->file, op->write, op->buffer + op->done, (DWORD)std::min(op->size - op->done, MaxTransfer), at, bytes)) {
+				Finish(op, -1);
+				return;
+			}
+			if (bytes == 0)
+				break;
+			op->done += bytes;
+		}
+		Finish(op, op->write && op->done < op->size ? -1 : (long long)op->done);
+		return;
+	}
+	case WorkKey: {
+		std::function<void()> work = std::move(op->work);
+		delete op;
+		work();
+		Done();
+		return;
+	}
+	default:
+		Finish(op, op->result);
+		return;
+	}
+}
+
+void AsyncIO::Issue(Operation* op) {
+	if (backend == AsyncBackend::ThreadPool) {
+		Post(op, BlockingKey);
+		return;
+	}
+	const DWORD size = (DWORD)std::min(op->size - op->done, MaxTransfer);
+	set_offset(op->overlapped, op->append ? AppendOffset : op->offset + op->done);
+	const BOOL ok = op->write ? WriteFile(op->file, op->buffer + op->done, size, nullptr, &op->overlapped)
+		: ReadFile(op->file, op->buffer + op->done, size, nullptr, &op->overlapped);
+	if (ok || GetLastError() == ERROR_IO_PENDING)
+		return;
+	// A call that fails outright queues no packet. It still finishes on a
+	// worker, so callbacks never run on the submitting thread.
+	op->result = !op->write && GetLastError() == ERROR_HANDLE_EOF ? (long long)op->done : -1;
+	Post(op, FinishKey);
+}
+
+void AsyncIO::Post(Operation* op, ULONG_PTR key) {
+	if (!PostQueuedCompletionStatus(port, 0, key, &op->overlapped))
+		Dispatch(op, key);
+}
+
+void AsyncIO::Finish(Operation* op, long long result) {
+	AsyncCallback callback = std::move(op->callback);
+	delete op;
+	if (callback)
+		callback(result);
+	Done();
+}
+
+void AsyncIO::Done() {
+	if (pending.fetch_sub(1) == 1) {
+		// Taking the lock orders this with a Wait() between its check and
+		// its sleep.
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+		}
+		idle.notify_all();
+	}
+}
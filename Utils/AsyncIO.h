@@ -0,0 +1,125 @@
+﻿#pragma once
+#include "defines.h"
+#include "FileStream.h"
+#include "Span.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class AsyncBackend {
+	// Overlapped handles on an I/O completion port. Requests stay in flight in
+	// the kernel and workers only run completions, so hundreds can be
+	// outstanding on a few threads.
+	CompletionPort,
+	// Blocking positional calls on the worker threads. Useful where overlapped
+	// I/O completes synchronously anyway (cached reads, some network shares);
+	// at most Threads() requests are in flight.
+	ThreadPool,
+};
+
+// A file opened by an AsyncIO engine. Only that engine may issue I/O on it,
+// and the file must stay open until its requests have completed.
+class AsyncFile {
+public:
+	AsyncFile() = default;
+	~AsyncFile();
+	AsyncFile(AsyncFile&& other) noexcept;
+	AsyncFile& operator=(AsyncFile&& other) noexcept;
+	AsyncFile(const AsyncFile&) = delete;
+	AsyncFile& operator=(const AsyncFile&) = delete;
+
+	bool IsOpen() const { return handle != INVALID_HANDLE_VALUE; }
+	uint64_t Length() const;
+	void Close();
+	HANDLE NativeHandle() const { return handle; }
+
+private:
+	friend class AsyncIO;
+	HANDLE handle = INVALID_HANDLE_VALUE;
+	bool append = false;
+};
+
+// Called on a worker thread with the bytes transferred, or -1 on error. A read
+// comes up short only at the end of the file.
+using AsyncCallback = std::function<void(long long bytes)>;
+
+struct AsyncRequest {
+	const AsyncFile* File;
+	void* Buffer;
+	size_t Size;
+	uint64_t Offset;
+	bool Write;
+	AsyncCallback Done;
+};
+
+// Asynchronous file I/O. Requests are submitted without blocking and complete
+// on the engine's worker threads through a callback or a future; buffers must
+// stay valid until then. Opening a file cannot be made asynchronous on
+// Windows, so ReadAllBytes() opens on a worker as well, which is what makes
+// reading thousands of small files overlap. Callbacks must not throw.
+//
+//     AsyncIO io;
+//     for (auto& path : paths)
+//         io.ReadAllBytes(path, [](bool ok, std::vector<uint8_t>& data) { ... });
+//     io.Wait();
+class AsyncIO {
+public:
+	// Completions dequeued by a worker per wake-up.
+	static constexpr size_t CompletionBatch = 64;
+
+	// threads 0 uses one per logical processor.
+	explicit AsyncIO(unsigned threads = 0, AsyncBackend backend = AsyncBackend::CompletionPort);
+	// Waits for every outstanding request.
+	~AsyncIO();
+	AsyncIO(const AsyncIO&) = delete;
+	AsyncIO& operator=(const AsyncIO&) = delete;
+
+	// Opens a file for this engine. Append writes ignore the request offset.
+	// Throws std::runtime_error if the file cannot be opened.
+	AsyncFile Open(const std::string& path, FileMode mode = FileMode::Read, FileOptions options = FileOptions::None);
+
+	// Issues every request before returning; each completes on its own.
+	void Submit(Span<const AsyncRequest> requests);
+	void Read(const AsyncFile& file, void* buffer, size_t size, uint64_t offset, AsyncCallback done);
+	void Write(const AsyncFile& file, const void* buffer, size_t size, uint64_t offset, AsyncCallback done);
+	std::future<long long> Read(const AsyncFile& file, void* buffer, size_t size, uint64_t offset);
+	std::future<long long> Write(const AsyncFile& file, const void* buffer, size_t size, uint64_t offset);
+
+	// Opens, reads and closes a whole file. done receives false and no data if
+	// the file cannot be opened or read.
+	void ReadAllBytes(const std::string& path, std::function<void(bool ok, std::vector<uint8_t>& data)> done);
+	// The future throws std::runtime_error if the file cannot be read.
+	std::future<std::vector<uint8_t>> ReadAllBytes(const std::string& path);
+
+	// Runs work on a worker thread; it counts as outstanding until it returns.
+	void Run(std::function<void()> work);
+	// Blocks until nothing is outstanding, including requests issued by
+	// callbacks meanwhile. Must not be called from a callback.
+	void Wait();
+	size_t Pending() const { return pending.load(); }
+	unsigned Threads() const { return (unsigned)workers.size(); }
+	AsyncBackend Backend() const { return backend; }
+
+	struct Operation;
+
+private:
+	HANDLE port = nullptr;
+	AsyncBackend backend;
+	std::vector<std::thread> workers;
+	std::atomic<size_t> pending{ 0 };
+	std::mutex mutex;
+	std::condition_variable idle;
+
+	void Worker();
+	void Dispatch(Operation* op, ULONG_PTR key);
+	void Issue(Operation* op);
+	void Post(Operation* op, ULONG_PTR key);
+	void Finish(Operation* op, long long result);
+	void Done();
+};
@@ -0,0 +1,92 @@
+﻿#include "BufferedFileWriter.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+	FileMode writer_mode(FileMode mode) {
+		if (mode != FileMode::Append && mode != FileMode::Write)
+			throw std::invalid_argument("BufferedFileWriter needs FileMode::Append or FileMode::Write");
+		return mode;
+	}
+}
+
+BufferedFileWriter::BufferedFileWriter(const std::string& path, FileMode mode, size_t bufferSize)
+	: stream(path, writer_mode(mode)), capacity(std::max<size_t>(bufferSize, 1)) {
+	buffer.reserve(capacity);
+}
+BufferedFileWriter::~BufferedFileWriter() {
+	Close();
+}
+
+bool BufferedFileWriter::Write(ByteSpan data) {
+	std::lock_guard<std::mutex> lock(mutex);
+	return Append(data.data(), data.size());
+}
+bool BufferedFileWriter::Write(std::string_view text) {
+	std::lock_guard<std::mutex> lock(mutex);
+	return Append(text.data(), text.size());
+}
+bool BufferedFileWriter::WriteLine(std::string_view text) {
+	std::lock_guard<std::mutex> lock(mutex);
+	return Append(text.data(), text.size()) && Append("\n", 1);
+}
+
+bool BufferedFileWriter::Append(const void* data, size_t size) {
+	if (!stream.IsOpen())
+		return false;
+	if (buffer.size() + size > capacity && !FlushBuffer())
+		return false;
+	if (size >= capacity) {
+		// Too big to batch; goes straight to the file.
+		if (!stream.Write(data, size) || !stream.Flush())
+			return false;
+		written += size;
+		return true;
+	}
+	if (buffer.empty())
+		oldest = std::chrono::steady_clock::now();
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	buffer.insert(buffer.end(), bytes, bytes + size);
+	written += size;
+	if (interval.count() > 0 && std::chrono::steady_clock::now() - oldest >= interval)
+		return FlushBuffer();
+	return true;
+}
+
+bool BufferedFileWriter::FlushBuffer() {
+	if (buffer.empty())
+		return true;
+	// FileStream keeps writes smaller than its own buffer; Flush() passes
+	// them on so a batch never waits twice.
+	const bool ok = stream.Write(buffer.data(), buffer.size()) && stream.Flush();
+	// A failed batch is dropped, so it no longer counts as written.
+	if (!ok)
+		written -= buffer.size();
+	buffer.clear();
+	return ok;
+}
+
+void BufferedFileWriter::SetFlushInterval(std::chrono::milliseconds interval) {
+	std::lock_guard<std::mutex> lock(mutex);
+	this->interval = interval;
+}
+bool BufferedFileWriter::Flush() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return FlushBuffer();
+}
+bool BufferedFileWriter::Sync() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return FlushBuffer() && stream.Sync();
+}
+void BufferedFileWriter::Close() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!stream.IsOpen())
+		return;
+	FlushBuffer();
+	stream.Close();
+}
+
+uint64_t BufferedFileWriter::BytesWritten() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return written;
+}
@@ -1,37 +1,621 @@
 ﻿#include "CRandom.h"
-#include "Utils.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <memory>
 #include <random>
-std::random_device rd;
-std::mt19937 gen(rd());
+#include <stdexcept>
+#include <thread>
+
+namespace {
+	uint64_t splitmix64(uint64_t& x) {
+		uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	// 64x64 -> 128-bit multiply, returning the low half and storing the high half.
+	inline uint64_t mul64(uint64_t a, uint64_t b, uint64_t* high) {
+#if defined(__SIZEOF_INT128__)
+		const unsigned __int128 product = (unsigned __int128)a * b;
+		*high = (uint64_t)(product >> 64);
+		return (uint64_t)product;
+#elif defined(_MSC_VER) && defined(_M_X64)
+		return _umul128(a, b, high);
+#else
+		const uint64_t lolo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+		const uint64_t hilo = (a >> 32) * (b & 0xFFFFFFFF);
+		const uint64_t lohi = (a & 0xFFFFFFFF) * (b >> 32);
+		const uint64_t hihi = (a >> 32) * (b >> 32);
+		const uint64_t cross = (lolo >> 32) + (hilo & 0xFFFFFFFF) + lohi;
+		*high = (hilo >> 32) + (cross >> 32) + hihi;
+		return (cross << 32) | (lolo & 0xFFFFFFFF);
+#endif
+	}
+
+	// Lemire, "Fast Random Integer Generation in an Interval" (2019).
+	template<typename Engine>
+	uint64_t bounded64(Engine& engine, uint64_t bound) {
+		uint64_t high;
+		uint64_t low = mul64(engine.Next(), bound, &high);
+		if (low < bound) {
+			const uint64_t threshold = (0 - bound) % bound;
+			while (low < threshold)
+				low = mul64(engine.Next(), bound, &high);
+		}
+		return high;
+	}
+
+	template<typename Engine>
+	void fill_bytes(Engine& engine, void* buffer, size_t count) {
+		uint8_t* p = static_cast<uint8_t*>(buffer);
+		for (; count >= 8; count -= 8, p += 8) {
+			const uint64_t word = engine.Next();
+			std::memcpy(p, &word, 8);
+		}
+		if (count) {
+			const uint64_t word = engine.Next();
+			std::memcpy(p, &word, count);
+		}
+	}
+
+	struct U128 {
+		uint64_t high, low;
+	};
+	inline U128 add128(U128 a, U128 b) {
+		const uint64_t low = a.low + b.low;
+		return { a.high + b.high + (low < a.low), low };
+	}
+	inline U128 mul128(U128 a, U128 b) {
+		uint64_t high;
+		const uint64_t low = mul64(a.low, b.low, &high);
+		return { high + a.high * b.low + a.low * b.high, low };
+	}
+
+	Xoshiro256 stream_origin(uint64_t seed, uint64_t stream) {
+		Xoshiro256 origin(seed);
+		for (uint64_t i = 0; i < stream; i++)
+			origin.LongJump();
+		return origin;
+	}
+
+	constexpr U128 PcgMultiplier = { 0x2360ED051FC65DA4ULL, 0x4385DF649FCCF645ULL };
+
+	// Brown, "Random Number Generation with Arbitrary Stride": the affine map
+	// x -> m x + c applied n times is again affine, built by repeated squaring.
+	U128 pcg_advance(U128 state, U128 inc, U128 delta) {
+		U128 accMult = { 0, 1 }, accPlus = { 0, 0 };
+		U128 curMult = PcgMultiplier, curPlus = inc;
+		while (delta.high | delta.low) {
+			if (delta.low & 1) {
+				accMult = mul128(accMult, curMult);
+				accPlus = add128(mul128(accPlus, curMult), curPlus);
+			}
+			curPlus = mul128(add128(curMult, { 0, 1 }), curPlus);
+			curMult = mul128(curMult, curMult);
+			delta.low = (delta.low >> 1) | (delta.high << 63);
+			delta.high >>= 1;
+		}
+		return add128(mul128(accMult, state), accPlus);
+	}
+}
+
+// ---- Xoshiro256 ----
+
+Xoshiro256::Xoshiro256(uint64_t seed) {
+	for (auto& word : s)
+		word = splitmix64(seed);
+}
+
+uint64_t Xoshiro256::Next(uint64_t bound) {
+	return bounded64(*this, bound);
+}
+
+uint32_t Xoshiro256::Next32(uint32_t bound) {
+	uint64_t m = (Next() >> 32) * bound;
+	if ((uint32_t)m < bound) {
+		const uint32_t threshold = (0u - bound) % bound;
+		while ((uint32_t)m < threshold)
+			m = (Next() >> 32) * bound;
+	}
+	return (uint32_t)(m >> 32);
+}
+
+void Xoshiro256::NextBytes(void* buffer, size_t count) {
+	fill_bytes(*this, buffer, count);
+}
+
+void Xoshiro256::Jump(const uint64_t (&polynomial)[4]) {
+	uint64_t t[4] = { 0, 0, 0, 0 };
+	for (uint64_t word : polynomial) {
+		for (int bit = 0; bit < 64; bit++) {
+			if (word & (1ULL << bit)) {
+				for (int i = 0; i < 4; i++)
+					t[i] ^= s[i];
+			}
+			Next();
+		}
+	}
+	std::memcpy(s, t, sizeof(s));
+}
+
+void Xoshiro256::Jump() {
+	static const uint64_t polynomial[4] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+	Jump(polynomial);
+}
+
+void Xoshiro256::LongJump() {
+	static const uint64_t polynomial[4] = { 0x76E15D3EFEFDCBBFULL, 0xC5004E441C522FB3ULL, 0x77710069854EE241ULL, 0x39109BB02ACBE635ULL };
+	Jump(polynomial);
+}
+
+Xoshiro256 Xoshiro256::Split() {
+	Xoshiro256 child = *this;
+	Jump();
+	return child;
+}
+
+// ---- Pcg64 ----
+
+Pcg64::Pcg64(uint64_t seed, uint64_t stream) {
+	// pcg_setseq_128_srandom_r with initstate = seed and initseq = stream.
+	incHigh = stream >> 63;
+	incLow = (stream << 1) | 1;
+	stateHigh = stateLow = 0;
+	Next();
+	const U128 state = add128({ stateHigh, stateLow }, { 0, seed });
+	stateHigh = state.high;
+	stateLow = state.low;
+	Next();
+}
+
+uint64_t Pcg64::Next() {
+	const U128 state = add128(mul128({ stateHigh, stateLow }, PcgMultiplier), { incHigh, incLow });
+	stateHigh = state.high;
+	stateLow = state.low;
+	const uint64_t value = state.high ^ state.low;
+	const unsigned rotate = (unsigned)(state.high >> 58);
+	return (value >> rotate) | (value << ((0 - rotate) & 63));
+}
+
+uint64_t Pcg64::Next(uint64_t bound) {
+	return bounded64(*this, bound);
+}
+
+void Pcg64::NextBytes(void* buffer, size_t count) {
+	fill_bytes(*this, buffer, count);
+}
+
+void Pcg64::Advance(uint64_t delta) {
+	const U128 state = pcg_advance({ stateHigh, stateLow }, { incHigh, incLow }, { 0, delta });
+	stateHigh = state.high;
+	stateLow = state.low;
+}
+
+void Pcg64::Jump() {
+	const U128 state = pcg_advance({ stateHigh, stateLow }, { incHigh, incLow }, { 1, 0 });
+	stateHigh = state.high;
+	stateLow = state.low;
+}
+
+Pcg64 Pcg64::Split() {
+	const uint64_t seed = Next();
+	return Pcg64(seed, Next());
+}
+
+// ---- Xoshiro256x8 ----
+
+namespace {
+	using LaneState = uint64_t[4][Xoshiro256x8::Lanes];
+
+	void x8_scalar(LaneState& s, uint64_t* out, size_t steps) {
+		for (size_t step = 0; step < steps; step++, out += Xoshiro256x8::Lanes) {
+			for (size_t lane = 0; lane < Xoshiro256x8::Lanes; lane++) {
+				const uint64_t s1 = s[1][lane];
+				const uint64_t x = s1 * 5;
+				out[lane] = ((x << 7) | (x >> 57)) * 9;
+				const uint64_t t = s1 << 17;
+				s[2][lane] ^= s[0][lane];
+				s[3][lane] ^= s1;
+				s[1][lane] ^= s[2][lane];
+				s[0][lane] ^= s[3][lane];
+				s[2][lane] ^= t;
+				s[3][lane] = (s[3][lane] << 45) | (s[3][lane] >> 19);
+			}
+		}
+	}
+
+#if defined(CPU_X86)
+	struct Avx2Ops {
+		using V = __m256i;
+		CPU_TARGET("avx2") static V Load(const uint64_t* p) { return _mm256_load_si256((const V*)p); }
+		CPU_TARGET("avx2") static void Store(uint64_t* p, V v) { _mm256_store_si256((V*)p, v); }
+		CPU_TARGET("avx2") static void StoreU(uint64_t* p, V v) { _mm256_storeu_si256((V*)p, v); }
+		CPU_TARGET("avx2") static V Xor(V a, V b) { return _mm256_xor_si256(a, b); }
+		CPU_TARGET("avx2") static V Shl(V a, int n) { return _mm256_slli_epi64(a, n); }
+		CPU_TARGET("avx2") static V Rotl(V a, int n) { return _mm256_or_si256(_mm256_slli_epi64(a, n), _mm256_srli_epi64(a, 64 - n)); }
+		// x * 5 and x * 9 as shift-and-add; AVX2 has no 64-bit multiply.
+		CPU_TARGET("avx2") static V Mul5(V a) { return _mm256_add_epi64(a, _mm256_slli_epi64(a, 2)); }
+		CPU_TARGET("avx2") static V Mul9(V a) { return _mm256_add_epi64(a, _mm256_slli_epi64(a, 3)); }
+	};
+
+	struct Avx512Ops {
+		using V = __m512i;
+		CPU_TARGET("avx512f") static V Load(const uint64_t* p) { return _mm512_load_si512(p); }
+		CPU_TARGET("avx512f") static void Store(uint64_t* p, V v) { _mm512_store_si512(p, v); }
+		CPU_TARGET("avx512f") static void StoreU(uint64_t* p, V v) { _mm512_storeu_si512(p, v); }
+		CPU_TARGET("avx512f") static V Xor(V a, V b) { return _mm512_xor_si512(a, b); }
+		CPU_TARGET("avx512f") static V Shl(V a, int n) { return _mm512_slli_epi64(a, n); }
+		CPU_TARGET("avx512f") static V Rotl(V a, int n) { return _mm512_or_si512(_mm512_slli_epi64(a, n), _mm512_srli_epi64(a, 64 - n)); }
+		CPU_TARGET("avx512f") static V Mul5(V a) { return _mm512_add_epi64(a, _mm512_slli_epi64(a, 2)); }
+		CPU_TARGET("avx512f") static V Mul9(V a) { return _mm512_add_epi64(a, _mm512_slli_epi64(a, 3)); }
+	};
+
+#define XOSHIRO_STEP(O, s0, s1, s2, s3, result)             \
+	do {                                                    \
+		result = O::Mul9(O::Rotl(O::Mul5(s1), 7));          \
+		const O::V t = O::Shl(s1, 17);                      \
+		s2 = O::Xor(s2, s0);                                \
+		s3 = O::Xor(s3, s1);                                \
+		s1 = O::Xor(s1, s2);                                \
+		s0 = O::Xor(s0, s3);                                \
+		s2 = O::Xor(s2, t);                                 \
+		s3 = O::Rotl(s3, 45);                               \
+	} while (0)
+
+	CPU_TARGET("avx2") void x8_avx2(LaneState& s, uint64_t* out, size_t steps) {
+		using O = Avx2Ops;
+		O::V a0 = O::Load(s[0]), a1 = O::Load(s[1]), a2 = O::Load(s[2]), a3 = O::Load(s[3]);
+		O::V b0 = O::Load(s[0] + 4), b1 = O::Load(s[1] + 4), b2 = O::Load(s[2] + 4), b3 = O::Load(s[3] + 4);
+		for (size_t step = 0; step < steps; step++, out += 8) {
+			O::V ra, rb;
+			XOSHIRO_STEP(O, a0, a1, a2, a3, ra);
+			XOSHIRO_STEP(O, b0, b1, b2, b3, rb);
+			O::StoreU(out, ra);
+			O::StoreU(out + 4, rb);
+		}
+		O::Store(s[0], a0); O::Store(s[1], a1); O::Store(s[2], a2); O::Store(s[3], a3);
+		O::Store(s[0] + 4, b0); O::Store(s[1] + 4, b1); O::Store(s[2] + 4, b2); O::Store(s[3] + 4, b3);
+	}
+
+	CPU_TARGET("avx512f") void x8_avx512(LaneState& s, uint64_t* out, size_t steps) {
+		using O = Avx512Ops;
+		O::V s0 = O::Load(s[0]), s1 = O::Load(s[1]), s2 = O::Load(s[2]), s3 = O::Load(s[3]);
+		for (size_t step = 0; step < steps; step++, out += 8) {
+			O::V r;
+			XOSHIRO_STEP(O, s0, s1, s2, s3, r);
+			O::StoreU(out, r);
+		}
+		O::Store(s[0], s0); O::Store(s[1], s1); O::Store(s[2], s2); O::Store(s[3], s3);
+	}
+
+#undef XOSHIRO_STEP
+#endif
+
+	void unit_doubles_scalar(const uint64_t* in, double* out, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			const uint64_t bits = (in[i] >> 12) | 0x3FF0000000000000ULL;
+			double d;
+			std::memcpy(&d, &bits, sizeof(d));
+			out[i] = d - 1.0;
+		}
+	}
+
+#if defined(CPU_X86)
+	// Same bit trick four at a time: the top 52 bits become the mantissa of a
+	// double in [1, 2), and subtracting 1 is exact.
+	CPU_TARGET("avx2") void unit_doubles_avx2(const uint64_t* in, double* out, size_t count) {
+		const __m256i exponent = _mm256_set1_epi64x(0x3FF0000000000000LL);
+		const __m256d one = _mm256_set1_pd(1.0);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			const __m256i bits = _mm256_or_si256(_mm256_srli_epi64(_mm256_load_si256((const __m256i*)(in + i)), 12), exponent);
+			_mm256_storeu_pd(out + i, _mm256_sub_pd(_mm256_castsi256_pd(bits), one));
+		}
+		unit_doubles_scalar(in + i, out + i, count - i);
+	}
+#endif
+
+	void unit_doubles(const uint64_t* in, double* out, size_t count) {
+#if defined(CPU_X86)
+		static const bool avx2 = CpuFeatures::AVX2();
+		if (avx2)
+			return unit_doubles_avx2(in, out, count);
+#endif
+		unit_doubles_scalar(in, out, count);
+	}
+
+	using LaneKernel = void (*)(LaneState&, uint64_t*, size_t);
+
+	LaneKernel lane_kernel() {
+		static const LaneKernel kernel = [] {
+#if defined(CPU_X86)
+			if (CpuFeatures::AVX512F())
+				return (LaneKernel)x8_avx512;
+			if (CpuFeatures::AVX2())
+				return (LaneKernel)x8_avx2;
+#endif
+			return (LaneKernel)x8_scalar;
+		}();
+		return kernel;
+	}
+}
+
+Xoshiro256x8::Xoshiro256x8(const Xoshiro256& base) {
+	Xoshiro256 lane = base;
+	for (size_t i = 0; i < Lanes; i++) {
+		for (int k = 0; k < 4; k++)
+			s[k][i] = lane.s[k];
+		lane.Jump();
+	}
+}
+
+Xoshiro256x8::Xoshiro256x8(uint64_t seed, uint64_t stream) : Xoshiro256x8(stream_origin(seed, stream)) {}
+
+void Xoshiro256x8::Fill(uint64_t* out, size_t steps) {
+	lane_kernel()(s, out, steps);
+}
+
+void Xoshiro256x8::NextBytes(void* buffer, size_t count) {
+	constexpr size_t StepBytes = Lanes * sizeof(uint64_t);
+	uint8_t* p = static_cast<uint8_t*>(buffer);
+	const size_t steps = count / StepBytes;
+	if (((uintptr_t)p & 7) == 0) {
+		Fill((uint64_t*)p, steps);
+	}
+	else {
+		// Stage through an aligned block so the kernel always stores whole words.
+		alignas(64) uint64_t block[Lanes * 32];
+		for (size_t done = 0; done < steps;) {
+			const size_t n = std::min<size_t>(steps - done, 32);
+			Fill(block, n);
+			std::memcpy(p + done * StepBytes, block, n * StepBytes);
+			done += n;
+		}
+	}
+	p += steps * StepBytes;
+	count -= steps * StepBytes;
+	if (count) {
+		alignas(64) uint64_t block[Lanes];
+		Fill(block, 1);
+		std::memcpy(p, block, count);
+	}
+}
+
+namespace {
+	// Hands out the lanes' words one at a time, refilling a block at once.
+	class LaneWords {
+	public:
+		explicit LaneWords(Xoshiro256x8& lanes) : lanes(lanes) {}
+		uint64_t Next() {
+			if (pos == Count) {
+				lanes.Fill(block, Steps);
+				pos = 0;
+			}
+			return block[pos++];
+		}
+		double NextDouble() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+	private:
+		static constexpr size_t Steps = 64;
+		static constexpr size_t Count = Steps * Xoshiro256x8::Lanes;
+		Xoshiro256x8& lanes;
+		alignas(64) uint64_t block[Count];
+		size_t pos = Count;
+	};
+
+	// Tables for the 256-layer normal ziggurat, generated as in Marsaglia &
+	// Tsang's zigset with 52-bit magnitudes. Layer 0 is the base strip plus
+	// the tail beyond R.
+	struct Ziggurat {
+		static constexpr double R = 3.6541528853610088;
+		static constexpr double Area = 0.00492867323399;
+		uint64_t k[256];
+		double w[256];
+		double f[256];
+
+		Ziggurat() {
+			const double m = 4503599627370496.0;
+			double dn = R, tn = R;
+			const double q = Area / std::exp(-0.5 * dn * dn);
+			k[0] = (uint64_t)((dn / q) * m);
+			k[1] = 0;
+			w[0] = q / m;
+			w[255] = dn / m;
+			f[0] = 1.0;
+			f[255] = std::exp(-0.5 * dn * dn);
+			for (int i = 254; i >= 1; i--) {
+				dn = std::sqrt(-2.0 * std::log(Area / dn + std::exp(-0.5 * dn * dn)));
+				k[i + 1] = (uint64_t)((dn / tn) * m);
+				tn = dn;
+				f[i] = std::exp(-0.5 * dn * dn);
+				w[i] = dn / m;
+			}
+		}
+
+		double Sample(LaneWords& words) const {
+			for (;;) {
+				const uint64_t r = words.Next();
+				const size_t layer = r & 0xff;
+				const uint64_t magnitude = (r >> 9) & 0x000FFFFFFFFFFFFFULL;
+				const bool negative = (r >> 8) & 1;
+				// The sign is applied by flipping the sign bit: a data-dependent
+				// branch here mispredicts half the time.
+				double x = (double)(int64_t)magnitude * w[layer];
+				uint64_t bits;
+				std::memcpy(&bits, &x, sizeof(bits));
+				bits ^= (r & 0x100) << 55;
+				std::memcpy(&x, &bits, sizeof(x));
+				// Inside the layer's rectangle: about 99% of samples stop here.
+				if (magnitude < k[layer])
+					return x;
+				if (layer == 0) {
+					for (;;) {
+						const double xx = -std::log1p(-words.NextDouble()) / R;
+						const double yy = -std::log1p(-words.NextDouble());
+						if (yy + yy > xx * xx)
+							return negative ? -(R + xx) : R + xx;
+					}
+				}
+				if ((f[layer - 1] - f[layer]) * words.NextDouble() + f[layer] < std::exp(-0.5 * x * x))
+					return x;
+			}
+		}
+	};
+}
+
+void Xoshiro256x8::FillDoubles(double* out, size_t count) {
+	constexpr size_t BlockSteps = 64;
+	alignas(64) uint64_t block[BlockSteps * Lanes];
+	while (count) {
+		const size_t steps = std::min(BlockSteps, (count + Lanes - 1) / Lanes);
+		const size_t n = std::min(count, steps * Lanes);
+		Fill(block, steps);
+		unit_doubles(block, out, n);
+		out += n;
+		count -= n;
+	}
+}
+
+void Xoshiro256x8::FillInt32(int32_t* out, size_t count, int32_t min, int32_t max) {
+	if (min > max)
+		throw std::invalid_argument("min must not exceed max");
+	LaneWords words(*this);
+	uint64_t word = 0;
+	bool high = false;
+	auto next32 = [&]() {
+		if (high) {
+			high = false;
+			return (uint32_t)(word >> 32);
+		}
+		word = words.Next();
+		high = true;
+		return (uint32_t)word;
+	};
+	// range wraps to 0 when [min, max] covers every int32_t.
+	const uint32_t range = (uint32_t)max - (uint32_t)min + 1;
+	if (range == 0) {
+		for (size_t i = 0; i < count; i++)
+			out[i] = (int32_t)next32();
+		return;
+	}
+	const uint32_t threshold = (0u - range) % range;
+	for (size_t i = 0; i < count; i++) {
+		uint64_t m = (uint64_t)next32() * range;
+		while ((uint32_t)m < threshold)
+			m = (uint64_t)next32() * range;
+		out[i] = (int32_t)((uint32_t)min + (uint32_t)(m >> 32));
+	}
+}
+
+void Xoshiro256x8::FillNormal(double* out, size_t count, double mean, double stddev) {
+	static const Ziggurat ziggurat;
+	LaneWords words(*this);
+	for (size_t i = 0; i < count; i++)
+		out[i] = mean + stddev * ziggurat.Sample(words);
+}
+
+// ---- Random ----
+
+namespace {
+	// Below this a single generator is faster than waking the lanes.
+	constexpr size_t BulkThreshold = 256;
+
+	struct ThreadRandom {
+		// Start of this thread's stream. The lanes cover its first 8 * 2^128
+		// steps and the scalar generator continues right after them; the next
+		// stream starts 2^192 steps in.
+		Xoshiro256 origin;
+		Xoshiro256 scalar;
+		std::unique_ptr<Xoshiro256x8> lanes;
+
+		ThreadRandom() { Seed(entropy(), 0); }
+
+		void Seed(uint64_t seed, uint64_t stream) {
+			origin = stream_origin(seed, stream);
+			scalar = origin;
+			for (size_t i = 0; i < Xoshiro256x8::Lanes; i++)
+				scalar.Jump();
+			lanes.reset();
+		}
+		Xoshiro256x8& Lanes() {
+			if (!lanes)
+				lanes.reset(new Xoshiro256x8(origin));
+			return *lanes;
+		}
+
+		static uint64_t entropy() {
+			std::random_device device;
+			const uint64_t seed = ((uint64_t)device() << 32) | device();
+			return seed ^ std::hash<std::thread::id>()(std::this_thread::get_id());
+		}
+	};
+
+	ThreadRandom& thread_random() {
+		thread_local ThreadRandom random;
+		return random;
+	}
+}
 
 int Random::Next() {
-    std::uniform_int_distribution<> dist(0, INT_MAX);
-    return dist(gen);
+	return (int)(thread_random().scalar.Next() >> 33);
 }
 
 int Random::Next(int min, int max) {
-    std::uniform_int_distribution<> dist(min, max);
-    return dist(gen);
+	if (min > max)
+		throw std::invalid_argument("min must not exceed max");
+	Xoshiro256& g = thread_random().scalar;
+	const uint32_t span = (uint32_t)max - (uint32_t)min;
+	if (span == UINT32_MAX)
+		return (int)(uint32_t)(g.Next() >> 32);
+	return (int)((uint32_t)min + g.Next32(span + 1));
 }
 
 double Random::NextDouble() {
-    std::uniform_real_distribution<> dist(0.0, 1.0);
-    return dist(gen);
+	return thread_random().scalar.NextDouble();
+}
+
+uint64_t Random::NextUInt64() {
+	return thread_random().scalar.Next();
+}
+
+uint64_t Random::NextUInt64(uint64_t bound) {
+	return thread_random().scalar.Next(bound);
 }
 
 std::vector<uint8_t> Random::NextBytes(int count) {
-    std::vector<uint8_t> bytes(count);
-    std::uniform_int_distribution<> dist(0, 0xFF);
-    for (int i = 0; i < count; ++i) {
-        bytes[i] = static_cast<uint8_t>(dist(gen));
-    }
-    return bytes;
+	std::vector<uint8_t> bytes(count);
+	NextBytes(bytes.data(), bytes.size());
+	return bytes;
 }
 
-void Random::NextBytes(void* buffer, int count) {
-    uint8_t* byteBuffer = static_cast<uint8_t*>(buffer);
-    std::uniform_int_distribution<> dist(0, 0xFF);
-    for (int i = 0; i < count; ++i) {
-        byteBuffer[i] = static_cast<uint8_t>(dist(gen));
-	}
-}
\ No newline at end of file
+void Random::NextBytes(void* buffer, size_t count) {
+	ThreadRandom& random = thread_random();
+	if (count < BulkThreshold)
+		random.scalar.NextBytes(buffer, count);
+	else
+		random.Lanes().NextBytes(buffer, count);
+}
+
+void Random::FillDoubles(Span<double> out) {
+	thread_random().Lanes().FillDoubles(out.data(), out.size());
+}
+
+void Random::FillInt32(Span<int32_t> out, int32_t min, int32_t max) {
+	thread_random().Lanes().FillInt32(out.data(), out.size(), min, max);
+}
+
+void Random::FillNormal(Span<double> out, double mean, double stddev) {
+	thread_random().Lanes().FillNormal(out.data(), out.size(), mean, stddev);
+}
+
+void Random::Seed(uint64_t seed, uint64_t stream) {
+	thread_random().Seed(seed, stream);
+}
+
+Xoshiro256& Random::Generator() {
+	return thread_random().scalar;
+}
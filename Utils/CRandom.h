@@ -1,11 +1,157 @@
 ﻿#pragma once
 #include "defines.h"
+#include "List.h"
+#include "Span.h"
+#include <cstdint>
+#include <utility>
 #include <vector>
+
+// xoshiro256** (Blackman & Vigna): 256-bit state, period 2^256 - 1.
+// Satisfies UniformRandomBitGenerator, so it also plugs into <random>.
+class Xoshiro256 {
+public:
+	using result_type = uint64_t;
+
+	// The seed is expanded with SplitMix64, so any value (including 0) is fine.
+	explicit Xoshiro256(uint64_t seed = 0);
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return UINT64_MAX; }
+	result_type operator()() { return Next(); }
+
+	uint64_t Next() {
+		const uint64_t result = Rotl(s[1] * 5, 7) * 9;
+		const uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = Rotl(s[3], 45);
+		return result;
+	}
+	// Unbiased integer in [0, bound) by Lemire's multiply-and-reject; bound > 0.
+	uint64_t Next(uint64_t bound);
+	// Unbiased integer in [0, bound) using 32 bits of output; bound > 0.
+	uint32_t Next32(uint32_t bound);
+	// Uniform in [0, 1) with 53 bits of precision.
+	double NextDouble() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+	// Fills buffer eight bytes per step.
+	void NextBytes(void* buffer, size_t count);
+
+	// Advances by 2^128 steps; 2^128 non-overlapping streams of that length.
+	void Jump();
+	// Advances by 2^192 steps; 2^64 non-overlapping streams of that length.
+	void LongJump();
+	// Returns a generator at the current position and jumps this one past it,
+	// so the two never overlap. Call repeatedly to hand out parallel streams.
+	Xoshiro256 Split();
+
+private:
+	friend class Xoshiro256x8;
+	uint64_t s[4];
+
+	static uint64_t Rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+	void Jump(const uint64_t (&polynomial)[4]);
+};
+
+// PCG64 (PCG-XSL-RR 128/64, O'Neill): 128-bit LCG state, period 2^128, with
+// 2^127 selectable streams. Output matches the reference pcg64 engine.
+class Pcg64 {
+public:
+	using result_type = uint64_t;
+
+	explicit Pcg64(uint64_t seed = 0, uint64_t stream = 0);
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return UINT64_MAX; }
+	result_type operator()() { return Next(); }
+
+	uint64_t Next();
+	uint64_t Next(uint64_t bound);
+	double NextDouble() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+	void NextBytes(void* buffer, size_t count);
+
+	// Advances by delta steps in O(log delta).
+	void Advance(uint64_t delta);
+	// Advances by 2^64 steps.
+	void Jump();
+	// Returns a generator on a different stream seeded from this one.
+	Pcg64 Split();
+
+private:
+	uint64_t stateHigh, stateLow;
+	uint64_t incHigh, incLow;
+};
+
+// Eight xoshiro256** lanes, each 2^128 steps apart, stepped together with
+// AVX-512 or AVX2 (or one at a time without them). Every step yields one word
+// per lane in lane order, so the output is the same on every CPU.
+class Xoshiro256x8 {
+public:
+	static constexpr size_t Lanes = 8;
+
+	// Lane i starts where base would be after i calls to Jump().
+	explicit Xoshiro256x8(const Xoshiro256& base);
+	// Stream k starts k LongJump()s (2^192 steps) past Xoshiro256(seed), so
+	// workers given the same seed and distinct streams never overlap and get
+	// the same numbers on every run.
+	explicit Xoshiro256x8(uint64_t seed = 0, uint64_t stream = 0);
+
+	// Writes steps * Lanes words.
+	void Fill(uint64_t* out, size_t steps);
+	void NextBytes(void* buffer, size_t count);
+	// Uniform in [0, 1) with 52 bits of precision.
+	void FillDoubles(double* out, size_t count);
+	// Uniform in [min, max], both inclusive, unbiased.
+	void FillInt32(int32_t* out, size_t count, int32_t min, int32_t max);
+	// Normal samples by the 256-layer ziggurat (Marsaglia & Tsang).
+	void FillNormal(double* out, size_t count, double mean, double stddev);
+
+private:
+	// s[k][lane]: word k of every lane's state, laid out for vector loads.
+	alignas(64) uint64_t s[4][Lanes];
+};
+
+// Process-wide convenience API. Each thread owns its own generator, so calls
+// never contend or race; threads are seeded independently from the OS unless
+// Seed() is called.
 class Random {
 public:
+	// [0, INT_MAX]
 	static int Next();
+	// [min, max], both inclusive.
 	static int Next(int min, int max);
+	// [0, 1)
 	static double NextDouble();
+	static uint64_t NextUInt64();
+	// [0, bound)
+	static uint64_t NextUInt64(uint64_t bound);
 	static std::vector<uint8_t> NextBytes(int count);
-	static void NextBytes(void* buffer,int count);
-};
\ No newline at end of file
+	static void NextBytes(void* buffer, size_t count);
+
+	// Bulk variants, filled by the calling thread's 8-lane generator.
+	static void FillDoubles(Span<double> out);
+	static void FillInt32(Span<int32_t> out, int32_t min, int32_t max);
+	static void FillNormal(Span<double> out, double mean = 0.0, double stddev = 1.0);
+
+	// Fisher-Yates shuffle driven by the calling thread's generator.
+	template<typename T>
+	static void Shuffle(T* items, size_t count) {
+		Xoshiro256& g = Generator();
+		for (size_t i = count; i > 1; i--) {
+			const size_t j = i <= UINT32_MAX ? g.Next32((uint32_t)i) : (size_t)g.Next(i);
+			std::swap(items[i - 1], items[j]);
+		}
+	}
+	template<typename T, typename A>
+	static void Shuffle(List<T, A>& list) { Shuffle(list.data(), list.size()); }
+
+	// Reseeds the calling thread's generators, making their sequences
+	// reproducible. Threads given the same seed and distinct stream numbers
+	// draw from non-overlapping parts of one sequence, so a parallel
+	// simulation that seeds worker i with (seed, i) repeats exactly.
+	static void Seed(uint64_t seed, uint64_t stream = 0);
+	// The calling thread's generator, for use with <random> distributions.
+	static Xoshiro256& Generator();
+};
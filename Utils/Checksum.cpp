@@ -0,0 +1,702 @@
+﻿#include "Checksum.h"
+#include "CpuFeatures.h"
+#include "zlib/zlib.h"
+#include <array>
+#include <cstring>
+
+namespace {
+	inline uint32_t load32(const uint8_t* p) {
+		uint32_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+	inline uint64_t load64(const uint8_t* p) {
+		uint64_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+	inline void store64(uint8_t* p, uint64_t v) {
+		std::memcpy(p, &v, sizeof(v));
+	}
+	inline uint64_t rotl64(uint64_t x, int r) {
+		return (x << r) | (x >> (64 - r));
+	}
+
+	// GF(2) arithmetic modulo a bit-reflected CRC polynomial, used to shift a
+	// CRC past a run of zero bytes (the same method as zlib's crc32_combine).
+	template<uint32_t Poly>
+	struct CrcMath {
+		// a * b mod P; a must not be zero.
+		static uint32_t MultModP(uint32_t a, uint32_t b) {
+			uint32_t m = 1u << 31, p = 0;
+			for (;;) {
+				if (a & m) {
+					p ^= b;
+					if ((a & (m - 1)) == 0)
+						break;
+				}
+				m >>= 1;
+				b = b & 1 ? (b >> 1) ^ Poly : b >> 1;
+			}
+			return p;
+		}
+		// x^(n * 2^k) mod P.
+		static uint32_t X2nModP(uint64_t n, unsigned k) {
+			static const std::array<uint32_t, 32> powers = [] {
+				std::array<uint32_t, 32> t{};
+				uint32_t p = 1u << 30;
+				t[0] = p;
+				for (size_t i = 1; i < t.size(); i++)
+					t[i] = p = MultModP(p, p);
+				return t;
+			}();
+			uint32_t p = 1u << 31;
+			for (; n; n >>= 1, k++)
+				if (n & 1)
+					p = MultModP(powers[k & 31], p);
+			return p;
+		}
+		static uint32_t Combine(uint32_t first, uint32_t second, uint64_t secondLength) {
+			return MultModP(X2nModP(secondLength, 3), first) ^ second;
+		}
+	};
+
+	constexpr uint32_t Crc32CPoly = 0x82F63B78;
+	constexpr uint32_t Crc32Poly = 0xEDB88320;
+
+	// Slicing-by-8 tables for CRC-32C, used when SSE4.2 is unavailable.
+	struct Crc32CTables {
+		uint32_t t[8][256];
+		Crc32CTables() {
+			for (uint32_t n = 0; n < 256; n++) {
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = c & 1 ? (c >> 1) ^ Crc32CPoly : c >> 1;
+				t[0][n] = c;
+			}
+			for (uint32_t n = 0; n < 256; n++)
+				for (int k = 1; k < 8; k++)
+					t[k][n] = (t[k - 1][n] >> 8) ^ t[0][t[k - 1][n] & 0xff];
+		}
+	};
+
+	uint32_t crc32c_software(uint32_t crc, const uint8_t* p, size_t n) {
+		static const Crc32CTables tables;
+		const auto& t = tables.t;
+		for (; n && ((uintptr_t)p & 7); n--)
+			crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		for (; n >= 8; n -= 8, p += 8) {
+			const uint64_t w = load64(p) ^ crc;
+			crc = t[7][w & 0xff] ^ t[6][(w >> 8) & 0xff] ^ t[5][(w >> 16) & 0xff] ^ t[4][(w >> 24) & 0xff] ^
+				t[3][(w >> 32) & 0xff] ^ t[2][(w >> 40) & 0xff] ^ t[1][(w >> 48) & 0xff] ^ t[0][w >> 56];
+		}
+		for (; n; n--)
+			crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		return crc;
+	}
+
+#if defined(CPU_X86)
+	// Lengths of the three interleaved streams. The crc32 instruction has a
+	// latency of three cycles and a throughput of one, so running three
+	// independent streams keeps it saturated; the partial CRCs are then merged
+	// with a precomputed "append Length zero bytes" operator.
+	constexpr size_t Crc32CLong = 8192;
+	constexpr size_t Crc32CShort = 256;
+
+	// Byte-wise tables for multiplying a CRC by x^(8 * Length) mod P.
+	template<size_t Length>
+	struct Crc32CShift {
+		uint32_t t[4][256];
+		Crc32CShift() {
+			const uint32_t op = CrcMath<Crc32CPoly>::X2nModP(Length, 3);
+			for (uint32_t n = 0; n < 256; n++)
+				for (int k = 0; k < 4; k++)
+					t[k][n] = n ? CrcMath<Crc32CPoly>::MultModP(op, n << (8 * k)) : 0;
+		}
+		uint32_t operator()(uint32_t crc) const {
+			return t[0][crc & 0xff] ^ t[1][(crc >> 8) & 0xff] ^ t[2][(crc >> 16) & 0xff] ^ t[3][crc >> 24];
+		}
+	};
+
+	CPU_TARGET("sse4.2") inline uint32_t crc32c_word(uint32_t crc, const uint8_t* p) {
+#if defined(_M_X64) || defined(__x86_64__)
+		return (uint32_t)_mm_crc32_u64(crc, load64(p));
+#else
+		return _mm_crc32_u32(_mm_crc32_u32(crc, load32(p)), load32(p + 4));
+#endif
+	}
+
+	template<size_t Length>
+	CPU_TARGET("sse4.2") inline uint32_t crc32c_three_way(uint32_t crc, const uint8_t*& p, size_t& n) {
+		static const Crc32CShift<Length> shift;
+		while (n >= 3 * Length) {
+			uint32_t crc1 = 0, crc2 = 0;
+			for (const uint8_t* end = p + Length; p < end; p += 8) {
+				crc = crc32c_word(crc, p);
+				crc1 = crc32c_word(crc1, p + Length);
+				crc2 = crc32c_word(crc2, p + 2 * Length);
+			}
+			crc = shift(crc) ^ crc1;
+			crc = shift(crc) ^ crc2;
+			p += 2 * Length;
+			n -= 3 * Length;
+		}
+		return crc;
+	}
+
+	CPU_TARGET("sse4.2") uint32_t crc32c_hardware(uint32_t crc, const uint8_t* p, size_t n) {
+		for (; n && ((uintptr_t)p & 7); n--)
+			crc = _mm_crc32_u8(crc, *p++);
+		crc = crc32c_three_way<Crc32CLong>(crc, p, n);
+		crc = crc32c_three_way<Crc32CShort>(crc, p, n);
+		for (; n >= 8; n -= 8, p += 8)
+			crc = crc32c_word(crc, p);
+		for (; n; n--)
+			crc = _mm_crc32_u8(crc, *p++);
+		return crc;
+	}
+
+	CPU_TARGET("pclmul,sse4.1") inline __m128i crc32_fold(__m128i acc, __m128i next, __m128i k) {
+		const __m128i lo = _mm_clmulepi64_si128(acc, k, 0x00);
+		return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(acc, k, 0x11), next), lo);
+	}
+
+	// Folds 16-byte multiples (at least 64 bytes) with carry-less multiplies,
+	// four lanes at a time, then Barrett-reduces to 32 bits. Constants are the
+	// bit-reflected ones from Intel's "Fast CRC Computation for Generic
+	// Polynomials Using PCLMULQDQ Instruction".
+	CPU_TARGET("pclmul,sse4.1") uint32_t crc32_pclmul(uint32_t crc, const uint8_t* p, size_t n) {
+		alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+		alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+		alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+		alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+		__m128i x1 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+		__m128i x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+		__m128i x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+		__m128i x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+		__m128i k = _mm_load_si128((const __m128i*)k1k2);
+		p += 64;
+		n -= 64;
+
+		for (; n >= 64; p += 64, n -= 64) {
+			const __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+			const __m128i x6 = _mm_clmulepi64_si128(x2, k, 0x00);
+			const __m128i x7 = _mm_clmulepi64_si128(x3, k, 0x00);
+			const __m128i x8 = _mm_clmulepi64_si128(x4, k, 0x00);
+			x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k, 0x11), x5);
+			x2 = _mm_xor_si128(_mm_clmulepi64_si128(x2, k, 0x11), x6);
+			x3 = _mm_xor_si128(_mm_clmulepi64_si128(x3, k, 0x11), x7);
+			x4 = _mm_xor_si128(_mm_clmulepi64_si128(x4, k, 0x11), x8);
+			x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)(p + 0x00)));
+			x2 = _mm_xor_si128(x2, _mm_loadu_si128((const __m128i*)(p + 0x10)));
+			x3 = _mm_xor_si128(x3, _mm_loadu_si128((const __m128i*)(p + 0x20)));
+			x4 = _mm_xor_si128(x4, _mm_loadu_si128((const __m128i*)(p + 0x30)));
+		}
+
+		k = _mm_load_si128((const __m128i*)k3k4);
+		x1 = crc32_fold(x1, x2, k);
+		x1 = crc32_fold(x1, x3, k);
+		x1 = crc32_fold(x1, x4, k);
+		for (; n >= 16; p += 16, n -= 16)
+			x1 = crc32_fold(x1, _mm_loadu_si128((const __m128i*)p), k);
+
+		// 128 -> 64 bits.
+		const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+		x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+		x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+		k = _mm_loadl_epi64((const __m128i*)k5k0);
+		x2 = _mm_srli_si128(x1, 4);
+		x1 = _mm_and_si128(x1, mask);
+		x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k, 0x00), x2);
+
+		// Barrett reduction to 32 bits.
+		k = _mm_load_si128((const __m128i*)poly);
+		x2 = _mm_and_si128(x1, mask);
+		x2 = _mm_clmulepi64_si128(x2, k, 0x10);
+		x2 = _mm_and_si128(x2, mask);
+		x2 = _mm_clmulepi64_si128(x2, k, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+		return (uint32_t)_mm_extract_epi32(x1, 1);
+	}
+#endif
+}
+
+uint32_t Crc32C::Compute(const void* data, size_t size, uint32_t crc) {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+#if defined(CPU_X86)
+	static const bool hardware = CpuFeatures::SSE42();
+	if (hardware)
+		return ~crc32c_hardware(~crc, p, size);
+#endif
+	return ~crc32c_software(~crc, p, size);
+}
+
+uint32_t Crc32C::Combine(uint32_t first, uint32_t second, uint64_t secondLength) {
+	return CrcMath<Crc32CPoly>::Combine(first, second, secondLength);
+}
+
+uint32_t Crc32::Compute(const void* data, size_t size, uint32_t crc) {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+#if defined(CPU_X86)
+	static const bool folding = CpuFeatures::PCLMUL() && CpuFeatures::SSE41();
+	if (folding && size >= 64) {
+		const size_t chunk = size & ~(size_t)15;
+		crc = ~crc32_pclmul(~crc, p, chunk);
+		p += chunk;
+		size -= chunk;
+	}
+#endif
+	return size ? (uint32_t)crc32_z(crc, p, size) : crc;
+}
+
+uint32_t Crc32::Combine(uint32_t first, uint32_t second, uint64_t secondLength) {
+	return CrcMath<Crc32Poly>::Combine(first, second, secondLength);
+}
+
+// ---- XXH64 ----
+
+namespace {
+	constexpr uint64_t Prime64_1 = 0x9E3779B185EBCA87ULL;
+	constexpr uint64_t Prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+	constexpr uint64_t Prime64_3 = 0x165667B19E3779F9ULL;
+	constexpr uint64_t Prime64_4 = 0x85EBCA77C2B2AE63ULL;
+	constexpr uint64_t Prime64_5 = 0x27D4EB2F165667C5ULL;
+	constexpr uint32_t Prime32_1 = 0x9E3779B1U;
+	constexpr uint32_t Prime32_2 = 0x85EBCA77U;
+	constexpr uint32_t Prime32_3 = 0xC2B2AE3DU;
+
+	inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+		acc += input * Prime64_2;
+		return rotl64(acc, 31) * Prime64_1;
+	}
+	inline uint64_t xxh64_merge(uint64_t h, uint64_t acc) {
+		h ^= xxh64_round(0, acc);
+		return h * Prime64_1 + Prime64_4;
+	}
+	inline uint64_t xxh64_avalanche(uint64_t h) {
+		h ^= h >> 33;
+		h *= Prime64_2;
+		h ^= h >> 29;
+		h *= Prime64_3;
+		return h ^ (h >> 32);
+	}
+	inline const uint8_t* xxh64_stripes(uint64_t acc[4], const uint8_t* p, size_t stripes) {
+		uint64_t v1 = acc[0], v2 = acc[1], v3 = acc[2], v4 = acc[3];
+		for (; stripes; stripes--, p += 32) {
+			v1 = xxh64_round(v1, load64(p));
+			v2 = xxh64_round(v2, load64(p + 8));
+			v3 = xxh64_round(v3, load64(p + 16));
+			v4 = xxh64_round(v4, load64(p + 24));
+		}
+		acc[0] = v1; acc[1] = v2; acc[2] = v3; acc[3] = v4;
+		return p;
+	}
+	uint64_t xxh64_finish(const uint64_t acc[4], uint64_t seed, uint64_t total, const uint8_t* p, size_t n) {
+		uint64_t h;
+		if (total >= 32) {
+			h = rotl64(acc[0], 1) + rotl64(acc[1], 7) + rotl64(acc[2], 12) + rotl64(acc[3], 18);
+			for (int i = 0; i < 4; i++)
+				h = xxh64_merge(h, acc[i]);
+		}
+		else {
+			h = seed + Prime64_5;
+		}
+		h += total;
+		for (; n >= 8; n -= 8, p += 8) {
+			h ^= xxh64_round(0, load64(p));
+			h = rotl64(h, 27) * Prime64_1 + Prime64_4;
+		}
+		if (n >= 4) {
+			h ^= (uint64_t)load32(p) * Prime64_1;
+			h = rotl64(h, 23) * Prime64_2 + Prime64_3;
+			p += 4;
+			n -= 4;
+		}
+		for (; n; n--) {
+			h ^= (*p++) * Prime64_5;
+			h = rotl64(h, 11) * Prime64_1;
+		}
+		return xxh64_avalanche(h);
+	}
+}
+
+void XxHash64::Reset(uint64_t seed) {
+	this->seed = seed;
+	acc[0] = seed + Prime64_1 + Prime64_2;
+	acc[1] = seed + Prime64_2;
+	acc[2] = seed;
+	acc[3] = seed - Prime64_1;
+	total = 0;
+	buffered = 0;
+}
+
+void XxHash64::Update(const void* data, size_t size) {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	total += size;
+	if (buffered + size < sizeof(buffer)) {
+		if (size) std::memcpy(buffer + buffered, p, size);
+		buffered += size;
+		return;
+	}
+	if (buffered) {
+		const size_t fill = sizeof(buffer) - buffered;
+		std::memcpy(buffer + buffered, p, fill);
+		xxh64_stripes(acc, buffer, 1);
+		p += fill;
+		size -= fill;
+		buffered = 0;
+	}
+	p = xxh64_stripes(acc, p, size / 32);
+	buffered = size % 32;
+	if (buffered) std::memcpy(buffer, p, buffered);
+}
+
+uint64_t XxHash64::Value() const {
+	return xxh64_finish(acc, seed, total, buffer, buffered);
+}
+
+uint64_t XxHash64::Compute(const void* data, size_t size, uint64_t seed) {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	uint64_t acc[4] = { seed + Prime64_1 + Prime64_2, seed + Prime64_2, seed, seed - Prime64_1 };
+	const uint8_t* tail = xxh64_stripes(acc, p, size / 32);
+	return xxh64_finish(acc, seed, size, tail, size % 32);
+}
+
+// ---- XXH3 (64-bit) ----
+
+namespace {
+	alignas(64) const uint8_t Xxh3DefaultSecret[Xxh3::SecretSize] = {
+		0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+		0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+		0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+		0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+		0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+		0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+		0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+		0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+		0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+		0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+		0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+		0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+	};
+	constexpr size_t Xxh3StripeLength = 64;
+	constexpr size_t Xxh3SecretRate = 8;
+	constexpr size_t Xxh3StripesPerBlock = (Xxh3::SecretSize - Xxh3StripeLength) / Xxh3SecretRate;
+	constexpr size_t Xxh3BlockLength = Xxh3StripeLength * Xxh3StripesPerBlock;
+	constexpr size_t Xxh3ScrambleOffset = Xxh3::SecretSize - Xxh3StripeLength;
+	constexpr size_t Xxh3LastStripeOffset = Xxh3::SecretSize - Xxh3StripeLength - 7;
+	constexpr size_t Xxh3MergeOffset = 11;
+	constexpr size_t Xxh3MidSizeMax = 240;
+
+	inline uint64_t mul128_fold64(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+		const unsigned __int128 product = (unsigned __int128)a * b;
+		return (uint64_t)product ^ (uint64_t)(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+		uint64_t high;
+		const uint64_t low = _umul128(a, b, &high);
+		return low ^ high;
+#else
+		const uint64_t lolo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+		const uint64_t hilo = (a >> 32) * (b & 0xFFFFFFFF);
+		const uint64_t lohi = (a & 0xFFFFFFFF) * (b >> 32);
+		const uint64_t hihi = (a >> 32) * (b >> 32);
+		const uint64_t cross = (lolo >> 32) + (hilo & 0xFFFFFFFF) + lohi;
+		const uint64_t upper = (hilo >> 32) + (cross >> 32) + hihi;
+		const uint64_t lower = (cross << 32) | (lolo & 0xFFFFFFFF);
+		return lower ^ upper;
+#endif
+	}
+	inline uint64_t swap64(uint64_t x) {
+		return ((x << 56) & 0xff00000000000000ULL) | ((x << 40) & 0x00ff000000000000ULL) |
+			((x << 24) & 0x0000ff0000000000ULL) | ((x << 8) & 0x000000ff00000000ULL) |
+			((x >> 8) & 0x00000000ff000000ULL) | ((x >> 24) & 0x0000000000ff0000ULL) |
+			((x >> 40) & 0x000000000000ff00ULL) | ((x >> 56) & 0x00000000000000ffULL);
+	}
+	inline uint32_t swap32(uint32_t x) {
+		return ((x << 24) & 0xff000000) | ((x << 8) & 0x00ff0000) | ((x >> 8) & 0x0000ff00) | ((x >> 24) & 0x000000ff);
+	}
+	inline uint64_t xxh3_avalanche(uint64_t h) {
+		h ^= h >> 37;
+		h *= 0x165667919E3779F9ULL;
+		return h ^ (h >> 32);
+	}
+	inline uint64_t xxh3_rrmxmx(uint64_t h, uint64_t length) {
+		h ^= rotl64(h, 49) ^ rotl64(h, 24);
+		h *= 0x9FB21C651E98DF25ULL;
+		h ^= (h >> 35) + length;
+		h *= 0x9FB21C651E98DF25ULL;
+		return h ^ (h >> 28);
+	}
+	inline uint64_t xxh3_mix16(const uint8_t* p, const uint8_t* secret, uint64_t seed) {
+		return mul128_fold64(load64(p) ^ (load64(secret) + seed), load64(p + 8) ^ (load64(secret + 8) - seed));
+	}
+
+	uint64_t xxh3_short(const uint8_t* p, size_t n, const uint8_t* secret, uint64_t seed) {
+		if (n > 8) {
+			const uint64_t lo = load64(p) ^ ((load64(secret + 24) ^ load64(secret + 32)) + seed);
+			const uint64_t hi = load64(p + n - 8) ^ ((load64(secret + 40) ^ load64(secret + 48)) - seed);
+			return xxh3_avalanche(n + swap64(lo) + hi + mul128_fold64(lo, hi));
+		}
+		if (n >= 4) {
+			seed ^= (uint64_t)swap32((uint32_t)seed) << 32;
+			const uint64_t input = load32(p + n - 4) + ((uint64_t)load32(p) << 32);
+			return xxh3_rrmxmx(input ^ ((load64(secret + 8) ^ load64(secret + 16)) - seed), n);
+		}
+		if (n > 0) {
+			const uint32_t combined = ((uint32_t)p[0] << 16) | ((uint32_t)p[n >> 1] << 24) | (uint32_t)p[n - 1] | ((uint32_t)n << 8);
+			return xxh64_avalanche((uint64_t)combined ^ ((uint64_t)(load32(secret) ^ load32(secret + 4)) + seed));
+		}
+		return xxh64_avalanche(seed ^ (load64(secret + 56) ^ load64(secret + 64)));
+	}
+
+	uint64_t xxh3_medium(const uint8_t* p, size_t n, const uint8_t* secret, uint64_t seed) {
+		uint64_t acc = n * Prime64_1;
+		if (n <= 128) {
+			if (n > 32) {
+				if (n > 64) {
+					if (n > 96) {
+						acc += xxh3_mix16(p + 48, secret + 96, seed);
+						acc += xxh3_mix16(p + n - 64, secret + 112, seed);
+					}
+					acc += xxh3_mix16(p + 32, secret + 64, seed);
+					acc += xxh3_mix16(p + n - 48, secret + 80, seed);
+				}
+				acc += xxh3_mix16(p + 16, secret + 32, seed);
+				acc += xxh3_mix16(p + n - 32, secret + 48, seed);
+			}
+			acc += xxh3_mix16(p, secret, seed);
+			acc += xxh3_mix16(p + n - 16, secret + 16, seed);
+			return xxh3_avalanche(acc);
+		}
+		for (size_t i = 0; i < 8; i++)
+			acc += xxh3_mix16(p + 16 * i, secret + 16 * i, seed);
+		acc = xxh3_avalanche(acc);
+		uint64_t end = xxh3_mix16(p + n - 16, secret + 136 - 17, seed);
+		for (size_t i = 8; i < n / 16; i++)
+			end += xxh3_mix16(p + 16 * i, secret + 16 * (i - 8) + 3, seed);
+		return xxh3_avalanche(acc + end);
+	}
+
+	// Long input kernels: accumulate runs of 64-byte stripes into eight 64-bit
+	// lanes, scramble once per block.
+	using Xxh3Accumulate = void (*)(uint64_t* acc, const uint8_t* p, const uint8_t* secret, size_t stripes);
+	using Xxh3Scramble = void (*)(uint64_t* acc, const uint8_t* secret);
+
+	void xxh3_accumulate_scalar(uint64_t* acc, const uint8_t* p, const uint8_t* secret, size_t stripes) {
+		for (size_t s = 0; s < stripes; s++, p += Xxh3StripeLength, secret += Xxh3SecretRate) {
+			for (size_t i = 0; i < 8; i++) {
+				const uint64_t value = load64(p + 8 * i);
+				const uint64_t key = value ^ load64(secret + 8 * i);
+				acc[i ^ 1] += value;
+				acc[i] += (key & 0xFFFFFFFF) * (key >> 32);
+			}
+		}
+	}
+	void xxh3_scramble_scalar(uint64_t* acc, const uint8_t* secret) {
+		for (size_t i = 0; i < 8; i++) {
+			uint64_t a = acc[i];
+			a ^= a >> 47;
+			a ^= load64(secret + 8 * i);
+			acc[i] = a * Prime32_1;
+		}
+	}
+
+#if defined(CPU_X86)
+	CPU_TARGET("sse2") void xxh3_accumulate_sse2(uint64_t* acc, const uint8_t* p, const uint8_t* secret, size_t stripes) {
+		__m128i a[4];
+		for (int i = 0; i < 4; i++)
+			a[i] = _mm_load_si128((const __m128i*)acc + i);
+		for (size_t s = 0; s < stripes; s++, p += Xxh3StripeLength, secret += Xxh3SecretRate) {
+			for (int i = 0; i < 4; i++) {
+				const __m128i value = _mm_loadu_si128((const __m128i*)p + i);
+				const __m128i key = _mm_xor_si128(value, _mm_loadu_si128((const __m128i*)secret + i));
+				const __m128i product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+				a[i] = _mm_add_epi64(_mm_add_epi64(a[i], _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2))), product);
+			}
+		}
+		for (int i = 0; i < 4; i++)
+			_mm_store_si128((__m128i*)acc + i, a[i]);
+	}
+	CPU_TARGET("sse2") void xxh3_scramble_sse2(uint64_t* acc, const uint8_t* secret) {
+		const __m128i prime = _mm_set1_epi32((int)Prime32_1);
+		for (int i = 0; i < 4; i++) {
+			__m128i a = _mm_load_si128((const __m128i*)acc + i);
+			a = _mm_xor_si128(_mm_xor_si128(a, _mm_srli_epi64(a, 47)), _mm_loadu_si128((const __m128i*)secret + i));
+			const __m128i low = _mm_mul_epu32(a, prime);
+			const __m128i high = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+			_mm_store_si128((__m128i*)acc + i, _mm_add_epi64(low, _mm_slli_epi64(high, 32)));
+		}
+	}
+	CPU_TARGET("avx2") void xxh3_accumulate_avx2(uint64_t* acc, const uint8_t* p, const uint8_t* secret, size_t stripes) {
+		__m256i a0 = _mm256_load_si256((const __m256i*)acc);
+		__m256i a1 = _mm256_load_si256((const __m256i*)acc + 1);
+		for (size_t s = 0; s < stripes; s++, p += Xxh3StripeLength, secret += Xxh3SecretRate) {
+			const __m256i v0 = _mm256_loadu_si256((const __m256i*)p);
+			const __m256i v1 = _mm256_loadu_si256((const __m256i*)p + 1);
+			const __m256i k0 = _mm256_xor_si256(v0, _mm256_loadu_si256((const __m256i*)secret));
+			const __m256i k1 = _mm256_xor_si256(v1, _mm256_loadu_si256((const __m256i*)secret + 1));
+			a0 = _mm256_add_epi64(_mm256_add_epi64(a0, _mm256_shuffle_epi32(v0, _MM_SHUFFLE(1, 0, 3, 2))),
+				_mm256_mul_epu32(k0, _mm256_srli_epi64(k0, 32)));
+			a1 = _mm256_add_epi64(_mm256_add_epi64(a1, _mm256_shuffle_epi32(v1, _MM_SHUFFLE(1, 0, 3, 2))),
+				_mm256_mul_epu32(k1, _mm256_srli_epi64(k1, 32)));
+		}
+		_mm256_store_si256((__m256i*)acc, a0);
+		_mm256_store_si256((__m256i*)acc + 1, a1);
+	}
+	CPU_TARGET("avx2") void xxh3_scramble_avx2(uint64_t* acc, const uint8_t* secret) {
+		const __m256i prime = _mm256_set1_epi32((int)Prime32_1);
+		for (int i = 0; i < 2; i++) {
+			__m256i a = _mm256_load_si256((const __m256i*)acc + i);
+			a = _mm256_xor_si256(_mm256_xor_si256(a, _mm256_srli_epi64(a, 47)), _mm256_loadu_si256((const __m256i*)secret + i));
+			const __m256i low = _mm256_mul_epu32(a, prime);
+			const __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+			_mm256_store_si256((__m256i*)acc + i, _mm256_add_epi64(low, _mm256_slli_epi64(high, 32)));
+		}
+	}
+#endif
+
+	struct Xxh3Kernels {
+		Xxh3Accumulate accumulate = xxh3_accumulate_scalar;
+		Xxh3Scramble scramble = xxh3_scramble_scalar;
+		Xxh3Kernels() {
+#if defined(CPU_X86)
+			if (CpuFeatures::AVX2()) {
+				accumulate = xxh3_accumulate_avx2;
+				scramble = xxh3_scramble_avx2;
+			}
+			else if (CpuFeatures::SSE2()) {
+				accumulate = xxh3_accumulate_sse2;
+				scramble = xxh3_scramble_sse2;
+			}
+#endif
+		}
+	};
+	const Xxh3Kernels& xxh3_kernels() {
+		static const Xxh3Kernels kernels;
+		return kernels;
+	}
+
+	void xxh3_init_acc(uint64_t* acc) {
+		acc[0] = Prime32_3; acc[1] = Prime64_1; acc[2] = Prime64_2; acc[3] = Prime64_3;
+		acc[4] = Prime64_4; acc[5] = Prime32_2; acc[6] = Prime64_5; acc[7] = Prime32_1;
+	}
+	void xxh3_init_secret(uint8_t* secret, uint64_t seed) {
+		for (size_t i = 0; i < Xxh3::SecretSize; i += 16) {
+			store64(secret + i, load64(Xxh3DefaultSecret + i) + seed);
+			store64(secret + i + 8, load64(Xxh3DefaultSecret + i + 8) - seed);
+		}
+	}
+	uint64_t xxh3_merge(const uint64_t* acc, const uint8_t* secret, uint64_t total) {
+		uint64_t result = total * Prime64_1;
+		for (size_t i = 0; i < 4; i++)
+			result += mul128_fold64(acc[2 * i] ^ load64(secret + 16 * i), acc[2 * i + 1] ^ load64(secret + 16 * i + 8));
+		return xxh3_avalanche(result);
+	}
+
+	// Consumes stripes starting at stripe index *done within the current block,
+	// scrambling at every block boundary.
+	const uint8_t* xxh3_consume(uint64_t* acc, size_t& done, const uint8_t* p, size_t stripes, const uint8_t* secret) {
+		const Xxh3Kernels& k = xxh3_kernels();
+		while (stripes >= Xxh3StripesPerBlock - done) {
+			const size_t count = Xxh3StripesPerBlock - done;
+			k.accumulate(acc, p, secret + done * Xxh3SecretRate, count);
+			k.scramble(acc, secret + Xxh3ScrambleOffset);
+			p += count * Xxh3StripeLength;
+			stripes -= count;
+			done = 0;
+		}
+		if (stripes) {
+			k.accumulate(acc, p, secret + done * Xxh3SecretRate, stripes);
+			p += stripes * Xxh3StripeLength;
+			done += stripes;
+		}
+		return p;
+	}
+
+	uint64_t xxh3_long(const uint8_t* p, size_t n, const uint8_t* secret) {
+		alignas(64) uint64_t acc[8];
+		xxh3_init_acc(acc);
+		size_t done = 0;
+		xxh3_consume(acc, done, p, (n - 1) / Xxh3StripeLength, secret);
+		xxh3_kernels().accumulate(acc, p + n - Xxh3StripeLength, secret + Xxh3LastStripeOffset, 1);
+		return xxh3_merge(acc, secret + Xxh3MergeOffset, n);
+	}
+
+	uint64_t xxh3_hash(const uint8_t* p, size_t n, uint64_t seed, const uint8_t* secret) {
+		if (n <= 16)
+			return xxh3_short(p, n, Xxh3DefaultSecret, seed);
+		if (n <= Xxh3MidSizeMax)
+			return xxh3_medium(p, n, Xxh3DefaultSecret, seed);
+		return xxh3_long(p, n, secret);
+	}
+}
+
+uint64_t Xxh3::Compute(const void* data, size_t size, uint64_t seed) {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	if (seed == 0 || size <= Xxh3MidSizeMax)
+		return xxh3_hash(p, size, seed, Xxh3DefaultSecret);
+	alignas(64) uint8_t custom[SecretSize];
+	xxh3_init_secret(custom, seed);
+	return xxh3_hash(p, size, seed, custom);
+}
+
+void Xxh3::Reset(uint64_t seed) {
+	this->seed = seed;
+	xxh3_init_acc(acc);
+	xxh3_init_secret(secret, seed);
+	buffered = 0;
+	stripes = 0;
+	total = 0;
+}
+
+// Mirrors the reference streaming state machine: input is staged through a
+// 256-byte buffer and the final stripe is always kept back so that Value()
+// can re-read the last 64 bytes.
+void Xxh3::Update(const void* data, size_t size) {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	const uint8_t* const end = p + size;
+	total += size;
+	if (size <= BufferSize - buffered) {
+		if (size) std::memcpy(buffer + buffered, p, size);
+		buffered += size;
+		return;
+	}
+	if (buffered) {
+		const size_t fill = BufferSize - buffered;
+		std::memcpy(buffer + buffered, p, fill);
+		p += fill;
+		xxh3_consume(acc, stripes, buffer, BufferSize / Xxh3StripeLength, secret);
+		buffered = 0;
+	}
+	if ((size_t)(end - p) > BufferSize) {
+		p = xxh3_consume(acc, stripes, p, (size_t)(end - p - 1) / Xxh3StripeLength, secret);
+		std::memcpy(buffer + BufferSize - Xxh3StripeLength, p - Xxh3StripeLength, Xxh3StripeLength);
+	}
+	buffered = (size_t)(end - p);
+	std::memcpy(buffer, p, buffered);
+}
+
+uint64_t Xxh3::Value() const {
+	if (total <= Xxh3MidSizeMax)
+		return xxh3_hash(buffer, (size_t)total, seed, secret);
+	alignas(64) uint64_t state[8];
+	std::memcpy(state, acc, sizeof(state));
+	uint8_t last[Xxh3StripeLength];
+	const uint8_t* lastStripe;
+	if (buffered >= Xxh3StripeLength) {
+		size_t done = stripes;
+		xxh3_consume(state, done, buffer, (buffered - 1) / Xxh3StripeLength, secret);
+		lastStripe = buffer + buffered - Xxh3StripeLength;
+	}
+	else {
+		const size_t catchup = Xxh3StripeLength - buffered;
+		std::memcpy(last, buffer + BufferSize - catchup, catchup);
+		std::memcpy(last + catchup, buffer, buffered);
+		lastStripe = last;
+	}
+	xxh3_kernels().accumulate(state, lastStripe, secret + Xxh3LastStripeOffset, 1);
+	return xxh3_merge(state, secret + Xxh3MergeOffset, total);
+}
@@ -0,0 +1,90 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "Span.h"
+
+// Non-cryptographic checksums with hardware fast paths selected at runtime.
+// Every class can be fed incrementally through Update() and read with Value()
+// at any point; the static Compute() helpers hash a single buffer.
+
+// CRC-32C (Castagnoli), as used by iSCSI, ext4 and most storage formats.
+// Uses the SSE4.2 crc32 instruction, three streams interleaved on large
+// buffers, and slicing-by-8 tables otherwise.
+class Crc32C {
+public:
+	explicit Crc32C(uint32_t crc = 0) : crc(crc) {}
+	void Update(const void* data, size_t size) { crc = Compute(data, size, crc); }
+	void Update(ByteSpan data) { crc = Compute(data.data(), data.size(), crc); }
+	uint32_t Value() const { return crc; }
+	void Reset() { crc = 0; }
+
+	// crc is the checksum of the preceding data, so calls can be chained.
+	static uint32_t Compute(const void* data, size_t size, uint32_t crc = 0);
+	// Checksum of A || B from the checksums of A and B and the length of B.
+	static uint32_t Combine(uint32_t first, uint32_t second, uint64_t secondLength);
+
+private:
+	uint32_t crc;
+};
+
+// CRC-32 (IEEE 802.3), bit-compatible with zlib's crc32(). Buffers of 64
+// bytes or more are folded with PCLMULQDQ; the rest goes through zlib.
+class Crc32 {
+public:
+	explicit Crc32(uint32_t crc = 0) : crc(crc) {}
+	void Update(const void* data, size_t size) { crc = Compute(data, size, crc); }
+	void Update(ByteSpan data) { crc = Compute(data.data(), data.size(), crc); }
+	uint32_t Value() const { return crc; }
+	void Reset() { crc = 0; }
+
+	static uint32_t Compute(const void* data, size_t size, uint32_t crc = 0);
+	static uint32_t Combine(uint32_t first, uint32_t second, uint64_t secondLength);
+
+private:
+	uint32_t crc;
+};
+
+// XXH64, matching the reference implementation for any seed.
+class XxHash64 {
+public:
+	explicit XxHash64(uint64_t seed = 0) { Reset(seed); }
+	void Update(const void* data, size_t size);
+	void Update(ByteSpan data) { Update(data.data(), data.size()); }
+	uint64_t Value() const;
+	void Reset(uint64_t seed = 0);
+
+	static uint64_t Compute(const void* data, size_t size, uint64_t seed = 0);
+
+private:
+	uint64_t acc[4];
+	uint64_t seed;
+	uint64_t total;
+	uint8_t buffer[32];
+	size_t buffered;
+};
+
+// XXH3 64-bit, matching the reference implementation for any seed. Long
+// inputs are accumulated with AVX2 or SSE2.
+class Xxh3 {
+public:
+	explicit Xxh3(uint64_t seed = 0) { Reset(seed); }
+	void Update(const void* data, size_t size);
+	void Update(ByteSpan data) { Update(data.data(), data.size()); }
+	uint64_t Value() const;
+	void Reset(uint64_t seed = 0);
+
+	static uint64_t Compute(const void* data, size_t size, uint64_t seed = 0);
+
+	static constexpr size_t SecretSize = 192;
+
+private:
+	static constexpr size_t BufferSize = 256;
+
+	alignas(64) uint64_t acc[8];
+	alignas(64) uint8_t secret[SecretSize];
+	uint8_t buffer[BufferSize];
+	size_t buffered;
+	size_t stripes;
+	uint64_t total;
+	uint64_t seed;
+};
@@ -0,0 +1,254 @@
+﻿#include "ContentChunker.h"
+#include "CpuFeatures.h"
+#include "FileStream.h"
+#include "MemoryMappedFile.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace {
+	// Files are mapped in windows of about this many bytes.
+	constexpr uint64_t RunBytes = 64ull << 20;
+	// Read size for ChunkStream.
+	constexpr size_t StreamBytes = 8 << 20;
+	// Bytes the gear hash depends on: older ones are shifted out.
+	constexpr size_t Window = 32;
+
+	constexpr uint64_t splitmix64(uint64_t& state) {
+		uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	// Fixed random value per byte. Chunk boundaries depend on it, so it must
+	// never change or stored indexes stop matching.
+	constexpr std::array<uint32_t, 256> make_gear() {
+		std::array<uint32_t, 256> table{};
+		uint64_t state = 0x6A09E667F3BCC908ull;
+		for (size_t i = 0; i < table.size(); i++)
+			table[i] = (uint32_t)(splitmix64(state) >> 32);
+		return table;
+	}
+	constexpr std::array<uint32_t, 256> Gear = make_gear();
+
+	// Rolls the hash over [begin, end) of p and returns the first position
+	// after which (hash & mask) == 0, or end. hash carries over between calls.
+	using ScanKernel = size_t(*)(const uint8_t* p, size_t begin, size_t end, uint32_t mask, uint32_t& hash);
+
+	size_t scan_scalar(const uint8_t* p, size_t begin, size_t end, uint32_t mask, uint32_t& hash) {
+		uint32_t h = hash;
+		for (size_t i = begin; i < end; i++) {
+			h = (h << 1) + Gear[p[i]];
+			if (!(h & mask)) {
+				hash = h;
+				return i;
+			}
+		}
+		hash = h;
+		return end;
+	}
+
+#if defined(CPU_X86)
+	// Sixteen positions at a time: the gear values are gathered, then
+	// h[i] = 2 * h[i - 1] + g[i] is solved with a log-step prefix scan,
+	// h[i] = sum of g[j] << (i - j), and the hash before the block is added
+	// shifted by i + 1.
+	CPU_TARGET("avx512f") size_t scan_avx512(const uint8_t* p, size_t begin, size_t end, uint32_t mask, uint32_t& hash) {
+		const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+		const __m512i back1 = _mm512_sub_epi32(lane, _mm512_set1_epi32(1));
+		const __m512i back2 = _mm512_sub_epi32(lane, _mm512_set1_epi32(2));
+		const __m512i back4 = _mm512_sub_epi32(lane, _mm512_set1_epi32(4));
+		const __m512i back8 = _mm512_sub_epi32(lane, _mm512_set1_epi32(8));
+		const __m512i carryShift = _mm512_add_epi32(lane, _mm512_set1_epi32(1));
+		const __m512i last = _mm512_set1_epi32(15);
+		const __m512i maskVector = _mm512_set1_epi32((int)mask);
+		const int* table = reinterpret_cast<const int*>(Gear.data());
+		__m512i carry = _mm512_set1_epi32((int)hash);
+		size_t i = begin;
+		for (; i + 16 <= end; i += 16) {
+			const __m512i bytes = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)));
+			__m512i h = _mm512_i32gather_epi32(bytes, table, 4);
+			h = _mm512_add_epi32(h, _mm512_slli_epi32(_mm512_maskz_permutexvar_epi32(0xFFFE, back1, h), 1));
+			h = _mm512_add_epi32(h, _mm512_slli_epi32(_mm512_maskz_permutexvar_epi32(0xFFFC, back2, h), 2));
+			h = _mm512_add_epi32(h, _mm512_slli_epi32(_mm512_maskz_permutexvar_epi32(0xFFF0, back4, h), 4));
+			h = _mm512_add_epi32(h, _mm512_slli_epi32(_mm512_maskz_permutexvar_epi32(0xFF00, back8, h), 8));
+			h = _mm512_add_epi32(h, _mm512_sllv_epi32(carry, carryShift));
+			const unsigned hits = _mm512_testn_epi32_mask(h, maskVector);
+			if (hits) {
+				alignas(64) uint32_t values[16];
+				_mm512_store_si512(values, h);
+				unsigned first = 0;
+				while (!(hits >> first & 1))
+					first++;
+				hash = values[first];
+				return i + first;
+			}
+			carry = _mm512_permutexvar_epi32(last, h);
+		}
+		hash = (uint32_t)_mm_cvtsi128_si32(_mm512_castsi512_si128(carry));
+		return scan_scalar(p, i, end, mask, hash);
+	}
+#endif
+
+	ScanKernel select_scan() {
+#if defined(CPU_X86)
+		if (CpuFeatures::AVX512F())
+			return scan_avx512;
+#endif
+		return scan_scalar;
+	}
+
+	void hash_chunks(const uint8_t* data, uint64_t offset, ContentChunk* chunks, size_t count) {
+		std::vector<ByteSpan> inputs(count);
+		std::vector<SHA256::Digest> digests(count);
+		for (size_t i = 0; i < count; i++)
+			inputs[i] = ByteSpan(data + (chunks[i].Offset - offset), chunks[i].Length);
+		SHA256::hash_batch(inputs.data(), count, digests.data());
+		for (size_t i = 0; i < count; i++)
+			chunks[i].Hash = digests[i];
+	}
+}
+
+ContentChunker::ContentChunker(size_t averageSize) : averageSize(averageSize) {
+	if (averageSize < 256 || averageSize > (4 << 20) || (averageSize & (averageSize - 1)))
+		throw std::invalid_argument("Average chunk size must be a power of two from 256 to 4 MB");
+	minSize = averageSize / 4;
+	maxSize = averageSize * 8;
+	int bits = 0;
+	while (((size_t)1 << bits) < averageSize)
+		bits++;
+	// The top bits of the hash depend on all 32 bytes of the window.
+	smallMask = ~0u << (32 - (bits + 2));
+	largeMask = ~0u << (32 - (bits - 2));
+}
+
+size_t ContentChunker::NextCut(const void* data, size_t size) const {
+	static const ScanKernel scan = select_scan();
+	if (size <= minSize)
+		return size;
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	const size_t limit = std::min(size, maxSize);
+	const size_t normal = std::min(limit, averageSize);
+	// No cut can fall within the minimum size, so only the window before the
+	// first candidate is hashed. A cut after byte i makes a chunk of i + 1.
+	uint32_t hash = 0;
+	for (size_t i = minSize - Window; i < minSize - 1; i++)
+		hash = (hash << 1) + Gear[p[i]];
+	size_t cut = scan(p, minSize - 1, normal - 1, smallMask, hash);
+	if (cut == normal - 1)
+		cut = scan(p, normal - 1, limit - 1, largeMask, hash);
+	return cut == limit - 1 ? limit : cut + 1;
+}
+
+void ContentChunker::Split(const void* data, size_t size, const std::function<void(uint64_t offset, size_t length)>& visit) const {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	for (size_t offset = 0; offset < size;) {
+		const size_t length = NextCut(p + offset, size - offset);
+		visit(offset, length);
+		offset += length;
+	}
+}
+
+size_t ContentChunker::Append(const uint8_t* data, size_t size, uint64_t offset, bool last, std::vector<ContentChunk>& chunks) const {
+	const size_t first = chunks.size();
+	size_t used = 0;
+	while (used < size && (last || size - used >= maxSize)) {
+		const size_t length = NextCut(data + used, size - used);
+		chunks.push_back({ offset + used, (uint32_t)length, {} });
+		used += length;
+	}
+	hash_chunks(data, offset, chunks.data() + first, chunks.size() - first);
+	return used;
+}
+
+std::vector<ContentChunk> ContentChunker::Chunk(const void* data, size_t size) const {
+	std::vector<ContentChunk> chunks;
+	chunks.reserve(size / averageSize + 1);
+	Append(static_cast<const uint8_t*>(data), size, 0, true, chunks);
+	return chunks;
+}
+
+std::vector<ContentChunk> ContentChunker::ChunkFile(const std::string& path) const {
+	MemoryMappedFile file(path, MapAccess::Read, 0, 0, MapAdvice::Sequential);
+	const uint64_t size = file.FileSize();
+	std::vector<ContentChunk> chunks;
+	chunks.reserve((size_t)(size / averageSize) + 1);
+	// Windows overlap by the maximum chunk size, so a chunk never has to be
+	// cut at a window end.
+	for (uint64_t offset = 0; offset < size;) {
+		const size_t length = (size_t)std::min<uint64_t>(size - offset, RunBytes + maxSize);
+		file.Remap(offset, length);
+		offset += Append(file.data(), length, offset, offset + length == size, chunks);
+	}
+	return chunks;
+}
+
+std::vector<ContentChunk> ContentChunker::ChunkStream(FileStream& stream) const {
+	std::vector<ContentChunk> chunks;
+	std::vector<uint8_t> buffer(StreamBytes + maxSize);
+	size_t filled = 0;
+	uint64_t offset = 0;
+	bool end = false;
+	while (!end || filled > 0) {
+		while (!end && filled < buffer.size()) {
+			const long long read = stream.Read(buffer.data() + filled, buffer.size() - filled);
+			if (read <= 0)
+				end = true;
+			else
+				filled += (size_t)read;
+		}
+		const size_t used = Append(buffer.data(), filled, offset, end, chunks);
+		std::memmove(buffer.data(), buffer.data() + used, filled - used);
+		filled -= used;
+		offset += used;
+	}
+	return chunks;
+}
+
+size_t ChunkIndex::DigestHash::operator()(const SHA256::Digest& digest) const {
+	// The digest is already uniformly distributed.
+	size_t value;
+	std::memcpy(&value, digest.data(), sizeof(value));
+	return value;
+}
+
+bool ChunkIndex::Add(const ContentChunk& chunk, uint32_t source) {
+	totalBytes += chunk.Length;
+	if (!chunks.emplace(chunk.Hash, Location{ source, chunk.Offset, chunk.Length }).second)
+		return false;
+	uniqueBytes += chunk.Length;
+	return true;
+}
+
+uint64_t ChunkIndex::Add(const std::vector<ContentChunk>& chunks, uint32_t source) {
+	uint64_t added = 0;
+	for (const ContentChunk& chunk : chunks) {
+		if (Add(chunk, source))
+			added += chunk.Length;
+	}
+	return added;
+}
+
+const ChunkIndex::Location* ChunkIndex::Find(const SHA256::Digest& hash) const {
+	auto it = chunks.find(hash);
+	return it == chunks.end() ? nullptr : &it->second;
+}
+
+std::vector<ContentChunk> ChunkIndex::Missing(const std::vector<ContentChunk>& chunks) const {
+	std::vector<ContentChunk> missing;
+	std::unordered_set<SHA256::Digest, DigestHash> seen;
+	for (const ContentChunk& chunk : chunks) {
+		if (!Contains(chunk.Hash) && seen.insert(chunk.Hash).second)
+			missing.push_back(chunk);
+	}
+	return missing;
+}
+
+void ChunkIndex::Clear() {
+	chunks.clear();
+	totalBytes = 0;
+	uniqueBytes = 0;
+}
@@ -0,0 +1,106 @@
+﻿#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "SHA256.h"
+
+class FileStream;
+
+struct ContentChunk {
+	uint64_t Offset;
+	uint32_t Length;
+	SHA256::Digest Hash;
+};
+
+// Content-defined chunking (FastCDC). A gear hash over the last 32 bytes picks
+// the boundaries, so they follow the content: an insertion moves only the
+// boundaries next to it and the remaining chunks of two versions of a file
+// still hash the same, where a fixed-size split or a whole-file MD5 would
+// differ from the edit onwards. Chunks are at least AverageSize() / 4 and at
+// most AverageSize() * 8 bytes; normalized chunking keeps most of them close
+// to the average. The scan uses AVX-512 when the CPU has it and skips the
+// minimum length of every chunk, and chunk hashes are SHA256 computed
+// side by side with SHA256::hash_batch.
+//
+//     ContentChunker chunker;
+//     ChunkIndex index;
+//     index.Add(chunker.ChunkFile("snapshot-1.pack"), 1);
+//     auto delta = index.Missing(chunker.ChunkFile("snapshot-2.pack"));
+class ContentChunker {
+public:
+	static constexpr size_t DefaultAverageSize = 8192;
+
+	// averageSize must be a power of two from 256 to 4 MB; otherwise throws
+	// std::invalid_argument.
+	explicit ContentChunker(size_t averageSize = DefaultAverageSize);
+
+	// Length of the chunk at the start of data. Fewer than MaxSize() bytes
+	// mean the data ends there, so the rest may become one short chunk.
+	size_t NextCut(const void* data, size_t size) const;
+	// Boundaries only, without hashing.
+	void Split(const void* data, size_t size, const std::function<void(uint64_t offset, size_t length)>& visit) const;
+
+	std::vector<ContentChunk> Chunk(const void* data, size_t size) const;
+	// Maps the file in windows, so memory use stays bounded for any size.
+	std::vector<ContentChunk> ChunkFile(const std::string& path) const;
+	// Reads from the current position to the end, for streams that cannot
+	// be mapped. Offsets are relative to the starting position.
+	std::vector<ContentChunk> ChunkStream(FileStream& stream) const;
+
+	size_t MinSize() const { return minSize; }
+	size_t AverageSize() const { return averageSize; }
+	size_t MaxSize() const { return maxSize; }
+
+private:
+	size_t minSize;
+	size_t averageSize;
+	size_t maxSize;
+	// Harder to match below the average size and easier above it.
+	uint32_t smallMask;
+	uint32_t largeMask;
+
+	// Cuts and hashes the chunks of data, which starts at offset in the
+	// input. Unless last, stops where fewer than MaxSize() bytes remain and
+	// returns how many bytes were consumed.
+	size_t Append(const uint8_t* data, size_t size, uint64_t offset, bool last, std::vector<ContentChunk>& chunks) const;
+};
+
+// Chunk hashes already stored, for deduplication and deltas. Each chunk is
+// remembered where it was first seen: source is a caller-chosen number such
+// as a snapshot or file id.
+class ChunkIndex {
+public:
+	struct Location {
+		uint32_t Source;
+		uint64_t Offset;
+		uint32_t Length;
+	};
+
+	// Returns true if the content was new.
+	bool Add(const ContentChunk& chunk, uint32_t source = 0);
+	// Returns the number of bytes that were new.
+	uint64_t Add(const std::vector<ContentChunk>& chunks, uint32_t source = 0);
+	bool Contains(const SHA256::Digest& hash) const { return chunks.count(hash) != 0; }
+	// Null if the content is not in the index.
+	const Location* Find(const SHA256::Digest& hash) const;
+	// Chunks whose content is neither in the index nor earlier in chunks:
+	// what a delta has to carry, the rest can be referenced.
+	std::vector<ContentChunk> Missing(const std::vector<ContentChunk>& chunks) const;
+	void Clear();
+
+	size_t Count() const { return chunks.size(); }
+	// Bytes added in total and bytes stored once per distinct chunk.
+	uint64_t TotalBytes() const { return totalBytes; }
+	uint64_t UniqueBytes() const { return uniqueBytes; }
+	double DedupRatio() const { return uniqueBytes ? (double)totalBytes / uniqueBytes : 1.0; }
+
+private:
+	struct DigestHash {
+		size_t operator()(const SHA256::Digest& digest) const;
+	};
+	std::unordered_map<SHA256::Digest, Location, DigestHash> chunks;
+	uint64_t totalBytes = 0;
+	uint64_t uniqueBytes = 0;
+};
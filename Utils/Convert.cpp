@@ -5,11 +5,17 @@
 #include <sstream>
 #include "MD5.h"
 #include "SHA256.h"
+#include "MerkleTree.h"
+#include "Utf.h"
 
 #include <vector>
 #include <string>
+#include <cstdlib>
 #include <cstring>
 #include <cassert>
+#include <charconv>
+#include <limits>
+#include <type_traits>
 
 #pragma warning(disable: 4267)
 #pragma warning(disable: 4244)
@@ -371,41 +377,100 @@ std::vector<uint8_t> Convert::FromHex(const std::wstring hex) {
 	return result;
 
 }
+// Code pages that encode ASCII as itself, so ASCII text can be widened or
+// narrowed byte for byte. The ANSI and OEM code pages of every Windows locale
+// are; EBCDIC, UTF-7 and the UTF-16/32 code pages are not.
+static bool is_ascii_superset(uint32_t codePage) {
+	switch (codePage) {
+	case CP_ACP:
+	case CP_OEMCP:
+	case CP_THREAD_ACP:
+	case CP_UTF8:
+	case 437: case 737: case 775: case 850: case 852: case 855: case 857: case 858:
+	case 860: case 861: case 862: case 863: case 865: case 866: case 869:
+	case 874: case 932: case 936: case 949: case 950:
+	case 1250: case 1251: case 1252: case 1253: case 1254: case 1255: case 1256: case 1257: case 1258:
+	case 20127: case 20866: case 21866: case 51932: case 51936: case 51949: case 54936:
+		return true;
+	default:
+		// ISO 8859-1 to 8859-16.
+		return codePage >= 28591 && codePage <= 28606;
+	}
+}
+
 std::wstring Convert::MultiByteToWide(const std::string& str, uint32_t codePage) {
+	if (is_ascii_superset(codePage) && Utf::IsAscii(str.data(), str.size())) {
+		std::wstring wstr(str.size(), L'\0');
+		Utf::ValidUtf8ToUtf16(str.data(), str.size(), (char16_t*)wstr.data());
+		return wstr;
+	}
 	int len = MultiByteToWideChar(codePage, 0, str.c_str(), static_cast<int>(str.length()), NULL, 0);
 	std::wstring wstr(len, L'\0');
 	MultiByteToWideChar(codePage, 0, str.c_str(), static_cast<int>(str.length()), &wstr[0], len);
 	return wstr;
 }
 std::string Convert::WideToMultiByte(const std::wstring& wstr, uint32_t codePage) {
+	if (is_ascii_superset(codePage) && Utf::IsAscii((const char16_t*)wstr.data(), wstr.size())) {
+		std::string str(wstr.size(), '\0');
+		Utf::ValidUtf16ToUtf8((const char16_t*)wstr.data(), wstr.size(), str.data());
+		return str;
+	}
 	int len = ::WideCharToMultiByte(codePage, 0, wstr.c_str(), static_cast<int>(wstr.length()), NULL, 0, NULL, NULL);
 	std::string str(len, '\0');
 	WideCharToMultiByte(codePage, 0, wstr.c_str(), static_cast<int>(wstr.length()), &str[0], len, NULL, NULL);
 	return str;
 }
 std::string Convert::AnsiToUtf8(const std::string str) {
+	if (Utf::IsAscii(str.data(), str.size()))
+		return str;
 	std::wstring wstr = MultiByteToWide(str, CP_ACP);
 	return WideToMultiByte(wstr, CP_UTF8);
 }
 std::string Convert::Utf8ToAnsi(const std::string str) {
+	if (Utf::IsAscii(str.data(), str.size()))
+		return str;
 	std::wstring wstr = MultiByteToWide(str, CP_UTF8);
 	return WideToMultiByte(wstr, CP_ACP);
 }
 std::u16string Convert::Utf8ToUtf16(const std::string utf8Str) {
-	std::wstring wideStr = MultiByteToWide(utf8Str, CP_UTF8);
-	return std::u16string(wideStr.begin(), wideStr.end());
+	std::u16string result(Utf::Utf16LengthFromUtf8(utf8Str.data(), utf8Str.size()), u'\0');
+	UtfResult r = Utf::Utf8ToUtf16(utf8Str.data(), utf8Str.size(), result.data());
+	if (!r.Ok()) {
+		result.resize(utf8Str.size());
+		r.Count = Utf::Utf8ToUtf16Lossy(utf8Str.data(), utf8Str.size(), result.data());
+	}
+	result.resize(r.Count);
+	return result;
 }
 std::string Convert::Utf16ToUtf8(const std::u16string utf16Str) {
-	std::wstring wideStr(utf16Str.begin(), utf16Str.end());
-	return WideToMultiByte(wideStr, CP_UTF8);
+	std::string result(Utf::Utf8LengthFromUtf16(utf16Str.data(), utf16Str.size()), '\0');
+	UtfResult r = Utf::Utf16ToUtf8(utf16Str.data(), utf16Str.size(), result.data());
+	if (!r.Ok()) {
+		result.resize(utf16Str.size() * 3);
+		r.Count = Utf::Utf16ToUtf8Lossy(utf16Str.data(), utf16Str.size(), result.data());
+	}
+	result.resize(r.Count);
+	return result;
 }
 std::u32string Convert::Utf8ToUtf32(const std::string utf8Str) {
-	std::wstring wideStr = MultiByteToWide(utf8Str, CP_UTF8);
-	return std::u32string(wideStr.begin(), wideStr.end());
+	std::u32string result(Utf::Utf32LengthFromUtf8(utf8Str.data(), utf8Str.size()), U'\0');
+	UtfResult r = Utf::Utf8ToUtf32(utf8Str.data(), utf8Str.size(), result.data());
+	if (!r.Ok()) {
+		result.resize(utf8Str.size());
+		r.Count = Utf::Utf8ToUtf32Lossy(utf8Str.data(), utf8Str.size(), result.data());
+	}
+	result.resize(r.Count);
+	return result;
 }
 std::string Convert::Utf32ToUtf8(const std::u32string utf32Str) {
-	std::wstring wideStr(utf32Str.begin(), utf32Str.end());
-	return WideToMultiByte(wideStr, CP_UTF8);
+	std::string result(Utf::Utf8LengthFromUtf32(utf32Str.data(), utf32Str.size()), '\0');
+	UtfResult r = Utf::Utf32ToUtf8(utf32Str.data(), utf32Str.size(), result.data());
+	if (!r.Ok()) {
+		result.resize(utf32Str.size() * 4);
+		r.Count = Utf::Utf32ToUtf8Lossy(utf32Str.data(), utf32Str.size(), result.data());
+	}
+	result.resize(r.Count);
+	return result;
 }
 std::wstring Convert::AnsiToUnicode(const std::string ansiStr) {
 	return MultiByteToWide(ansiStr, CP_ACP);
@@ -414,10 +479,26 @@ std::string Convert::UnicodeToAnsi(const std::wstring unicodeStr) {
 	return WideToMultiByte(unicodeStr, CP_ACP);
 }
 std::wstring Convert::Utf8ToUnicode(const std::string utf8Str) {
-	return MultiByteToWide(utf8Str, CP_UTF8);
+	static_assert(sizeof(wchar_t) == sizeof(char16_t), "wchar_t is expected to hold UTF-16");
+	std::wstring result(Utf::Utf16LengthFromUtf8(utf8Str.data(), utf8Str.size()), L'\0');
+	UtfResult r = Utf::Utf8ToUtf16(utf8Str.data(), utf8Str.size(), (char16_t*)result.data());
+	if (!r.Ok()) {
+		result.resize(utf8Str.size());
+		r.Count = Utf::Utf8ToUtf16Lossy(utf8Str.data(), utf8Str.size(), (char16_t*)result.data());
+	}
+	result.resize(r.Count);
+	return result;
 }
 std::string Convert::UnicodeToUtf8(const std::wstring unicodeStr) {
-	return WideToMultiByte(unicodeStr, CP_UTF8);
+	const char16_t* input = (const char16_t*)unicodeStr.data();
+	std::string result(Utf::Utf8LengthFromUtf16(input, unicodeStr.size()), '\0');
+	UtfResult r = Utf::Utf16ToUtf8(input, unicodeStr.size(), result.data());
+	if (!r.Ok()) {
+		result.resize(unicodeStr.size() * 3);
+		r.Count = Utf::Utf16ToUtf8Lossy(input, unicodeStr.size(), result.data());
+	}
+	result.resize(r.Count);
+	return result;
 }
 std::string Convert::wstring_to_string(const std::wstring wstr) {
 	return WideToMultiByte(wstr, CP_ACP);
@@ -672,12 +753,321 @@ std::string Convert::CalcSHA256(const std::string& data) {
 	sha256.finalize();
 	return sha256.hexdigest();
 }
-int Convert::ToInt32(const std::string input) {
-	return atoi(input.c_str());
+std::vector<std::string> Convert::CalcMD5Batch(Span<const ByteSpan> inputs) {
+	std::vector<MD5::Digest> digests = MD5::hash_batch(inputs);
+	std::vector<std::string> result;
+	result.reserve(digests.size());
+	for (const MD5::Digest& digest : digests)
+		result.push_back(MD5::hexdigest(digest));
+	return result;
+}
+std::vector<std::string> Convert::CalcSHA256Batch(Span<const ByteSpan> inputs) {
+	std::vector<SHA256::Digest> digests = SHA256::hash_batch(inputs);
+	std::vector<std::string> result;
+	result.reserve(digests.size());
+	for (const SHA256::Digest& digest : digests)
+		result.push_back(SHA256::hexdigest(digest));
+	return result;
+}
+std::string Convert::CalcTreeSHA256(const void* data, size_t size, size_t leafSize) {
+	return SHA256::hexdigest(MerkleTree::Hash(data, size, leafSize));
+}
+std::string Convert::CalcTreeSHA256File(const std::string& path, size_t leafSize) {
+	return SHA256::hexdigest(MerkleTree::HashFile(path, leafSize));
+}
+static constexpr const char digit_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+static constexpr const double exact_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+static inline bool is_digit(char c) {
+	return (unsigned char)(c - '0') < 10;
+}
+static inline uint64_t load_u64(const char* p) {
+	uint64_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+// SWAR check that all eight bytes of a little-endian word are '0'..'9'.
+static inline bool is_eight_digits(uint64_t v) {
+	return (((v + 0x4646464646464646ull) | (v - 0x3030303030303030ull)) & 0x8080808080808080ull) == 0;
+}
+// Converts eight ASCII digits to their value with three multiplies.
+static inline uint32_t parse_eight_digits(uint64_t v) {
+	v -= 0x3030303030303030ull;
+	v = (v * 10) + (v >> 8);
+	v = (((v & 0x000000FF000000FFull) * 0x000F424000000064ull) +
+		(((v >> 16) & 0x000000FF000000FFull) * 0x0000271000000001ull)) >> 32;
+	return (uint32_t)v;
+}
+static inline const char* skip_digits(const char* p, const char* last) {
+	while (last - p >= 8 && is_eight_digits(load_u64(p)))
+		p += 8;
+	while (p < last && is_digit(*p))
+		p++;
+	return p;
+}
+// Parses the longest integer prefix of [first, last). consumed is left at 0 if
+// no digits were found.
+template<typename T>
+static NumberError parse_integer(const char* first, const char* last, T& value, size_t& consumed) {
+	using U = std::make_unsigned_t<T>;
+	consumed = 0;
+	const char* p = first;
+	bool negative = false;
+	if (p < last && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		if (negative && !std::is_signed_v<T>)
+			return NumberError::InvalidFormat;
+		p++;
+	}
+	const char* digits = p;
+	while (p < last && *p == '0')
+		p++;
+	const char* significant = p;
+	p = skip_digits(p, last);
+	if (p == digits)
+		return NumberError::InvalidFormat;
+	consumed = (size_t)(p - first);
+	const size_t count = (size_t)(p - significant);
+	if (count > std::numeric_limits<uint64_t>::digits10 + 1)
+		return NumberError::OutOfRange;
+	uint64_t v = 0;
+	const char* q = significant;
+	const size_t fast = count > 19 ? 19 : count;
+	for (; q + 8 <= significant + fast; q += 8)
+		v = v * 100000000 + parse_eight_digits(load_u64(q));
+	for (; q < significant + fast; q++)
+		v = v * 10 + (uint64_t)(*q - '0');
+	if (count == 20) {
+		const uint64_t d = (uint64_t)(*q - '0');
+		if (v > (UINT64_MAX - d) / 10)
+			return NumberError::OutOfRange;
+		v = v * 10 + d;
+	}
+	const uint64_t limit = negative ? (uint64_t)(U)std::numeric_limits<T>::max() + 1 : (uint64_t)std::numeric_limits<T>::max();
+	if (v > limit)
+		return NumberError::OutOfRange;
+	value = negative ? (T)(U)(0 - v) : (T)v;
+	return NumberError::None;
+}
+// Clinger's fast path: when the decimal significand and the power of ten are
+// both exactly representable, one IEEE multiply or divide is correctly
+// rounded. Everything else is handed to std::from_chars.
+template<typename T>
+static NumberError parse_float(const char* first, const char* last, T& value, size_t& consumed) {
+	constexpr uint64_t max_exact = (uint64_t)1 << std::numeric_limits<T>::digits;
+	constexpr int max_pow10 = std::is_same_v<T, float> ? 10 : 22;
+	consumed = 0;
+	const char* p = first;
+	bool negative = false;
+	if (p < last && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+	const char* number = p;
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	while (p < last && *p == '0')
+		p++;
+	while (last - p >= 8 && is_eight_digits(load_u64(p)) && digits + 8 <= 19) {
+		mantissa = mantissa * 100000000 + parse_eight_digits(load_u64(p));
+		p += 8;
+		digits += 8;
+	}
+	while (p < last && is_digit(*p)) {
+		if (digits < 19)
+			mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+		else
+			exponent++;
+		digits++;
+		p++;
+	}
+	bool anyDigits = p != number;
+	if (p < last && *p == '.') {
+		p++;
+		const char* fracStart = p;
+		if (digits == 0) {
+			while (p < last && *p == '0')
+				p++;
+			exponent -= (int)(p - fracStart);
+		}
+		while (p < last && is_digit(*p)) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+				exponent--;
+			}
+			digits++;
+			p++;
+		}
+		anyDigits = anyDigits || p != fracStart;
+	}
+	if (!anyDigits) {
+		// inf, nan and other spellings go to the library parser.
+		const char* start = (negative || *first != '+') ? first : first + 1;
+		auto r = std::from_chars(start, last, value);
+		if (r.ec != std::errc())
+			return NumberError::InvalidFormat;
+		consumed = (size_t)(r.ptr - first);
+		return NumberError::None;
+	}
+	if (p < last && (*p == 'e' || *p == 'E')) {
+		const char* e = p + 1;
+		bool expNegative = false;
+		if (e < last && (*e == '-' || *e == '+')) {
+			expNegative = *e == '-';
+			e++;
+		}
+		if (e < last && is_digit(*e)) {
+			int exp10 = 0;
+			while (e < last && is_digit(*e)) {
+				if (exp10 < 100000)
+					exp10 = exp10 * 10 + (*e - '0');
+				e++;
+			}
+			exponent += expNegative ? -exp10 : exp10;
+			p = e;
+		}
+	}
+	consumed = (size_t)(p - first);
+	if (digits <= 19 && mantissa <= max_exact && exponent >= -max_pow10 && exponent <= max_pow10) {
+		T result = (T)mantissa;
+		if (exponent < 0)
+			result /= (T)exact_pow10[-exponent];
+		else
+			result *= (T)exact_pow10[exponent];
+		value = negative ? -result : result;
+		return NumberError::None;
+	}
+	if (mantissa == 0 && digits == 0) {
+		value = negative ? -(T)0 : (T)0;
+		return NumberError::None;
+	}
+	const char* start = negative ? first : number;
+	auto r = std::from_chars(start, p, value);
+	if (r.ec == std::errc::result_out_of_range)
+		return NumberError::OutOfRange;
+	if (r.ec != std::errc())
+		return NumberError::InvalidFormat;
+	return NumberError::None;
+}
+template<typename T>
+static NumberError parse_number(const char* first, const char* last, T& value, size_t& consumed) {
+	if constexpr (std::is_floating_point_v<T>)
+		return parse_float(first, last, value, consumed);
+	else
+		return parse_integer(first, last, value, consumed);
+}
+template<typename T>
+NumberResult Convert::TryParse(std::string_view input, T& value) {
+	static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "TryParse requires an integer or floating point type");
+	if (input.empty())
+		return { NumberError::Empty, 0 };
+	const char* first = input.data();
+	const char* last = first + input.size();
+	size_t consumed = 0;
+	T result{};
+	const NumberError err = parse_number(first, last, result, consumed);
+	if (err != NumberError::None)
+		return { err, consumed };
+	if (consumed != input.size())
+		return { NumberError::InvalidFormat, consumed };
+	value = result;
+	return { NumberError::None, consumed };
+}
+static size_t format_unsigned(uint64_t v, char* out) {
+	char buffer[20];
+	char* p = buffer + sizeof(buffer);
+	while (v >= 100) {
+		const size_t index = (size_t)(v % 100) * 2;
+		v /= 100;
+		p -= 2;
+		std::memcpy(p, digit_pairs + index, 2);
+	}
+	if (v >= 10) {
+		p -= 2;
+		std::memcpy(p, digit_pairs + v * 2, 2);
+	}
+	else {
+		*--p = (char)('0' + v);
+	}
+	const size_t len = (size_t)(buffer + sizeof(buffer) - p);
+	std::memcpy(out, p, len);
+	return len;
+}
+template<typename T>
+size_t Convert::Format(T value, char* out) {
+	static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "Format requires an integer or floating point type");
+	if constexpr (std::is_floating_point_v<T>) {
+		auto r = std::to_chars(out, out + FormatBufferSize, value);
+		return (size_t)(r.ptr - out);
+	}
+	else if constexpr (std::is_signed_v<T>) {
+		if (value < 0) {
+			*out = '-';
+			return 1 + format_unsigned(0 - (uint64_t)(int64_t)value, out + 1);
+		}
+		return format_unsigned((uint64_t)value, out);
+	}
+	else {
+		return format_unsigned((uint64_t)value, out);
+	}
+}
+#define CONVERT_INSTANTIATE_NUMBER(T) \
+	template NumberResult Convert::TryParse<T>(std::string_view, T&); \
+	template size_t Convert::Format<T>(T, char*);
+CONVERT_INSTANTIATE_NUMBER(signed char)
+CONVERT_INSTANTIATE_NUMBER(unsigned char)
+CONVERT_INSTANTIATE_NUMBER(short)
+CONVERT_INSTANTIATE_NUMBER(unsigned short)
+CONVERT_INSTANTIATE_NUMBER(int)
+CONVERT_INSTANTIATE_NUMBER(unsigned int)
+CONVERT_INSTANTIATE_NUMBER(long)
+CONVERT_INSTANTIATE_NUMBER(unsigned long)
+CONVERT_INSTANTIATE_NUMBER(long long)
+CONVERT_INSTANTIATE_NUMBER(unsigned long long)
+CONVERT_INSTANTIATE_NUMBER(float)
+CONVERT_INSTANTIATE_NUMBER(double)
+#undef CONVERT_INSTANTIATE_NUMBER
+
+// The legacy helpers keep atoi/atof semantics: leading whitespace is skipped,
+// trailing text is ignored and unparsable input yields 0.
+static std::string_view trim_number_prefix(std::string_view input) {
+	size_t i = 0;
+	while (i < input.size() && (input[i] == ' ' || (input[i] >= '\t' && input[i] <= '\r')))
+		i++;
+	return input.substr(i);
+}
+static bool is_hex_float(std::string_view input) {
+	size_t i = (!input.empty() && (input[0] == '-' || input[0] == '+')) ? 1 : 0;
+	return input.size() > i + 1 && input[i] == '0' && (input[i + 1] == 'x' || input[i + 1] == 'X');
+}
+template<typename T>
+static T parse_prefix_or_zero(std::string_view input) {
+	input = trim_number_prefix(input);
+	T value{};
+	size_t consumed = 0;
+	const NumberError err = parse_number(input.data(), input.data() + input.size(), value, consumed);
+	if constexpr (std::is_floating_point_v<T>) {
+		// Overflow (±HUGE_VAL), underflow and hex floats are rare, so strtod
+		// gives them the atof result on a terminated copy.
+		if (err == NumberError::OutOfRange || is_hex_float(input))
+			return (T)std::strtod(std::string(input).c_str(), nullptr);
+	}
+	else if (err == NumberError::OutOfRange)
+		return (!input.empty() && input[0] == '-') ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max();
+	return err == NumberError::None ? value : T{};
+}
+int Convert::ToInt32(std::string_view input) {
+	return parse_prefix_or_zero<int>(input);
+}
+long long Convert::ToInt64(std::string_view input) {
+	return parse_prefix_or_zero<long long>(input);
 }
-long long Convert::ToInt64(const std::string input) {
-	return _atoi64(input.c_str());
+double Convert::ToFloat(std::string_view input) {
+	return parse_prefix_or_zero<double>(input);
 }
-double Convert::ToFloat(const std::string input) {
-	return atof(input.c_str());
-}
\ No newline at end of file
@@ -0,0 +1,97 @@
+﻿#pragma once
+#include <cstdint>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CPU_TARGET(x)
+#elif defined(CPU_X86)
+#include <cpuid.h>
+#include <immintrin.h>
+#define CPU_TARGET(x) __attribute__((target(x)))
+#else
+#define CPU_TARGET(x)
+#endif
+
+// Runtime instruction set detection used to pick SIMD code paths.
+// Results are computed once and cached for the life of the process.
+class CpuFeatures {
+public:
+	static bool SSE2() { return Get().sse2; }
+	static bool SSSE3() { return Get().ssse3; }
+	static bool SSE41() { return Get().sse41; }
+	static bool SSE42() { return Get().sse42; }
+	static bool PCLMUL() { return Get().pclmul; }
+	static bool AVX2() { return Get().avx2; }
+	static bool BMI2() { return Get().bmi2; }
+	static bool AVX512F() { return Get().avx512f; }
+	static bool AVX512BW() { return Get().avx512bw; }
+	static bool SHA() { return Get().sha; }
+
+private:
+	struct Flags {
+		bool sse2 = false;
+		bool ssse3 = false;
+		bool sse41 = false;
+		bool sse42 = false;
+		bool pclmul = false;
+		bool avx2 = false;
+		bool bmi2 = false;
+		bool avx512f = false;
+		bool avx512bw = false;
+		bool sha = false;
+	};
+#if defined(CPU_X86)
+	static void CpuId(int leaf, int sub, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+		int r[4];
+		__cpuidex(r, leaf, sub);
+		for (int i = 0; i < 4; i++) regs[i] = (uint32_t)r[i];
+#else
+		__cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+	static uint64_t XGetBV() {
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		uint32_t lo, hi;
+		__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		return ((uint64_t)hi << 32) | lo;
+#endif
+	}
+#endif
+	static Flags Detect() {
+		Flags f;
+#if defined(CPU_X86)
+		uint32_t r[4];
+		CpuId(0, 0, r);
+		const uint32_t maxLeaf = r[0];
+		CpuId(1, 0, r);
+		f.sse2 = (r[3] >> 26) & 1;
+		f.ssse3 = (r[2] >> 9) & 1;
+		f.sse41 = (r[2] >> 19) & 1;
+		f.sse42 = (r[2] >> 20) & 1;
+		f.pclmul = (r[2] >> 1) & 1;
+		const bool osxsave = (r[2] >> 27) & 1;
+		const bool avx = (r[2] >> 28) & 1;
+		const uint64_t xcr0 = osxsave ? XGetBV() : 0;
+		const bool ymmState = (xcr0 & 0x6) == 0x6;
+		const bool zmmState = (xcr0 & 0xE6) == 0xE6;
+		if (maxLeaf >= 7) {
+			CpuId(7, 0, r);
+			f.avx2 = avx && ymmState && ((r[1] >> 5) & 1);
+			f.bmi2 = (r[1] >> 8) & 1;
+			f.avx512f = zmmState && ((r[1] >> 16) & 1);
+			f.avx512bw = f.avx512f && ((r[1] >> 30) & 1);
+			f.sha = (r[1] >> 29) & 1;
+		}
+#endif
+		return f;
+	}
+	static const Flags& Get() {
+		static const Flags flags = Detect();
+		return flags;
+	}
+};
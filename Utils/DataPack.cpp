@@ -1,37 +1,151 @@
 ﻿#pragma once
 #include "DataPack.h"
-#include <unordered_map>
+#include "FileStream.h"
+#include "DataPackContainer.h"
+#include "DataPackView.h"
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
-enum class DataPachKey : uint8_t {
-	FileStart = 0x81,
-	FileEnd = 0x98,
-	IdStart = 0xC7,
-	IdEnd = 0xC8,
-	ValueStart = 0x55,
-	ValueEnd = 0x56,
-	ValueStart_Small = 0x57,
-	ValueStart_Small_X = 0x58,
-	ChildStart = 0xD4,
-	ChildEnd = 0xD5,
-	ChildStart_Small = 0xD6,
-	ChildStart_Small_X = 0xD7,
-};
-
 DataPack& DataPack::operator[](int index) {
 	return this->Child[index];
 }
 DataPack& DataPack::operator[](const std::string& id) {
-	for (int i = 0; i < Child.size(); i++) {
-		if (this->Child[i].Id == id) {
-			return this->Child[i];
-		}
-	}
+	if (DataPack* child = FindChild(id))
+		return *child;
 	Child.push_back(DataPack(id, 0));
 	return this->Child[this->Child.size() - 1];
 }
 
+static inline uint32_t key_hash(const std::string& id) {
+	return (uint32_t)std::hash<std::string>{}(id);
+}
+
+// Covers Child[0, count). The table is kept at most half full, so probe runs
+// stay short.
+struct DataPack::KeyIndex {
+	static constexpr uint32_t Empty = UINT32_MAX;
+	struct Slot {
+		uint32_t hash;
+		uint32_t child;
+	};
+	std::vector<Slot> slots;
+	size_t count = 0;
+
+	void Extend(const std::vector<DataPack>& children) {
+		for (; count < children.size(); count++)
+			Insert(children, count, key_hash(children[count].Id));
+	}
+	// Inserts child unless an earlier child already owns its Id.
+	void Insert(const std::vector<DataPack>& children, size_t child, uint32_t hash) {
+		if ((count + 1) * 2 > slots.size()) {
+			std::vector<Slot> old(std::max<size_t>(slots.size() * 2, 64), Slot{ 0, Empty });
+			old.swap(slots);
+			for (const Slot& slot : old) {
+				if (slot.child != Empty)
+					Place(slot);
+			}
+		}
+		const size_t mask = slots.size() - 1;
+		size_t i = hash & mask;
+		for (; slots[i].child != Empty; i = (i + 1) & mask) {
+			if (slots[i].hash == hash && children[slots[i].child].Id == children[child].Id)
+				return;
+		}
+		slots[i] = Slot{ hash, (uint32_t)child };
+	}
+	void Place(Slot slot) {
+		const size_t mask = slots.size() - 1;
+		size_t i = slot.hash & mask;
+		while (slots[i].child != Empty)
+			i = (i + 1) & mask;
+		slots[i] = slot;
+	}
+	// A hit is checked against the child's current Id.
+	const DataPack* Find(const std::vector<DataPack>& children, const std::string& id) const {
+		const uint32_t hash = key_hash(id);
+		const size_t mask = slots.size() - 1;
+		for (size_t i = hash & mask; slots[i].child != Empty; i = (i + 1) & mask) {
+			if (slots[i].hash == hash && children[slots[i].child].Id == id)
+				return &children[slots[i].child];
+		}
+		return nullptr;
+	}
+};
+
+DataPack::KeyIndexHolder::KeyIndexHolder() = default;
+DataPack::KeyIndexHolder::KeyIndexHolder(const KeyIndexHolder&) {}
+DataPack::KeyIndexHolder::KeyIndexHolder(KeyIndexHolder&& other) noexcept = default;
+DataPack::KeyIndexHolder& DataPack::KeyIndexHolder::operator=(const KeyIndexHolder&) {
+	index.reset();
+	return *this;
+}
+DataPack::KeyIndexHolder& DataPack::KeyIndexHolder::operator=(KeyIndexHolder&& other) noexcept = default;
+DataPack::KeyIndexHolder::~KeyIndexHolder() = default;
+
+void DataPack::DropKeyIndex() {
+	keyIndex.index.reset();
+}
+
+void DataPack::RebuildKeyIndex() {
+	if (!keyIndex.index)
+		keyIndex.index = std::make_unique<KeyIndex>();
+	KeyIndex& index = *keyIndex.index;
+	std::fill(index.slots.begin(), index.slots.end(), KeyIndex::Slot{ 0, KeyIndex::Empty });
+	index.count = 0;
+	index.Extend(Child);
+}
+
+// Ids can be assigned through Child without the index noticing, so a miss is
+// confirmed by scanning the children.
+static const DataPack* scan_children(const std::vector<DataPack>& children, const std::string& id) {
+	for (const DataPack& child : children) {
+		if (child.Id == id)
+			return &child;
+	}
+	return nullptr;
+}
+
+const DataPack* DataPack::FindChild(const std::string& id) const {
+	const KeyIndex* index = keyIndex.index.get();
+	// A shrunk vector means the index points past the end.
+	if (index && index->count <= Child.size()) {
+		if (const DataPack* child = index->Find(Child, id))
+			return child;
+	}
+	return scan_children(Child, id);
+}
+
+DataPack* DataPack::FindChild(const std::string& id) {
+	if (Child.size() < KeyIndexThreshold || Child.size() > UINT32_MAX - 1) {
+		DropKeyIndex();
+		return const_cast<DataPack*>(scan_children(Child, id));
+	}
+	if (!keyIndex.index || keyIndex.index->count > Child.size())
+		RebuildKeyIndex();
+	else
+		keyIndex.index->Extend(Child);
+	if (const DataPack* child = keyIndex.index->Find(Child, id))
+		return const_cast<DataPack*>(child);
+	const DataPack* child = scan_children(Child, id);
+	// Found only by the scan: Child was edited directly.
+	if (child)
+		RebuildKeyIndex();
+	return const_cast<DataPack*>(child);
+}
+
+bool DataPack::ContainsKsy(const std::string& key) const {
+	return FindChild(key) != nullptr;
+}
+
+bool DataPack::ContainsKsy(const std::string& key) {
+	return FindChild(key) != nullptr;
+}
+
 static inline bool is_little_endian() {
 	const uint16_t one = 1;
 	return *(const uint8_t*)&one == 1;
@@ -66,99 +180,148 @@ static inline bool read_u32_le(const uint8_t* data, size_t data_len, size_t offs
 	return true;
 }
 
-static inline void append_u8(std::vector<uint8_t>& out, uint8_t v) {
-	out.push_back(v);
-}
-
-static inline void append_bytes(std::vector<uint8_t>& out, const void* data, size_t len) {
-	if (len == 0)
-		return;
-	const uint8_t* p = (const uint8_t*)data;
-	const size_t oldSize = out.size();
-	out.resize(oldSize + len);
-	std::memcpy(out.data() + oldSize, p, len);
-}
-
-static inline void append_u16_le(std::vector<uint8_t>& out, uint16_t v) {
+static inline void store_u16_le(uint8_t* dst, uint16_t v) {
 	if (!is_little_endian())
 		v = bswap16(v);
-	append_bytes(out, &v, sizeof(v));
+	std::memcpy(dst, &v, sizeof(v));
 }
 
-static inline void append_u32_le(std::vector<uint8_t>& out, uint32_t v) {
+static inline void store_u32_le(uint8_t* dst, uint32_t v) {
 	if (!is_little_endian())
 		v = bswap32(v);
-	append_bytes(out, &v, sizeof(v));
+	std::memcpy(dst, &v, sizeof(v));
 }
 
-static size_t serialized_size(const DataPack& pack) {
-	// FileStart (1) + size32 (4) + FileEnd (1)
-	size_t total = 6;
-	if (!pack.Id.empty()) {
-		// IdStart + u16 len + bytes + IdEnd
-		total += 1 + 2 + pack.Id.size() + 1;
-	}
-	if (!pack.Value.empty()) {
-		const size_t valueLen = pack.Value.size();
-		if (valueLen > UINT32_MAX)
-			return 0;
-		// ValueStartX + len(1/2/4) + bytes + ValueEnd
-		if (valueLen > UINT16_MAX)
-			total += 1 + 4 + valueLen + 1;
-		else if (valueLen > UINT8_MAX)
-			total += 1 + 2 + valueLen + 1;
-		else
-			total += 1 + 1 + valueLen + 1;
-	}
-	for (const auto& sub : pack.Child) {
-		const size_t childSize = serialized_size(sub);
-		if (childSize == 0)
-			return 0;
-		if (childSize > UINT32_MAX)
-			return 0;
-		// ChildStartX + len(1/2/4) + childBytes + ChildEnd
-		if (childSize > UINT16_MAX)
-			total += 1 + 4 + childSize + 1;
-		else if (childSize > UINT8_MAX)
-			total += 1 + 2 + childSize + 1;
-		else
-			total += 1 + 1 + childSize + 1;
-	}
-	return total;
+static inline size_t length_width(size_t len) {
+	return len > UINT16_MAX ? 4 : len > UINT8_MAX ? 2 : 1;
 }
 
-using SizeMap = std::unordered_map<const DataPack*, size_t>;
+// The serializer below is shared by DataPack and ArenaDataPack.
+static inline const std::vector<DataPack>& children_of(const DataPack& pack) {
+	return pack.Child;
+}
+static inline const ArenaDataPack& children_of(const ArenaDataPack& pack) {
+	return pack;
+}
 
-static size_t compute_sizes(const DataPack& pack, SizeMap& sizes) {
+// Exact encoded size of a pack's header, Id, Value and trailer: the whole pack
+// when it has no children. O(1).
+template<typename Pack>
+static size_t own_size(const Pack& pack) {
 	size_t total = 6;
 	if (!pack.Id.empty())
 		total += 1 + 2 + pack.Id.size() + 1;
+	if (!pack.Value.empty())
+		total += 1 + length_width(pack.Value.size()) + pack.Value.size() + 1;
+	return total;
+}
+
+// Output cursor over a growable vector. Space is claimed per pack rather than
+// per byte, and the vector is trimmed to the written length by Finish().
+class PackBuffer {
+public:
+	explicit PackBuffer(std::vector<uint8_t>& out) : out(out), pos(out.size()) {}
+
+	uint8_t* Claim(size_t n) {
+		if (out.size() - pos < n)
+			out.resize(std::max(out.size() * 2, pos + n));
+		uint8_t* p = out.data() + pos;
+		pos += n;
+		return p;
+	}
+	uint8_t* At(size_t offset) { return out.data() + offset; }
+	size_t Position() const { return pos; }
+	void Rewind(size_t offset) { pos = offset; }
+	void Finish() { out.resize(pos); }
+
+private:
+	std::vector<uint8_t>& out;
+	size_t pos;
+};
+
+static uint8_t* put_length(uint8_t* p, DataPachKey wide, DataPachKey small, DataPachKey tiny, size_t len) {
+	switch (length_width(len)) {
+	case 4: *p = (uint8_t)wide; store_u32_le(p + 1, (uint32_t)len); return p + 5;
+	case 2: *p = (uint8_t)small; store_u16_le(p + 1, (uint16_t)len); return p + 3;
+	default: *p = (uint8_t)tiny; p[1] = (uint8_t)len; return p + 2;
+	}
+}
+
+// Header, Id and Value of a pack; own_size(pack) - 1 bytes, everything but FileEnd.
+template<typename Pack>
+static uint8_t* put_head(uint8_t* p, const Pack& pack, size_t total) {
+	*p = (uint8_t)DataPachKey::FileStart;
+	store_u32_le(p + 1, (uint32_t)total);
+	p += 5;
+	if (!pack.Id.empty()) {
+		*p = (uint8_t)DataPachKey::IdStart;
+		store_u16_le(p + 1, (uint16_t)pack.Id.size());
+		std::memcpy(p + 3, pack.Id.data(), pack.Id.size());
+		p += 3 + pack.Id.size();
+		*p++ = (uint8_t)DataPachKey::IdEnd;
+	}
 	if (!pack.Value.empty()) {
-		const size_t valueLen = pack.Value.size();
-		if (valueLen > std::numeric_limits<uint32_t>::max())
-			return 0;
-		if (valueLen > UINT16_MAX)
-			total += 1 + 4 + valueLen + 1;
-		else if (valueLen > UINT8_MAX)
-			total += 1 + 2 + valueLen + 1;
-		else
-			total += 1 + 1 + valueLen + 1;
+		p = put_length(p, DataPachKey::ValueStart, DataPachKey::ValueStart_Small, DataPachKey::ValueStart_Small_X, pack.Value.size());
+		std::memcpy(p, pack.Value.data(), pack.Value.size());
+		p += pack.Value.size();
+		*p++ = (uint8_t)DataPachKey::ValueEnd;
 	}
-	for (const auto& sub : pack.Child) {
-		const size_t childSize = compute_sizes(sub, sizes);
-		if (childSize == 0)
-			return 0;
-		if (childSize > std::numeric_limits<uint32_t>::max())
-			return 0;
-		if (childSize > UINT16_MAX)
-			total += 1 + 4 + childSize + 1;
-		else if (childSize > UINT8_MAX)
-			total += 1 + 2 + childSize + 1;
-		else
-			total += 1 + 1 + childSize + 1;
+	return p;
+}
+
+template<typename Pack>
+static void write_pack(const Pack& pack, PackBuffer& out);
+
+// Writes the children of pack, each exactly once. A childless child's size is
+// known up front, so it is written in one go with the narrowest length
+// prefix. A child with children of its own gets a 4-byte slot that is
+// back-patched once its size is known and, when a narrower prefix suffices,
+// compacted by shifting the child's bytes down, so the output is the minimal
+// encoding. childDone runs after each child.
+template<typename Pack, typename ChildDone>
+static void write_children(const Pack& pack, PackBuffer& out, ChildDone childDone) {
+	for (const auto& sub : children_of(pack)) {
+		if (sub.Value.size() > UINT32_MAX)
+			throw std::length_error("DataPack value exceeds 4 GB");
+		if (children_of(sub).empty()) {
+			const size_t childLen = own_size(sub);
+			uint8_t* p = out.Claim(1 + length_width(childLen) + childLen + 1);
+			p = put_length(p, DataPachKey::ChildStart, DataPachKey::ChildStart_Small, DataPachKey::ChildStart_Small_X, childLen);
+			p = put_head(p, sub, childLen);
+			p[0] = (uint8_t)DataPachKey::FileEnd;
+			p[1] = (uint8_t)DataPachKey::ChildEnd;
+		}
+		else {
+			const size_t slot = out.Position();
+			out.Claim(5);
+			write_pack(sub, out);
+			const size_t body = slot + 5;
+			const size_t childLen = out.Position() - body;
+			if (childLen > UINT32_MAX)
+				throw std::length_error("DataPack child exceeds 4 GB");
+			const size_t width = length_width(childLen);
+			if (width < 4) {
+				std::memmove(out.At(slot + 1 + width), out.At(body), childLen);
+				out.Rewind(out.Position() - (4 - width));
+			}
+			put_length(out.At(slot), DataPachKey::ChildStart, DataPachKey::ChildStart_Small, DataPachKey::ChildStart_Small_X, childLen);
+			*out.Claim(1) = (uint8_t)DataPachKey::ChildEnd;
+		}
+		childDone();
 	}
-	sizes[&pack] = total;
-	return total;
+}
+
+template<typename Pack>
+static void write_pack(const Pack& pack, PackBuffer& out) {
+	const size_t start = out.Position();
+	const size_t head = own_size(pack) - 1;
+	put_head(out.Claim(head), pack, 0);
+	write_children(pack, out, [] {});
+	*out.Claim(1) = (uint8_t)DataPachKey::FileEnd;
+	const size_t total = out.Position() - start;
+	if (total > UINT32_MAX)
+		throw std::length_error("DataPack exceeds 4 GB");
+	store_u32_le(out.At(start + 1), (uint32_t)total);
 }
 
 void DataPack::operator=(const std::initializer_list<uint8_t> data) {
@@ -206,7 +369,40 @@ void DataPack::operator=(std::wstring data) {
 		std::memcpy(this->Value.data(), data.c_str(), data.size() * 2);
 }
 void DataPack::RemoveAt(int index) {
+	KeyIndex* keys = keyIndex.index.get();
+	if (keys && keys->count > Child.size()) {
+		DropKeyIndex();
+		keys = nullptr;
+	}
+	if (!keys || (size_t)index >= keys->count) {
+		this->Child.erase(this->Child.begin() + index);
+		return;
+	}
+	const std::string removedId = std::move(Child[index].Id);
 	this->Child.erase(this->Child.begin() + index);
+	// Renumbering the table is one pass over it, cheaper than rehashing every Id.
+	const std::vector<KeyIndex::Slot> old = std::move(keys->slots);
+	keys->slots.assign(old.size(), KeyIndex::Slot{ 0, KeyIndex::Empty });
+	keys->count--;
+	bool wasFirst = false;
+	for (const KeyIndex::Slot& slot : old) {
+		if (slot.child == KeyIndex::Empty)
+			continue;
+		if (slot.child == (uint32_t)index) {
+			wasFirst = true;
+			continue;
+		}
+		keys->Place(KeyIndex::Slot{ slot.hash, slot.child > (uint32_t)index ? slot.child - 1 : slot.child });
+	}
+	// A later child with the same Id becomes the first one.
+	if (wasFirst) {
+		for (size_t i = index; i < keys->count; i++) {
+			if (Child[i].Id == removedId) {
+				keys->Insert(Child, i, key_hash(removedId));
+				break;
+			}
+		}
+	}
 }
 DataPack::DataPack() :Id({}), Value({}) {}
 DataPack::DataPack(const uint8_t* data, int data_len) {
@@ -214,14 +410,24 @@ DataPack::DataPack(const uint8_t* data, int data_len) {
 		return;
 	if (data_len < 6)
 		return;
+	// Only a whole buffer can be a container; nested children are plain packs.
+	if (DataPackContainer::IsContainer(data, (size_t)data_len)) {
+		if (!DataPackContainer(data, (size_t)data_len).Decode(*this))
+			throw std::runtime_error("DataPack container is corrupt");
+		return;
+	}
+	Parse(data, (size_t)data_len);
+}
+
+void DataPack::Parse(const uint8_t* data, size_t data_len) {
 	if (data[0] != (uint8_t)DataPachKey::FileStart) {
 		return;
 	}
 	uint32_t bufferSizeU32 = 0;
-	if (!read_u32_le(data, (size_t)data_len, 1, bufferSizeU32))
+	if (!read_u32_le(data, data_len, 1, bufferSizeU32))
 		return;
 	const size_t bufferSize = (size_t)bufferSizeU32;
-	if (bufferSize < 6 || bufferSize >(size_t)data_len) {
+	if (bufferSize < 6 || bufferSize > data_len) {
 		return;
 	}
 	if (data[bufferSize - 1] != (uint8_t)DataPachKey::FileEnd) {
@@ -303,7 +509,8 @@ DataPack::DataPack(const uint8_t* data, int data_len) {
 				return;
 			if (data[index + childLen] != (uint8_t)DataPachKey::ChildEnd)
 				return;
-			this->Child.emplace_back(&data[index], (int)childLen);
+			this->Child.emplace_back();
+			this->Child.back().Parse(&data[index], childLen);
 			index += childLen + 1;
 			break;
 		}
@@ -320,7 +527,8 @@ DataPack::DataPack(const uint8_t* data, int data_len) {
 				return;
 			if (data[index + childLen] != (uint8_t)DataPachKey::ChildEnd)
 				return;
-			this->Child.emplace_back(&data[index], (int)childLen);
+			this->Child.emplace_back();
+			this->Child.back().Parse(&data[index], childLen);
 			index += childLen + 1;
 			break;
 		}
@@ -337,7 +545,8 @@ DataPack::DataPack(const uint8_t* data, int data_len) {
 				return;
 			if (data[index + childLen] != (uint8_t)DataPachKey::ChildEnd)
 				return;
-			this->Child.emplace_back(&data[index], (int)childLen);
+			this->Child.emplace_back();
+			this->Child.back().Parse(&data[index], childLen);
 			index += childLen + 1;
 			break;
 		}
@@ -405,140 +614,268 @@ void DataPack::Add(const DataPack& val) {
 }
 void DataPack::clear() {
 	this->Child.clear();
+	DropKeyIndex();
 }
 size_t DataPack::size() const {
 	return this->Child.size();
 }
 void DataPack::resize(size_t value) {
 	this->Child.resize(value);
+	if (keyIndex.index && keyIndex.index->count > value)
+		DropKeyIndex();
 }
 void DataPack::WriteTo(std::vector<uint8_t>& out) const {
-	append_u8(out, (uint8_t)DataPachKey::FileStart);
-	const size_t sizePos = out.size();
-	append_u32_le(out, 0u);
-
-	if (!this->Id.empty()) {
-		append_u8(out, (uint8_t)DataPachKey::IdStart);
-		append_u16_le(out, (uint16_t)this->Id.size());
-		append_bytes(out, this->Id.data(), this->Id.size());
-		append_u8(out, (uint8_t)DataPachKey::IdEnd);
-	}
+	if (this->Value.size() > UINT32_MAX)
+		throw std::length_error("DataPack value exceeds 4 GB");
+	PackBuffer buffer(out);
+	write_pack(*this, buffer);
+	buffer.Finish();
+}
 
-	if (!this->Value.empty()) {
-		const size_t valueLen = this->Value.size();
-		if (valueLen > UINT16_MAX) {
-			append_u8(out, (uint8_t)DataPachKey::ValueStart);
-			append_u32_le(out, (uint32_t)valueLen);
+bool DataPack::WriteTo(FileStream& stream) const {
+	// Patching seeks back, and every append-mode write lands at the end.
+	if (stream.Mode() == FileMode::Append)
+		throw std::invalid_argument("DataPack cannot patch a stream opened with FileMode::Append");
+	if (this->Value.size() > UINT32_MAX)
+		throw std::length_error("DataPack value exceeds 4 GB");
+	// Completed children of the root are flushed in chunks, so only the root
+	// header's size slot is left to patch, by seeking back once at the end.
+	constexpr size_t ChunkSize = 1 << 20;
+	std::vector<uint8_t> storage;
+	PackBuffer buffer(storage);
+	const size_t origin = stream.Position();
+	size_t flushed = 0;
+	bool ok = true;
+	put_head(buffer.Claim(own_size(*this) - 1), *this, 0);
+	write_children(*this, buffer, [&] {
+		if (buffer.Position() >= ChunkSize) {
+			ok = ok && stream.Write(buffer.At(0), buffer.Position());
+			flushed += buffer.Position();
+			buffer.Rewind(0);
 		}
-		else if (valueLen > UINT8_MAX) {
-			append_u8(out, (uint8_t)DataPachKey::ValueStart_Small);
-			append_u16_le(out, (uint16_t)valueLen);
-		}
-		else {
-			append_u8(out, (uint8_t)DataPachKey::ValueStart_Small_X);
-			append_u8(out, (uint8_t)valueLen);
-		}
-		append_bytes(out, this->Value.data(), this->Value.size());
-		append_u8(out, (uint8_t)DataPachKey::ValueEnd);
+	});
+	*buffer.Claim(1) = (uint8_t)DataPachKey::FileEnd;
+	const size_t total = flushed + buffer.Position();
+	if (total > UINT32_MAX)
+		throw std::length_error("DataPack exceeds 4 GB");
+	if (flushed == 0) {
+		store_u32_le(buffer.At(1), (uint32_t)total);
+		return ok && stream.Write(buffer.At(0), buffer.Position());
 	}
+	ok = ok && stream.Write(buffer.At(0), buffer.Position());
+	uint8_t size[4];
+	store_u32_le(size, (uint32_t)total);
+	stream.Seek(origin + 1);
+	ok = ok && stream.Write(size, sizeof(size));
+	stream.Seek(origin + total);
+	return ok;
+}
 
-	for (const auto& sub : this->Child) {
-		const size_t childLen = serialized_size(sub);
-		if (childLen == 0)
-			continue;
-		if (childLen > UINT16_MAX) {
-			append_u8(out, (uint8_t)DataPachKey::ChildStart);
-			append_u32_le(out, (uint32_t)childLen);
-		}
-		else if (childLen > UINT8_MAX) {
-			append_u8(out, (uint8_t)DataPachKey::ChildStart_Small);
-			append_u16_le(out, (uint16_t)childLen);
-		}
-		else {
-			append_u8(out, (uint8_t)DataPachKey::ChildStart_Small_X);
-			append_u8(out, (uint8_t)childLen);
-		}
-		sub.WriteTo(out);
-		append_u8(out, (uint8_t)DataPachKey::ChildEnd);
+std::vector<uint8_t> DataPack::GetBytes() const {
+	std::vector<uint8_t> out;
+	WriteTo(out);
+	return out;
+}
+
+// Chunk headers are padded so the first allocation is maximally aligned.
+static constexpr size_t ArenaHeaderSize = (sizeof(void*) * 2 + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+static constexpr size_t ArenaMaxChunk = 16 * 1024 * 1024;
+
+DataPackArena::DataPackArena(size_t firstChunk) : nextSize(std::max<size_t>(firstChunk, 256)) {}
+
+DataPackArena::~DataPackArena() {
+	while (chunks) {
+		Chunk* next = chunks->next;
+		::operator delete(chunks);
+		chunks = next;
 	}
+}
 
-	append_u8(out, (uint8_t)DataPachKey::FileEnd);
+void* DataPackArena::Grow(size_t size, size_t align) {
+	size_t chunkSize = nextSize;
+	while (chunkSize < ArenaHeaderSize + size + align)
+		chunkSize *= 2;
+	Chunk* chunk = (Chunk*)::operator new(chunkSize);
+	chunk->next = chunks;
+	chunk->size = chunkSize;
+	chunks = chunk;
+	capacity += chunkSize;
+	cursor = (uint8_t*)chunk + ArenaHeaderSize;
+	limit = (uint8_t*)chunk + chunkSize;
+	nextSize = std::min(nextSize * 2, ArenaMaxChunk);
+	return Allocate(size, align);
+}
 
-	const size_t packStart = sizePos - 1;
-	const size_t totalSize = out.size() - packStart;
-	uint32_t totalSizeU32 = (uint32_t)totalSize;
-	if (!is_little_endian())
-		totalSizeU32 = bswap32(totalSizeU32);
-	std::memcpy(out.data() + sizePos, &totalSizeU32, sizeof(totalSizeU32));
+void DataPackArena::Reset() {
+	if (!chunks)
+		return;
+	// An oversized chunk is not always the newest, so keep the largest.
+	Chunk* largest = chunks;
+	for (Chunk* chunk = chunks->next; chunk; chunk = chunk->next) {
+		if (chunk->size > largest->size)
+			largest = chunk;
+	}
+	while (chunks) {
+		Chunk* next = chunks->next;
+		if (chunks != largest) {
+			capacity -= chunks->size;
+			::operator delete(chunks);
+		}
+		chunks = next;
+	}
+	largest->next = nullptr;
+	chunks = largest;
+	cursor = (uint8_t*)chunks + ArenaHeaderSize;
+	limit = (uint8_t*)chunks + chunks->size;
 }
 
-static void write_to_sized(const DataPack& pack, std::vector<uint8_t>& out, const SizeMap& sizes) {
-	append_u8(out, (uint8_t)DataPachKey::FileStart);
-	const size_t sizePos = out.size();
-	append_u32_le(out, 0u);
+ArenaDataPack& ArenaDataPack::Create(DataPackArena& arena, std::string_view id) {
+	ArenaDataPack* pack = new (arena.Allocate(sizeof(ArenaDataPack), alignof(ArenaDataPack))) ArenaDataPack(arena);
+	pack->SetId(id);
+	return *pack;
+}
 
-	if (!pack.Id.empty()) {
-		append_u8(out, (uint8_t)DataPachKey::IdStart);
-		append_u16_le(out, (uint16_t)pack.Id.size());
-		append_bytes(out, pack.Id.data(), pack.Id.size());
-		append_u8(out, (uint8_t)DataPachKey::IdEnd);
+void ArenaDataPack::SetId(std::string_view id) {
+	if (id.empty()) {
+		Id = {};
+		return;
 	}
+	char* p = (char*)arena->Allocate(id.size(), 1);
+	std::memcpy(p, id.data(), id.size());
+	Id = std::string_view(p, id.size());
+}
 
-	if (!pack.Value.empty()) {
-		const size_t valueLen = pack.Value.size();
-		if (valueLen > UINT16_MAX) {
-			append_u8(out, (uint8_t)DataPachKey::ValueStart);
-			append_u32_le(out, (uint32_t)valueLen);
-		}
-		else if (valueLen > UINT8_MAX) {
-			append_u8(out, (uint8_t)DataPachKey::ValueStart_Small);
-			append_u16_le(out, (uint16_t)valueLen);
-		}
-		else {
-			append_u8(out, (uint8_t)DataPachKey::ValueStart_Small_X);
-			append_u8(out, (uint8_t)valueLen);
-		}
-		append_bytes(out, pack.Value.data(), pack.Value.size());
-		append_u8(out, (uint8_t)DataPachKey::ValueEnd);
+void ArenaDataPack::SetValue(const void* data, size_t size) {
+	if (size == 0) {
+		Value = {};
+		return;
 	}
+	uint8_t* p = (uint8_t*)arena->Allocate(size, 1);
+	std::memcpy(p, data, size);
+	Value = ByteSpan(p, size);
+}
+
+ArenaDataPack& ArenaDataPack::Add(std::string_view id) {
+	ArenaDataPack& child = Create(*arena, id);
+	if (lastChild)
+		lastChild->next = &child;
+	else
+		firstChild = &child;
+	lastChild = &child;
+	count++;
+	return child;
+}
+
+ArenaDataPack& ArenaDataPack::AddCopy(const DataPack& pack) {
+	ArenaDataPack& child = Add(pack.Id);
+	child.SetValue(pack.Value.data(), pack.Value.size());
+	for (const DataPack& sub : pack.Child)
+		child.AddCopy(sub);
+	return child;
+}
 
-	for (const auto& sub : pack.Child) {
-		auto it = sizes.find(&sub);
-		if (it == sizes.end())
+ArenaDataPack& ArenaDataPack::FromDataPack(DataPackArena& arena, const DataPack& pack) {
+	ArenaDataPack& root = Create(arena, pack.Id);
+	root.SetValue(pack.Value.data(), pack.Value.size());
+	for (const DataPack& sub : pack.Child)
+		root.AddCopy(sub);
+	return root;
+}
+
+// One pass that checks the framing as strictly as DataPackView and builds
+// nodes as it goes. Iterative, so deep input cannot exhaust the stack; a
+// malformed buffer leaves what was built so far in the arena until Reset.
+ArenaDataPack* ArenaDataPack::Parse(DataPackArena& arena, const uint8_t* data, size_t size) {
+	if (data == nullptr)
+		return nullptr;
+	const size_t rootSize = DataPackView::PackSize(data, size);
+	if (rootSize == 0)
+		return nullptr;
+	ArenaDataPack& root = Create(arena);
+	struct Frame {
+		const uint8_t* pos;
+		const uint8_t* end;
+		ArenaDataPack* node;
+	};
+	std::vector<Frame> stack;
+	stack.push_back({ data + 5, data + rootSize - 1, &root });
+	while (!stack.empty()) {
+		Frame& frame = stack.back();
+		if (frame.pos == frame.end) {
+			stack.pop_back();
 			continue;
-		const size_t childLen = it->second;
-		if (childLen > UINT16_MAX) {
-			append_u8(out, (uint8_t)DataPachKey::ChildStart);
-			append_u32_le(out, (uint32_t)childLen);
 		}
-		else if (childLen > UINT8_MAX) {
-			append_u8(out, (uint8_t)DataPachKey::ChildStart_Small);
-			append_u16_le(out, (uint16_t)childLen);
+		DataPackView::Entry e;
+		if (!DataPackView::ReadEntry(frame.pos, frame.end, e))
+			return nullptr;
+		frame.pos = e.next;
+		ArenaDataPack* node = frame.node;
+		switch (e.key) {
+		case DataPachKey::IdStart:
+			node->SetId(std::string_view((const char*)e.payload, e.length));
+			break;
+		case DataPachKey::ValueStart:
+		case DataPachKey::ValueStart_Small:
+		case DataPachKey::ValueStart_Small_X:
+			node->SetValue(e.payload, e.length);
+			break;
+		default: {
+			const size_t childSize = e.length < 6 ? 0 : DataPackView::PackSize(e.payload, e.length);
+			if (childSize == 0)
+				return nullptr;
+			stack.push_back({ e.payload + 5, e.payload + childSize - 1, &node->Add() });
+			break;
 		}
-		else {
-			append_u8(out, (uint8_t)DataPachKey::ChildStart_Small_X);
-			append_u8(out, (uint8_t)childLen);
 		}
-		write_to_sized(sub, out, sizes);
-		append_u8(out, (uint8_t)DataPachKey::ChildEnd);
 	}
+	return &root;
+}
 
-	append_u8(out, (uint8_t)DataPachKey::FileEnd);
+ArenaDataPack& ArenaDataPack::operator[](size_t index) {
+	ArenaDataPack* child = firstChild;
+	while (index--)
+		child = child->next;
+	return *child;
+}
 
-	const size_t packStart = sizePos - 1;
-	const size_t totalSize = out.size() - packStart;
-	uint32_t totalSizeU32 = (uint32_t)totalSize;
-	if (!is_little_endian())
-		totalSizeU32 = bswap32(totalSizeU32);
-	std::memcpy(out.data() + sizePos, &totalSizeU32, sizeof(totalSizeU32));
+ArenaDataPack& ArenaDataPack::operator[](std::string_view id) {
+	if (ArenaDataPack* child = Find(id))
+		return *child;
+	return Add(id);
 }
 
-std::vector<uint8_t> DataPack::GetBytes() const {
+const ArenaDataPack* ArenaDataPack::Find(std::string_view id) const {
+	for (const ArenaDataPack* child = firstChild; child; child = child->next) {
+		if (child->Id == id)
+			return child;
+	}
+	return nullptr;
+}
+
+ArenaDataPack* ArenaDataPack::Find(std::string_view id) {
+	return const_cast<ArenaDataPack*>(std::as_const(*this).Find(id));
+}
+
+void ArenaDataPack::WriteTo(std::vector<uint8_t>& out) const {
+	if (Value.size() > UINT32_MAX)
+		throw std::length_error("DataPack value exceeds 4 GB");
+	PackBuffer buffer(out);
+	write_pack(*this, buffer);
+	buffer.Finish();
+}
+
+std::vector<uint8_t> ArenaDataPack::GetBytes() const {
 	std::vector<uint8_t> out;
-	SizeMap sizes;
-	const size_t total = compute_sizes(*this, sizes);
-	if (total > 0)
-		out.reserve(total);
-	write_to_sized(*this, out, sizes);
+	WriteTo(out);
 	return out;
-}
\ No newline at end of file
+}
+
+DataPack ArenaDataPack::ToDataPack() const {
+	DataPack pack;
+	pack.Id.assign(Id.data(), Id.size());
+	pack.Value.assign(Value.begin(), Value.end());
+	pack.Child.reserve(count);
+	for (const ArenaDataPack& child : *this)
+		pack.Child.push_back(child.ToDataPack());
+	return pack;
+}
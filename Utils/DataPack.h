@@ -1,9 +1,33 @@
 ﻿#pragma once
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <initializer_list>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
+#include "Span.h"
+class FileStream;
+
+// Wire markers of the DataPack binary format.
+enum class DataPachKey : uint8_t {
+    FileStart = 0x81,
+    FileEnd = 0x98,
+    IdStart = 0xC7,
+    IdEnd = 0xC8,
+    ValueStart = 0x55,
+    ValueEnd = 0x56,
+    ValueStart_Small = 0x57,
+    ValueStart_Small_X = 0x58,
+    ChildStart = 0xD4,
+    ChildEnd = 0xD5,
+    ChildStart_Small = 0xD6,
+    ChildStart_Small_X = 0xD7,
+};
+
 class DataPack {
 public:
     std::string Id;
@@ -64,6 +88,9 @@ public:
     }
     DataPack();
     DataPack(const char* key);
+    // Decodes a plain pack or a DataPackContainer. Malformed plain input
+    // leaves what was read; a container that fails its checks throws
+    // std::runtime_error.
     DataPack(const uint8_t* data, int data_len);
     DataPack(std::string id, uint8_t* data, int len);
     DataPack(std::vector<uint8_t> data);
@@ -110,17 +137,205 @@ public:
         if (this->Value.size() >= sizeof(T))
             std::memcpy(output, this->Value.data(), sizeof(T));
     }
-    bool ContainsKsy(const std::string& key) const {
-        for (const auto& child : this->Child) {
-            if (child.Id == key)
-                return true;
-        }
-        return false;
-    }
+    // Keyed lookups on nodes with at least KeyIndexThreshold children go
+    // through a hash index allocated on first use; children appended since
+    // are indexed on the next lookup. The const overload only reads an index
+    // that is already built, so concurrent readers stay safe. The index
+    // follows Add, RemoveAt, clear and resize. Children renamed, moved or
+    // replaced through Child are still found: every hit is checked against
+    // the child's Id and a miss is confirmed by a linear scan, which rebuilds
+    // the index if it finds the child. Adding new keys through operator[]
+    // therefore costs a scan each, as without the index; Add does not.
+    static constexpr size_t KeyIndexThreshold = 16;
+    bool ContainsKsy(const std::string& key) const;
+    bool ContainsKsy(const std::string& key);
     void RemoveAt(int index);
+    // Appends the encoding in a single pass over the tree.
     void WriteTo(std::vector<uint8_t>& out) const;
+    // Writes at the stream's current position. Output is flushed in chunks of
+    // about 1 MB at root-child boundaries, so memory stays bounded by the
+    // largest child of the root. Returns false if a write failed. Throws
+    // std::invalid_argument for a stream opened with FileMode::Append, where
+    // the size could not be patched.
+    bool WriteTo(FileStream& stream) const;
     std::vector<uint8_t> GetBytes() const;
     void clear();
     size_t size() const;
     void resize(size_t value);
-};
\ No newline at end of file
+
+private:
+    // Open-addressing table mapping an Id to the first child carrying it,
+    // see DataPack.cpp. Not part of the wire format.
+    struct KeyIndex;
+    // Owns the index, so a narrow node pays one pointer for it. Copies start
+    // without an index and build their own on first use.
+    class KeyIndexHolder {
+    public:
+        KeyIndexHolder();
+        KeyIndexHolder(const KeyIndexHolder&);
+        KeyIndexHolder(KeyIndexHolder&& other) noexcept;
+        KeyIndexHolder& operator=(const KeyIndexHolder&);
+        KeyIndexHolder& operator=(KeyIndexHolder&& other) noexcept;
+        ~KeyIndexHolder();
+
+        std::unique_ptr<KeyIndex> index;
+    };
+    KeyIndexHolder keyIndex;
+
+    // Decodes a plain encoded pack; malformed input leaves what was read.
+    void Parse(const uint8_t* data, size_t data_len);
+    const DataPack* FindChild(const std::string& id) const;
+    DataPack* FindChild(const std::string& id);
+    void RebuildKeyIndex();
+    void DropKeyIndex();
+};
+
+// Monotonic memory for ArenaDataPack trees. Allocation bumps a pointer through
+// chunks that double in size; nothing is freed on its own, and destroying or
+// resetting the arena releases every tree built in it at once, with no walk
+// over the nodes.
+class DataPackArena {
+public:
+    explicit DataPackArena(size_t firstChunk = 64 * 1024);
+    ~DataPackArena();
+    DataPackArena(const DataPackArena&) = delete;
+    DataPackArena& operator=(const DataPackArena&) = delete;
+
+    void* Allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        const uintptr_t aligned = ((uintptr_t)cursor + align - 1) & ~(uintptr_t)(align - 1);
+        if (cursor == nullptr || aligned + size > (uintptr_t)limit)
+            return Grow(size, align);
+        cursor = (uint8_t*)(aligned + size);
+        return (void*)aligned;
+    }
+    // Invalidates every pack built in the arena and keeps the largest chunk
+    // for reuse. Chunks keep growing, so a loop handling one message at a
+    // time stops allocating once a single chunk holds its largest message.
+    void Reset();
+    // Bytes reserved from the system.
+    size_t Capacity() const { return capacity; }
+
+private:
+    struct Chunk {
+        Chunk* next;
+        size_t size;
+    };
+    Chunk* chunks = nullptr;
+    uint8_t* cursor = nullptr;
+    uint8_t* limit = nullptr;
+    size_t nextSize;
+    size_t capacity = 0;
+
+    void* Grow(size_t size, size_t align);
+};
+
+// DataPack whose nodes, ids and values all live in a DataPackArena. Nodes are
+// trivially destructible and children form a linked list, so building a tree
+// never reallocates and dropping it costs nothing beyond the arena's own
+// release. The wire format is the same as DataPack's. Keyed lookups scan the
+// children; build wide nodes with Add rather than operator[].
+class ArenaDataPack {
+public:
+    template<typename Node>
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = ArenaDataPack;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Node*;
+        using reference = Node&;
+
+        Iterator(Node* node = nullptr) : node(node) {}
+        Node& operator*() const { return *node; }
+        Node* operator->() const { return node; }
+        Iterator& operator++() { node = node->next; return *this; }
+        Iterator operator++(int) { Iterator old = *this; node = node->next; return old; }
+        bool operator==(const Iterator& other) const { return node == other.node; }
+        bool operator!=(const Iterator& other) const { return node != other.node; }
+
+    private:
+        Node* node;
+    };
+    using iterator = Iterator<ArenaDataPack>;
+    using const_iterator = Iterator<const ArenaDataPack>;
+    // Values stored by their bytes; pointers and arrays go through the
+    // string_view overloads instead.
+    template<typename T>
+    static constexpr bool IsPlainValue = std::is_trivially_copyable_v<T> && !std::is_pointer_v<T> && !std::is_array_v<T>;
+
+    // Both point into the arena.
+    std::string_view Id;
+    ByteSpan Value;
+
+    ArenaDataPack(const ArenaDataPack&) = delete;
+    ArenaDataPack& operator=(const ArenaDataPack&) = delete;
+
+    static ArenaDataPack& Create(DataPackArena& arena, std::string_view id = {});
+    // Copies the tree into the arena in one pass, rejecting malformed input as
+    // DataPackView does; returns nullptr in that case.
+    static ArenaDataPack* Parse(DataPackArena& arena, const uint8_t* data, size_t size);
+    static ArenaDataPack* Parse(DataPackArena& arena, ByteSpan data) { return Parse(arena, data.data(), data.size()); }
+    static ArenaDataPack& FromDataPack(DataPackArena& arena, const DataPack& pack);
+
+    // Id and value bytes are copied into the arena.
+    void SetId(std::string_view id);
+    void SetValue(const void* data, size_t size);
+    void SetValue(ByteSpan data) { SetValue(data.data(), data.size()); }
+    template<typename T, typename = std::enable_if_t<IsPlainValue<T>>>
+    void operator=(const T& data) { SetValue(&data, sizeof(T)); }
+    void operator=(std::string_view data) { SetValue(data.data(), data.size()); }
+
+    ArenaDataPack& Add(std::string_view id = {});
+    template<typename T, typename = std::enable_if_t<IsPlainValue<T>>>
+    ArenaDataPack& Add(std::string_view id, const T& val) {
+        ArenaDataPack& child = Add(id);
+        child.SetValue(&val, sizeof(T));
+        return child;
+    }
+    ArenaDataPack& Add(std::string_view id, std::string_view val) {
+        ArenaDataPack& child = Add(id);
+        child.SetValue(val.data(), val.size());
+        return child;
+    }
+    // Copies pack and its subtree in as the last child.
+    ArenaDataPack& AddCopy(const DataPack& pack);
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    iterator begin() { return iterator(firstChild); }
+    iterator end() { return iterator(); }
+    const_iterator begin() const { return const_iterator(firstChild); }
+    const_iterator end() const { return const_iterator(); }
+
+    // Walks the children, so O(index); index must be below size().
+    ArenaDataPack& operator[](size_t index);
+    // Adds an empty child when no child has this id, like DataPack.
+    ArenaDataPack& operator[](std::string_view id);
+    // First child with this id, or nullptr.
+    ArenaDataPack* Find(std::string_view id);
+    const ArenaDataPack* Find(std::string_view id) const;
+    bool ContainsKey(std::string_view id) const { return Find(id) != nullptr; }
+
+    template<typename T>
+    T convert() const {
+        static_assert(std::is_trivially_copyable_v<T>, "DataPack only supports trivially copyable types");
+        T output{};
+        if (Value.size() >= sizeof(T))
+            std::memcpy(&output, Value.data(), sizeof(T));
+        return output;
+    }
+    std::string_view ValueString() const { return std::string_view((const char*)Value.data(), Value.size()); }
+
+    void WriteTo(std::vector<uint8_t>& out) const;
+    std::vector<uint8_t> GetBytes() const;
+    DataPack ToDataPack() const;
+
+private:
+    explicit ArenaDataPack(DataPackArena& arena) : arena(&arena) {}
+
+    DataPackArena* arena;
+    ArenaDataPack* firstChild = nullptr;
+    ArenaDataPack* lastChild = nullptr;
+    ArenaDataPack* next = nullptr;
+    size_t count = 0;
+};
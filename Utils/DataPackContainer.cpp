@@ -0,0 +1,257 @@
+﻿#include "DataPackContainer.h"
+#include "DataPackView.h"
+#include "Checksum.h"
+#include "zlib/zlib.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+	constexpr uint8_t Magic[4] = { 'D', 'P', 'K', 'C' };
+	constexpr size_t HeaderSize = 32;
+	constexpr size_t EntrySize = 32;
+	// Smallest encoded pack: FileStart, size and FileEnd.
+	constexpr size_t MinPackSize = 6;
+	// Deflate cannot expand data by more than about 1032 to 1.
+	constexpr uint64_t MaxInflateRatio = 1032;
+
+	enum class Codec : uint8_t {
+		Stored = 0,
+		Zlib = 1,
+	};
+
+	inline void put_u16(uint8_t* p, uint16_t v) {
+		p[0] = (uint8_t)v;
+		p[1] = (uint8_t)(v >> 8);
+	}
+	inline void put_u32(uint8_t* p, uint32_t v) {
+		for (int i = 0; i < 4; i++)
+			p[i] = (uint8_t)(v >> (8 * i));
+	}
+	inline void put_u64(uint8_t* p, uint64_t v) {
+		for (int i = 0; i < 8; i++)
+			p[i] = (uint8_t)(v >> (8 * i));
+	}
+	inline uint16_t get_u16(const uint8_t* p) {
+		return (uint16_t)(p[0] | (p[1] << 8));
+	}
+	inline uint32_t get_u32(const uint8_t* p) {
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+	inline uint64_t get_u64(const uint8_t* p) {
+		return (uint64_t)get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+	}
+
+	// Blocks are built one at a time: raw collects the packs of the current
+	// block, which Close() compresses into out while recording its entry.
+	class BlockEncoder {
+	public:
+		std::vector<uint8_t> raw;
+		std::vector<uint8_t> index;
+
+		BlockEncoder(std::vector<uint8_t>& out, int level) : out(out), level(level) {}
+
+		void Close(uint32_t firstChild, uint32_t childCount) {
+			if (raw.size() > UINT32_MAX)
+				throw std::length_error("DataPack container block exceeds 4 GB");
+			uint8_t entry[EntrySize] = {};
+			put_u64(entry, out.size());
+			put_u32(entry + 12, (uint32_t)raw.size());
+			put_u32(entry + 16, firstChild);
+			put_u32(entry + 20, childCount);
+			Codec codec = Codec::Stored;
+			if (level > 0) {
+				uLongf storedSize = compressBound((uLong)raw.size());
+				const size_t start = out.size();
+				out.resize(start + storedSize);
+				if (compress2(out.data() + start, &storedSize, raw.data(), (uLong)raw.size(), level) == Z_OK && storedSize < raw.size()) {
+					out.resize(start + storedSize);
+					codec = Codec::Zlib;
+				}
+				else {
+					out.resize(start);
+				}
+			}
+			if (codec == Codec::Stored)
+				out.insert(out.end(), raw.begin(), raw.end());
+			const size_t storedSize = out.size() - (size_t)get_u64(entry);
+			put_u32(entry + 8, (uint32_t)storedSize);
+			put_u32(entry + 24, Crc32C::Compute(out.data() + get_u64(entry), storedSize));
+			entry[28] = (uint8_t)codec;
+			index.insert(index.end(), entry, entry + EntrySize);
+			raw.clear();
+		}
+
+	private:
+		std::vector<uint8_t>& out;
+		const int level;
+	};
+}
+
+std::vector<uint8_t> DataPackContainer::Encode(const DataPack& pack, const DataPackContainerOptions& options) {
+	if (options.Level < 0 || options.Level > 9)
+		throw std::invalid_argument("zlib level must be between 0 and 9");
+	std::vector<uint8_t> out(HeaderSize);
+	BlockEncoder encoder(out, options.Level);
+
+	DataPack head;
+	head.Id = pack.Id;
+	head.Value = pack.Value;
+	head.WriteTo(encoder.raw);
+	encoder.Close(0, 0);
+
+	uint32_t first = 0;
+	for (size_t i = 0; i < pack.Child.size(); i++) {
+		pack.Child[i].WriteTo(encoder.raw);
+		if (encoder.raw.size() >= options.BlockSize || i + 1 == pack.Child.size()) {
+			encoder.Close(first, (uint32_t)(i + 1 - first));
+			first = (uint32_t)(i + 1);
+		}
+	}
+
+	const uint64_t indexOffset = out.size();
+	const uint32_t blockCount = (uint32_t)(encoder.index.size() / EntrySize);
+	out.insert(out.end(), encoder.index.begin(), encoder.index.end());
+	uint8_t indexCrc[4];
+	put_u32(indexCrc, Crc32C::Compute(encoder.index.data(), encoder.index.size()));
+	out.insert(out.end(), indexCrc, indexCrc + 4);
+
+	uint8_t* header = out.data();
+	std::copy(Magic, Magic + 4, header);
+	put_u16(header + 4, Version);
+	put_u16(header + 6, 0);
+	put_u64(header + 8, indexOffset);
+	put_u32(header + 16, (uint32_t)encoder.index.size());
+	put_u32(header + 20, blockCount);
+	put_u32(header + 24, Crc32C::Compute(header, 24));
+	put_u32(header + 28, 0);
+	return out;
+}
+
+bool DataPackContainer::IsContainer(const uint8_t* data, size_t size) {
+	return data != nullptr && size >= HeaderSize && std::equal(Magic, Magic + 4, data);
+}
+
+DataPackContainer::DataPackContainer(const uint8_t* data, size_t size) {
+	if (!IsContainer(data, size) || get_u32(data + 24) != Crc32C::Compute(data, 24) || get_u16(data + 4) != Version)
+		return;
+	const uint64_t indexOffset = get_u64(data + 8);
+	const uint32_t indexSize = get_u32(data + 16);
+	const uint32_t blockCount = get_u32(data + 20);
+	if (blockCount == 0 || indexSize != (uint64_t)blockCount * EntrySize || indexOffset < HeaderSize ||
+		indexOffset > size || size - indexOffset < (uint64_t)indexSize + 4)
+		return;
+	const uint8_t* index = data + indexOffset;
+	if (get_u32(index + indexSize) != Crc32C::Compute(index, indexSize))
+		return;
+	std::vector<Block> parsed(blockCount);
+	uint64_t nextChild = 0;
+	for (uint32_t i = 0; i < blockCount; i++) {
+		const uint8_t* entry = index + (size_t)i * EntrySize;
+		Block& block = parsed[i];
+		block.offset = get_u64(entry);
+		block.storedSize = get_u32(entry + 8);
+		block.rawSize = get_u32(entry + 12);
+		block.firstChild = get_u32(entry + 16);
+		block.childCount = get_u32(entry + 20);
+		block.checksum = get_u32(entry + 24);
+		block.codec = entry[28];
+		// Blocks lie between the header and the index; block 0 is the head
+		// and the rest number the children consecutively. The sizes are only
+		// covered by a CRC, so the raw size must be reachable from the stored
+		// bytes and hold every child the block claims before anything is
+		// allocated from them.
+		if (block.offset < HeaderSize || block.offset > indexOffset || indexOffset - block.offset < block.storedSize ||
+			block.codec > (uint8_t)Codec::Zlib || block.firstChild != (i == 0 ? 0 : nextChild) ||
+			(i == 0) != (block.childCount == 0))
+			return;
+		if (block.codec == (uint8_t)Codec::Stored ? block.rawSize != block.storedSize : block.rawSize > block.storedSize * MaxInflateRatio)
+			return;
+		if ((uint64_t)block.childCount * MinPackSize > block.rawSize)
+			return;
+		nextChild += block.childCount;
+	}
+	this->data = data;
+	this->size = size;
+	blocks = std::move(parsed);
+	childCount = (size_t)nextChild;
+}
+
+bool DataPackContainer::Load(const Block& block, std::vector<uint8_t>& raw) const {
+	const uint8_t* stored = data + block.offset;
+	if (Crc32C::Compute(stored, block.storedSize) != block.checksum)
+		return false;
+	raw.resize(block.rawSize);
+	if (block.codec == (uint8_t)Codec::Stored) {
+		std::copy(stored, stored + block.storedSize, raw.begin());
+		return true;
+	}
+	uLongf rawSize = block.rawSize;
+	return uncompress(raw.data(), &rawSize, stored, block.storedSize) == Z_OK && rawSize == block.rawSize;
+}
+
+bool DataPackContainer::ReadHead(DataPack& pack) const {
+	std::vector<uint8_t> raw;
+	if (!Valid() || !Load(blocks[0], raw) || DataPackView::PackSize(raw.data(), raw.size()) != raw.size())
+		return false;
+	pack = DataPack(raw.data(), (int)raw.size());
+	return true;
+}
+
+bool DataPackContainer::ReadChild(size_t index, DataPack& child) const {
+	if (!Valid() || index >= childCount)
+		return false;
+	const auto it = std::upper_bound(blocks.begin() + 1, blocks.end(), index,
+		[](size_t value, const Block& block) { return value < block.firstChild; }) - 1;
+	std::vector<uint8_t> raw;
+	if (!Load(*it, raw))
+		return false;
+	size_t pos = 0;
+	for (size_t i = it->firstChild;; i++) {
+		const size_t packSize = DataPackView::PackSize(raw.data() + pos, raw.size() - pos);
+		if (packSize == 0)
+			return false;
+		if (i == index) {
+			child = DataPack(raw.data() + pos, (int)packSize);
+			return true;
+		}
+		pos += packSize;
+	}
+}
+
+bool DataPackContainer::Decode(DataPack& pack) const {
+	DataPack result;
+	if (!ReadHead(result))
+		return false;
+	std::vector<uint8_t> raw;
+	for (size_t b = 1; b < blocks.size(); b++) {
+		if (!Load(blocks[b], raw))
+			return false;
+		// Reserved per block once its bytes are in hand, so the index alone
+		// never decides an allocation.
+		const size_t needed = result.Child.size() + blocks[b].childCount;
+		if (needed > result.Child.capacity())
+			result.Child.reserve(std::max(needed, result.Child.capacity() * 2));
+		size_t pos = 0;
+		for (uint32_t i = 0; i < blocks[b].childCount; i++) {
+			const size_t packSize = DataPackView::PackSize(raw.data() + pos, raw.size() - pos);
+			if (packSize == 0)
+				return false;
+			result.Child.emplace_back(raw.data() + pos, (int)packSize);
+			pos += packSize;
+		}
+		if (pos != raw.size())
+			return false;
+	}
+	pack = std::move(result);
+	return true;
+}
+
+bool DataPackContainer::Verify() const {
+	if (!Valid())
+		return false;
+	for (const Block& block : blocks) {
+		if (Crc32C::Compute(data + block.offset, block.storedSize) != block.checksum)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,574 @@
+﻿#include "Socket.h"
+#include "DataPackStream.h"
+#include "FileStream.h"
+#include <algorithm>
+#include <stdexcept>
+#include <Windows.h>
+
+namespace {
+	inline void store_u32_le(uint8_t* p, uint32_t v) {
+		p[0] = (uint8_t)v;
+		p[1] = (uint8_t)(v >> 8);
+		p[2] = (uint8_t)(v >> 16);
+		p[3] = (uint8_t)(v >> 24);
+	}
+	inline uint16_t load_u16_le(const uint8_t* p) {
+		return (uint16_t)(p[0] | (p[1] << 8));
+	}
+	inline uint32_t load_u32_le(const uint8_t* p) {
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+	inline size_t length_width(size_t len) {
+		return len > UINT16_MAX ? 4 : len > UINT8_MAX ? 2 : 1;
+	}
+
+	bool send_all(TCPSocket& socket, const uint8_t* data, size_t size) {
+		while (size > 0) {
+			const int chunk = (int)std::min<size_t>(size, 1 << 30);
+			const int sent = socket.Send((const char*)data, chunk);
+			if (sent <= 0)
+				return false;
+			data += sent;
+			size -= sent;
+		}
+		return true;
+	}
+}
+
+// Where the writer's bytes go. Patch rewrites bytes that were already
+// written; Finish receives the unflushed tail once the root is patched.
+class DataPackWriter::Sink {
+public:
+	virtual ~Sink() = default;
+	virtual bool Write(const uint8_t* data, size_t size) = 0;
+	virtual bool Patch(uint64_t offset, const uint8_t* data, size_t size) = 0;
+	virtual bool Finish(const uint8_t* data, size_t size) = 0;
+};
+
+namespace {
+	class FileSink : public DataPackWriter::Sink {
+	public:
+		explicit FileSink(FileStream& stream) : stream(stream), origin(stream.Position()) {
+			// Patching seeks back, and every append-mode write lands at the end.
+			if (stream.Mode() == FileMode::Append)
+				throw std::invalid_argument("DataPackWriter cannot patch a stream opened with FileMode::Append");
+		}
+
+		bool Write(const uint8_t* data, size_t size) override {
+			return stream.Write(data, size);
+		}
+		bool Patch(uint64_t offset, const uint8_t* data, size_t size) override {
+			const size_t position = stream.Position();
+			stream.Seek((size_t)(origin + offset));
+			const bool written = stream.Write(data, size);
+			stream.Seek(position);
+			return written;
+		}
+		bool Finish(const uint8_t* data, size_t size) override {
+			return size == 0 || stream.Write(data, size);
+		}
+
+	private:
+		FileStream& stream;
+		const uint64_t origin;
+	};
+
+	// Output that outgrows the writer's buffer is spooled to a temporary file
+	// and sent once complete, since the root's size leads the pack.
+	class SocketSink : public DataPackWriter::Sink {
+	public:
+		explicit SocketSink(TCPSocket& socket) : socket(socket) {}
+		~SocketSink() override {
+			if (spool) {
+				spool->Close();
+				DeleteFileA(spoolPath.c_str());
+			}
+		}
+
+		bool Write(const uint8_t* data, size_t size) override {
+			if (!spool) {
+				char dir[MAX_PATH];
+				char path[MAX_PATH];
+				if (GetTempPathA(MAX_PATH, dir) == 0 || GetTempFileNameA(dir, "dpk", 0, path) == 0)
+					return false;
+				spoolPath = path;
+				spool = std::make_unique<FileStream>(spoolPath, FileMode::ReadWrite);
+			}
+			return spool->Write(data, size);
+		}
+		bool Patch(uint64_t offset, const uint8_t* data, size_t size) override {
+			const size_t position = spool->Position();
+			spool->Seek((size_t)offset);
+			const bool written = spool->Write(data, size);
+			spool->Seek(position);
+			return written;
+		}
+		bool Finish(const uint8_t* data, size_t size) override {
+			if (!spool)
+				return send_all(socket, data, size);
+			if (!spool->Write(data, size))
+				return false;
+			std::vector<uint8_t> chunk(DataPackWriter::BufferSize);
+			spool->Seek(0);
+			long long read;
+			while ((read = spool->Read(chunk.data(), chunk.size())) > 0) {
+				if (!send_all(socket, chunk.data(), (size_t)read))
+					return false;
+			}
+			return true;
+		}
+
+	private:
+		TCPSocket& socket;
+		std::unique_ptr<FileStream> spool;
+		std::string spoolPath;
+	};
+}
+
+DataPackWriter::DataPackWriter(FileStream& stream, std::string_view rootId) : sink(std::make_unique<FileSink>(stream)) {
+	BeginPack(rootId);
+}
+
+DataPackWriter::DataPackWriter(TCPSocket& socket, std::string_view rootId) : sink(std::make_unique<SocketSink>(socket)) {
+	BeginPack(rootId);
+}
+
+DataPackWriter::~DataPackWriter() = default;
+
+// FileStart, a size slot patched on close, and the Id entry.
+void DataPackWriter::BeginPack(std::string_view id) {
+	if (id.size() > UINT16_MAX)
+		throw std::length_error("DataPack id exceeds 64 KB");
+	uint8_t header[5] = { (uint8_t)DataPachKey::FileStart };
+	Append(header, sizeof(header));
+	if (!id.empty()) {
+		const uint8_t start[3] = { (uint8_t)DataPachKey::IdStart, (uint8_t)id.size(), (uint8_t)(id.size() >> 8) };
+		const uint8_t idEnd = (uint8_t)DataPachKey::IdEnd;
+		Append(start, sizeof(start));
+		Append(id.data(), id.size());
+		Append(&idEnd, 1);
+	}
+}
+
+void DataPackWriter::Append(const void* data, size_t size) {
+	if (buffer.size() + size > BufferSize)
+		Flush(size);
+	if (size >= BufferSize) {
+		ok = ok && sink->Write((const uint8_t*)data, size);
+		flushed += size;
+		return;
+	}
+	buffer.insert(buffer.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+}
+
+// Makes room for room more bytes. The outermost open child that fits in half
+// the buffer stays behind, so it can still be compacted when it closes.
+void DataPackWriter::Flush(size_t room) {
+	size_t count = buffer.size();
+	for (uint64_t slot : open) {
+		if (slot >= flushed && Position() - slot <= BufferSize / 2) {
+			count = (size_t)(slot - flushed);
+			break;
+		}
+	}
+	if (buffer.size() - count + room > BufferSize)
+		count = buffer.size();
+	if (count == 0)
+		return;
+	ok = ok && sink->Write(buffer.data(), count);
+	flushed += count;
+	buffer.erase(buffer.begin(), buffer.begin() + count);
+}
+
+// The slot may straddle the last flush, so each side is patched separately.
+void DataPackWriter::Patch(uint64_t offset, uint32_t value) {
+	uint8_t bytes[4];
+	store_u32_le(bytes, value);
+	const size_t head = offset < flushed ? (size_t)std::min<uint64_t>(sizeof(bytes), flushed - offset) : 0;
+	if (head > 0)
+		ok = ok && sink->Patch(offset, bytes, head);
+	if (head < sizeof(bytes))
+		std::memcpy(buffer.data() + (offset + head - flushed), bytes + head, sizeof(bytes) - head);
+}
+
+void DataPackWriter::BeginChild(std::string_view id) {
+	if (ended)
+		throw std::logic_error("DataPackWriter has already ended");
+	open.push_back(Position());
+	const uint8_t slot[5] = { (uint8_t)DataPachKey::ChildStart };
+	Append(slot, sizeof(slot));
+	BeginPack(id);
+}
+
+void DataPackWriter::EndChild() {
+	if (ended || open.empty())
+		throw std::logic_error("DataPackWriter has no open child");
+	const uint8_t fileEnd = (uint8_t)DataPachKey::FileEnd;
+	Append(&fileEnd, 1);
+	const uint64_t slot = open.back();
+	open.pop_back();
+	const uint64_t packSize = Position() - (slot + 5);
+	if (packSize > UINT32_MAX)
+		throw std::length_error("DataPack child exceeds 4 GB");
+	Patch(slot + 6, (uint32_t)packSize);
+	const size_t width = length_width((size_t)packSize);
+	if (slot >= flushed && width < 4) {
+		// Still buffered: shift the child down to the narrowest prefix.
+		uint8_t* p = buffer.data() + (slot - flushed);
+		std::memmove(p + 1 + width, p + 5, (size_t)packSize);
+		buffer.resize(buffer.size() - (4 - width));
+		if (width == 2) {
+			p[0] = (uint8_t)DataPachKey::ChildStart_Small;
+			p[1] = (uint8_t)packSize;
+			p[2] = (uint8_t)(packSize >> 8);
+		}
+		else {
+			p[0] = (uint8_t)DataPachKey::ChildStart_Small_X;
+			p[1] = (uint8_t)packSize;
+		}
+	}
+	else {
+		Patch(slot + 1, (uint32_t)packSize);
+	}
+	const uint8_t childEnd = (uint8_t)DataPachKey::ChildEnd;
+	Append(&childEnd, 1);
+}
+
+void DataPackWriter::Value(const void* data, size_t size) {
+	if (ended)
+		throw std::logic_error("DataPackWriter has already ended");
+	if (size > UINT32_MAX)
+		throw std::length_error("DataPack value exceeds 4 GB");
+	uint8_t header[5];
+	size_t headerSize;
+	switch (length_width(size)) {
+	case 4:
+		header[0] = (uint8_t)DataPachKey::ValueStart;
+		store_u32_le(header + 1, (uint32_t)size);
+		headerSize = 5;
+		break;
+	case 2:
+		header[0] = (uint8_t)DataPachKey::ValueStart_Small;
+		header[1] = (uint8_t)size;
+		header[2] = (uint8_t)(size >> 8);
+		headerSize = 3;
+		break;
+	default:
+		header[0] = (uint8_t)DataPachKey::ValueStart_Small_X;
+		header[1] = (uint8_t)size;
+		headerSize = 2;
+		break;
+	}
+	const uint8_t valueEnd = (uint8_t)DataPachKey::ValueEnd;
+	Append(header, headerSize);
+	Append(data, size);
+	Append(&valueEnd, 1);
+}
+
+void DataPackWriter::Add(const DataPack& pack) {
+	if (ended)
+		throw std::logic_error("DataPackWriter has already ended");
+	// Encoded straight into the buffer behind a slot and then closed like
+	// any other child, so the buffer only outgrows its size for a pack that
+	// is larger than it.
+	open.push_back(Position());
+	const uint8_t slot[5] = { (uint8_t)DataPachKey::ChildStart };
+	Append(slot, sizeof(slot));
+	pack.WriteTo(buffer);
+	buffer.pop_back();
+	EndChild();
+	if (buffer.size() >= BufferSize)
+		Flush(0);
+}
+
+bool DataPackWriter::End() {
+	if (ended)
+		throw std::logic_error("DataPackWriter has already ended");
+	if (!open.empty())
+		throw std::logic_error("DataPackWriter has open children");
+	const uint8_t fileEnd = (uint8_t)DataPachKey::FileEnd;
+	Append(&fileEnd, 1);
+	const uint64_t total = Position();
+	if (total > UINT32_MAX)
+		throw std::length_error("DataPack exceeds 4 GB");
+	Patch(1, (uint32_t)total);
+	ok = ok && sink->Finish(buffer.data(), buffer.size());
+	flushed += buffer.size();
+	buffer.clear();
+	buffer.shrink_to_fit();
+	ended = true;
+	return ok;
+}
+
+// Where the reader's bytes come from. Read returns 0 at the end of input or
+// on error.
+class DataPackReader::Source {
+public:
+	virtual ~Source() = default;
+	virtual size_t Read(uint8_t* data, size_t size) = 0;
+};
+
+namespace {
+	class FileSource : public DataPackReader::Source {
+	public:
+		explicit FileSource(FileStream& stream) : stream(stream) {}
+		size_t Read(uint8_t* data, size_t size) override {
+			const long long read = stream.Read(data, size);
+			return read > 0 ? (size_t)read : 0;
+		}
+
+	private:
+		FileStream& stream;
+	};
+
+	class SocketSource : public DataPackReader::Source {
+	public:
+		explicit SocketSource(TCPSocket& socket) : socket(socket) {}
+		size_t Read(uint8_t* data, size_t size) override {
+			const int received = socket.Receive((char*)data, (int)std::min<size_t>(size, 1 << 30));
+			return received > 0 ? (size_t)received : 0;
+		}
+
+	private:
+		TCPSocket& socket;
+	};
+
+	// Large enough for the longest Id entry, so an Id is always read whole.
+	constexpr size_t ReadBufferSize = 128 * 1024;
+}
+
+DataPackReader::DataPackReader(FileStream& stream) : source(std::make_unique<FileSource>(stream)), buffer(ReadBufferSize) {}
+
+DataPackReader::DataPackReader(TCPSocket& socket) : source(std::make_unique<SocketSource>(socket)), buffer(ReadBufferSize) {}
+
+DataPackReader::~DataPackReader() = default;
+
+// Makes at least size bytes available from buffer[begin].
+bool DataPackReader::Fill(size_t size) {
+	if (end - begin >= size)
+		return true;
+	if (begin > 0) {
+		std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+		end -= begin;
+		begin = 0;
+	}
+	while (end < size) {
+		const size_t read = source->Read(buffer.data() + end, buffer.size() - end);
+		if (read == 0)
+			return false;
+		end += read;
+	}
+	return true;
+}
+
+bool DataPackReader::Discard(uint64_t size) {
+	while (size > 0) {
+		if (begin == end && !Fill(1))
+			return false;
+		const size_t step = (size_t)std::min<uint64_t>(size, end - begin);
+		begin += step;
+		offset += step;
+		size -= step;
+	}
+	return true;
+}
+
+bool DataPackReader::Expect(uint8_t marker) {
+	if (!Fill(1) || buffer[begin] != marker)
+		return false;
+	begin++;
+	offset++;
+	return true;
+}
+
+bool DataPackReader::FinishValue() {
+	if (!Discard(valueLeft))
+		return false;
+	valueLeft = 0;
+	inValue = false;
+	return Expect((uint8_t)DataPachKey::ValueEnd);
+}
+
+DataPackEvent DataPackReader::Fail() {
+	failed = true;
+	inValue = false;
+	return DataPackEvent::Error;
+}
+
+DataPackEvent DataPackReader::Next() {
+	if (failed)
+		return DataPackEvent::Error;
+	if (inValue && !FinishValue())
+		return Fail();
+	if (frames.empty()) {
+		// Between root packs; running out of input here is a clean end.
+		if (!Fill(1))
+			return DataPackEvent::End;
+		if (!Fill(5) || buffer[begin] != (uint8_t)DataPachKey::FileStart)
+			return Fail();
+		const uint32_t size = load_u32_le(&buffer[begin + 1]);
+		if (size < 6)
+			return Fail();
+		frames.push_back({ offset + size - 1, 0 });
+		begin += 5;
+		offset += 5;
+		return DataPackEvent::BeginPack;
+	}
+	const Frame frame = frames.back();
+	if (offset == frame.packEnd) {
+		if (!Expect((uint8_t)DataPachKey::FileEnd))
+			return Fail();
+		frames.pop_back();
+		if (frame.entryEnd != 0 && (!Discard(frame.entryEnd - offset) || !Expect((uint8_t)DataPachKey::ChildEnd)))
+			return Fail();
+		return DataPackEvent::EndPack;
+	}
+	if (!Fill(1))
+		return Fail();
+	const DataPachKey key = (DataPachKey)buffer[begin];
+	size_t header;
+	switch (key) {
+	case DataPachKey::ValueStart:
+	case DataPachKey::ChildStart:
+		header = 5;
+		break;
+	case DataPachKey::IdStart:
+	case DataPachKey::ValueStart_Small:
+	case DataPachKey::ChildStart_Small:
+		header = 3;
+		break;
+	case DataPachKey::ValueStart_Small_X:
+	case DataPachKey::ChildStart_Small_X:
+		header = 2;
+		break;
+	default:
+		return Fail();
+	}
+	// The entry and its terminator must fit before the pack's FileEnd.
+	const uint64_t available = frame.packEnd - offset;
+	if (available < header || !Fill(header))
+		return Fail();
+	const uint8_t* p = &buffer[begin];
+	const size_t length = header == 5 ? load_u32_le(p + 1) : header == 3 ? load_u16_le(p + 1) : p[1];
+	if (length >= available - header)
+		return Fail();
+	begin += header;
+	offset += header;
+	switch (key) {
+	case DataPachKey::IdStart:
+		if (!Fill(length + 1) || buffer[begin + length] != (uint8_t)DataPachKey::IdEnd)
+			return Fail();
+		id.assign((const char*)&buffer[begin], length);
+		begin += length + 1;
+		offset += length + 1;
+		return DataPackEvent::Id;
+	case DataPachKey::ValueStart:
+	case DataPachKey::ValueStart_Small:
+	case DataPachKey::ValueStart_Small_X:
+		valueSize = valueLeft = length;
+		inValue = true;
+		return DataPackEvent::Value;
+	default: {
+		if (length < 6 || !Fill(5) || buffer[begin] != (uint8_t)DataPachKey::FileStart)
+			return Fail();
+		const uint32_t size = load_u32_le(&buffer[begin + 1]);
+		if (size < 6 || size > length)
+			return Fail();
+		frames.push_back({ offset + size - 1, offset + length });
+		begin += 5;
+		offset += 5;
+		return DataPackEvent::BeginPack;
+	}
+	}
+}
+
+size_t DataPackReader::ReadValue(void* data, size_t size) {
+	if (!inValue || failed)
+		return 0;
+	size = std::min(size, valueLeft);
+	uint8_t* out = (uint8_t*)data;
+	size_t copied = 0;
+	while (copied < size) {
+		if (begin < end) {
+			const size_t step = std::min(size - copied, end - begin);
+			std::memcpy(out + copied, &buffer[begin], step);
+			begin += step;
+			copied += step;
+			continue;
+		}
+		// Reads at least a buffer long go straight into the caller's memory.
+		if (size - copied >= buffer.size()) {
+			const size_t read = source->Read(out + copied, size - copied);
+			if (read == 0)
+				break;
+			copied += read;
+		}
+		else if (!Fill(1)) {
+			break;
+		}
+	}
+	offset += copied;
+	valueLeft -= copied;
+	if (copied < size)
+		Fail();
+	return copied;
+}
+
+ByteSpan DataPackReader::Value() {
+	if (!inValue || failed)
+		return ByteSpan();
+	// The length comes from the input, so the buffer grows with the bytes
+	// that actually arrive, doubling each step: a forged length on a short
+	// input claims no more memory than was sent.
+	value.clear();
+	while (valueLeft > 0) {
+		const size_t size = value.size();
+		const size_t step = std::min(valueLeft, std::max(size, ReadBufferSize));
+		value.resize(size + step);
+		if (ReadValue(value.data() + size, step) < step)
+			return ByteSpan();
+	}
+	return ByteSpan(value.data(), value.size());
+}
+
+bool DataPackReader::ReadPack(DataPack& pack) {
+	std::vector<DataPack*> path{ &pack };
+	while (!path.empty()) {
+		switch (Next()) {
+		case DataPackEvent::BeginPack:
+			path.back()->Child.emplace_back();
+			path.push_back(&path.back()->Child.back());
+			break;
+		case DataPackEvent::Id:
+			path.back()->Id = id;
+			break;
+		case DataPackEvent::Value: {
+			const ByteSpan bytes = Value();
+			if (failed)
+				return false;
+			path.back()->Value.assign(bytes.begin(), bytes.end());
+			break;
+		}
+		case DataPackEvent::EndPack:
+			path.pop_back();
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+bool DataPackReader::Skip() {
+	if (failed || frames.empty())
+		return false;
+	if (inValue && !FinishValue()) {
+		Fail();
+		return false;
+	}
+	if (!Discard(frames.back().packEnd - offset)) {
+		Fail();
+		return false;
+	}
+	return Next() == DataPackEvent::EndPack;
+}
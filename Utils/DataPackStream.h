@@ -0,0 +1,176 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "DataPack.h"
+#include "Span.h"
+class FileStream;
+class TCPSocket;
+
+// Push-style DataPack encoder that writes as it goes, so a pack of any size
+// is produced with memory bounded by the write buffer and the nesting depth.
+// Length fields are back-patched: a child that closes while still in the
+// buffer (any child up to half its size) gets the narrowest length prefix,
+// exactly as DataPack::GetBytes writes it; a larger one keeps a 4-byte
+// prefix, which every reader accepts.
+// A FileStream is patched in place by seeking. A socket cannot seek, so the
+// output is spooled to a temporary file once it outgrows the buffer and is
+// sent when End() is called.
+//
+//     DataPackWriter writer(stream, "root");
+//     writer.BeginChild("items");
+//     for (...) writer.Add("item", value);
+//     writer.EndChild();
+//     writer.End();
+class DataPackWriter {
+public:
+	static constexpr size_t BufferSize = 1 << 20;
+
+	// Starts the root pack at the stream's current position. Sizes are
+	// patched in place, so a stream opened with FileMode::Append throws
+	// std::invalid_argument.
+	explicit DataPackWriter(FileStream& stream, std::string_view rootId = {});
+	explicit DataPackWriter(TCPSocket& socket, std::string_view rootId = {});
+	~DataPackWriter();
+	DataPackWriter(const DataPackWriter&) = delete;
+	DataPackWriter& operator=(const DataPackWriter&) = delete;
+
+	void BeginChild(std::string_view id = {});
+	void EndChild();
+	// Sets the value of the innermost open pack. Large values bypass the
+	// buffer. Writing a value twice leaves two entries; readers keep the last.
+	void Value(const void* data, size_t size);
+	void Value(ByteSpan data) { Value(data.data(), data.size()); }
+	void Value(std::string_view text) { Value(text.data(), text.size()); }
+	template<typename T, typename = std::enable_if_t<std::is_trivially_copyable_v<T> && !std::is_pointer_v<T> && !std::is_array_v<T>>>
+	void Value(const T& value) { Value(&value, sizeof(T)); }
+
+	// A childless child with the given value.
+	template<typename T>
+	void Add(std::string_view id, const T& value) {
+		BeginChild(id);
+		Value(value);
+		EndChild();
+	}
+	// Writes pack and its subtree as a child of the innermost open pack.
+	void Add(const DataPack& pack);
+
+	// Closes the root, patches its size and, for a socket, sends the output.
+	// Every child must have been closed. Returns false if any write failed.
+	bool End();
+
+	// Open packs, the root included; 0 once End() has been called.
+	size_t Depth() const { return ended ? 0 : open.size() + 1; }
+	// Bytes produced so far.
+	uint64_t Position() const { return flushed + buffer.size(); }
+
+	class Sink;
+
+private:
+	std::unique_ptr<Sink> sink;
+	std::vector<uint8_t> buffer;
+	// Bytes handed to the sink; buffer[0] sits at this offset.
+	uint64_t flushed = 0;
+	// Offset of each open child's ChildStart marker.
+	std::vector<uint64_t> open;
+	bool ok = true;
+	bool ended = false;
+
+	void BeginPack(std::string_view id);
+	void Append(const void* data, size_t size);
+	void Flush(size_t room);
+	void Patch(uint64_t offset, uint32_t value);
+};
+
+enum class DataPackEvent {
+	// A pack starts: the root, or a child of the innermost open pack.
+	BeginPack,
+	// Id() holds the Id of the innermost open pack.
+	Id,
+	// A value of ValueSize() bytes follows; read it with ReadValue() or
+	// Value(), or call Next() to skip it.
+	Value,
+	EndPack,
+	// The input ended cleanly between two root packs.
+	End,
+	// The input is malformed or a read failed. Sticky.
+	Error,
+};
+
+// Pull-style DataPack decoder over an incremental byte source. Events come in
+// wire order, one call to Next() at a time; memory is bounded by the read
+// buffer, one Id and the nesting depth, unless the caller asks for a whole
+// value or subtree. Framing is checked as the bytes arrive, so an Error can
+// follow events from the same malformed pack. Several packs written back to
+// back, as on a socket, are read one after another.
+class DataPackReader {
+public:
+	explicit DataPackReader(FileStream& stream);
+	explicit DataPackReader(TCPSocket& socket);
+	~DataPackReader();
+	DataPackReader(const DataPackReader&) = delete;
+	DataPackReader& operator=(const DataPackReader&) = delete;
+
+	DataPackEvent Next();
+
+	// Open packs, the root included.
+	size_t Depth() const { return frames.size(); }
+	std::string_view Id() const { return id; }
+	size_t ValueSize() const { return valueSize; }
+	// Streams the current value; returns the bytes copied, 0 once it is
+	// exhausted or on error.
+	size_t ReadValue(void* data, size_t size);
+	// Reads the rest of the current value into an internal buffer, valid
+	// until the next call. The buffer grows as the bytes arrive rather than
+	// to the declared length up front.
+	ByteSpan Value();
+	template<typename T>
+	T convert() {
+		static_assert(std::is_trivially_copyable_v<T>, "DataPack only supports trivially copyable types");
+		T output{};
+		const ByteSpan value = Value();
+		if (value.size() >= sizeof(T))
+			std::memcpy(&output, value.data(), sizeof(T));
+		return output;
+	}
+
+	// After BeginPack: reads the pack and its subtree into pack, consuming its
+	// EndPack. Memory grows with that subtree only.
+	bool ReadPack(DataPack& pack);
+	// Discards the rest of the innermost open pack, its EndPack included.
+	bool Skip();
+
+	class Source;
+
+private:
+	struct Frame {
+		// Offset of the pack's FileEnd marker.
+		uint64_t packEnd;
+		// For a child, offset of its ChildEnd marker; 0 for a root.
+		uint64_t entryEnd;
+	};
+
+	std::unique_ptr<Source> source;
+	std::vector<uint8_t> buffer;
+	size_t begin = 0;
+	size_t end = 0;
+	// Input offset of buffer[begin].
+	uint64_t offset = 0;
+	std::vector<Frame> frames;
+	std::string id;
+	std::vector<uint8_t> value;
+	size_t valueSize = 0;
+	size_t valueLeft = 0;
+	bool inValue = false;
+	bool failed = false;
+
+	bool Fill(size_t size);
+	bool Discard(uint64_t size);
+	bool Expect(uint8_t marker);
+	bool FinishValue();
+	DataPackEvent Fail();
+};
@@ -0,0 +1,173 @@
+﻿#include "DataPackView.h"
+#include <vector>
+
+namespace {
+	inline uint16_t load_u16_le(const uint8_t* p) {
+		return (uint16_t)(p[0] | (p[1] << 8));
+	}
+	inline uint32_t load_u32_le(const uint8_t* p) {
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	inline bool is_child(DataPachKey key) {
+		return key == DataPachKey::ChildStart || key == DataPachKey::ChildStart_Small || key == DataPachKey::ChildStart_Small_X;
+	}
+
+	// Validates the whole tree. Iterative so that deeply nested input cannot
+	// exhaust the stack.
+	bool validate(const uint8_t* data, size_t size) {
+		struct Frame {
+			const uint8_t* pos;
+			const uint8_t* end;
+		};
+		std::vector<Frame> stack;
+		stack.push_back({ data + 5, data + size - 1 });
+		while (!stack.empty()) {
+			Frame& frame = stack.back();
+			if (frame.pos == frame.end) {
+				stack.pop_back();
+				continue;
+			}
+			DataPackView::Entry e;
+			if (!DataPackView::ReadEntry(frame.pos, frame.end, e))
+				return false;
+			frame.pos = e.next;
+			if (is_child(e.key)) {
+				const size_t childSize = e.length < 6 ? 0 : DataPackView::PackSize(e.payload, e.length);
+				if (childSize == 0)
+					return false;
+				stack.push_back({ e.payload + 5, e.payload + childSize - 1 });
+			}
+		}
+		return true;
+	}
+}
+
+// The entry and its terminator must fit before end, with the same bounds the
+// DataPack parser enforces.
+bool DataPackView::ReadEntry(const uint8_t* p, const uint8_t* end, Entry& e) {
+	const size_t available = (size_t)(end - p);
+	size_t header;
+	uint8_t terminator;
+	e.key = (DataPachKey)p[0];
+	switch (e.key) {
+	case DataPachKey::IdStart:
+		header = 3;
+		terminator = (uint8_t)DataPachKey::IdEnd;
+		break;
+	case DataPachKey::ValueStart:
+	case DataPachKey::ChildStart:
+		header = 5;
+		terminator = (uint8_t)(e.key == DataPachKey::ValueStart ? DataPachKey::ValueEnd : DataPachKey::ChildEnd);
+		break;
+	case DataPachKey::ValueStart_Small:
+	case DataPachKey::ChildStart_Small:
+		header = 3;
+		terminator = (uint8_t)(e.key == DataPachKey::ValueStart_Small ? DataPachKey::ValueEnd : DataPachKey::ChildEnd);
+		break;
+	case DataPachKey::ValueStart_Small_X:
+	case DataPachKey::ChildStart_Small_X:
+		header = 2;
+		terminator = (uint8_t)(e.key == DataPachKey::ValueStart_Small_X ? DataPachKey::ValueEnd : DataPachKey::ChildEnd);
+		break;
+	default:
+		return false;
+	}
+	if (available < header)
+		return false;
+	e.length = header == 5 ? load_u32_le(p + 1) : header == 3 ? load_u16_le(p + 1) : p[1];
+	if (e.length >= available - header)
+		return false;
+	e.payload = p + header;
+	if (e.payload[e.length] != terminator)
+		return false;
+	e.next = e.payload + e.length + 1;
+	return true;
+}
+
+size_t DataPackView::PackSize(const uint8_t* data, size_t available) {
+	if (available < 6 || data[0] != (uint8_t)DataPachKey::FileStart)
+		return 0;
+	const size_t size = load_u32_le(data + 1);
+	if (size < 6 || size > available || data[size - 1] != (uint8_t)DataPachKey::FileEnd)
+		return 0;
+	return size;
+}
+
+DataPackView::DataPackView(const uint8_t* data, size_t size) {
+	if (data == nullptr)
+		return;
+	const size_t packSize = PackSize(data, size);
+	if (packSize == 0 || !validate(data, packSize))
+		return;
+	this->data = data;
+	length = packSize;
+	Index();
+}
+
+DataPackView::DataPackView(const uint8_t* data, Trusted) : data(data), length(load_u32_le(data + 1)) {
+	Index();
+}
+
+// One pass over the top-level entries. Later Id/Value entries override
+// earlier ones, as in the DataPack parser.
+void DataPackView::Index() {
+	const uint8_t* end = data + length - 1;
+	Entry e;
+	for (const uint8_t* p = data + 5; p < end && ReadEntry(p, end, e); p = e.next) {
+		switch (e.key) {
+		case DataPachKey::IdStart:
+			idData = e.payload;
+			idSize = e.length;
+			break;
+		case DataPachKey::ValueStart:
+		case DataPachKey::ValueStart_Small:
+		case DataPachKey::ValueStart_Small_X:
+			valueData = e.payload;
+			valueSize = e.length;
+			break;
+		default:
+			if (!firstChild)
+				firstChild = p;
+			childrenEnd = e.next;
+			count++;
+			break;
+		}
+	}
+}
+
+DataPackView DataPackView::iterator::operator*() const {
+	Entry e;
+	ReadEntry(pos, end, e);
+	return DataPackView(e.payload, Trusted{});
+}
+
+DataPackView::iterator& DataPackView::iterator::operator++() {
+	Entry e;
+	ReadEntry(pos, end, e);
+	pos = e.next;
+	while (pos < end && ReadEntry(pos, end, e) && !is_child(e.key))
+		pos = e.next;
+	return *this;
+}
+
+DataPackView DataPackView::operator[](size_t index) const {
+	if (index >= count)
+		return DataPackView();
+	iterator it = begin();
+	while (index--)
+		++it;
+	return *it;
+}
+
+DataPackView DataPackView::operator[](std::string_view id) const {
+	for (DataPackView child : *this) {
+		if (child.Id() == id)
+			return child;
+	}
+	return DataPackView();
+}
+
+DataPack DataPackView::ToDataPack() const {
+	return Valid() ? DataPack(data, (int)length) : DataPack();
+}
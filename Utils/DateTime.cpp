@@ -1,21 +1,104 @@
 ﻿#include "DateTime.h"
-#include <sstream>
-#include <iomanip>
+#include <algorithm>
+#include <cstring>
 #include <ctime>
-void DateTime::GetSystemTime(SYSTEMTIME& sysTime) const {
-    FILETIME fileTime;
-    fileTime.dwLowDateTime = (DWORD)(dateData & 0xFFFFFFFF);
-    fileTime.dwHighDateTime = (DWORD)(dateData >> 32);
-    FileTimeToSystemTime(&fileTime, &sysTime);
-}
 
-void DateTime::SetSystemTime(const SYSTEMTIME& sysTime) {
-    FILETIME fileTime;
-    if (SystemTimeToFileTime(&sysTime, &fileTime))
-        dateData = (((ULONGLONG)fileTime.dwHighDateTime) << 32) | fileTime.dwLowDateTime;
-    else
-        dateData = 0;
+namespace {
+    const ULONGLONG TicksPerMillisecond = 10000;
+    const ULONGLONG TicksPerSecond = TicksPerMillisecond * 1000;
+    const ULONGLONG TicksPerMinute = TicksPerSecond * 60;
+    const ULONGLONG TicksPerHour = TicksPerMinute * 60;
+    const ULONGLONG TicksPerDay = TicksPerHour * 24;
+    // Days from 0000-03-01, where the civil algorithms count from, to
+    // 1601-01-01.
+    const ULONGLONG EpochDays = 584694;
+    // Last year SystemTimeToFileTime accepted.
+    const int MaxYear = 30827;
+
+    // Howard Hinnant's days_from_civil: March-based years put the leap day
+    // last, so the day of the year is a linear function of the month.
+    ULONGLONG days_from_civil(int year, int month, int day) {
+        year -= month <= 2;
+        const unsigned era = (unsigned)year / 400;
+        const unsigned yearOfEra = (unsigned)year - era * 400;
+        const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return (ULONGLONG)era * 146097 + dayOfEra - EpochDays;
+    }
+
+    void civil_from_days(ULONGLONG days, DateTimeParts& parts) {
+        const ULONGLONG z = days + EpochDays;
+        const ULONGLONG era = z / 146097;
+        const unsigned dayOfEra = (unsigned)(z - era * 146097);
+        const unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        const unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        const unsigned shiftedMonth = (5 * dayOfYear + 2) / 153;
+        parts.Day = (int)(dayOfYear - (153 * shiftedMonth + 2) / 5 + 1);
+        parts.Month = (int)(shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9);
+        parts.Year = (int)(yearOfEra + era * 400) + (parts.Month <= 2);
+    }
+
+    bool make_ticks(int year, int month, int day, int hour, int minute, int second, int millisecond, ULONGLONG& ticks) {
+        if (year < 1601 || year > MaxYear || month < 1 || month > 12 || day < 1 || day > DateTime::DaysInMonth(year, month) ||
+            hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 59 || millisecond < 0 || millisecond > 999)
+            return false;
+        ticks = days_from_civil(year, month, day) * TicksPerDay + hour * TicksPerHour + minute * TicksPerMinute +
+            second * TicksPerSecond + millisecond * TicksPerMillisecond;
+        return true;
+    }
+
+    inline char* write_digits(char* out, unsigned value, int count) {
+        for (int i = count - 1; i >= 0; i--) {
+            out[i] = (char)('0' + value % 10);
+            value /= 10;
+        }
+        return out + count;
+    }
+
+    // "yyyy-MM-dd?HH:mm:ss" with the given separator; returns the end.
+    char* write_date_time(char* out, const DateTimeParts& parts, char separator) {
+        out = write_digits(out, parts.Year, parts.Year > 9999 ? 5 : 4);
+        *out++ = '-';
+        out = write_digits(out, parts.Month, 2);
+        *out++ = '-';
+        out = write_digits(out, parts.Day, 2);
+        *out++ = separator;
+        out = write_digits(out, parts.Hour, 2);
+        *out++ = ':';
+        out = write_digits(out, parts.Minute, 2);
+        *out++ = ':';
+        return write_digits(out, parts.Second, 2);
+    }
+
+    // Reads 1 to maxDigits digits.
+    bool read_number(std::string_view input, size_t& pos, int maxDigits, int& value) {
+        value = 0;
+        const size_t start = pos;
+        while (pos < input.size() && pos - start < (size_t)maxDigits && input[pos] >= '0' && input[pos] <= '9')
+            value = value * 10 + (input[pos++] - '0');
+        return pos > start;
+    }
+
+    bool read_char(std::string_view input, size_t& pos, char c) {
+        if (pos < input.size() && input[pos] == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    typedef VOID(WINAPI* fnGetSystemTimePreciseAsFileTime)(LPFILETIME fileTime);
+
+    // Windows 8 and later; older systems fall back to the coarse clock.
+    fnGetSystemTimePreciseAsFileTime precise_clock() {
+        static const fnGetSystemTimePreciseAsFileTime clock = [] {
+            HMODULE kernel32 = GetModuleHandleA("kernel32.dll");
+            return kernel32 ? (fnGetSystemTimePreciseAsFileTime)GetProcAddress(kernel32, "GetSystemTimePreciseAsFileTime") : nullptr;
+        }();
+        return clock;
+    }
 }
+
 DateTime::DateTime() {
     dateData = 0;
 }
@@ -29,71 +112,35 @@ DateTime::DateTime(FILETIME fileTime) {
 }
 
 DateTime::DateTime(SYSTEMTIME sysTime) {
-    SetSystemTime(sysTime);
+    if (!make_ticks(sysTime.wYear, sysTime.wMonth, sysTime.wDay, sysTime.wHour, sysTime.wMinute, sysTime.wSecond, sysTime.wMilliseconds, dateData))
+        dateData = 0;
 }
 
 DateTime::DateTime(int years, int months, int days, int hours, int minutes, int seconds, int milliseconds) {
-    SYSTEMTIME sysTime = { 0 };
-    sysTime.wYear = years;
-    sysTime.wMonth = months;
-    sysTime.wDay = days;
-    sysTime.wHour = hours;
-    sysTime.wMinute = minutes;
-    sysTime.wSecond = seconds;
-    sysTime.wMilliseconds = milliseconds;
-    SetSystemTime(sysTime);
+    if (!make_ticks(years, months, days, hours, minutes, seconds, milliseconds, dateData))
+        dateData = 0;
 }
 
 DateTime::DateTime(tm time_) {
-    SYSTEMTIME sysTime = { 0 };
-    sysTime.wYear = time_.tm_year + 1900;
-    sysTime.wMonth = time_.tm_mon + 1;
-    sysTime.wDay = time_.tm_mday;
-    sysTime.wHour = time_.tm_hour;
-    sysTime.wMinute = time_.tm_min;
-    sysTime.wSecond = time_.tm_sec;
-    sysTime.wMilliseconds = 0;
-    SetSystemTime(sysTime);
+    if (!make_ticks(time_.tm_year + 1900, time_.tm_mon + 1, time_.tm_mday, time_.tm_hour, time_.tm_min, time_.tm_sec, 0, dateData))
+        dateData = 0;
 }
 
 DateTime DateTime::AddYears(int years) const {
-    SYSTEMTIME sysTime;
-    GetSystemTime(sysTime);
-    sysTime.wYear += years;
-    DateTime newDateTime;
-    newDateTime.SetSystemTime(sysTime);
-    return newDateTime;
+    return AddMonths(years * 12);
 }
 
 DateTime DateTime::AddMonths(int months) const {
-    SYSTEMTIME sysTime;
-    GetSystemTime(sysTime);
-
-    int y = sysTime.wYear;
-    int m = sysTime.wMonth;
-
-    int totalMonths = y * 12 + m - 1 + months;
-
-    y = totalMonths / 12;
-    m = totalMonths % 12;
-
-    if (m < 0) {
-        m += 12;
-        y -= 1;
-    }
-    sysTime.wYear = y;
-    sysTime.wMonth = m + 1;
-    static const int daysInMonth[] = { 31,28,31,30,31,30,31,31,30,31,30,31 };
-    int maxDay = daysInMonth[sysTime.wMonth - 1];
-
-    if (sysTime.wMonth == 2 && IsLeapYear(sysTime.wYear))
-        maxDay = 29;
-    if (sysTime.wDay > maxDay)
-        sysTime.wDay = maxDay;
-
-    DateTime newDateTime;
-    newDateTime.SetSystemTime(sysTime);
-    return newDateTime;
+    const DateTimeParts parts = Decompose();
+    int totalMonths = parts.Year * 12 + parts.Month - 1 + months;
+    const int y = totalMonths / 12;
+    const int m = totalMonths % 12 + 1;
+    // The 31st becomes the last day of a shorter month.
+    const int day = std::min(parts.Day, DaysInMonth(y, m));
+    ULONGLONG ticks;
+    if (!make_ticks(y, m, day, parts.Hour, parts.Minute, parts.Second, parts.Millisecond, ticks))
+        return DateTime();
+    return DateTime(ticks + parts.Ticks);
 }
 
 DateTime DateTime::AddDays(int days) const {
@@ -128,14 +175,53 @@ DateTime DateTime::Add(int years, int months, int days, int hours, int minutes,
     return tempDateTime;
 }
 
+DateTimeParts DateTime::Decompose() const {
+    DateTimeParts parts;
+    const ULONGLONG days = dateData / TicksPerDay;
+    const ULONGLONG time = dateData - days * TicksPerDay;
+    civil_from_days(days, parts);
+    const unsigned seconds = (unsigned)(time / TicksPerSecond);
+    const unsigned fraction = (unsigned)(time - seconds * TicksPerSecond);
+    parts.Hour = (int)(seconds / 3600);
+    parts.Minute = (int)(seconds / 60 % 60);
+    parts.Second = (int)(seconds % 60);
+    parts.Millisecond = (int)(fraction / TicksPerMillisecond);
+    parts.Ticks = (int)(fraction % TicksPerMillisecond);
+    // 1601-01-01 was a Monday.
+    parts.DayOfWeek = (int)((days + 1) % 7);
+    return parts;
+}
+
 std::string DateTime::ToString() const {
-    SYSTEMTIME sysTime;
-    GetSystemTime(sysTime);
-    char buffer[100];
-    sprintf_s(buffer, "%04d-%02d-%02d %02d:%02d:%02d.%03d",
-        sysTime.wYear, sysTime.wMonth, sysTime.wDay,
-        sysTime.wHour, sysTime.wMinute, sysTime.wSecond, sysTime.wMilliseconds);
-    return std::string(buffer);
+    const DateTimeParts parts = Decompose();
+    char buffer[FormatBufferSize];
+    char* out = write_date_time(buffer, parts, ' ');
+    *out++ = '.';
+    out = write_digits(out, parts.Millisecond, 3);
+    return std::string(buffer, out);
+}
+
+size_t DateTime::Format(char* out, int fractionDigits) const {
+    // Log lines stamped within the same second share everything up to the
+    // fraction.
+    thread_local ULONGLONG cachedSecond = ~0ULL;
+    thread_local char cached[FormatBufferSize];
+    thread_local size_t cachedLength = 0;
+    const ULONGLONG second = dateData / TicksPerSecond;
+    if (second != cachedSecond) {
+        cachedLength = write_date_time(cached, Decompose(), 'T') - cached;
+        cachedSecond = second;
+    }
+    std::memcpy(out, cached, cachedLength);
+    char* end = out + cachedLength;
+    fractionDigits = std::max(0, std::min(fractionDigits, 7));
+    if (fractionDigits > 0) {
+        static const unsigned divisors[] = { 1000000, 100000, 10000, 1000, 100, 10, 1 };
+        *end++ = '.';
+        end = write_digits(end, (unsigned)(dateData - second * TicksPerSecond) / divisors[fractionDigits - 1], fractionDigits);
+    }
+    *end++ = 'Z';
+    return end - out;
 }
 
 bool DateTime::operator==(const DateTime& other) const {
@@ -163,59 +249,47 @@ bool DateTime::operator<=(const DateTime& other) const {
 }
 
 GET_CPP(DateTime, UINT, Year) {
-    SYSTEMTIME sysTime;
-    GetSystemTime(sysTime);
-    return sysTime.wYear;
+    return Decompose().Year;
 }
 
 GET_CPP(DateTime, UINT, Month) {
-    SYSTEMTIME sysTime;
-    GetSystemTime(sysTime);
-    return sysTime.wMonth;
+    return Decompose().Month;
 }
 
 GET_CPP(DateTime, UINT, DayOfWeek) {
-    SYSTEMTIME sysTime;
-    GetSystemTime(sysTime);
-    return sysTime.wDayOfWeek;
+    return (UINT)((dateData / TicksPerDay + 1) % 7);
 }
 
 GET_CPP(DateTime, UINT, Day) {
-    SYSTEMTIME sysTime;
-    GetSystemTime(sysTime);
-    return sysTime.wDay;
+    return Decompose().Day;
 }
 
 GET_CPP(DateTime, UINT, Hour) {
-    SYSTEMTIME sysTime;
-    GetSystemTime(sysTime);
-    return sysTime.wHour;
+    return (UINT)(dateData % TicksPerDay / TicksPerHour);
 }
 
 GET_CPP(DateTime, UINT, Minute) {
-    SYSTEMTIME sysTime;
-    GetSystemTime(sysTime);
-    return sysTime.wMinute;
+    return (UINT)(dateData % TicksPerHour / TicksPerMinute);
 }
 
 GET_CPP(DateTime, UINT, Second) {
-    SYSTEMTIME sysTime;
-    GetSystemTime(sysTime);
-    return sysTime.wSecond;
+    return (UINT)(dateData % TicksPerMinute / TicksPerSecond);
 }
 
 GET_CPP(DateTime, UINT, Milliseconds) {
-    SYSTEMTIME sysTime;
-    GetSystemTime(sysTime);
-    return sysTime.wMilliseconds;
+    return (UINT)(dateData % TicksPerSecond / TicksPerMillisecond);
 }
 
 GET_CPP(DateTime, ULONGLONG, Data) {
     return this->dateData;
 }
-DateTime DateTime::Now() {
+DateTime DateTime::Now(ClockPrecision precision) {
     FILETIME fileTime;
-    GetSystemTimeAsFileTime(&fileTime);
+    fnGetSystemTimePreciseAsFileTime precise = precision == ClockPrecision::Fine ? precise_clock() : nullptr;
+    if (precise)
+        precise(&fileTime);
+    else
+        GetSystemTimeAsFileTime(&fileTime);
     return DateTime(fileTime);
 }
 
@@ -230,14 +304,78 @@ bool DateTime::IsLeapYear(int year) {
         return true;
 }
 
+int DateTime::DaysInMonth(int year, int month) {
+    static const int daysInMonth[] = { 31,28,31,30,31,30,31,31,30,31,30,31 };
+    if (month < 1 || month > 12)
+        return 0;
+    return month == 2 && IsLeapYear(year) ? 29 : daysInMonth[month - 1];
+}
+
 DateTime DateTime::Parse(const std::string& str) {
-    int year, month, day, hour, minute, second, millisecond = 0;
-    int count = sscanf_s(str.c_str(), "%d-%d-%d %d:%d:%d.%d",
-        &year, &month, &day, &hour, &minute, &second, &millisecond);
-    if (count >= 6) {
-        return DateTime(year, month, day, hour, minute, second, millisecond);
+    DateTime result;
+    return TryParse(str, result) ? result : DateTime();
+}
+
+bool DateTime::TryParse(std::string_view input, DateTime& value) {
+    size_t pos = 0;
+    int year, month, day, hour = 0, minute = 0, second = 0;
+    if (!read_number(input, pos, 5, year) || !read_char(input, pos, '-') || !read_number(input, pos, 2, month) ||
+        !read_char(input, pos, '-') || !read_number(input, pos, 2, day))
+        return false;
+    ULONGLONG fraction = 0;
+    if (pos < input.size() && (input[pos] == 'T' || input[pos] == 't' || input[pos] == ' ')) {
+        pos++;
+        if (!read_number(input, pos, 2, hour) || !read_char(input, pos, ':') || !read_number(input, pos, 2, minute))
+            return false;
+        if (read_char(input, pos, ':')) {
+            if (!read_number(input, pos, 2, second))
+                return false;
+            if (read_char(input, pos, '.') || read_char(input, pos, ',')) {
+                // Digits beyond the 100 ns tick are dropped.
+                ULONGLONG scale = TicksPerSecond;
+                const size_t start = pos;
+                for (; pos < input.size() && input[pos] >= '0' && input[pos] <= '9'; pos++) {
+                    scale /= 10;
+                    fraction += (input[pos] - '0') * scale;
+                }
+                if (pos == start)
+                    return false;
+            }
+        }
     }
-    else {
-        return DateTime();
+    ULONGLONG ticks;
+    if (!make_ticks(year, month, day, hour, minute, second, 0, ticks))
+        return false;
+    ticks += fraction;
+    if (pos < input.size() && (input[pos] == 'Z' || input[pos] == 'z')) {
+        pos++;
     }
-}
\ No newline at end of file
+    else if (pos < input.size() && (input[pos] == '+' || input[pos] == '-')) {
+        const bool east = input[pos++] == '+';
+        int offsetHours, offsetMinutes = 0;
+        const size_t start = pos;
+        if (!read_number(input, pos, 2, offsetHours) || pos - start != 2)
+            return false;
+        if (read_char(input, pos, ':') || pos < input.size()) {
+            const size_t minuteStart = pos;
+            if (!read_number(input, pos, 2, offsetMinutes) || pos - minuteStart != 2)
+                return false;
+        }
+        if (offsetHours > 23 || offsetMinutes > 59)
+            return false;
+        // Local time = UTC + offset.
+        const ULONGLONG offset = offsetHours * TicksPerHour + offsetMinutes * TicksPerMinute;
+        if (east) {
+            if (ticks < offset)
+                return false;
+            ticks -= offset;
+        }
+        else {
+            ticks += offset;
+        }
+    }
+    if (pos != input.size())
+        return false;
+    value = DateTime(ticks);
+    return true;
+}
@@ -0,0 +1,233 @@
+﻿#include "DirectoryWalker.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+	struct PendingDirectory {
+		std::string path;
+		int depth;
+	};
+
+	inline char fold_case(char c) {
+		return c >= 'A' && c <= 'Z' ? (char)(c + ('a' - 'A')) : c;
+	}
+
+	inline bool is_separator(char c) {
+		return c == '\\' || c == '/';
+	}
+
+	inline uint64_t make_uint64(DWORD high, DWORD low) {
+		return ((uint64_t)high << 32) | low;
+	}
+
+	// Closes a find handle even when visit throws.
+	struct FindHandle {
+		HANDLE handle;
+		~FindHandle() {
+			if (handle != INVALID_HANDLE_VALUE)
+				FindClose(handle);
+		}
+	};
+
+	class WalkState {
+	public:
+		WalkState(const std::function<bool(const DirectoryEntry&)>& visit, const WalkOptions& options) : visit(visit), options(options) {}
+
+		// Reports the entries of one directory and collects the
+		// subdirectories to enter. Returns false if it cannot be listed.
+		bool ListDirectory(const PendingDirectory& dir, DirectoryEntry& entry, std::vector<PendingDirectory>& found) {
+			const bool trailing = !dir.path.empty() && is_separator(dir.path.back());
+			entry.Path.assign(dir.path);
+			if (!trailing)
+				entry.Path += '\\';
+			const size_t base = entry.Path.size();
+			entry.Path += '*';
+			WIN32_FIND_DATAA data;
+			// Basic info skips the 8.3 name; large fetch asks for the listing
+			// in bigger batches.
+			FindHandle find{ FindFirstFileExA(entry.Path.c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH) };
+			if (find.handle == INVALID_HANDLE_VALUE)
+				return false;
+			const bool descend = options.Recursive && (options.MaxDepth < 0 || dir.depth < options.MaxDepth);
+			do {
+				if (stop)
+					break;
+				const char* name = data.cFileName;
+				if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+					continue;
+				const bool directory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+				if (options.SkipHidden && (data.dwFileAttributes & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM)))
+					continue;
+				if (!directory && (!options.Files || !Matches(name)))
+					continue;
+				entry.Path.resize(base);
+				entry.Path += name;
+				entry.Length = directory ? 0 : make_uint64(data.nFileSizeHigh, data.nFileSizeLow);
+				entry.Attributes = data.dwFileAttributes;
+				entry.CreationTime = data.ftCreationTime;
+				entry.LastAccessTime = data.ftLastAccessTime;
+				entry.LastWriteTime = data.ftLastWriteTime;
+				entry.Depth = dir.depth;
+				if (directory) {
+					if (options.DirectoryFilter && !options.DirectoryFilter(entry))
+						continue;
+					if (options.Directories && !Visit(entry))
+						break;
+					if (descend && (options.FollowLinks || !(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)))
+						found.push_back({ entry.Path, dir.depth + 1 });
+				}
+				else if (!Visit(entry)) {
+					break;
+				}
+			} while (FindNextFileA(find.handle, &data));
+			return true;
+		}
+
+		void Push(std::vector<PendingDirectory>& found) {
+			// Reversed, so the stack hands them out in listing order.
+			for (auto it = found.rbegin(); it != found.rend(); ++it)
+				pending.push_back(std::move(*it));
+			found.clear();
+		}
+
+		void Worker() {
+			DirectoryEntry entry{};
+			std::vector<PendingDirectory> found;
+			std::unique_lock<std::mutex> guard(lock);
+			for (;;) {
+				wake.wait(guard, [this] { return !pending.empty() || busy == 0 || stop; });
+				if (stop || pending.empty())
+					break;
+				PendingDirectory dir = std::move(pending.back());
+				pending.pop_back();
+				busy++;
+				guard.unlock();
+				try {
+					ListDirectory(dir, entry, found);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> errorGuard(errorLock);
+					if (!error) error = std::current_exception();
+					stop = true;
+				}
+				guard.lock();
+				busy--;
+				const bool more = !found.empty();
+				Push(found);
+				if (more || busy == 0 || stop)
+					wake.notify_all();
+			}
+		}
+
+		uint64_t Visited() const { return visited; }
+		std::exception_ptr Error() const { return error; }
+
+	private:
+		const std::function<bool(const DirectoryEntry&)>& visit;
+		const WalkOptions& options;
+		std::mutex lock;
+		std::condition_variable wake;
+		std::vector<PendingDirectory> pending;
+		// Workers listing a directory; once none is and nothing is pending,
+		// the walk is done.
+		size_t busy = 0;
+		std::atomic<bool> stop{ false };
+		std::atomic<uint64_t> visited{ 0 };
+		std::mutex errorLock;
+		std::exception_ptr error;
+
+		bool Matches(const char* name) const {
+			if (options.Patterns.empty())
+				return true;
+			for (const std::string& pattern : options.Patterns) {
+				if (DirectoryWalker::MatchPattern(name, pattern))
+					return true;
+			}
+			return false;
+		}
+
+		bool Visit(const DirectoryEntry& entry) {
+			visited++;
+			if (!visit(entry)) {
+				stop = true;
+				return false;
+			}
+			return true;
+		}
+	};
+}
+
+std::string_view DirectoryEntry::Name() const {
+	const size_t separator = Path.find_last_of("\\/");
+	return separator == std::string::npos ? std::string_view(Path) : std::string_view(Path).substr(separator + 1);
+}
+
+std::string_view DirectoryEntry::Extension() const {
+	const std::string_view name = Name();
+	const size_t dot = name.rfind('.');
+	return dot == std::string_view::npos || dot == 0 ? std::string_view() : name.substr(dot);
+}
+
+uint64_t DirectoryWalker::Walk(const std::string& root, const std::function<bool(const DirectoryEntry&)>& visit, const WalkOptions& options) {
+	WalkState state(visit, options);
+	// The root is listed on the calling thread, so that a missing root
+	// throws before any worker starts.
+	DirectoryEntry entry{};
+	std::vector<PendingDirectory> found;
+	if (!state.ListDirectory({ root, 0 }, entry, found))
+		throw std::runtime_error("Failed to list directory");
+	state.Push(found);
+	unsigned threads = options.Threads ? options.Threads : std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> pool;
+	for (unsigned t = 1; t < threads; t++)
+		pool.emplace_back([&state] { state.Worker(); });
+	state.Worker();
+	for (auto& t : pool)
+		t.join();
+	if (state.Error()) std::rethrow_exception(state.Error());
+	return state.Visited();
+}
+
+std::vector<DirectoryEntry> DirectoryWalker::List(const std::string& root, const WalkOptions& options) {
+	std::vector<DirectoryEntry> entries;
+	std::mutex lock;
+	Walk(root, [&](const DirectoryEntry& entry) {
+		std::lock_guard<std::mutex> guard(lock);
+		entries.push_back(entry);
+		return true;
+	}, options);
+	return entries;
+}
+
+bool DirectoryWalker::MatchPattern(std::string_view name, std::string_view pattern) {
+	// Greedy match that backtracks to the last '*'.
+	size_t n = 0;
+	size_t p = 0;
+	size_t star = std::string_view::npos;
+	size_t resume = 0;
+	while (n < name.size()) {
+		if (p < pattern.size() && pattern[p] == '*') {
+			star = p++;
+			resume = n;
+		}
+		else if (p < pattern.size() && (pattern[p] == '?' || fold_case(pattern[p]) == fold_case(name[n]))) {
+			n++;
+			p++;
+		}
+		else if (star != std::string_view::npos) {
+			p = star + 1;
+			n = ++resume;
+		}
+		else {
+			return false;
+		}
+	}
+	while (p < pattern.size() && pattern[p] == '*')
+		p++;
+	return p == pattern.size();
+}
@@ -1,10 +1,39 @@
 ﻿#include "File.h"
 #include <fstream>
 #include <filesystem>
+#include <stdexcept>
 #include "StringHelper.h"
+#include "LineReader.h"
+#include "FileCopy.h"
+#include <algorithm>
+#include <atomic>
 #pragma warning(disable: 4267)
 #pragma warning(disable: 4244)
 #pragma warning(disable: 4018)
+namespace {
+	bool write_all(HANDLE file, const void* data, size_t size) {
+		const uint8_t* p = static_cast<const uint8_t*>(data);
+		while (size > 0) {
+			DWORD written;
+			if (!WriteFile(file, p, (DWORD)std::min<size_t>(size, 1u << 30), &written, NULL) || written == 0)
+				return false;
+			p += written;
+			size -= written;
+		}
+		return true;
+	}
+	// One open and one write. Appends use FILE_APPEND_DATA, so each lands
+	// whole at the end even with other writers sharing the file.
+	bool write_file(const std::string& path, const void* data, size_t size, bool append) {
+		HANDLE file = CreateFileA(path.c_str(), append ? FILE_APPEND_DATA : GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+			append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		const bool ok = write_all(file, data, size);
+		CloseHandle(file);
+		return ok;
+	}
+}
 bool File::Exists(const std::string path) {
 	return std::filesystem::exists(path);
 }
@@ -12,7 +41,19 @@ void File::Delete(const std::string path) {
 	std::filesystem::remove(path);
 }
 void File::Copy(const std::string src, const std::string dest) {
-	std::filesystem::copy(src, dest);
+	if (std::filesystem::is_directory(src)) {
+		std::filesystem::copy(src, dest);
+		return;
+	}
+	// As with std::filesystem::copy, a directory receives the file under its
+	// own name.
+	std::filesystem::path target(dest);
+	if (std::filesystem::is_directory(target))
+		target /= std::filesystem::path(src).filename();
+	CopyOptions options;
+	options.Overwrite = false;
+	if (!FileCopy::Copy(src, target.string(), options))
+		throw std::runtime_error("Failed to copy file");
 }
 void File::Move(const std::string src, const std::string dest) {
 	std::filesystem::rename(src, dest);
@@ -39,54 +80,88 @@ std::vector<uint8_t> File::ReadAllBytes(const std::string path) {
 	}
 	return {};
 }
-std::vector<std::string> File::ReadAllLines(const std::string path) {
-	std::string str = File::ReadAllText(path);
-	return StringHelper::Split(str, { '\r','\n' });
-}
-void File::WriteAllText(const std::string path, const std::string content) {
-	std::ofstream ofs(path, std::ios::binary);
-	if (ofs) {
-		ofs.write((char*)content.data(), content.size());
-		ofs.close();
+MemoryMappedFile File::MapAllBytes(const std::string path) {
+	try {
+		return MemoryMappedFile(path, MapAccess::Read, 0, MemoryMappedFile::WholeFile, MapAdvice::Sequential);
+	}
+	catch (const std::runtime_error&) {
+		return {};
 	}
 }
-void File::WriteAllBytes(const std::string path, const std::vector<uint8_t> content) {
-	std::ofstream ofs(path, std::ios::binary);
-	if (ofs) {
-		ofs.write((char*)content.data(), content.size());
-		ofs.close();
+std::vector<std::string> File::ReadAllLines(const std::string path) {
+	std::vector<std::string> lines;
+	try {
+		LineReader reader(path);
+		for (std::string_view line : reader) {
+			// As before, blank lines are skipped and a lone '\r' also ends a line.
+			for (size_t start = 0; start < line.size();) {
+				size_t end = line.find('\r', start);
+				if (end == std::string_view::npos)
+					end = line.size();
+				if (end > start)
+					lines.emplace_back(line.substr(start, end - start));
+				start = end + 1;
+			}
+		}
 	}
+	catch (const std::runtime_error&) {
+		return {};
+	}
+	return lines;
+}
+void File::WriteAllText(const std::string path, std::string_view content) {
+	write_file(path, content.data(), content.size(), false);
+}
+void File::WriteAllBytes(const std::string path, ByteSpan content) {
+	write_file(path, content.data(), content.size(), false);
 }
 
 void File::WriteAllBytes(const std::string path, const uint8_t* content, size_t size) {
-	std::ofstream ofs(path, std::ios::binary);
-	if (ofs) {
-		ofs.write((char*)content, size);
-		ofs.close();
-	}
+	write_file(path, content, size, false);
 }
 void File::WriteAllLines(const std::string path, const std::vector<std::string> content) {
 	auto str = StringHelper::Join(content, "\n");
 	File::WriteAllText(path, str);
 }
-void File::AppendAllText(const std::string path, const std::string content) {
-	std::ofstream fout(path, std::ios::app);
-	if (fout) {
-		fout.write((char*)content.data(), content.size());
-		fout.close();
-	}
+void File::AppendAllText(const std::string path, std::string_view content) {
+	write_file(path, content.data(), content.size(), true);
 }
-void File::AppendAllBytes(const std::string path, const std::vector<uint8_t> content) {
-	std::ofstream fout(path, std::ios::app);
-	if (fout) {
-		fout.write((char*)content.data(), content.size());
-		fout.close();
-	}
+void File::AppendAllBytes(const std::string path, ByteSpan content) {
+	write_file(path, content.data(), content.size(), true);
 }
 void File::AppendAllLines(const std::string path, const std::vector<std::string> content) {
 	auto str = StringHelper::Join(content, "\n");
 	File::AppendAllText(path, str);
 }
+bool File::WriteAllBytesAtomic(const std::string path, ByteSpan content) {
+	// The temporary file sits in the same directory, so the rename never
+	// crosses volumes; the counter keeps concurrent writers apart.
+	static std::atomic<uint32_t> counter{ 0 };
+	const std::string temp = path + "." + std::to_string(GetCurrentProcessId()) + "." + std::to_string(counter++) + ".tmp";
+	HANDLE file = CreateFileA(temp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	const bool written = write_all(file, content.data(), content.size()) && FlushFileBuffers(file);
+	CloseHandle(file);
+	// ReplaceFile keeps the target's ACL, attributes and alternate streams,
+	// which a rename would swap for the temporary file's. A target that does
+	// not exist, or vanished in between, is created by the rename.
+	bool replaced = false;
+	if (written) {
+		if (GetFileAttributesA(path.c_str()) != INVALID_FILE_ATTRIBUTES)
+			replaced = ReplaceFileA(path.c_str(), temp.c_str(), NULL, REPLACEFILE_IGNORE_MERGE_ERRORS, NULL, NULL) != FALSE;
+		if (!replaced && GetFileAttributesA(path.c_str()) == INVALID_FILE_ATTRIBUTES)
+			replaced = MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+	}
+	if (!replaced) {
+		DeleteFileA(temp.c_str());
+		return false;
+	}
+	return true;
+}
+bool File::WriteAllTextAtomic(const std::string path, std::string_view content) {
+	return WriteAllBytesAtomic(path, AsBytes(content.data(), content.size()));
+}
 void File::SetAttributes(const std::string path, FileAttributes attributes) {
 	SetFileAttributesA(path.c_str(), (DWORD)attributes);
 }
@@ -170,7 +245,7 @@ void Directory::Delete(std::string dirPath, bool recursive) {
 std::vector<FileInfo> Directory::GetFiles(std::string path) {
 	std::vector<FileInfo> files;
 	for (auto& p : std::filesystem::directory_iterator(path)) {
-		if (std::filesystem::is_regular_file(p.status())) {
+		if (p.is_regular_file()) {
 			files.push_back(p.path().string());
 		}
 	}
@@ -179,7 +254,7 @@ std::vector<FileInfo> Directory::GetFiles(std::string path) {
 std::vector<DirectoryInfo> Directory::GetDirectories(std::string path) {
 	std::vector<DirectoryInfo> directories;
 	for (auto& p : std::filesystem::directory_iterator(path)) {
-		if (std::filesystem::is_directory(p.status())) {
+		if (p.is_directory()) {
 			directories.push_back(p.path().string());
 		}
 	}
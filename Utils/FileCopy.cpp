@@ -0,0 +1,412 @@
+﻿#include "FileCopy.h"
+#include "Checksum.h"
+#include "DirectoryWalker.h"
+#include "FileStream.h"
+#include "SHA256.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#pragma warning(disable: 4267)
+#pragma warning(disable: 4244)
+
+namespace {
+	// Attributes SetFileAttributes accepts and a copy should keep.
+	constexpr DWORD CopiedAttributes = FILE_ATTRIBUTE_READONLY | FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM |
+		FILE_ATTRIBUTE_ARCHIVE | FILE_ATTRIBUTE_TEMPORARY | FILE_ATTRIBUTE_NOT_CONTENT_INDEXED;
+
+	unsigned thread_count(unsigned threads) {
+		return threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	bool is_separator(char c) {
+		return c == '\\' || c == '/';
+	}
+
+	std::string join_path(const std::string& directory, const std::string& name) {
+		return !directory.empty() && is_separator(directory.back()) ? directory + name : directory + '\\' + name;
+	}
+
+	bool uses_system_copy(const CopyOptions& options) {
+		return options.Method == CopyMethod::System || (options.Method == CopyMethod::Auto && options.Hash == CopyHash::None);
+	}
+
+	// Runs body on threads threads, the caller's included, and rethrows the
+	// first exception.
+	void run_parallel(unsigned threads, const std::function<void()>& body) {
+		std::mutex lock;
+		std::exception_ptr error;
+		auto guarded = [&] {
+			try {
+				body();
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> guard(lock);
+				if (!error) error = std::current_exception();
+			}
+		};
+		std::vector<std::thread> pool;
+		for (unsigned t = 1; t < threads; t++)
+			pool.emplace_back(guarded);
+		guarded();
+		for (auto& t : pool)
+			t.join();
+		if (error) std::rethrow_exception(error);
+	}
+
+	// Progress of one Copy or CopyTree, shared by all of its threads.
+	class ProgressState {
+	public:
+		explicit ProgressState(const std::function<bool(const CopyProgress&)>& callback) : callback(callback) {}
+
+		void AddFile(uint64_t length) {
+			std::lock_guard<std::mutex> guard(lock);
+			state.TotalFiles++;
+			state.TotalBytes += length;
+		}
+		// False once the copy is cancelled or stopped.
+		bool Advance(uint64_t bytes) { return Report(bytes, 0); }
+		bool FileDone() { return Report(0, 1); }
+		void Stop() { stopped = true; }
+		bool Stopped() const { return stopped; }
+
+	private:
+		const std::function<bool(const CopyProgress&)>& callback;
+		std::mutex lock;
+		CopyProgress state{};
+		std::atomic<bool> stopped{ false };
+
+		bool Report(uint64_t bytes, uint64_t files) {
+			std::lock_guard<std::mutex> guard(lock);
+			state.BytesCopied += bytes;
+			state.FilesCopied += files;
+			if (callback && !stopped && !callback(state))
+				stopped = true;
+			return !stopped;
+		}
+	};
+
+	class ContentHash {
+	public:
+		explicit ContentHash(CopyHash kind) : kind(kind) {}
+
+		void Update(const uint8_t* data, size_t size) {
+			switch (kind) {
+			case CopyHash::Crc32C: crc.Update(data, size); break;
+			case CopyHash::Xxh3: xxh3.Update(data, size); break;
+			case CopyHash::SHA256: sha256.update(data, size); break;
+			default: break;
+			}
+		}
+		std::string Hex() {
+			char text[17];
+			switch (kind) {
+			case CopyHash::Crc32C:
+				snprintf(text, sizeof(text), "%08x", crc.Value());
+				return text;
+			case CopyHash::Xxh3:
+				snprintf(text, sizeof(text), "%016llx", (unsigned long long)xxh3.Value());
+				return text;
+			case CopyHash::SHA256:
+				sha256.finalize();
+				return sha256.hexdigest();
+			default:
+				return {};
+			}
+		}
+
+	private:
+		CopyHash kind;
+		Crc32C crc;
+		Xxh3 xxh3;
+		SHA256 sha256;
+	};
+
+	struct SystemCopy {
+		ProgressState* progress;
+		uint64_t reported;
+	};
+
+	DWORD CALLBACK system_copy_progress(LARGE_INTEGER, LARGE_INTEGER transferred, LARGE_INTEGER, LARGE_INTEGER, DWORD, DWORD, HANDLE, HANDLE, LPVOID data) {
+		SystemCopy* copy = static_cast<SystemCopy*>(data);
+		const uint64_t done = (uint64_t)transferred.QuadPart;
+		const bool more = copy->progress->Advance(done - copy->reported);
+		copy->reported = done;
+		return more ? PROGRESS_CONTINUE : PROGRESS_CANCEL;
+	}
+
+	bool copy_system(const std::string& source, const std::string& destination, uint64_t length, const CopyOptions& options, ProgressState& progress) {
+		SystemCopy copy{ &progress, 0 };
+		DWORD flags = 0;
+		if (!options.Overwrite)
+			flags |= COPY_FILE_FAIL_IF_EXISTS;
+		if (length >= options.ParallelThreshold)
+			flags |= COPY_FILE_NO_BUFFERING;
+		return CopyFileExA(source.c_str(), destination.c_str(), system_copy_progress, &copy, NULL, flags) != FALSE;
+	}
+
+	// Chunk i covers [i * chunk, (i + 1) * chunk). Threads take chunks in
+	// increasing order, so the destination grows nearly sequentially and the
+	// file system does not zero-fill wide gaps; with a hash each chunk also
+	// waits for its predecessors before it is hashed.
+	bool copy_content(FileStream& input, FileStream& output, uint64_t size, bool direct, const CopyOptions& options, unsigned threads, ProgressState& progress, std::string& digest) {
+		const size_t align = FileStream::DirectAlignment;
+		size_t chunk = std::max<size_t>(options.ChunkSize, 1);
+		if (direct)
+			chunk = (chunk + align - 1) / align * align;
+		else
+			chunk = (size_t)std::min<uint64_t>(chunk, std::max<uint64_t>(size, 1));
+		const uint64_t chunks = (size + chunk - 1) / chunk;
+		threads = (unsigned)std::min<uint64_t>(direct ? threads : 1, std::max<uint64_t>(chunks, 1));
+
+		const bool hashing = options.Hash != CopyHash::None;
+		ContentHash hash(options.Hash);
+		std::mutex hashLock;
+		std::condition_variable hashTurn;
+		uint64_t hashed = 0;
+		std::atomic<uint64_t> next{ 0 };
+		bool failed = false;
+		auto fail = [&] {
+			std::lock_guard<std::mutex> guard(hashLock);
+			failed = true;
+			hashTurn.notify_all();
+		};
+		auto running = [&] {
+			std::lock_guard<std::mutex> guard(hashLock);
+			return !failed;
+		};
+
+		output.Preallocate(size);
+		run_parallel(threads, [&] {
+			try {
+				AlignedBuffer buffer(chunk);
+				for (uint64_t i; running() && (i = next++) < chunks; ) {
+					const uint64_t offset = i * chunk;
+					const size_t want = (size_t)std::min<uint64_t>(chunk, size - offset);
+					// Direct I/O moves whole sectors; the padding past the end
+					// is cut off once every chunk is written.
+					const size_t padded = direct ? (want + align - 1) / align * align : want;
+					if (input.ReadAt(buffer.data(), padded, offset) < (long long)want || !output.WriteAt(buffer.data(), padded, offset)) {
+						fail();
+						break;
+					}
+					if (hashing) {
+						std::unique_lock<std::mutex> guard(hashLock);
+						hashTurn.wait(guard, [&] { return hashed == i || failed; });
+						if (failed)
+							break;
+						hash.Update(buffer.data(), want);
+						hashed++;
+						hashTurn.notify_all();
+					}
+					if (!progress.Advance(want)) {
+						fail();
+						break;
+					}
+				}
+			}
+			catch (...) {
+				fail();
+				throw;
+			}
+		});
+		if (failed || (direct && !output.SetLength(size)))
+			return false;
+		digest = hash.Hex();
+		return true;
+	}
+
+	bool copy_chunked(const std::string& source, const std::string& destination, uint64_t length, const CopyOptions& options, unsigned threads, ProgressState& progress, std::string& digest) {
+		if (!options.Overwrite && GetFileAttributesA(destination.c_str()) != INVALID_FILE_ATTRIBUTES)
+			return false;
+		// Large files skip the system cache: they would only evict more
+		// useful pages, and unbuffered chunks need no extra memory copy.
+		const bool direct = length >= options.ParallelThreshold;
+		const FileOptions flags = direct ? FileOptions::Direct : FileOptions::Sequential;
+		std::optional<FileStream> input;
+		std::optional<FileStream> output;
+		try {
+			input.emplace(source, FileMode::Read, flags);
+			output.emplace(destination, FileMode::Write, flags);
+		}
+		catch (const std::runtime_error&) {
+			return false;
+		}
+		bool ok;
+		try {
+			ok = copy_content(*input, *output, input->Length(), direct, options, threads, progress, digest);
+			FILETIME creation, access, write;
+			ok = ok && GetFileTime(input->NativeHandle(), &creation, &access, &write) && SetFileTime(output->NativeHandle(), &creation, &access, &write);
+		}
+		catch (...) {
+			output.reset();
+			DeleteFileA(destination.c_str());
+			throw;
+		}
+		output.reset();
+		if (!ok) {
+			DeleteFileA(destination.c_str());
+			return false;
+		}
+		const DWORD attributes = GetFileAttributesA(source.c_str());
+		if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & CopiedAttributes) != FILE_ATTRIBUTE_ARCHIVE)
+			SetFileAttributesA(destination.c_str(), attributes & CopiedAttributes);
+		return true;
+	}
+
+	bool copy_file(const std::string& source, const std::string& destination, uint64_t length, const CopyOptions& options, unsigned threads, ProgressState& progress, std::string* hash) {
+		if (progress.Stopped())
+			return false;
+		std::string digest;
+		const bool ok = uses_system_copy(options)
+			? copy_system(source, destination, length, options, progress)
+			: copy_chunked(source, destination, length, options, threads, progress, digest);
+		if (!ok)
+			return false;
+		progress.FileDone();
+		if (options.FileCopied)
+			options.FileCopied(source, destination, digest);
+		if (hash)
+			*hash = std::move(digest);
+		return true;
+	}
+
+	void check_options(const CopyOptions& options) {
+		if (options.Method == CopyMethod::System && options.Hash != CopyHash::None)
+			throw std::invalid_argument("CopyMethod::System cannot hash the content");
+	}
+}
+
+bool FileCopy::Copy(const std::string& source, const std::string& destination, const CopyOptions& options, std::string* hash) {
+	check_options(options);
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesExA(source.c_str(), GetFileExInfoStandard, &info) || (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+		return false;
+	const uint64_t length = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	ProgressState progress(options.Progress);
+	progress.AddFile(length);
+	return copy_file(source, destination, length, options, thread_count(options.Threads), progress, hash);
+}
+
+bool FileCopy::CopyTree(const std::string& source, const std::string& destination, const CopyOptions& options) {
+	check_options(options);
+	std::error_code ec;
+	std::filesystem::create_directories(destination, ec);
+	if (ec)
+		return false;
+
+	struct Job {
+		std::string source;
+		std::string destination;
+		uint64_t length;
+	};
+	const unsigned threads = thread_count(options.Threads);
+	ProgressState progress(options.Progress);
+	std::mutex lock;
+	std::condition_variable ready;
+	// Small files go to the pool as soon as they are listed; large ones
+	// wait for the listing to end and are then split across all threads.
+	std::deque<Job> small;
+	std::vector<Job> large;
+	bool listed = false;
+	std::exception_ptr error;
+	auto stop = [&](std::exception_ptr thrown) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (thrown && !error) error = thrown;
+		}
+		progress.Stop();
+		ready.notify_all();
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned t = 0; t < threads; t++) {
+		pool.emplace_back([&] {
+			for (;;) {
+				Job job;
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					ready.wait(guard, [&] { return !small.empty() || listed || progress.Stopped(); });
+					if (progress.Stopped() || small.empty())
+						return;
+					job = std::move(small.front());
+					small.pop_front();
+				}
+				try {
+					if (!copy_file(job.source, job.destination, job.length, options, 1, progress, nullptr))
+						stop(nullptr);
+				}
+				catch (...) {
+					stop(std::current_exception());
+				}
+			}
+		});
+	}
+
+	// One listing thread creates each directory before any of its entries
+	// is reported, so files can be queued the moment they are seen.
+	const size_t base = source.size() + (!source.empty() && is_separator(source.back()) ? 0 : 1);
+	WalkOptions walk;
+	walk.DirectoryFilter = [](const DirectoryEntry& entry) { return !entry.IsReparsePoint(); };
+	try {
+		DirectoryWalker::Walk(source, [&](const DirectoryEntry& entry) {
+			if (progress.Stopped())
+				return false;
+			std::string target = join_path(destination, entry.Path.substr(base));
+			if (entry.IsDirectory()) {
+				if (!CreateDirectoryA(target.c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+					stop(nullptr);
+					return false;
+				}
+				return true;
+			}
+			progress.AddFile(entry.Length);
+			if (entry.Length >= options.ParallelThreshold) {
+				large.push_back({ entry.Path, std::move(target), entry.Length });
+				return true;
+			}
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				small.push_back({ entry.Path, std::move(target), entry.Length });
+			}
+			ready.notify_one();
+			return true;
+		}, walk);
+	}
+	catch (const std::runtime_error&) {
+		stop(nullptr);
+	}
+	catch (...) {
+		stop(std::current_exception());
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		listed = true;
+	}
+	ready.notify_all();
+
+	for (const Job& job : large) {
+		try {
+			if (!copy_file(job.source, job.destination, job.length, options, threads, progress, nullptr)) {
+				stop(nullptr);
+				break;
+			}
+		}
+		catch (...) {
+			stop(std::current_exception());
+			break;
+		}
+	}
+	for (auto& t : pool)
+		t.join();
+	if (error) std::rethrow_exception(error);
+	return !progress.Stopped();
+}
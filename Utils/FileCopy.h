@@ -0,0 +1,72 @@
+﻿#pragma once
+#include "defines.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+
+enum class CopyMethod {
+	// The system copy, unless a hash is wanted.
+	Auto,
+	// CopyFileEx: the system picks offloaded, server-side or block-cloned
+	// copies where the volume supports them.
+	System,
+	// Reads and writes the content in chunks on several threads, bypassing
+	// the system cache for files of at least CopyOptions::ParallelThreshold.
+	Chunked
+};
+
+enum class CopyHash {
+	None,
+	Crc32C,
+	Xxh3,
+	SHA256
+};
+
+struct CopyProgress {
+	uint64_t BytesCopied;
+	// For CopyTree this grows while the source is still being listed.
+	uint64_t TotalBytes;
+	uint64_t FilesCopied;
+	uint64_t TotalFiles;
+};
+
+struct CopyOptions {
+	CopyMethod Method = CopyMethod::Auto;
+	// Replaces existing destination files; otherwise they fail the copy.
+	bool Overwrite = true;
+	// 0 uses one per logical processor.
+	unsigned Threads = 0;
+	size_t ChunkSize = 8 << 20;
+	// Smaller files are copied by one thread with buffered I/O.
+	uint64_t ParallelThreshold = 64ull << 20;
+	// Hashes the content as it is copied. Requires the chunked copy.
+	CopyHash Hash = CopyHash::None;
+	// Called one at a time as data is copied; returning false cancels.
+	std::function<bool(const CopyProgress&)> Progress;
+	// Called after each file with its hex digest, or "" without a hash. From
+	// several threads at once during CopyTree.
+	std::function<void(const std::string& source, const std::string& destination, const std::string& hash)> FileCopied;
+};
+
+// Copy engine behind File::Copy. Large files are split into chunks that
+// several threads read and write at once through big sector-aligned buffers,
+// and CopyTree creates directories while it lists the source, so small files
+// are already being copied while the rest of the tree is still listed.
+//
+//     CopyOptions options;
+//     options.Hash = CopyHash::Xxh3;
+//     std::string hash;
+//     FileCopy::Copy("D:\\image.vhdx", "E:\\image.vhdx", options, &hash);
+class FileCopy {
+public:
+	// Copies content, timestamps and attributes. Returns false if the copy
+	// fails or is cancelled, leaving no partial destination behind; hash
+	// receives the digest when options.Hash is set. Throws
+	// std::invalid_argument for CopyMethod::System with a hash.
+	static bool Copy(const std::string& source, const std::string& destination, const CopyOptions& options = CopyOptions(), std::string* hash = nullptr);
+	// Copies every file and directory under source into destination, which
+	// is created if needed. Junctions and directory symbolic links are
+	// skipped, and directory timestamps are not copied. Stops at the first
+	// failure or on cancel and returns false; files already copied stay.
+	static bool CopyTree(const std::string& source, const std::string& destination, const CopyOptions& options = CopyOptions());
+};
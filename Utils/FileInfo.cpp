@@ -1,4 +1,6 @@
 ﻿#include "FileInfo.h"
+#include "FileCopy.h"
+#include <stdexcept>
 
 #pragma warning(disable: 4267)
 #pragma warning(disable: 4244)
@@ -19,7 +21,17 @@ std::string FileInfo::FullName() {
     return m_path.string();
 }
 void FileInfo::CopyTo(std::string dest) {
-    std::filesystem::copy(m_path, dest, std::filesystem::copy_options::overwrite_existing);
+    if (std::filesystem::is_directory(m_path)) {
+        std::filesystem::copy(m_path, dest, std::filesystem::copy_options::overwrite_existing);
+        return;
+    }
+    // As with std::filesystem::copy, a directory receives the file under its
+    // own name.
+    std::filesystem::path target(dest);
+    if (std::filesystem::is_directory(target))
+        target /= m_path.filename();
+    if (!FileCopy::Copy(m_path.string(), target.string()))
+        throw std::runtime_error("Failed to copy file");
 }
 void FileInfo::MoveTo(std::string dest) {
     std::filesystem::rename(m_path, dest);
@@ -28,10 +40,10 @@ bool FileInfo::Exists() {
     return std::filesystem::exists(m_path);
 }
 long FileInfo::Length() {
-    if (Exists()) {
-        return std::filesystem::file_size(m_path);
-    }
-    return NULL;
+    // One query instead of an exists() check followed by file_size().
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(m_path, ec);
+    return ec ? 0 : (long)size;
 }
 void FileInfo::Create() {
     std::ofstream fout(m_path);
@@ -71,7 +83,7 @@ std::string DirectoryInfo::ParentDirectoryName() {
 std::vector<FileInfo> DirectoryInfo::GetFiles() {
     std::vector<FileInfo> files;
     for (auto& p : std::filesystem::directory_iterator(dirPath)) {
-        if (std::filesystem::is_regular_file(p.status())) {
+        if (p.is_regular_file()) {
             files.push_back(p.path().string());
         }
     }
@@ -80,7 +92,7 @@ std::vector<FileInfo> DirectoryInfo::GetFiles() {
 std::vector<DirectoryInfo> DirectoryInfo::GetDirectories() {
     std::vector<DirectoryInfo> directories;
     for (auto& p : std::filesystem::directory_iterator(dirPath)) {
-        if (std::filesystem::is_directory(p.status())) {
+        if (p.is_directory()) {
             directories.push_back(p.path().string());
         }
     }
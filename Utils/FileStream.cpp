@@ -1,56 +1,370 @@
 ﻿#include "FileStream.h"
+#include <algorithm>
+#include <cstring>
+#include <malloc.h>
+#include <new>
+#include <stdexcept>
 #pragma warning(disable: 4267)
 #pragma warning(disable: 4244)
 #pragma warning(disable: 4018)
-FileStream::FileStream(const std::string& filename, FileMode mode) {
-	std::ios_base::openmode open_mode = std::ios_base::binary;
+
+namespace {
+	// Offset that makes WriteFile append, whatever the current length.
+	constexpr uint64_t AppendOffset = UINT64_MAX;
+	// Largest single ReadFile/WriteFile, kept well inside a DWORD.
+	constexpr size_t MaxTransfer = 1u << 30;
+	// Small scatter/gather pieces are combined into runs of up to this size.
+	constexpr size_t MaxRun = 1 << 20;
+
+	// The handle is overlapped so that positional calls from several threads
+	// run concurrently instead of queuing on the file object's lock. Each
+	// thread waits on an event of its own.
+	HANDLE io_event() {
+		struct Event {
+			HANDLE handle = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+			~Event() { if (handle) CloseHandle(handle); }
+		};
+		thread_local Event event;
+		return event.handle;
+	}
+
+	bool transfer(HANDLE file, bool write, void* data, DWORD size, uint64_t offset, DWORD& done) {
+		OVERLAPPED overlapped{};
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		overlapped.hEvent = io_event();
+		done = 0;
+		BOOL ok = write ? WriteFile(file, data, size, nullptr, &overlapped) : ReadFile(file, data, size, nullptr, &overlapped);
+		if (ok || GetLastError() == ERROR_IO_PENDING)
+			ok = GetOverlappedResult(file, &overlapped, &done, TRUE);
+		if (!ok && !write && GetLastError() == ERROR_HANDLE_EOF) {
+			done = 0;
+			return true;
+		}
+		return ok != FALSE;
+	}
+
+	// Reads until size bytes or the end of the file; -1 on error.
+	long long read_at(HANDLE file, void* data, size_t size, uint64_t offset) {
+		size_t total = 0;
+		while (total < size) {
+			DWORD done;
+			if (!transfer(file, false, (uint8_t*)data + total, (DWORD)std::min(size - total, MaxTransfer), offset + total, done))
+				return -1;
+			if (done == 0)
+				break;
+			total += done;
+		}
+		return (long long)total;
+	}
+
+	bool write_at(HANDLE file, const void* data, size_t size, uint64_t offset) {
+		size_t total = 0;
+		while (total < size) {
+			DWORD done;
+			const uint64_t at = offset == AppendOffset ? AppendOffset : offset + total;
+			if (!transfer(file, true, (uint8_t*)data + total, (DWORD)std::min(size - total, MaxTransfer), at, done) || done == 0)
+				return false;
+			total += done;
+		}
+		return true;
+	}
+
+	bool has(FileOptions options, FileOptions flag) {
+		return ((int)options & (int)flag) != 0;
+	}
+}
+
+FileStream::FileStream(const std::string& filename, FileMode mode, FileOptions options) : mode(mode) {
+	DWORD access;
+	DWORD disposition;
 	switch (mode) {
 	case FileMode::Read:
-		open_mode |= std::ios_base::in;
+		access = GENERIC_READ;
+		disposition = OPEN_EXISTING;
 		break;
 	case FileMode::Write:
-		open_mode |= std::ios_base::out;
+		access = GENERIC_WRITE;
+		disposition = CREATE_ALWAYS;
 		break;
 	case FileMode::Append:
-		open_mode |= std::ios_base::app;
+		access = GENERIC_WRITE;
+		disposition = OPEN_ALWAYS;
 		break;
 	case FileMode::ReadWrite:
-		open_mode |= std::ios_base::in | std::ios_base::out;
+		access = GENERIC_READ | GENERIC_WRITE;
+		disposition = OPEN_EXISTING;
 		break;
 	default:
 		throw std::invalid_argument("Invalid mode");
 	}
-	file_.open(filename, open_mode);
-	if (!file_) {
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED;
+	if (has(options, FileOptions::Direct))
+		flags |= FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH;
+	if (has(options, FileOptions::Sequential))
+		flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+	if (has(options, FileOptions::RandomAccess))
+		flags |= FILE_FLAG_RANDOM_ACCESS;
+	if (has(options, FileOptions::WriteThrough))
+		flags |= FILE_FLAG_WRITE_THROUGH;
+	direct = has(options, FileOptions::Direct);
+	handle = CreateFileA(filename.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, disposition, flags, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
 		throw std::runtime_error("Failed to open file");
 	}
+	if (mode == FileMode::Append)
+		position = Length();
 }
 FileStream::~FileStream() {
-	if (file_.is_open()) file_.close();
+	Close();
+}
+FileStream::FileStream(FileStream&& other) noexcept {
+	*this = std::move(other);
+}
+FileStream& FileStream::operator=(FileStream&& other) noexcept {
+	if (this != &other) {
+		Close();
+		std::swap(handle, other.handle);
+		std::swap(mode, other.mode);
+		std::swap(direct, other.direct);
+		std::swap(position, other.position);
+		std::swap(buffer, other.buffer);
+		std::swap(bufferOffset, other.bufferOffset);
+		std::swap(readLength, other.readLength);
+		std::swap(readAhead, other.readAhead);
+		std::swap(writeLength, other.writeLength);
+	}
+	return *this;
 }
-long long FileStream::Read(void* buffer, size_t size) {
-	return (long long)file_.read(static_cast<char*>(buffer), size).gcount();
+long long FileStream::Read(void* data, size_t size) {
+	if (!IsOpen() || !FlushWrite())
+		return 0;
+	if (direct) {
+		const long long read = read_at(handle, data, size, position);
+		if (read <= 0)
+			return 0;
+		position += read;
+		return read;
+	}
+	uint8_t* out = static_cast<uint8_t*>(data);
+	size_t total = 0;
+	while (total < size) {
+		if (readLength > 0 && position >= bufferOffset && position < bufferOffset + readLength) {
+			const size_t at = (size_t)(position - bufferOffset);
+			const size_t n = std::min(size - total, readLength - at);
+			std::memcpy(out + total, buffer.data() + at, n);
+			total += n;
+			position += n;
+			continue;
+		}
+		// Large reads skip the buffer; a short one means the end of the file.
+		const size_t remaining = size - total;
+		if (remaining >= BufferSize) {
+			const long long read = read_at(handle, out + total, remaining, position);
+			if (read > 0) {
+				total += (size_t)read;
+				position += read;
+			}
+			break;
+		}
+		// Read-ahead starts small after a seek and doubles while the reads
+		// stay sequential, so random access does not pay for a full buffer.
+		readAhead = readLength > 0 && position == bufferOffset + readLength ? std::min(readAhead * 2, BufferSize) : MinReadAhead;
+		const size_t fill = std::max(readAhead, remaining);
+		buffer.resize(BufferSize);
+		const long long read = read_at(handle, buffer.data(), fill, position);
+		readLength = read > 0 ? (size_t)read : 0;
+		bufferOffset = position;
+		if (readLength == 0)
+			break;
+	}
+	return (long long)total;
 }
-bool FileStream::Write(const void* buffer, size_t size) {
-	return file_.write(static_cast<const char*>(buffer), size).good();
+bool FileStream::Write(const void* data, size_t size) {
+	if (!IsOpen() || mode == FileMode::Read)
+		return false;
+	readLength = 0;
+	const bool append = mode == FileMode::Append;
+	if (direct) {
+		if (!write_at(handle, data, size, append ? AppendOffset : position))
+			return false;
+		position += size;
+		return true;
+	}
+	// The buffer holds one contiguous run; a write elsewhere starts a new one.
+	if (writeLength > 0 && !append && bufferOffset + writeLength != position && !FlushWrite())
+		return false;
+	if (writeLength + size > BufferSize && !FlushWrite())
+		return false;
+	if (size >= BufferSize) {
+		if (!write_at(handle, data, size, append ? AppendOffset : position))
+			return false;
+		position += size;
+		return true;
+	}
+	if (writeLength == 0) {
+		buffer.resize(BufferSize);
+		bufferOffset = position;
+	}
+	std::memcpy(buffer.data() + writeLength, data, size);
+	writeLength += size;
+	position += size;
+	return true;
+}
+bool FileStream::FlushWrite() {
+	if (writeLength == 0)
+		return true;
+	const bool ok = write_at(handle, buffer.data(), writeLength, mode == FileMode::Append ? AppendOffset : bufferOffset);
+	writeLength = 0;
+	return ok;
 }
 size_t FileStream::Position() {
-	return file_.tellg();
+	return (size_t)position;
 }
 void FileStream::Seek(size_t pos) {
-	file_.seekg(pos);
+	position = pos;
 }
 void FileStream::SeekToEnd() {
-	file_.seekg(0, std::ios_base::end);
+	position = Length();
 }
 size_t FileStream::Length() {
-	auto pos = file_.tellg();
-	file_.seekg(0, std::ios_base::end);
-	auto length = file_.tellg();
-	file_.seekg(pos);
-	return length;
+	LARGE_INTEGER length;
+	if (!IsOpen() || !GetFileSizeEx(handle, &length))
+		return 0;
+	uint64_t result = (uint64_t)length.QuadPart;
+	if (writeLength > 0)
+		result = mode == FileMode::Append ? result + writeLength : std::max<uint64_t>(result, bufferOffset + writeLength);
+	return (size_t)result;
 }
 
 void FileStream::Close() {
-	if (file_.is_open()) file_.close();
-}
\ No newline at end of file
+	if (!IsOpen())
+		return;
+	FlushWrite();
+	CloseHandle(handle);
+	handle = INVALID_HANDLE_VALUE;
+	buffer = std::vector<uint8_t>();
+	readLength = 0;
+	position = 0;
+}
+
+long long FileStream::ReadAt(void* data, size_t size, uint64_t offset) {
+	if (!IsOpen())
+		return -1;
+	return read_at(handle, data, size, offset);
+}
+bool FileStream::WriteAt(const void* data, size_t size, uint64_t offset) {
+	if (!IsOpen() || mode == FileMode::Read)
+		return false;
+	return write_at(handle, data, size, offset);
+}
+
+long long FileStream::ReadV(Span<const MutableByteSpan> buffers, uint64_t offset) {
+	if (!IsOpen())
+		return -1;
+	std::vector<uint8_t> scratch;
+	long long total = 0;
+	for (size_t i = 0; i < buffers.size();) {
+		// Large pieces, and every piece of a direct stream, which must stay
+		// aligned, are read in place.
+		if (direct || buffers[i].size() >= BufferSize) {
+			const long long read = read_at(handle, buffers[i].data(), buffers[i].size(), offset);
+			if (read < 0)
+				return -1;
+			total += read;
+			offset += read;
+			if ((size_t)read < buffers[i].size())
+				return total;
+			i++;
+			continue;
+		}
+		size_t end = i;
+		size_t run = 0;
+		while (end < buffers.size() && buffers[end].size() < BufferSize && run + buffers[end].size() <= MaxRun)
+			run += buffers[end++].size();
+		scratch.resize(run);
+		const long long read = read_at(handle, scratch.data(), run, offset);
+		if (read < 0)
+			return -1;
+		size_t copied = 0;
+		for (; i < end && copied < (size_t)read; i++) {
+			const size_t n = std::min(buffers[i].size(), (size_t)read - copied);
+			std::memcpy(buffers[i].data(), scratch.data() + copied, n);
+			copied += n;
+		}
+		total += read;
+		offset += read;
+		if ((size_t)read < run)
+			return total;
+		i = end;
+	}
+	return total;
+}
+bool FileStream::WriteV(Span<const ByteSpan> buffers, uint64_t offset) {
+	if (!IsOpen() || mode == FileMode::Read)
+		return false;
+	std::vector<uint8_t> scratch;
+	for (size_t i = 0; i < buffers.size();) {
+		if (direct || buffers[i].size() >= BufferSize) {
+			if (!write_at(handle, buffers[i].data(), buffers[i].size(), offset))
+				return false;
+			offset += buffers[i].size();
+			i++;
+			continue;
+		}
+		scratch.clear();
+		while (i < buffers.size() && buffers[i].size() < BufferSize && scratch.size() + buffers[i].size() <= MaxRun) {
+			scratch.insert(scratch.end(), buffers[i].begin(), buffers[i].end());
+			i++;
+		}
+		if (!write_at(handle, scratch.data(), scratch.size(), offset))
+			return false;
+		offset += scratch.size();
+	}
+	return true;
+}
+
+bool FileStream::Preallocate(uint64_t size) {
+	if (!IsOpen())
+		return false;
+	FILE_ALLOCATION_INFO info;
+	info.AllocationSize.QuadPart = (LONGLONG)size;
+	return SetFileInformationByHandle(handle, FileAllocationInfo, &info, sizeof(info)) != FALSE;
+}
+bool FileStream::SetLength(uint64_t length) {
+	if (!IsOpen() || !FlushWrite())
+		return false;
+	readLength = 0;
+	FILE_END_OF_FILE_INFO info;
+	info.EndOfFile.QuadPart = (LONGLONG)length;
+	return SetFileInformationByHandle(handle, FileEndOfFileInfo, &info, sizeof(info)) != FALSE;
+}
+bool FileStream::Flush() {
+	if (!IsOpen() || !FlushWrite())
+		return false;
+	// Bytes read ahead may predate a WriteAt or WriteV; the next Read fetches
+	// them again.
+	readLength = 0;
+	return true;
+}
+bool FileStream::Sync() {
+	return Flush() && FlushFileBuffers(handle) != FALSE;
+}
+
+AlignedBuffer::AlignedBuffer(size_t size, size_t alignment) : length(size) {
+	ptr = (uint8_t*)_aligned_malloc(std::max<size_t>(size, 1), alignment);
+	if (!ptr)
+		throw std::bad_alloc();
+}
+AlignedBuffer::~AlignedBuffer() {
+	_aligned_free(ptr);
+}
+AlignedBuffer::AlignedBuffer(AlignedBuffer&& other) noexcept : ptr(other.ptr), length(other.length) {
+	other.ptr = nullptr;
+	other.length = 0;
+}
+AlignedBuffer& AlignedBuffer::operator=(AlignedBuffer&& other) noexcept {
+	std::swap(ptr, other.ptr);
+	std::swap(length, other.length);
+	return *this;
+}
@@ -1,7 +1,10 @@
 ﻿#pragma once
 #include "defines.h"
-#include <string>
+#include <cstdint>
 #include <fstream>
+#include <string>
+#include <vector>
+#include "Span.h"
 
 enum class FileMode {
 	Read,
@@ -9,14 +12,47 @@ enum class FileMode {
 	Append,
 	ReadWrite
 };
+
+enum class FileOptions {
+	None = 0,
+	// Bypasses the system cache (FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH)
+	// and the stream's own buffer. Every offset, size and buffer address must
+	// be a multiple of FileStream::DirectAlignment; AlignedBuffer provides such
+	// memory. Trim the padded tail with SetLength().
+	Direct = 0x1,
+	Sequential = 0x2,
+	RandomAccess = 0x4,
+	// Writes reach the disk before they return.
+	WriteThrough = 0x8,
+};
+inline FileOptions operator|(FileOptions a, FileOptions b) {
+	return (FileOptions)((int)a | (int)b);
+}
+
+// Binary file over a native handle. Read/Write go through a small buffer at a
+// position of the stream's own; ReadAt/WriteAt and the vectored forms take an
+// explicit offset, bypass that buffer and touch no shared state, so several
+// threads can read or write different offsets of one stream at once. Mixing
+// the two on overlapping bytes needs a Flush() in between.
 class FileStream {
 public:
-	FileStream(const std::string& filename, FileMode mode = FileMode::ReadWrite);
+	static constexpr size_t BufferSize = 64 * 1024;
+	static constexpr size_t MinReadAhead = 4 * 1024;
+	// Sector alignment that satisfies FileOptions::Direct on 512-byte and
+	// 4K-sector disks alike.
+	static constexpr size_t DirectAlignment = 4096;
+
+	FileStream(const std::string& filename, FileMode mode = FileMode::ReadWrite, FileOptions options = FileOptions::None);
 	~FileStream();
+	FileStream(FileStream&& other) noexcept;
+	FileStream& operator=(FileStream&& other) noexcept;
+	FileStream(const FileStream&) = delete;
+	FileStream& operator=(const FileStream&) = delete;
+
 	long long Read(void* buffer, size_t size);
 	template <class T>
 	bool Read(T* buffer) {
-		return Read(&buffer, sizeof(T)) == sizeof(T);
+		return Read(buffer, sizeof(T)) == sizeof(T);
 	}
 	bool Write(const void* buffer, size_t size);
 	template <class T>
@@ -28,7 +64,59 @@ public:
 	void SeekToEnd();
 	size_t Length();
 	void Close();
+
+	// Positional I/O. ReadAt returns the bytes read, short only at the end of
+	// the file, or -1 on error.
+	long long ReadAt(void* buffer, size_t size, uint64_t offset);
+	bool WriteAt(const void* buffer, size_t size, uint64_t offset);
+	// Scatter/gather over consecutive bytes from offset. Small pieces are
+	// combined so a run of them costs one system call.
+	long long ReadV(Span<const MutableByteSpan> buffers, uint64_t offset);
+	bool WriteV(Span<const ByteSpan> buffers, uint64_t offset);
+
+	// Reserves disk space for size bytes without changing the length, so a
+	// file written sequentially does not fragment or fail half way.
+	bool Preallocate(uint64_t size);
+	bool SetLength(uint64_t length);
+	// Hands buffered writes to the system and drops bytes read ahead.
+	bool Flush();
+	// Flush, then waits until the data and metadata are on disk.
+	bool Sync();
+
+	bool IsOpen() const { return handle != INVALID_HANDLE_VALUE; }
+	FileMode Mode() const { return mode; }
+	HANDLE NativeHandle() const { return handle; }
+
 private:
-	std::fstream file_;
+	HANDLE handle = INVALID_HANDLE_VALUE;
+	FileMode mode = FileMode::Read;
+	bool direct = false;
+	uint64_t position = 0;
+	// File offset of buffer[0]. Holds either readLength bytes read ahead or
+	// writeLength bytes not yet written, never both.
+	std::vector<uint8_t> buffer;
+	uint64_t bufferOffset = 0;
+	size_t readLength = 0;
+	size_t readAhead = MinReadAhead;
+	size_t writeLength = 0;
+
+	bool FlushWrite();
 };
 
+// Heap block aligned for FileOptions::Direct.
+class AlignedBuffer {
+public:
+	explicit AlignedBuffer(size_t size, size_t alignment = FileStream::DirectAlignment);
+	~AlignedBuffer();
+	AlignedBuffer(AlignedBuffer&& other) noexcept;
+	AlignedBuffer& operator=(AlignedBuffer&& other) noexcept;
+	AlignedBuffer(const AlignedBuffer&) = delete;
+	AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+	uint8_t* data() const { return ptr; }
+	size_t size() const { return length; }
+
+private:
+	uint8_t* ptr;
+	size_t length;
+};
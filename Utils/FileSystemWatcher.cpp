@@ -0,0 +1,290 @@
+﻿#include "FileSystemWatcher.h"
+#include "DirectoryWalker.h"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+	// Larger buffers fail on network shares.
+	constexpr size_t NotifyBufferSize = 64 * 1024;
+	constexpr DWORD NotifyFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+		FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+	// A steady stream of changes is still delivered after this many intervals.
+	constexpr int MaxDebounceIntervals = 10;
+
+	std::string narrow(const WCHAR* text, int length) {
+		const int size = WideCharToMultiByte(CP_ACP, 0, text, length, NULL, 0, NULL, NULL);
+		std::string result(size, '\0');
+		WideCharToMultiByte(CP_ACP, 0, text, length, &result[0], size, NULL, NULL);
+		return result;
+	}
+
+	std::string join_path(const std::string& directory, const std::string& name) {
+		return !directory.empty() && (directory.back() == '\\' || directory.back() == '/') ? directory + name : directory + '\\' + name;
+	}
+
+	bool matches(const std::string& name, const std::vector<std::string>& patterns) {
+		if (patterns.empty())
+			return true;
+		const size_t separator = name.find_last_of("\\/");
+		const std::string_view leaf = separator == std::string::npos ? std::string_view(name) : std::string_view(name).substr(separator + 1);
+		return std::any_of(patterns.begin(), patterns.end(), [&](const std::string& pattern) {
+			return DirectoryWalker::MatchPattern(leaf, pattern);
+		});
+	}
+
+	// Changes of one batch, at most one per path, in the order the paths
+	// first changed.
+	class ChangeSet {
+	public:
+		bool Empty() const { return index.empty(); }
+
+		void Created(const std::string& name) {
+			Change* change = Find(name);
+			if (!change)
+				Append(WatcherChangeTypes::Created, name);
+			else if (change->type == WatcherChangeTypes::Deleted)
+				change->type = WatcherChangeTypes::Changed;
+		}
+		void Changed(const std::string& name) {
+			if (!Find(name))
+				Append(WatcherChangeTypes::Changed, name);
+		}
+		void Deleted(const std::string& name) {
+			Change* change = Find(name);
+			if (!change) {
+				Append(WatcherChangeTypes::Deleted, name);
+				return;
+			}
+			switch (change->type) {
+			case WatcherChangeTypes::Created:
+				Erase(name);
+				break;
+			case WatcherChangeTypes::Changed:
+				change->type = WatcherChangeTypes::Deleted;
+				break;
+			case WatcherChangeTypes::Renamed: {
+				// Renamed and then deleted: the original name is what went away,
+				// unless it was created again meanwhile, as when saving through a
+				// backup copy. Then the original was only rewritten.
+				const std::string original = change->oldName;
+				Erase(name);
+				Change* recreated = Find(original);
+				if (!recreated)
+					Deleted(original);
+				else if (recreated->type == WatcherChangeTypes::Created)
+					recreated->type = WatcherChangeTypes::Changed;
+				break;
+			}
+			default:
+				break;
+			}
+		}
+		void Renamed(const std::string& oldName, const std::string& newName) {
+			// Saving through a temporary file renamed over the target.
+			Change* target = Find(newName);
+			const bool replaced = target && target->type == WatcherChangeTypes::Deleted;
+			Erase(newName);
+			Change* change = Find(oldName);
+			if (!change) {
+				Append(WatcherChangeTypes::Renamed, newName, oldName);
+				return;
+			}
+			const WatcherChangeTypes type = change->type;
+			const std::string original = type == WatcherChangeTypes::Renamed ? change->oldName : oldName;
+			Erase(oldName);
+			if (type == WatcherChangeTypes::Created)
+				Append(replaced ? WatcherChangeTypes::Changed : WatcherChangeTypes::Created, newName);
+			else if (original != newName)
+				Append(WatcherChangeTypes::Renamed, newName, original);
+		}
+
+		std::vector<FileSystemEventArgs> Take(const std::string& root, const std::vector<std::string>& patterns) {
+			std::vector<FileSystemEventArgs> batch;
+			for (Change& change : changes) {
+				if (!change.live || !(matches(change.name, patterns) || (!change.oldName.empty() && matches(change.oldName, patterns))))
+					continue;
+				FileSystemEventArgs e;
+				e.ChangeType = change.type;
+				e.FullPath = join_path(root, change.name);
+				e.Name = std::move(change.name);
+				if (change.type == WatcherChangeTypes::Renamed) {
+					e.OldFullPath = join_path(root, change.oldName);
+					e.OldName = std::move(change.oldName);
+				}
+				batch.push_back(std::move(e));
+			}
+			changes.clear();
+			index.clear();
+			return batch;
+		}
+
+	private:
+		struct Change {
+			WatcherChangeTypes type;
+			std::string name;
+			std::string oldName;
+			bool live;
+		};
+		std::vector<Change> changes;
+		std::unordered_map<std::string, size_t> index;
+
+		Change* Find(const std::string& name) {
+			auto it = index.find(name);
+			return it == index.end() ? nullptr : &changes[it->second];
+		}
+		void Append(WatcherChangeTypes type, const std::string& name, const std::string& oldName = std::string()) {
+			index[name] = changes.size();
+			changes.push_back({ type, name, oldName, true });
+		}
+		void Erase(const std::string& name) {
+			auto it = index.find(name);
+			if (it == index.end())
+				return;
+			changes[it->second].live = false;
+			index.erase(it);
+		}
+	};
+}
+
+FileSystemWatcher::FileSystemWatcher(const std::string& path, bool includeSubdirectories) : path(path), recursive(includeSubdirectories) {
+}
+FileSystemWatcher::~FileSystemWatcher() {
+	Stop();
+}
+
+void FileSystemWatcher::Start() {
+	if (running)
+		return;
+	// Clean up after a watcher thread that ended on its own.
+	Stop();
+	directory = CreateFileA(path.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+	if (directory == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Failed to watch directory");
+	buffer.resize(NotifyBufferSize / sizeof(DWORD));
+	overlapped = OVERLAPPED{};
+	overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+	stopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+	if (!overlapped.hEvent || !stopEvent || !Read()) {
+		Close();
+		throw std::runtime_error("Failed to watch directory");
+	}
+	running = true;
+	thread = std::thread(&FileSystemWatcher::Run, this);
+}
+
+void FileSystemWatcher::Stop() {
+	if (thread.joinable()) {
+		SetEvent(stopEvent);
+		thread.join();
+	}
+	Close();
+}
+
+void FileSystemWatcher::Close() {
+	if (directory != INVALID_HANDLE_VALUE) {
+		CloseHandle(directory);
+		directory = INVALID_HANDLE_VALUE;
+	}
+	if (overlapped.hEvent) {
+		CloseHandle(overlapped.hEvent);
+		overlapped.hEvent = NULL;
+	}
+	if (stopEvent) {
+		CloseHandle(stopEvent);
+		stopEvent = NULL;
+	}
+}
+
+bool FileSystemWatcher::Read() {
+	ResetEvent(overlapped.hEvent);
+	return ReadDirectoryChangesW(directory, buffer.data(), (DWORD)NotifyBufferSize, recursive, NotifyFilter, NULL, &overlapped, NULL) != FALSE;
+}
+
+void FileSystemWatcher::Run() {
+	using Clock = std::chrono::steady_clock;
+	ChangeSet changes;
+	Clock::time_point first;
+	Clock::time_point last;
+	// Old name of a rename whose new name has not been seen yet.
+	std::string renamedFrom;
+	bool reading = true;
+	for (;;) {
+		DWORD timeout = INFINITE;
+		if (!changes.Empty()) {
+			const std::chrono::milliseconds debounce = this->debounce;
+			const Clock::time_point deadline = std::min(last + debounce, first + debounce * MaxDebounceIntervals);
+			const Clock::time_point now = Clock::now();
+			timeout = deadline <= now ? 0 : (DWORD)std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+		}
+		HANDLE handles[2] = { overlapped.hEvent, stopEvent };
+		const DWORD wait = WaitForMultipleObjects(2, handles, FALSE, timeout);
+		if (wait == WAIT_TIMEOUT) {
+			std::vector<FileSystemEventArgs> batch = changes.Take(path, Patterns);
+			Raise(batch);
+			continue;
+		}
+		if (wait != WAIT_OBJECT_0)
+			break;
+		reading = false;
+		DWORD bytes = 0;
+		if (!GetOverlappedResult(directory, &overlapped, &bytes, FALSE) && GetLastError() != ERROR_NOTIFY_ENUM_DIR)
+			break;
+		if (bytes == 0) {
+			// The system's buffer overflowed and the changes were dropped.
+			Overflow(this);
+		}
+		else {
+			if (changes.Empty())
+				first = Clock::now();
+			last = Clock::now();
+			const uint8_t* data = reinterpret_cast<const uint8_t*>(buffer.data());
+			for (size_t offset = 0;;) {
+				const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(data + offset);
+				std::string name = narrow(info->FileName, (int)(info->FileNameLength / sizeof(WCHAR)));
+				switch (info->Action) {
+				case FILE_ACTION_ADDED: changes.Created(name); break;
+				case FILE_ACTION_REMOVED: changes.Deleted(name); break;
+				case FILE_ACTION_MODIFIED: changes.Changed(name); break;
+				case FILE_ACTION_RENAMED_OLD_NAME: renamedFrom = std::move(name); break;
+				case FILE_ACTION_RENAMED_NEW_NAME:
+					if (renamedFrom.empty())
+						changes.Created(name);
+					else
+						changes.Renamed(renamedFrom, name);
+					renamedFrom.clear();
+					break;
+				}
+				if (info->NextEntryOffset == 0)
+					break;
+				offset += info->NextEntryOffset;
+			}
+		}
+		if (!Read())
+			break;
+		reading = true;
+	}
+	if (reading) {
+		DWORD bytes;
+		CancelIoEx(directory, &overlapped);
+		GetOverlappedResult(directory, &overlapped, &bytes, TRUE);
+	}
+	std::vector<FileSystemEventArgs> batch = changes.Take(path, Patterns);
+	Raise(batch);
+	running = false;
+}
+
+void FileSystemWatcher::Raise(std::vector<FileSystemEventArgs>& batch) {
+	if (batch.empty())
+		return;
+	Batch(this, batch);
+	for (const FileSystemEventArgs& e : batch) {
+		switch (e.ChangeType) {
+		case WatcherChangeTypes::Created: Created(this, e); break;
+		case WatcherChangeTypes::Changed: Changed(this, e); break;
+		case WatcherChangeTypes::Deleted: Deleted(this, e); break;
+		case WatcherChangeTypes::Renamed: Renamed(this, e); break;
+		}
+	}
+}
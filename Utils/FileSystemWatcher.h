@@ -0,0 +1,102 @@
+﻿#pragma once
+#include "defines.h"
+#include "Event.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class WatcherChangeTypes {
+	Created = 1,
+	Deleted = 2,
+	Changed = 4,
+	Renamed = 8
+};
+
+class FileSystemEventArgs : public EventArgs {
+public:
+	WatcherChangeTypes ChangeType;
+	std::string FullPath;
+	// Path relative to the watched directory.
+	std::string Name;
+	// Previous paths, for Renamed only.
+	std::string OldFullPath;
+	std::string OldName;
+};
+
+class FileSystemWatcher;
+using FileSystemEventHandler = void(FileSystemWatcher* sender, const FileSystemEventArgs& e);
+
+// Watches a directory with ReadDirectoryChangesW instead of polling
+// timestamps. Notifications are collected until the directory has been
+// quiet for the debounce interval and are coalesced per path: a file
+// created, written and closed is one Created, a temporary file created and
+// deleted again is nothing, and repeated writes are one Changed. Handlers run
+// on the watcher's own thread; subscribe and set Patterns before Start().
+//
+//     FileSystemWatcher watcher("C:\\app\\config");
+//     watcher.Patterns = { "*.json" };
+//     watcher.Changed += [](FileSystemWatcher*, const FileSystemEventArgs& e) {
+//         Reload(e.FullPath);
+//     };
+//     watcher.Start();
+class FileSystemWatcher {
+public:
+	static constexpr std::chrono::milliseconds DefaultDebounce{ 50 };
+
+	explicit FileSystemWatcher(const std::string& path, bool includeSubdirectories = true);
+	// Stops the watcher.
+	~FileSystemWatcher();
+	FileSystemWatcher(const FileSystemWatcher&) = delete;
+	FileSystemWatcher& operator=(const FileSystemWatcher&) = delete;
+
+	Event<FileSystemEventHandler> Created;
+	Event<FileSystemEventHandler> Changed;
+	Event<FileSystemEventHandler> Deleted;
+	Event<FileSystemEventHandler> Renamed;
+	// Each debounced batch as a whole, raised before its single events.
+	Event<void(FileSystemWatcher* sender, const std::vector<FileSystemEventArgs>& batch)> Batch;
+	// More changes happened than the system could buffer, so some were
+	// lost; rescan what matters.
+	Event<void(FileSystemWatcher* sender)> Overflow;
+
+	// Wildcards the last path component must match, as in
+	// WalkOptions::Patterns; a rename matches by either name. Empty matches
+	// everything.
+	std::vector<std::string> Patterns;
+
+	// Throws std::runtime_error if the directory cannot be opened. Does
+	// nothing if already running.
+	void Start();
+	// Delivers the pending batch and waits for the watcher thread. Not to be
+	// called from a handler.
+	void Stop();
+	// False after Stop() or once the directory can no longer be watched,
+	// for example because it was deleted.
+	bool IsRunning() const { return running; }
+
+	// Quiet time before a batch is delivered. Under a steady stream of
+	// changes a batch still goes out every ten intervals.
+	void SetDebounce(std::chrono::milliseconds interval) { debounce = interval; }
+	std::chrono::milliseconds Debounce() const { return debounce; }
+	const std::string& Path() const { return path; }
+	bool IncludeSubdirectories() const { return recursive; }
+
+private:
+	std::string path;
+	bool recursive;
+	std::atomic<std::chrono::milliseconds> debounce{ DefaultDebounce };
+	HANDLE directory = INVALID_HANDLE_VALUE;
+	HANDLE stopEvent = NULL;
+	// The first read is issued by Start(), so nothing after it is missed.
+	std::vector<DWORD> buffer;
+	OVERLAPPED overlapped{};
+	std::thread thread;
+	std::atomic<bool> running{ false };
+
+	bool Read();
+	void Run();
+	void Close();
+	void Raise(std::vector<FileSystemEventArgs>& batch);
+};
@@ -0,0 +1,225 @@
+﻿#include "LineReader.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+	// Newlines are located a chunk at a time and returned from a bitmap, so a
+	// short line costs a bit scan instead of a memchr call.
+	constexpr size_t Chunk = 64;
+
+	inline int TrailingZeros64(uint64_t v) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+		unsigned long index;
+		_BitScanForward64(&index, v);
+		return (int)index;
+#elif defined(_MSC_VER)
+		unsigned long index;
+		if (_BitScanForward(&index, (unsigned long)v))
+			return (int)index;
+		_BitScanForward(&index, (unsigned long)(v >> 32));
+		return (int)index + 32;
+#else
+		return __builtin_ctzll(v);
+#endif
+	}
+
+	uint64_t newline_mask_scalar(const char* p, size_t n) {
+		uint64_t mask = 0;
+		for (size_t i = 0; i < n; i++)
+			mask |= (uint64_t)(p[i] == '\n') << i;
+		return mask;
+	}
+
+	uint64_t newline_mask_portable(const char* p) {
+		return newline_mask_scalar(p, Chunk);
+	}
+
+#if defined(CPU_X86)
+	CPU_TARGET("sse2") uint64_t newline_mask_sse2(const char* p) {
+		const __m128i newline = _mm_set1_epi8('\n');
+		uint64_t mask = 0;
+		for (int i = 0; i < 4; i++) {
+			const __m128i bytes = _mm_loadu_si128((const __m128i*)(p + 16 * i));
+			mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)) << (16 * i);
+		}
+		return mask;
+	}
+
+	CPU_TARGET("avx2") uint64_t newline_mask_avx2(const char* p) {
+		const __m256i newline = _mm256_set1_epi8('\n');
+		const uint32_t lo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), newline));
+		const uint32_t hi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + 32)), newline));
+		return lo | (uint64_t)hi << 32;
+	}
+#endif
+
+	typedef uint64_t(*NewlineMask)(const char* p);
+
+	NewlineMask newline_mask() {
+		static const NewlineMask kernel = [] {
+#if defined(CPU_X86)
+			if (CpuFeatures::AVX2())
+				return (NewlineMask)newline_mask_avx2;
+			if (CpuFeatures::SSE2())
+				return (NewlineMask)newline_mask_sse2;
+#endif
+			return (NewlineMask)newline_mask_portable;
+		}();
+		return kernel;
+	}
+}
+
+LineReader::LineReader(const std::string& path, uint64_t offset, uint64_t length, size_t blockSize)
+	: file(std::make_unique<FileStream>(path, FileMode::Read, FileOptions::Sequential)), fileOffset(offset) {
+	const uint64_t total = file->Length();
+	remaining = offset < total ? std::min(length, total - offset) : 0;
+	buffer.resize(std::max<size_t>(blockSize, Chunk));
+	data = buffer.data();
+}
+
+LineReader LineReader::FromText(std::string_view text) {
+	LineReader reader;
+	reader.data = text.data();
+	reader.size = text.size();
+	return reader;
+}
+
+bool LineReader::Fill() {
+	if (remaining == 0 || !file)
+		return false;
+	// Keep the unfinished line, moving it to the front of the buffer; a line
+	// longer than the buffer grows it.
+	size -= position;
+	scanned -= position;
+	std::memmove(buffer.data(), buffer.data() + position, size);
+	position = 0;
+	if (size == buffer.size())
+		buffer.resize(buffer.size() * 2);
+	data = buffer.data();
+	const size_t want = (size_t)std::min<uint64_t>(buffer.size() - size, remaining);
+	const long long read = file->ReadAt(buffer.data() + size, want, fileOffset);
+	if (read <= 0) {
+		failed = read < 0;
+		remaining = 0;
+		return false;
+	}
+	fileOffset += read;
+	remaining -= read;
+	size += (size_t)read;
+	return true;
+}
+
+void LineReader::Emit(size_t end, std::string_view& line) {
+	size_t length = end - position;
+	if (length > 0 && data[position + length - 1] == '\r')
+		length--;
+	line = std::string_view(data + position, length);
+	position = end + 1;
+	lines++;
+}
+
+bool LineReader::Next(std::string_view& line) {
+	const NewlineMask scan = newline_mask();
+	for (;;) {
+		if (mask) {
+			const size_t end = chunk + TrailingZeros64(mask);
+			mask &= mask - 1;
+			Emit(end, line);
+			return true;
+		}
+		if (scanned + Chunk <= size) {
+			chunk = scanned;
+			mask = scan(data + scanned);
+			scanned += Chunk;
+			continue;
+		}
+		if (Fill())
+			continue;
+		// Input exhausted: scan the short tail, then return the last line
+		// if it has no newline.
+		if (scanned < size) {
+			chunk = scanned;
+			mask = newline_mask_scalar(data + scanned, size - scanned);
+			scanned = size;
+			continue;
+		}
+		if (position < size) {
+			Emit(size, line);
+			position = size;
+			return true;
+		}
+		return false;
+	}
+}
+
+std::vector<LineRange> LineReader::Partition(const std::string& path, size_t parts) {
+	FileStream file(path, FileMode::Read, FileOptions::RandomAccess);
+	const uint64_t total = file.Length();
+	std::vector<LineRange> ranges;
+	parts = std::max<size_t>(parts, 1);
+	std::vector<char> probe(64 * 1024);
+	uint64_t start = 0;
+	for (size_t k = 1; k < parts && start < total; k++) {
+		// The next part starts after the first newline at or past its share.
+		uint64_t at = std::max(start, total / parts * k);
+		uint64_t boundary = total;
+		while (at < total) {
+			const long long read = file.ReadAt(probe.data(), probe.size(), at);
+			if (read <= 0)
+				break;
+			if (const void* newline = std::memchr(probe.data(), '\n', (size_t)read)) {
+				boundary = at + ((const char*)newline - probe.data()) + 1;
+				break;
+			}
+			at += read;
+		}
+		if (boundary > start && boundary < total) {
+			ranges.push_back({ start, boundary - start });
+			start = boundary;
+		}
+	}
+	if (start < total || ranges.empty())
+		ranges.push_back({ start, total - start });
+	return ranges;
+}
+
+void LineReader::ParallelForEach(const std::string& path, const std::function<void(size_t part, std::string_view line)>& body, unsigned threads) {
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	// A few parts per thread even out lines of uneven cost.
+	const std::vector<LineRange> ranges = Partition(path, threads > 1 ? threads * 4 : 1);
+	std::atomic<size_t> next{ 0 };
+	std::exception_ptr error;
+	std::mutex errorLock;
+	auto worker = [&]() {
+		for (size_t part; (part = next.fetch_add(1)) < ranges.size();) {
+			try {
+				LineReader reader(path, ranges[part].Offset, ranges[part].Length);
+				std::string_view line;
+				while (reader.Next(line))
+					body(part, line);
+				if (reader.Failed())
+					throw std::runtime_error("Failed to read file");
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> guard(errorLock);
+				if (!error) error = std::current_exception();
+				next = ranges.size();
+			}
+		}
+	};
+	std::vector<std::thread> pool;
+	const size_t workers = std::min<size_t>(threads, ranges.size());
+	for (size_t t = 1; t < workers; t++)
+		pool.emplace_back(worker);
+	worker();
+	for (auto& t : pool)
+		t.join();
+	if (error) std::rethrow_exception(error);
+}
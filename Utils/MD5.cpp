@@ -1,4 +1,5 @@
 ﻿#include "MD5.h"
+#include "CpuFeatures.h"
 
 void MD5::init() {
     count[0] = count[1] = 0;
@@ -42,9 +43,23 @@ void MD5::finalize() {
 
 std::string MD5::hexdigest() const {
     if (!finalized) return "";
-    std::ostringstream result;
-    for (int i = 0; i < 16; i++) result << std::hex << std::setw(2) << std::setfill('0') << (int)digest[i];
-    return result.str();
+    return hexdigest(rawdigest());
+}
+
+MD5::Digest MD5::rawdigest() const {
+    Digest result{};
+    if (finalized) std::memcpy(result.data(), digest, sizeof(digest));
+    return result;
+}
+
+std::string MD5::hexdigest(const Digest& value) {
+    static const char hex[] = "0123456789abcdef";
+    std::string result(value.size() * 2, '\0');
+    for (size_t i = 0; i < value.size(); i++) {
+        result[2 * i] = hex[value[i] >> 4];
+        result[2 * i + 1] = hex[value[i] & 0x0f];
+    }
+    return result;
 }
 
 void MD5::transform(const uint8_t block[64]) {
@@ -76,4 +91,256 @@ void MD5::decode(uint32_t* output, const uint8_t* input, size_t length) {
     for (size_t i = 0, j = 0; j < length; i++, j += 4) {
         output[i] = input[j] | (input[j + 1] << 8) | (input[j + 2] << 16) | (input[j + 3] << 24);
     }
-}
\ No newline at end of file
+}
+
+void MD5::hash_batch(const ByteSpan* inputs, size_t count, Digest* output) {
+#if defined(CPU_X86)
+    if (count > 8 && CpuFeatures::AVX512F())
+        return hash_lanes(16, transform_x16, inputs, count, output);
+    if (count > 4 && CpuFeatures::AVX2())
+        return hash_lanes(8, transform_x8, inputs, count, output);
+    if (count > 1 && CpuFeatures::SSE2())
+        return hash_lanes(4, transform_x4, inputs, count, output);
+#endif
+    for (size_t i = 0; i < count; i++) {
+        MD5 md5;
+        md5.update(inputs[i].data(), inputs[i].size());
+        md5.finalize();
+        output[i] = md5.rawdigest();
+    }
+}
+
+std::vector<MD5::Digest> MD5::hash_batch(Span<const ByteSpan> inputs) {
+    std::vector<Digest> result(inputs.size());
+    hash_batch(inputs.data(), inputs.size(), result.data());
+    return result;
+}
+
+// Lane scheduler shared by the SIMD kernels. Each lane streams whole blocks
+// straight from its input and then one or two padded tail blocks built on the
+// side. Lane state is stored transposed: word j of lane i is state[j * lanes + i].
+void MD5::hash_lanes(size_t lanes, LaneKernel kernel, const ByteSpan* inputs, size_t count, Digest* output) {
+    struct Lane {
+        const uint8_t* data;
+        size_t blocks;
+        size_t tail_blocks;
+        size_t tail_next;
+        size_t job;
+        bool busy;
+        uint8_t tail[128];
+    };
+    static const uint8_t idle[64] = {};
+    Lane lane[16];
+    alignas(64) uint32_t state[4 * 16];
+    const uint8_t* blocks[16];
+    size_t next = 0, active = 0;
+
+    auto start = [&](size_t i) {
+        Lane& l = lane[i];
+        const size_t length = inputs[next].size();
+        const size_t rest = length % 64;
+        l.job = next++;
+        l.data = inputs[l.job].data();
+        l.blocks = length / 64;
+        l.tail_blocks = rest < 56 ? 1 : 2;
+        l.tail_next = 0;
+        l.busy = true;
+        std::memset(l.tail, 0, sizeof(l.tail));
+        if (rest) std::memcpy(l.tail, l.data + l.blocks * 64, rest);
+        l.tail[rest] = 0x80;
+        const uint64_t bits = (uint64_t)length << 3;
+        for (int b = 0; b < 8; b++) l.tail[l.tail_blocks * 64 - 8 + b] = (uint8_t)(bits >> (8 * b));
+        state[0 * lanes + i] = 0x67452301;
+        state[1 * lanes + i] = 0xefcdab89;
+        state[2 * lanes + i] = 0x98badcfe;
+        state[3 * lanes + i] = 0x10325476;
+        active++;
+    };
+    auto finish = [&](size_t i) {
+        uint8_t* out = output[lane[i].job].data();
+        for (size_t j = 0; j < 4; j++) {
+            const uint32_t v = state[j * lanes + i];
+            out[4 * j] = (uint8_t)v;
+            out[4 * j + 1] = (uint8_t)(v >> 8);
+            out[4 * j + 2] = (uint8_t)(v >> 16);
+            out[4 * j + 3] = (uint8_t)(v >> 24);
+        }
+        lane[i].busy = false;
+        active--;
+    };
+
+    for (size_t i = 0; i < lanes; i++) {
+        lane[i].busy = false;
+        if (next < count) start(i);
+    }
+    // Once the queue is drained and only a few lanes remain, a full-width
+    // kernel call costs more than finishing those lanes one block at a time.
+    while (active > 0 && (next < count || active * 4 > lanes)) {
+        for (size_t i = 0; i < lanes; i++) {
+            const Lane& l = lane[i];
+            blocks[i] = !l.busy ? idle : l.blocks ? l.data : l.tail + 64 * l.tail_next;
+        }
+        kernel(state, blocks);
+        for (size_t i = 0; i < lanes; i++) {
+            Lane& l = lane[i];
+            if (!l.busy) continue;
+            if (l.blocks) {
+                l.blocks--;
+                l.data += 64;
+            }
+            else if (++l.tail_next == l.tail_blocks) {
+                finish(i);
+                if (next < count) start(i);
+            }
+        }
+    }
+    for (size_t i = 0; i < lanes && active > 0; i++) {
+        Lane& l = lane[i];
+        if (!l.busy) continue;
+        MD5 md5;
+        for (size_t j = 0; j < 4; j++) md5.state[j] = state[j * lanes + i];
+        for (; l.blocks; l.blocks--, l.data += 64) md5.transform(l.data);
+        for (; l.tail_next < l.tail_blocks; l.tail_next++) md5.transform(l.tail + 64 * l.tail_next);
+        for (size_t j = 0; j < 4; j++) state[j * lanes + i] = md5.state[j];
+        finish(i);
+    }
+}
+
+#if defined(CPU_X86)
+namespace {
+    constexpr uint8_t md5_message_index[64] = {
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+        1, 6, 11, 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12,
+        5, 8, 11, 14, 1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15, 2,
+        0, 7, 14, 5, 12, 3, 10, 1, 8, 15, 6, 13, 4, 11, 2, 9
+    };
+
+    struct Sse2Lanes {
+        using T = __m128i;
+        static CPU_TARGET("sse2") inline T Load(const uint32_t* p) { return _mm_load_si128((const __m128i*)p); }
+        static CPU_TARGET("sse2") inline void Store(uint32_t* p, T x) { _mm_store_si128((__m128i*)p, x); }
+        static CPU_TARGET("sse2") inline T Set1(uint32_t v) { return _mm_set1_epi32((int)v); }
+        static CPU_TARGET("sse2") inline T Add(T a, T b) { return _mm_add_epi32(a, b); }
+        template<uint32_t N>
+        static CPU_TARGET("sse2") inline T Rotl(T x) { return _mm_or_si128(_mm_slli_epi32(x, N), _mm_srli_epi32(x, 32 - N)); }
+        static CPU_TARGET("sse2") inline T F(T x, T y, T z) { return _mm_xor_si128(z, _mm_and_si128(x, _mm_xor_si128(y, z))); }
+        static CPU_TARGET("sse2") inline T G(T x, T y, T z) { return _mm_xor_si128(y, _mm_and_si128(z, _mm_xor_si128(x, y))); }
+        static CPU_TARGET("sse2") inline T H(T x, T y, T z) { return _mm_xor_si128(_mm_xor_si128(x, y), z); }
+        static CPU_TARGET("sse2") inline T I(T x, T y, T z) { return _mm_xor_si128(y, _mm_or_si128(x, _mm_xor_si128(z, _mm_set1_epi32(-1)))); }
+        // 4x4 transpose: w[k] holds message word k of every lane.
+        static CPU_TARGET("sse2") inline void LoadMessage(const uint8_t* const* blocks, T w[16]) {
+            for (int k = 0; k < 16; k += 4) {
+                const T r0 = _mm_loadu_si128((const __m128i*)(blocks[0] + 4 * k));
+                const T r1 = _mm_loadu_si128((const __m128i*)(blocks[1] + 4 * k));
+                const T r2 = _mm_loadu_si128((const __m128i*)(blocks[2] + 4 * k));
+                const T r3 = _mm_loadu_si128((const __m128i*)(blocks[3] + 4 * k));
+                const T t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3);
+                const T t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3);
+                w[k] = _mm_unpacklo_epi64(t0, t1);
+                w[k + 1] = _mm_unpackhi_epi64(t0, t1);
+                w[k + 2] = _mm_unpacklo_epi64(t2, t3);
+                w[k + 3] = _mm_unpackhi_epi64(t2, t3);
+            }
+        }
+    };
+
+    // 8x8 transpose of the 32-byte rows at blocks[0..7] + offset.
+    CPU_TARGET("avx2") inline void transpose_8x8(const uint8_t* const* blocks, size_t offset, __m256i w[8]) {
+        __m256i s[8], u[8];
+        for (int i = 0; i < 8; i += 2) {
+            const __m256i r0 = _mm256_loadu_si256((const __m256i*)(blocks[i] + offset));
+            const __m256i r1 = _mm256_loadu_si256((const __m256i*)(blocks[i + 1] + offset));
+            s[i] = _mm256_unpacklo_epi32(r0, r1);
+            s[i + 1] = _mm256_unpackhi_epi32(r0, r1);
+        }
+        for (int i = 0; i < 8; i += 4) {
+            u[i] = _mm256_unpacklo_epi64(s[i], s[i + 2]);
+            u[i + 1] = _mm256_unpackhi_epi64(s[i], s[i + 2]);
+            u[i + 2] = _mm256_unpacklo_epi64(s[i + 1], s[i + 3]);
+            u[i + 3] = _mm256_unpackhi_epi64(s[i + 1], s[i + 3]);
+        }
+        for (int k = 0; k < 4; k++) {
+            w[k] = _mm256_permute2x128_si256(u[k], u[k + 4], 0x20);
+            w[k + 4] = _mm256_permute2x128_si256(u[k], u[k + 4], 0x31);
+        }
+    }
+
+    struct Avx2Lanes {
+        using T = __m256i;
+        static CPU_TARGET("avx2") inline T Load(const uint32_t* p) { return _mm256_load_si256((const __m256i*)p); }
+        static CPU_TARGET("avx2") inline void Store(uint32_t* p, T x) { _mm256_store_si256((__m256i*)p, x); }
+        static CPU_TARGET("avx2") inline T Set1(uint32_t v) { return _mm256_set1_epi32((int)v); }
+        static CPU_TARGET("avx2") inline T Add(T a, T b) { return _mm256_add_epi32(a, b); }
+        template<uint32_t N>
+        static CPU_TARGET("avx2") inline T Rotl(T x) { return _mm256_or_si256(_mm256_slli_epi32(x, N), _mm256_srli_epi32(x, 32 - N)); }
+        static CPU_TARGET("avx2") inline T F(T x, T y, T z) { return _mm256_xor_si256(z, _mm256_and_si256(x, _mm256_xor_si256(y, z))); }
+        static CPU_TARGET("avx2") inline T G(T x, T y, T z) { return _mm256_xor_si256(y, _mm256_and_si256(z, _mm256_xor_si256(x, y))); }
+        static CPU_TARGET("avx2") inline T H(T x, T y, T z) { return _mm256_xor_si256(_mm256_xor_si256(x, y), z); }
+        static CPU_TARGET("avx2") inline T I(T x, T y, T z) { return _mm256_xor_si256(y, _mm256_or_si256(x, _mm256_xor_si256(z, _mm256_set1_epi32(-1)))); }
+        static CPU_TARGET("avx2") inline void LoadMessage(const uint8_t* const* blocks, T w[16]) {
+            transpose_8x8(blocks, 0, w);
+            transpose_8x8(blocks, 32, w + 8);
+        }
+    };
+
+    struct Avx512Lanes {
+        using T = __m512i;
+        static CPU_TARGET("avx512f") inline T Load(const uint32_t* p) { return _mm512_load_si512(p); }
+        static CPU_TARGET("avx512f") inline void Store(uint32_t* p, T x) { _mm512_store_si512(p, x); }
+        static CPU_TARGET("avx512f") inline T Set1(uint32_t v) { return _mm512_set1_epi32((int)v); }
+        static CPU_TARGET("avx512f") inline T Add(T a, T b) { return _mm512_add_epi32(a, b); }
+        template<uint32_t N>
+        static CPU_TARGET("avx512f") inline T Rotl(T x) { return _mm512_rol_epi32(x, N); }
+        static CPU_TARGET("avx512f") inline T F(T x, T y, T z) { return _mm512_ternarylogic_epi32(x, y, z, 0xCA); }
+        static CPU_TARGET("avx512f") inline T G(T x, T y, T z) { return _mm512_ternarylogic_epi32(x, y, z, 0xE4); }
+        static CPU_TARGET("avx512f") inline T H(T x, T y, T z) { return _mm512_ternarylogic_epi32(x, y, z, 0x96); }
+        static CPU_TARGET("avx512f") inline T I(T x, T y, T z) { return _mm512_ternarylogic_epi32(x, y, z, 0x39); }
+        static CPU_TARGET("avx512f") inline void LoadMessage(const uint8_t* const* blocks, T w[16]) {
+            __m256i lo[16], hi[16];
+            transpose_8x8(blocks, 0, lo);
+            transpose_8x8(blocks, 32, lo + 8);
+            transpose_8x8(blocks + 8, 0, hi);
+            transpose_8x8(blocks + 8, 32, hi + 8);
+            for (int k = 0; k < 16; k++) w[k] = _mm512_inserti64x4(_mm512_castsi256_si512(lo[k]), hi[k], 1);
+        }
+    };
+}
+
+#define MD5_LANE_STEP(V, f, a, b, c, d, i) \
+    a = V::Add(b, V::Rotl<S[i]>(V::Add(V::Add(a, V::f(b, c, d)), V::Add(w[md5_message_index[i]], V::Set1(K[i])))))
+#define MD5_LANE_QUAD(V, f, i) \
+    MD5_LANE_STEP(V, f, a, b, c, d, i); \
+    MD5_LANE_STEP(V, f, d, a, b, c, i + 1); \
+    MD5_LANE_STEP(V, f, c, d, a, b, i + 2); \
+    MD5_LANE_STEP(V, f, b, c, d, a, i + 3)
+#define MD5_LANE_BLOCK(V, lanes) \
+    V::T w[16]; \
+    V::LoadMessage(blocks, w); \
+    V::T a = V::Load(state), b = V::Load(state + lanes), c = V::Load(state + 2 * lanes), d = V::Load(state + 3 * lanes); \
+    const V::T a0 = a, b0 = b, c0 = c, d0 = d; \
+    MD5_LANE_QUAD(V, F, 0); MD5_LANE_QUAD(V, F, 4); MD5_LANE_QUAD(V, F, 8); MD5_LANE_QUAD(V, F, 12); \
+    MD5_LANE_QUAD(V, G, 16); MD5_LANE_QUAD(V, G, 20); MD5_LANE_QUAD(V, G, 24); MD5_LANE_QUAD(V, G, 28); \
+    MD5_LANE_QUAD(V, H, 32); MD5_LANE_QUAD(V, H, 36); MD5_LANE_QUAD(V, H, 40); MD5_LANE_QUAD(V, H, 44); \
+    MD5_LANE_QUAD(V, I, 48); MD5_LANE_QUAD(V, I, 52); MD5_LANE_QUAD(V, I, 56); MD5_LANE_QUAD(V, I, 60); \
+    V::Store(state, V::Add(a, a0)); \
+    V::Store(state + lanes, V::Add(b, b0)); \
+    V::Store(state + 2 * lanes, V::Add(c, c0)); \
+    V::Store(state + 3 * lanes, V::Add(d, d0))
+
+CPU_TARGET("sse2") void MD5::transform_x4(uint32_t* state, const uint8_t* const* blocks) {
+    MD5_LANE_BLOCK(Sse2Lanes, 4);
+}
+CPU_TARGET("avx2") void MD5::transform_x8(uint32_t* state, const uint8_t* const* blocks) {
+    MD5_LANE_BLOCK(Avx2Lanes, 8);
+}
+CPU_TARGET("avx512f") void MD5::transform_x16(uint32_t* state, const uint8_t* const* blocks) {
+    MD5_LANE_BLOCK(Avx512Lanes, 16);
+}
+#undef MD5_LANE_BLOCK
+#undef MD5_LANE_QUAD
+#undef MD5_LANE_STEP
+#else
+void MD5::transform_x4(uint32_t*, const uint8_t* const*) {}
+void MD5::transform_x8(uint32_t*, const uint8_t* const*) {}
+void MD5::transform_x16(uint32_t*, const uint8_t* const*) {}
+#endif
@@ -4,16 +4,37 @@
 #include <cstring>
 #include <cstdint>
 #include <sstream>
+#include <array>
+#include <string>
+#include <vector>
+#include "Span.h"
 class MD5 {
 public:
+    using Digest = std::array<uint8_t, 16>;
+
     MD5() { init(); }
     void update(const uint8_t* input, size_t length);
     void finalize();
     std::string hexdigest() const;
+    Digest rawdigest() const;
+
+    static std::string hexdigest(const Digest& digest);
+
+    // Hashes independent messages side by side, one per SIMD lane: 16 with
+    // AVX-512, 8 with AVX2 and 4 with SSE2. Lanes are refilled as soon as a
+    // message finishes, so batches of mixed sizes keep every lane busy.
+    static void hash_batch(const ByteSpan* inputs, size_t count, Digest* output);
+    static std::vector<Digest> hash_batch(Span<const ByteSpan> inputs);
 
 private:
+    using LaneKernel = void (*)(uint32_t* state, const uint8_t* const* blocks);
+
     void init();
     void transform(const uint8_t block[64]);
+    static void hash_lanes(size_t lanes, LaneKernel kernel, const ByteSpan* inputs, size_t count, Digest* output);
+    static void transform_x4(uint32_t* state, const uint8_t* const* blocks);
+    static void transform_x8(uint32_t* state, const uint8_t* const* blocks);
+    static void transform_x16(uint32_t* state, const uint8_t* const* blocks);
     void encode(uint8_t* output, const uint32_t* input, size_t length);
     void decode(uint32_t* output, const uint8_t* input, size_t length);
 
@@ -0,0 +1,193 @@
+﻿#include "MemoryMappedFile.h"
+#include <Windows.h>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+struct MemoryMappedFile::Handles {
+	HANDLE file = INVALID_HANDLE_VALUE;
+	// Null for an empty file, which cannot be mapped.
+	HANDLE mapping = nullptr;
+	uint64_t size = 0;
+	bool writable = false;
+
+	~Handles() {
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	}
+};
+
+namespace {
+	DWORD allocation_granularity() {
+		static const DWORD granularity = [] {
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			return info.dwAllocationGranularity;
+		}();
+		return granularity;
+	}
+
+	// PrefetchVirtualMemory is Windows 8 and later; older systems skip the hint.
+	struct MemoryRange {
+		PVOID VirtualAddress;
+		SIZE_T NumberOfBytes;
+	};
+	typedef BOOL(WINAPI* fnPrefetchVirtualMemory)(HANDLE process, ULONG_PTR count, MemoryRange* ranges, ULONG flags);
+
+	fnPrefetchVirtualMemory prefetch_virtual_memory() {
+		static const fnPrefetchVirtualMemory prefetch = [] {
+			HMODULE kernel32 = GetModuleHandleA("kernel32.dll");
+			return kernel32 ? (fnPrefetchVirtualMemory)GetProcAddress(kernel32, "PrefetchVirtualMemory") : nullptr;
+		}();
+		return prefetch;
+	}
+
+	std::shared_ptr<MemoryMappedFile::Handles> open_file(const std::string& path, MapAccess access, DWORD disposition, DWORD flags, const uint64_t* resize) {
+		auto handles = std::make_shared<MemoryMappedFile::Handles>();
+		handles->writable = access == MapAccess::ReadWrite;
+		const DWORD desired = handles->writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+		handles->file = CreateFileA(path.c_str(), desired, FILE_SHARE_READ, nullptr, disposition, flags, nullptr);
+		if (handles->file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Failed to open file");
+		if (resize) {
+			LARGE_INTEGER end;
+			end.QuadPart = (LONGLONG)*resize;
+			if (!SetFilePointerEx(handles->file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(handles->file))
+				throw std::runtime_error("Failed to resize file");
+		}
+		LARGE_INTEGER length;
+		if (!GetFileSizeEx(handles->file, &length))
+			throw std::runtime_error("Failed to query file size");
+		handles->size = (uint64_t)length.QuadPart;
+		if (handles->size > 0) {
+			handles->mapping = CreateFileMappingA(handles->file, nullptr, handles->writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+			if (!handles->mapping)
+				throw std::runtime_error("Failed to map file");
+		}
+		return handles;
+	}
+}
+
+MemoryMappedFile::MemoryMappedFile(const std::string& path, MapAccess access, uint64_t offset, size_t length, MapAdvice advice) {
+	const DWORD flags = advice == MapAdvice::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN :
+		advice == MapAdvice::Random ? FILE_FLAG_RANDOM_ACCESS : FILE_ATTRIBUTE_NORMAL;
+	file = open_file(path, access, OPEN_EXISTING, flags, nullptr);
+	Remap(offset, length);
+	if (advice == MapAdvice::WillNeed)
+		Advise(advice);
+}
+
+MemoryMappedFile MemoryMappedFile::Create(const std::string& path, uint64_t size) {
+	return MemoryMappedFile(open_file(path, MapAccess::ReadWrite, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, &size), 0, WholeFile);
+}
+
+MemoryMappedFile::MemoryMappedFile(std::shared_ptr<Handles> file, uint64_t offset, size_t length) : file(std::move(file)) {
+	Remap(offset, length);
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+	Unmap();
+}
+
+MemoryMappedFile::MemoryMappedFile(MemoryMappedFile&& other) noexcept
+	: file(std::move(other.file)), base(other.base), view(other.view), length(other.length), offset(other.offset) {
+	other.base = nullptr;
+	other.view = nullptr;
+	other.length = 0;
+	other.offset = 0;
+}
+
+MemoryMappedFile& MemoryMappedFile::operator=(MemoryMappedFile&& other) noexcept {
+	if (this != &other) {
+		Close();
+		file = std::move(other.file);
+		std::swap(base, other.base);
+		std::swap(view, other.view);
+		std::swap(length, other.length);
+		std::swap(offset, other.offset);
+	}
+	return *this;
+}
+
+MemoryMappedFile MemoryMappedFile::Window(uint64_t offset, size_t length) const {
+	if (!file)
+		throw std::logic_error("File is not open");
+	return MemoryMappedFile(file, offset, length);
+}
+
+void MemoryMappedFile::Remap(uint64_t offset, size_t length) {
+	if (!file)
+		throw std::logic_error("File is not open");
+	if (offset > file->size)
+		throw std::out_of_range("Window starts past the end of the file");
+	length = (size_t)std::min<uint64_t>(length, file->size - offset);
+	Unmap();
+	this->offset = offset;
+	if (length == 0)
+		return;
+	// Views start on an allocation-granularity boundary; the window begins
+	// inside the first one.
+	const uint64_t aligned = offset - offset % allocation_granularity();
+	base = MapViewOfFile(file->mapping, file->writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+		(DWORD)(aligned >> 32), (DWORD)aligned, (SIZE_T)(offset - aligned + length));
+	if (!base)
+		throw std::runtime_error("Failed to map file view");
+	view = (uint8_t*)base + (offset - aligned);
+	this->length = length;
+}
+
+void MemoryMappedFile::Unmap() {
+	if (base)
+		UnmapViewOfFile(base);
+	base = nullptr;
+	view = nullptr;
+	length = 0;
+}
+
+void MemoryMappedFile::Close() {
+	Unmap();
+	offset = 0;
+	file.reset();
+}
+
+bool MemoryMappedFile::Writable() const {
+	return file && file->writable;
+}
+
+MutableByteSpan MemoryMappedFile::MutableBytes() {
+	if (!Writable())
+		throw std::logic_error("File is mapped read-only");
+	return MutableByteSpan(view, length);
+}
+
+uint64_t MemoryMappedFile::FileSize() const {
+	return file ? file->size : 0;
+}
+
+void MemoryMappedFile::Advise(MapAdvice advice, size_t offset, size_t length) const {
+	if (offset >= this->length)
+		return;
+	MemoryRange range{ view + offset, std::min(length, this->length - offset) };
+	switch (advice) {
+	case MapAdvice::WillNeed:
+		if (fnPrefetchVirtualMemory prefetch = prefetch_virtual_memory())
+			prefetch(GetCurrentProcess(), 1, &range, 0);
+		break;
+	case MapAdvice::DontNeed:
+		// Unlocking pages that are not locked fails, but still removes them
+		// from the working set; a mapped file needs nothing more.
+		VirtualUnlock(range.VirtualAddress, range.NumberOfBytes);
+		break;
+	default:
+		break;
+	}
+}
+
+void MemoryMappedFile::Flush() {
+	if (!Writable())
+		return;
+	if (base && !FlushViewOfFile(view, length))
+		throw std::runtime_error("Failed to flush file view");
+	if (!FlushFileBuffers(file->file))
+		throw std::runtime_error("Failed to flush file");
+}
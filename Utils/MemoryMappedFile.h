@@ -0,0 +1,87 @@
+﻿#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "Span.h"
+
+enum class MapAccess {
+	Read,
+	ReadWrite,
+};
+
+// Access-pattern hints. Sequential and Random are handed to the cache manager
+// when the file is opened and are ignored by Advise(); WillNeed prefetches
+// pages of a window and DontNeed trims them from the working set.
+enum class MapAdvice {
+	Normal,
+	Sequential,
+	Random,
+	WillNeed,
+	DontNeed,
+};
+
+// A file, or a window of it, mapped into memory. The bytes are read straight
+// from the page cache, so scanning, hashing or parsing a multi-GB file costs no
+// copy and no heap. Windows of one file share its handles: a worker can take
+// its own window with Window() while the file is opened only once. Empty files
+// and zero-length windows map nothing and have a null data().
+//
+//     MemoryMappedFile file("big.bin");
+//     DataPackView view(file.data(), file.size());
+class MemoryMappedFile {
+public:
+	static constexpr size_t WholeFile = SIZE_MAX;
+
+	MemoryMappedFile() = default;
+	// Maps length bytes from offset, clipped to the end of the file, or the
+	// rest of the file for WholeFile. Length 0 maps nothing and only opens the
+	// file for Window(). Throws std::runtime_error if the file cannot be
+	// opened or mapped and std::out_of_range if offset is past its end.
+	explicit MemoryMappedFile(const std::string& path, MapAccess access = MapAccess::Read, uint64_t offset = 0, size_t length = WholeFile, MapAdvice advice = MapAdvice::Normal);
+	// Creates the file, or truncates or extends it, to size bytes and maps it
+	// read-write.
+	static MemoryMappedFile Create(const std::string& path, uint64_t size);
+	~MemoryMappedFile();
+	MemoryMappedFile(MemoryMappedFile&& other) noexcept;
+	MemoryMappedFile& operator=(MemoryMappedFile&& other) noexcept;
+	MemoryMappedFile(const MemoryMappedFile&) = delete;
+	MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+	// Another window over the same file; the file stays open while any window
+	// of it is alive. Safe to call from several threads at once.
+	MemoryMappedFile Window(uint64_t offset, size_t length) const;
+	// Moves this window, keeping the file open.
+	void Remap(uint64_t offset, size_t length);
+	void Close();
+
+	bool IsOpen() const { return file != nullptr; }
+	bool Writable() const;
+	const uint8_t* data() const { return view; }
+	size_t size() const { return length; }
+	bool empty() const { return length == 0; }
+	const uint8_t* begin() const { return view; }
+	const uint8_t* end() const { return view + length; }
+	ByteSpan Bytes() const { return ByteSpan(view, length); }
+	// Throws std::logic_error for a read-only mapping.
+	MutableByteSpan MutableBytes();
+	// File offset of data()[0].
+	uint64_t Offset() const { return offset; }
+	uint64_t FileSize() const;
+
+	// Applies WillNeed or DontNeed to [offset, offset + length) of this window.
+	void Advise(MapAdvice advice, size_t offset = 0, size_t length = WholeFile) const;
+	// Writes dirty pages of this window back and flushes the file to disk.
+	void Flush();
+
+	struct Handles;
+
+private:
+	std::shared_ptr<Handles> file;
+	void* base = nullptr;
+	uint8_t* view = nullptr;
+	size_t length = 0;
+	uint64_t offset = 0;
+
+	MemoryMappedFile(std::shared_ptr<Handles> file, uint64_t offset, size_t length);
+	void Unmap();
+};
@@ -0,0 +1,226 @@
+﻿#include "MerkleTree.h"
+#include "MemoryMappedFile.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+	// Leaves are hashed in runs of about this many bytes; a file source maps
+	// one window per run, so memory use stays bounded for any file size.
+	constexpr uint64_t RunBytes = 64ull << 20;
+	// Inner nodes are cheap, so levels are split into larger runs.
+	constexpr size_t NodeRun = 16384;
+
+	void parallel_for(size_t count, unsigned threads, const std::function<void(size_t)>& body) {
+		if (threads <= 1 || count <= 1) {
+			for (size_t i = 0; i < count; i++)
+				body(i);
+			return;
+		}
+		std::atomic<size_t> next{ 0 };
+		std::exception_ptr error;
+		std::mutex errorLock;
+		auto worker = [&]() {
+			for (size_t i; (i = next.fetch_add(1)) < count;) {
+				try {
+					body(i);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> guard(errorLock);
+					if (!error) error = std::current_exception();
+					next = count;
+				}
+			}
+		};
+		std::vector<std::thread> pool;
+		const size_t workers = std::min<size_t>(threads, count);
+		for (size_t t = 1; t < workers; t++)
+			pool.emplace_back(worker);
+		worker();
+		for (auto& t : pool)
+			t.join();
+		if (error) std::rethrow_exception(error);
+	}
+
+	MerkleTree::Digest hash_leaf(const uint8_t* data, size_t length) {
+		static const uint8_t prefix = 0x00;
+		SHA256 sha256;
+		sha256.update(&prefix, 1);
+		sha256.update(data, length);
+		sha256.finalize();
+		return sha256.rawdigest();
+	}
+
+	MerkleTree::Digest hash_node(const MerkleTree::Digest& left, const MerkleTree::Digest& right) {
+		uint8_t node[1 + 2 * sizeof(MerkleTree::Digest)];
+		node[0] = 0x01;
+		std::memcpy(node + 1, left.data(), left.size());
+		std::memcpy(node + 1 + left.size(), right.data(), right.size());
+		SHA256 sha256;
+		sha256.update(node, sizeof(node));
+		sha256.finalize();
+		return sha256.rawdigest();
+	}
+
+	// Sorts ranges and merges overlapping or adjacent ones, dropping anything
+	// at or beyond limit.
+	template<typename Range>
+	void normalize(std::vector<Range>& ranges, size_t limit) {
+		for (auto& r : ranges)
+			r.last = std::min(r.last, limit);
+		ranges.erase(std::remove_if(ranges.begin(), ranges.end(), [](const Range& r) { return r.first >= r.last; }), ranges.end());
+		std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) { return a.first < b.first; });
+		size_t out = 0;
+		for (size_t i = 0; i < ranges.size(); i++) {
+			if (out > 0 && ranges[i].first <= ranges[out - 1].last)
+				ranges[out - 1].last = std::max(ranges[out - 1].last, ranges[i].last);
+			else
+				ranges[out++] = ranges[i];
+		}
+		ranges.resize(out);
+	}
+
+	struct MemorySource {
+		struct View {
+			const uint8_t* ptr;
+			const uint8_t* data() const { return ptr; }
+		};
+		const uint8_t* base;
+		View Map(uint64_t offset, size_t) const { return View{ base + offset }; }
+	};
+
+	// Read-only file mapping handing out one window per run of leaves.
+	class FileSource {
+	public:
+		explicit FileSource(const std::string& path) : file(path, MapAccess::Read, 0, 0, MapAdvice::Sequential) {}
+
+		uint64_t Size() const { return file.FileSize(); }
+		MemoryMappedFile Map(uint64_t offset, size_t length) const { return file.Window(offset, length); }
+
+	private:
+		MemoryMappedFile file;
+	};
+}
+
+MerkleTree::MerkleTree(size_t leafSize, unsigned threads) : leafSize(leafSize), threads(threads) {
+	if (leafSize == 0)
+		throw std::invalid_argument("Leaf size must be positive");
+	if (this->threads == 0)
+		this->threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+void MerkleTree::Resize(uint64_t newSize) {
+	const size_t leaves = newSize == 0 ? 1 : (size_t)((newSize - 1) / leafSize + 1);
+	size_t depth = 1;
+	for (size_t n = leaves; n > 1; n = (n + 1) / 2)
+		depth++;
+	levels.resize(depth);
+	for (size_t i = 0, n = leaves; i < depth; i++, n = (n + 1) / 2)
+		levels[i].resize(n);
+	size = newSize;
+}
+
+template<typename Source>
+void MerkleTree::Rehash(const Source& source, uint64_t newSize, std::vector<LeafRange> dirty) {
+	const size_t oldCount = LeafCount();
+	const uint64_t oldSize = size;
+	Resize(newSize);
+	const size_t count = LeafCount();
+	if (oldCount == 0)
+		dirty.assign(1, { 0, count });
+	else if (newSize != oldSize)
+		dirty.push_back({ std::min(oldCount, count) - 1, count });
+	normalize(dirty, count);
+
+	std::vector<LeafRange> runs;
+	const size_t perRun = (size_t)std::max<uint64_t>(1, RunBytes / leafSize);
+	for (const auto& r : dirty)
+		for (size_t first = r.first; first < r.last; first += perRun)
+			runs.push_back({ first, std::min(r.last, first + perRun) });
+	parallel_for(runs.size(), threads, [&](size_t k) {
+		const LeafRange& r = runs[k];
+		const uint64_t begin = (uint64_t)r.first * leafSize;
+		const uint64_t end = std::min<uint64_t>((uint64_t)r.last * leafSize, size);
+		auto view = source.Map(begin, (size_t)(end - begin));
+		for (size_t i = r.first; i < r.last; i++) {
+			const uint64_t offset = (uint64_t)i * leafSize;
+			const size_t length = (size_t)std::min<uint64_t>(leafSize, size - offset);
+			levels[0][i] = hash_leaf(view.data() + (offset - begin), length);
+		}
+	});
+
+	for (size_t level = 1; level < levels.size(); level++) {
+		const std::vector<Digest>& below = levels[level - 1];
+		std::vector<Digest>& nodes = levels[level];
+		for (auto& r : dirty) {
+			r.first /= 2;
+			r.last = (r.last + 1) / 2;
+		}
+		normalize(dirty, nodes.size());
+		runs.clear();
+		for (const auto& r : dirty)
+			for (size_t first = r.first; first < r.last; first += NodeRun)
+				runs.push_back({ first, std::min(r.last, first + NodeRun) });
+		parallel_for(runs.size(), threads, [&](size_t k) {
+			for (size_t j = runs[k].first; j < runs[k].last; j++)
+				nodes[j] = 2 * j + 1 < below.size() ? hash_node(below[2 * j], below[2 * j + 1]) : below[2 * j];
+		});
+	}
+}
+
+void MerkleTree::Build(const void* data, size_t size) {
+	levels.clear();
+	this->size = 0;
+	Rehash(MemorySource{ (const uint8_t*)data }, size, {});
+}
+
+void MerkleTree::BuildFile(const std::string& path) {
+	FileSource source(path);
+	levels.clear();
+	size = 0;
+	Rehash(source, source.Size(), {});
+}
+
+void MerkleTree::Update(const void* data, size_t size, uint64_t offset, uint64_t length) {
+	if (levels.empty())
+		return Build(data, size);
+	std::vector<LeafRange> dirty;
+	if (length > 0 && offset < size)
+		dirty.push_back({ (size_t)(offset / leafSize), (size_t)((std::min<uint64_t>(offset + length, size) - 1) / leafSize + 1) });
+	Rehash(MemorySource{ (const uint8_t*)data }, size, std::move(dirty));
+}
+
+void MerkleTree::UpdateFile(const std::string& path, uint64_t offset, uint64_t length) {
+	if (levels.empty())
+		return BuildFile(path);
+	FileSource source(path);
+	std::vector<LeafRange> dirty;
+	if (length > 0 && offset < source.Size())
+		dirty.push_back({ (size_t)(offset / leafSize), (size_t)((std::min(offset + length, source.Size()) - 1) / leafSize + 1) });
+	Rehash(source, source.Size(), std::move(dirty));
+}
+
+MerkleTree::Digest MerkleTree::Root() const {
+	return levels.empty() ? Digest{} : levels.back()[0];
+}
+
+std::string MerkleTree::HexRoot() const {
+	return SHA256::hexdigest(Root());
+}
+
+MerkleTree::Digest MerkleTree::Hash(const void* data, size_t size, size_t leafSize, unsigned threads) {
+	MerkleTree tree(leafSize, threads);
+	tree.Build(data, size);
+	return tree.Root();
+}
+
+MerkleTree::Digest MerkleTree::HashFile(const std::string& path, size_t leafSize, unsigned threads) {
+	MerkleTree tree(leafSize, threads);
+	tree.BuildFile(path);
+	return tree.Root();
+}
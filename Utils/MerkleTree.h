@@ -0,0 +1,55 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "SHA256.h"
+
+// SHA256 Merkle tree over fixed-size leaves, hashed on all cores.
+// Leaf i covers bytes [i * LeafSize, (i + 1) * LeafSize); the last leaf may be
+// short and empty input is a single empty leaf. Leaves hash as
+// SHA256(0x00 || data), inner nodes as SHA256(0x01 || left || right), and an
+// unpaired node at the end of a level moves up unchanged (the RFC 6962 shape).
+// The root therefore depends only on the content and the leaf size, never on
+// the thread count.
+class MerkleTree {
+public:
+	using Digest = SHA256::Digest;
+	static constexpr size_t DefaultLeafSize = 1 << 20;
+
+	// threads = 0 uses every hardware thread.
+	explicit MerkleTree(size_t leafSize = DefaultLeafSize, unsigned threads = 0);
+
+	void Build(const void* data, size_t size);
+	void BuildFile(const std::string& path);
+	// Re-hashes the leaves overlapping [offset, offset + length) and their
+	// ancestors; data/path is the complete new content. A change in size also
+	// re-hashes the old and new trailing leaves.
+	void Update(const void* data, size_t size, uint64_t offset, uint64_t length);
+	void UpdateFile(const std::string& path, uint64_t offset, uint64_t length);
+
+	Digest Root() const;
+	std::string HexRoot() const;
+	size_t LeafSize() const { return leafSize; }
+	size_t LeafCount() const { return levels.empty() ? 0 : levels[0].size(); }
+	uint64_t Size() const { return size; }
+	const Digest& Leaf(size_t index) const { return levels[0][index]; }
+
+	static Digest Hash(const void* data, size_t size, size_t leafSize = DefaultLeafSize, unsigned threads = 0);
+	static Digest HashFile(const std::string& path, size_t leafSize = DefaultLeafSize, unsigned threads = 0);
+
+private:
+	struct LeafRange {
+		size_t first;
+		size_t last;
+	};
+
+	size_t leafSize;
+	unsigned threads;
+	uint64_t size = 0;
+	// levels[0] holds the leaves and levels.back() the single root.
+	std::vector<std::vector<Digest>> levels;
+
+	template<typename Source>
+	void Rehash(const Source& source, uint64_t newSize, std::vector<LeafRange> dirty);
+	void Resize(uint64_t newSize);
+};
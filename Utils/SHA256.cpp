@@ -1,5 +1,5 @@
 ﻿#include "SHA256.h"
-#include <sstream>
+#include "CpuFeatures.h"
 void SHA256::init() {
     count[0] = count[1] = 0;
     state[0] = 0x6a09e667;
@@ -22,8 +22,10 @@ void SHA256::update(const uint8_t* input, size_t length) {
     size_t i = 0;
     if (length >= first_part) {
         std::memcpy(&buffer[index], input, first_part);
-        transform(buffer);
-        for (i = first_part; i + 63 < length; i += 64) transform(&input[i]);
+        transform_blocks(buffer, 1);
+        size_t blocks = (length - first_part) / 64;
+        transform_blocks(&input[first_part], blocks);
+        i = first_part + blocks * 64;
         index = 0;
     }
     std::memcpy(&buffer[index], &input[i], length - i);
@@ -55,9 +57,34 @@ void SHA256::finalize() {
 
 std::string SHA256::hexdigest() const {
     if (!finalized) return "";
-    std::ostringstream result;
-    for (int i = 0; i < 32; i++) result << std::hex << std::setw(2) << std::setfill('0') << (int)digest[i];
-    return result.str();
+    return hexdigest(rawdigest());
+}
+
+SHA256::Digest SHA256::rawdigest() const {
+    Digest result{};
+    if (finalized) std::memcpy(result.data(), digest, sizeof(digest));
+    return result;
+}
+
+std::string SHA256::hexdigest(const Digest& value) {
+    static const char hex[] = "0123456789abcdef";
+    std::string result(value.size() * 2, '\0');
+    for (size_t i = 0; i < value.size(); i++) {
+        result[2 * i] = hex[value[i] >> 4];
+        result[2 * i + 1] = hex[value[i] & 0x0f];
+    }
+    return result;
+}
+
+void SHA256::transform_blocks(const uint8_t* data, size_t blocks) {
+#if defined(CPU_X86)
+    static const bool shani = CpuFeatures::SHA() && CpuFeatures::SSE41();
+    if (shani) {
+        transform_shani(state, data, blocks);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < blocks; i++) transform(data + 64 * i);
 }
 
 void SHA256::transform(const uint8_t block[64]) {
@@ -114,4 +141,271 @@ void SHA256::decode(uint32_t* output, const uint8_t* input, size_t length) {
     for (size_t i = 0, j = 0; j < length; i++, j += 4) {
         output[i] = (input[j] << 24) | (input[j + 1] << 16) | (input[j + 2] << 8) | input[j + 3];
     }
-}
\ No newline at end of file
+}
+
+void SHA256::hash_batch(const ByteSpan* inputs, size_t count, Digest* output) {
+#if defined(CPU_X86)
+    // One SHA-NI stream is faster per message than a lane of either
+    // multi-buffer kernel, so the lanes are only used without it.
+    if (!CpuFeatures::SHA()) {
+        if (count > 8 && CpuFeatures::AVX512F())
+            return hash_lanes(16, transform_x16, inputs, count, output);
+        if (count > 1 && CpuFeatures::AVX2())
+            return hash_lanes(8, transform_x8, inputs, count, output);
+    }
+#endif
+    for (size_t i = 0; i < count; i++) {
+        SHA256 sha256;
+        sha256.update(inputs[i].data(), inputs[i].size());
+        sha256.finalize();
+        output[i] = sha256.rawdigest();
+    }
+}
+
+std::vector<SHA256::Digest> SHA256::hash_batch(Span<const ByteSpan> inputs) {
+    std::vector<Digest> result(inputs.size());
+    hash_batch(inputs.data(), inputs.size(), result.data());
+    return result;
+}
+
+// Lane scheduler shared by the SIMD kernels, see MD5::hash_lanes. Lane state
+// is stored transposed: word j of lane i is state[j * lanes + i].
+void SHA256::hash_lanes(size_t lanes, LaneKernel kernel, const ByteSpan* inputs, size_t count, Digest* output) {
+    struct Lane {
+        const uint8_t* data;
+        size_t blocks;
+        size_t tail_blocks;
+        size_t tail_next;
+        size_t job;
+        bool busy;
+        uint8_t tail[128];
+    };
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    static const uint8_t idle[64] = {};
+    Lane lane[16];
+    alignas(64) uint32_t state[8 * 16];
+    const uint8_t* blocks[16];
+    size_t next = 0, active = 0;
+
+    auto start = [&](size_t i) {
+        Lane& l = lane[i];
+        const size_t length = inputs[next].size();
+        const size_t rest = length % 64;
+        l.job = next++;
+        l.data = inputs[l.job].data();
+        l.blocks = length / 64;
+        l.tail_blocks = rest < 56 ? 1 : 2;
+        l.tail_next = 0;
+        l.busy = true;
+        std::memset(l.tail, 0, sizeof(l.tail));
+        if (rest) std::memcpy(l.tail, l.data + l.blocks * 64, rest);
+        l.tail[rest] = 0x80;
+        const uint64_t bits = (uint64_t)length << 3;
+        for (int b = 0; b < 8; b++) l.tail[l.tail_blocks * 64 - 1 - b] = (uint8_t)(bits >> (8 * b));
+        for (size_t j = 0; j < 8; j++) state[j * lanes + i] = initial[j];
+        active++;
+    };
+    auto finish = [&](size_t i) {
+        uint8_t* out = output[lane[i].job].data();
+        for (size_t j = 0; j < 8; j++) {
+            const uint32_t v = state[j * lanes + i];
+            out[4 * j] = (uint8_t)(v >> 24);
+            out[4 * j + 1] = (uint8_t)(v >> 16);
+            out[4 * j + 2] = (uint8_t)(v >> 8);
+            out[4 * j + 3] = (uint8_t)v;
+        }
+        lane[i].busy = false;
+        active--;
+    };
+
+    for (size_t i = 0; i < lanes; i++) {
+        lane[i].busy = false;
+        if (next < count) start(i);
+    }
+    while (active > 0 && (next < count || active * 4 > lanes)) {
+        for (size_t i = 0; i < lanes; i++) {
+            const Lane& l = lane[i];
+            blocks[i] = !l.busy ? idle : l.blocks ? l.data : l.tail + 64 * l.tail_next;
+        }
+        kernel(state, blocks);
+        for (size_t i = 0; i < lanes; i++) {
+            Lane& l = lane[i];
+            if (!l.busy) continue;
+            if (l.blocks) {
+                l.blocks--;
+                l.data += 64;
+            }
+            else if (++l.tail_next == l.tail_blocks) {
+                finish(i);
+                if (next < count) start(i);
+            }
+        }
+    }
+    for (size_t i = 0; i < lanes && active > 0; i++) {
+        Lane& l = lane[i];
+        if (!l.busy) continue;
+        SHA256 sha256;
+        for (size_t j = 0; j < 8; j++) sha256.state[j] = state[j * lanes + i];
+        sha256.transform_blocks(l.data, l.blocks);
+        sha256.transform_blocks(l.tail + 64 * l.tail_next, l.tail_blocks - l.tail_next);
+        for (size_t j = 0; j < 8; j++) state[j * lanes + i] = sha256.state[j];
+        finish(i);
+    }
+}
+
+#if defined(CPU_X86)
+// Single-stream compression with the SHA extensions. The state is kept in
+// the ABEF/CDGH register layout that sha256rnds2 expects across all blocks.
+CPU_TARGET("sha,sse4.1") void SHA256::transform_shani(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; blocks; blocks--, data += 64) {
+        const __m128i abef = state0, cdgh = state1;
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), mask);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), mask);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), mask);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), mask);
+        __m128i m;
+        // Four rounds per group; the schedule for later groups is computed
+        // with sha256msg1/msg2 while the rounds of the current group run.
+#define SHA256_NI_GROUP(g, cur, prev, next) \
+        m = _mm_add_epi32(cur, _mm_loadu_si128((const __m128i*)&K[4 * g])); \
+        state1 = _mm_sha256rnds2_epu32(state1, state0, m); \
+        if (g >= 3 && g <= 14) next = _mm_sha256msg2_epu32(_mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4)), cur); \
+        state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E)); \
+        if (g >= 1 && g <= 12) prev = _mm_sha256msg1_epu32(prev, cur)
+        SHA256_NI_GROUP(0, m0, m3, m1);
+        SHA256_NI_GROUP(1, m1, m0, m2);
+        SHA256_NI_GROUP(2, m2, m1, m3);
+        SHA256_NI_GROUP(3, m3, m2, m0);
+        SHA256_NI_GROUP(4, m0, m3, m1);
+        SHA256_NI_GROUP(5, m1, m0, m2);
+        SHA256_NI_GROUP(6, m2, m1, m3);
+        SHA256_NI_GROUP(7, m3, m2, m0);
+        SHA256_NI_GROUP(8, m0, m3, m1);
+        SHA256_NI_GROUP(9, m1, m0, m2);
+        SHA256_NI_GROUP(10, m2, m1, m3);
+        SHA256_NI_GROUP(11, m3, m2, m0);
+        SHA256_NI_GROUP(12, m0, m3, m1);
+        SHA256_NI_GROUP(13, m1, m0, m2);
+        SHA256_NI_GROUP(14, m2, m1, m3);
+        SHA256_NI_GROUP(15, m3, m2, m0);
+#undef SHA256_NI_GROUP
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i*)&state[0], state0);
+    _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+namespace {
+    // 8x8 transpose of the 32-byte rows at blocks[0..7] + offset, converting
+    // the big-endian message words to native order on the way.
+    CPU_TARGET("avx2") inline void transpose_8x8_be(const uint8_t* const* blocks, size_t offset, __m256i w[8]) {
+        const __m256i swap = _mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL, 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+        __m256i s[8], u[8];
+        for (int i = 0; i < 8; i += 2) {
+            const __m256i r0 = _mm256_loadu_si256((const __m256i*)(blocks[i] + offset));
+            const __m256i r1 = _mm256_loadu_si256((const __m256i*)(blocks[i + 1] + offset));
+            s[i] = _mm256_unpacklo_epi32(r0, r1);
+            s[i + 1] = _mm256_unpackhi_epi32(r0, r1);
+        }
+        for (int i = 0; i < 8; i += 4) {
+            u[i] = _mm256_unpacklo_epi64(s[i], s[i + 2]);
+            u[i + 1] = _mm256_unpackhi_epi64(s[i], s[i + 2]);
+            u[i + 2] = _mm256_unpacklo_epi64(s[i + 1], s[i + 3]);
+            u[i + 3] = _mm256_unpackhi_epi64(s[i + 1], s[i + 3]);
+        }
+        for (int k = 0; k < 4; k++) {
+            w[k] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[k], u[k + 4], 0x20), swap);
+            w[k + 4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[k], u[k + 4], 0x31), swap);
+        }
+    }
+
+    struct Avx2Lanes {
+        using T = __m256i;
+        static CPU_TARGET("avx2") inline T Load(const uint32_t* p) { return _mm256_load_si256((const __m256i*)p); }
+        static CPU_TARGET("avx2") inline void Store(uint32_t* p, T x) { _mm256_store_si256((__m256i*)p, x); }
+        static CPU_TARGET("avx2") inline T Set1(uint32_t v) { return _mm256_set1_epi32((int)v); }
+        static CPU_TARGET("avx2") inline T Add(T a, T b) { return _mm256_add_epi32(a, b); }
+        template<uint32_t N>
+        static CPU_TARGET("avx2") inline T Rotr(T x) { return _mm256_or_si256(_mm256_srli_epi32(x, N), _mm256_slli_epi32(x, 32 - N)); }
+        template<uint32_t N>
+        static CPU_TARGET("avx2") inline T Shr(T x) { return _mm256_srli_epi32(x, N); }
+        static CPU_TARGET("avx2") inline T Xor3(T a, T b, T c) { return _mm256_xor_si256(_mm256_xor_si256(a, b), c); }
+        static CPU_TARGET("avx2") inline T Choice(T x, T y, T z) { return _mm256_xor_si256(z, _mm256_and_si256(x, _mm256_xor_si256(y, z))); }
+        static CPU_TARGET("avx2") inline T Majority(T x, T y, T z) { return _mm256_or_si256(_mm256_and_si256(x, y), _mm256_and_si256(z, _mm256_or_si256(x, y))); }
+        static CPU_TARGET("avx2") inline void LoadMessage(const uint8_t* const* blocks, T w[16]) {
+            transpose_8x8_be(blocks, 0, w);
+            transpose_8x8_be(blocks, 32, w + 8);
+        }
+    };
+
+    struct Avx512Lanes {
+        using T = __m512i;
+        static CPU_TARGET("avx512f") inline T Load(const uint32_t* p) { return _mm512_load_si512(p); }
+        static CPU_TARGET("avx512f") inline void Store(uint32_t* p, T x) { _mm512_store_si512(p, x); }
+        static CPU_TARGET("avx512f") inline T Set1(uint32_t v) { return _mm512_set1_epi32((int)v); }
+        static CPU_TARGET("avx512f") inline T Add(T a, T b) { return _mm512_add_epi32(a, b); }
+        template<uint32_t N>
+        static CPU_TARGET("avx512f") inline T Rotr(T x) { return _mm512_ror_epi32(x, N); }
+        template<uint32_t N>
+        static CPU_TARGET("avx512f") inline T Shr(T x) { return _mm512_srli_epi32(x, N); }
+        static CPU_TARGET("avx512f") inline T Xor3(T a, T b, T c) { return _mm512_ternarylogic_epi32(a, b, c, 0x96); }
+        static CPU_TARGET("avx512f") inline T Choice(T x, T y, T z) { return _mm512_ternarylogic_epi32(x, y, z, 0xCA); }
+        static CPU_TARGET("avx512f") inline T Majority(T x, T y, T z) { return _mm512_ternarylogic_epi32(x, y, z, 0xE8); }
+        static CPU_TARGET("avx512f") inline void LoadMessage(const uint8_t* const* blocks, T w[16]) {
+            __m256i lo[16], hi[16];
+            transpose_8x8_be(blocks, 0, lo);
+            transpose_8x8_be(blocks, 32, lo + 8);
+            transpose_8x8_be(blocks + 8, 0, hi);
+            transpose_8x8_be(blocks + 8, 32, hi + 8);
+            for (int k = 0; k < 16; k++) w[k] = _mm512_inserti64x4(_mm512_castsi256_si512(lo[k]), hi[k], 1);
+        }
+    };
+}
+
+// The message schedule is kept in a 16-entry ring instead of all 64 words.
+#define SHA256_LANE_BLOCK(V, lanes) \
+    V::T w[16]; \
+    V::LoadMessage(blocks, w); \
+    V::T s[8], v[8]; \
+    for (int j = 0; j < 8; j++) s[j] = v[j] = V::Load(state + j * lanes); \
+    for (int i = 0; i < 64; i++) { \
+        if (i >= 16) { \
+            const V::T w2 = w[(i - 2) & 15], w15 = w[(i - 15) & 15]; \
+            w[i & 15] = V::Add(V::Add(w[i & 15], w[(i - 7) & 15]), V::Add( \
+                V::Xor3(V::Rotr<17>(w2), V::Rotr<19>(w2), V::Shr<10>(w2)), \
+                V::Xor3(V::Rotr<7>(w15), V::Rotr<18>(w15), V::Shr<3>(w15)))); \
+        } \
+        const V::T t1 = V::Add(V::Add(v[7], V::Xor3(V::Rotr<6>(v[4]), V::Rotr<11>(v[4]), V::Rotr<25>(v[4]))), \
+            V::Add(V::Choice(v[4], v[5], v[6]), V::Add(V::Set1(K[i]), w[i & 15]))); \
+        const V::T t2 = V::Add(V::Xor3(V::Rotr<2>(v[0]), V::Rotr<13>(v[0]), V::Rotr<22>(v[0])), V::Majority(v[0], v[1], v[2])); \
+        v[7] = v[6]; v[6] = v[5]; v[5] = v[4]; v[4] = V::Add(v[3], t1); \
+        v[3] = v[2]; v[2] = v[1]; v[1] = v[0]; v[0] = V::Add(t1, t2); \
+    } \
+    for (int j = 0; j < 8; j++) V::Store(state + j * lanes, V::Add(v[j], s[j]))
+
+CPU_TARGET("avx2") void SHA256::transform_x8(uint32_t* state, const uint8_t* const* blocks) {
+    SHA256_LANE_BLOCK(Avx2Lanes, 8);
+}
+CPU_TARGET("avx512f") void SHA256::transform_x16(uint32_t* state, const uint8_t* const* blocks) {
+    SHA256_LANE_BLOCK(Avx512Lanes, 16);
+}
+#undef SHA256_LANE_BLOCK
+#else
+void SHA256::transform_shani(uint32_t*, const uint8_t*, size_t) {}
+void SHA256::transform_x8(uint32_t*, const uint8_t* const*) {}
+void SHA256::transform_x16(uint32_t*, const uint8_t* const*) {}
+#endif
@@ -0,0 +1,64 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+template<typename T>
+class Span;
+
+template<typename T>
+struct IsSpan : std::false_type {};
+template<typename T>
+struct IsSpan<Span<T>> : std::true_type {};
+
+// Non-owning view over a contiguous range, a C++17 stand-in for std::span.
+// Any container exposing data()/size() with a compatible element type converts
+// implicitly, so std::vector, std::array and other Spans can be passed directly.
+// Only named containers convert: a view of a temporary vector would dangle as
+// soon as the statement ends. Spans are views themselves and convert either way.
+template<typename T>
+class Span {
+public:
+	using element_type = T;
+	using value_type = std::remove_cv_t<T>;
+	using iterator = T*;
+
+	constexpr Span() noexcept : ptr(nullptr), len(0) {}
+	constexpr Span(T* data, size_t size) noexcept : ptr(data), len(size) {}
+	template<size_t N>
+	constexpr Span(T(&arr)[N]) noexcept : ptr(arr), len(N) {}
+	template<typename C, typename = std::enable_if_t<
+		!std::is_array_v<std::remove_reference_t<C>> &&
+		(std::is_lvalue_reference_v<C> || IsSpan<std::remove_cv_t<C>>::value) &&
+		std::is_convertible_v<decltype(std::declval<C&>().data()), T*>>>
+	constexpr Span(C&& c) noexcept : ptr(c.data()), len(c.size()) {}
+
+	constexpr T* data() const noexcept { return ptr; }
+	constexpr size_t size() const noexcept { return len; }
+	constexpr size_t size_bytes() const noexcept { return len * sizeof(T); }
+	constexpr bool empty() const noexcept { return len == 0; }
+	constexpr T& operator[](size_t i) const noexcept { return ptr[i]; }
+	constexpr T* begin() const noexcept { return ptr; }
+	constexpr T* end() const noexcept { return ptr + len; }
+
+	constexpr Span first(size_t count) const noexcept { return Span(ptr, count); }
+	constexpr Span last(size_t count) const noexcept { return Span(ptr + len - count, count); }
+	constexpr Span subspan(size_t offset, size_t count = (size_t)-1) const noexcept {
+		return Span(ptr + offset, count == (size_t)-1 ? len - offset : count);
+	}
+
+private:
+	T* ptr;
+	size_t len;
+};
+
+using ByteSpan = Span<const uint8_t>;
+using MutableByteSpan = Span<uint8_t>;
+
+inline ByteSpan AsBytes(const void* data, size_t size) {
+	return ByteSpan(static_cast<const uint8_t*>(data), size);
+}
+inline ByteSpan AsBytes(std::string_view text) {
+	return ByteSpan(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+}
@@ -0,0 +1,647 @@
+﻿#include "Utf.h"
+#include "CpuFeatures.h"
+#include <cstring>
+
+namespace {
+	constexpr char32_t ReplacementChar = 0xFFFD;
+
+	inline int TrailingZeros(uint32_t v) {
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, v);
+		return (int)index;
+#else
+		return __builtin_ctz(v);
+#endif
+	}
+
+	inline int PopCount(uint32_t v) {
+		v = v - ((v >> 1) & 0x55555555u);
+		v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+		return (int)((((v + (v >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24);
+	}
+
+	// Decodes one code point. consumed receives the sequence length, or on
+	// error the length of the maximal invalid subpart (at least 1).
+	inline UtfError DecodeUtf8(const uint8_t* s, size_t n, size_t& consumed, char32_t& cp) {
+		const uint8_t b0 = s[0];
+		consumed = 1;
+		if (b0 < 0x80) {
+			cp = b0;
+			return UtfError::None;
+		}
+		if (b0 < 0xC2)
+			return b0 < 0xC0 ? UtfError::TooLong : UtfError::Overlong;
+		if (b0 < 0xE0) {
+			if (n < 2 || (s[1] & 0xC0) != 0x80)
+				return UtfError::TooShort;
+			cp = ((char32_t)(b0 & 0x1F) << 6) | (s[1] & 0x3F);
+			consumed = 2;
+			return UtfError::None;
+		}
+		if (b0 < 0xF0) {
+			if (n < 2 || (s[1] & 0xC0) != 0x80)
+				return UtfError::TooShort;
+			if (b0 == 0xE0 && s[1] < 0xA0)
+				return UtfError::Overlong;
+			if (b0 == 0xED && s[1] > 0x9F)
+				return UtfError::Surrogate;
+			if (n < 3 || (s[2] & 0xC0) != 0x80) {
+				consumed = 2;
+				return UtfError::TooShort;
+			}
+			cp = ((char32_t)(b0 & 0x0F) << 12) | ((char32_t)(s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+			consumed = 3;
+			return UtfError::None;
+		}
+		if (b0 < 0xF5) {
+			if (n < 2 || (s[1] & 0xC0) != 0x80)
+				return UtfError::TooShort;
+			if (b0 == 0xF0 && s[1] < 0x90)
+				return UtfError::Overlong;
+			if (b0 == 0xF4 && s[1] > 0x8F)
+				return UtfError::TooLarge;
+			if (n < 3 || (s[2] & 0xC0) != 0x80) {
+				consumed = 2;
+				return UtfError::TooShort;
+			}
+			if (n < 4 || (s[3] & 0xC0) != 0x80) {
+				consumed = 3;
+				return UtfError::TooShort;
+			}
+			cp = ((char32_t)(b0 & 0x07) << 18) | ((char32_t)(s[1] & 0x3F) << 12) |
+				((char32_t)(s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+			consumed = 4;
+			return UtfError::None;
+		}
+		return b0 < 0xF8 ? UtfError::TooLarge : UtfError::HeaderBits;
+	}
+
+	inline char* EncodeUtf8(char* o, char32_t cp) {
+		if (cp < 0x80) {
+			*o++ = (char)cp;
+		}
+		else if (cp < 0x800) {
+			*o++ = (char)(0xC0 | (cp >> 6));
+			*o++ = (char)(0x80 | (cp & 0x3F));
+		}
+		else if (cp < 0x10000) {
+			*o++ = (char)(0xE0 | (cp >> 12));
+			*o++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+			*o++ = (char)(0x80 | (cp & 0x3F));
+		}
+		else {
+			*o++ = (char)(0xF0 | (cp >> 18));
+			*o++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+			*o++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+			*o++ = (char)(0x80 | (cp & 0x3F));
+		}
+		return o;
+	}
+
+	inline char16_t* PutCodePoint(char16_t* o, char32_t cp) {
+		if (cp < 0x10000) {
+			*o++ = (char16_t)cp;
+		}
+		else {
+			cp -= 0x10000;
+			*o++ = (char16_t)(0xD800 + (cp >> 10));
+			*o++ = (char16_t)(0xDC00 + (cp & 0x3FF));
+		}
+		return o;
+	}
+
+	inline char32_t* PutCodePoint(char32_t* o, char32_t cp) {
+		*o++ = cp;
+		return o;
+	}
+
+	// Number of leading ASCII bytes.
+	size_t AsciiPrefix(const uint8_t* s, size_t n) {
+		size_t i = 0;
+#if defined(CPU_X86)
+		for (; i + 16 <= n; i += 16) {
+			const int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(s + i)));
+			if (mask != 0)
+				return i + TrailingZeros((uint32_t)mask);
+		}
+#endif
+		while (i < n && s[i] < 0x80)
+			i++;
+		return i;
+	}
+
+	// Widens count ASCII bytes into the output code units.
+	template <typename Char>
+	inline void WidenAscii(const uint8_t* s, size_t count, Char* o) {
+		for (size_t j = 0; j < count; j++)
+			o[j] = (Char)s[j];
+	}
+
+	// Widens up to 16 leading ASCII bytes at s and returns how many were
+	// copied. Requires 16 readable bytes.
+	template <typename Char>
+	inline size_t WidenAsciiBlock(const uint8_t* s, Char* o) {
+#if defined(CPU_X86)
+		const __m128i v = _mm_loadu_si128((const __m128i*)s);
+		const int mask = _mm_movemask_epi8(v);
+		if (mask == 0) {
+			const __m128i z = _mm_setzero_si128();
+			const __m128i lo = _mm_unpacklo_epi8(v, z);
+			const __m128i hi = _mm_unpackhi_epi8(v, z);
+			if (sizeof(Char) == 2) {
+				_mm_storeu_si128((__m128i*)o, lo);
+				_mm_storeu_si128((__m128i*)(o + 8), hi);
+			}
+			else {
+				_mm_storeu_si128((__m128i*)o, _mm_unpacklo_epi16(lo, z));
+				_mm_storeu_si128((__m128i*)(o + 4), _mm_unpackhi_epi16(lo, z));
+				_mm_storeu_si128((__m128i*)(o + 8), _mm_unpacklo_epi16(hi, z));
+				_mm_storeu_si128((__m128i*)(o + 12), _mm_unpackhi_epi16(hi, z));
+			}
+			return 16;
+		}
+		const size_t count = (size_t)TrailingZeros((uint32_t)mask);
+		WidenAscii(s, count, o);
+		return count;
+#else
+		size_t count = 0;
+		while (count < 16 && s[count] < 0x80)
+			count++;
+		WidenAscii(s, count, o);
+		return count;
+#endif
+	}
+
+	template <typename Char, bool Lossy>
+	size_t DecodeUtf8Impl(const uint8_t* s, size_t n, Char* out) {
+		Char* o = out;
+		size_t i = 0;
+		while (i < n) {
+			const uint8_t b0 = s[i];
+			if (b0 < 0x80) {
+				if (i + 16 <= n) {
+					const size_t count = WidenAsciiBlock(s + i, o);
+					i += count;
+					o += count;
+				}
+				else {
+					*o++ = (Char)b0;
+					i++;
+				}
+				continue;
+			}
+			if (Lossy) {
+				size_t consumed;
+				char32_t cp;
+				if (DecodeUtf8(s + i, n - i, consumed, cp) != UtfError::None)
+					cp = ReplacementChar;
+				o = PutCodePoint(o, cp);
+				i += consumed;
+			}
+			else if (b0 < 0xE0) {
+				*o++ = (Char)(((b0 & 0x1F) << 6) | (s[i + 1] & 0x3F));
+				i += 2;
+			}
+			else if (b0 < 0xF0) {
+				*o++ = (Char)(((b0 & 0x0F) << 12) | ((s[i + 1] & 0x3F) << 6) | (s[i + 2] & 0x3F));
+				i += 3;
+			}
+			else {
+				const char32_t cp = ((char32_t)(b0 & 0x07) << 18) | ((char32_t)(s[i + 1] & 0x3F) << 12) |
+					((char32_t)(s[i + 2] & 0x3F) << 6) | (s[i + 3] & 0x3F);
+				o = PutCodePoint(o, cp);
+				i += 4;
+			}
+		}
+		return (size_t)(o - out);
+	}
+
+	UtfResult ValidateUtf8Scalar(const uint8_t* s, size_t n, size_t i) {
+		while (i < n) {
+			if (s[i] < 0x80) {
+				i += AsciiPrefix(s + i, n - i);
+				continue;
+			}
+			size_t consumed;
+			char32_t cp;
+			const UtfError err = DecodeUtf8(s + i, n - i, consumed, cp);
+			if (err != UtfError::None)
+				return { err, i };
+			i += consumed;
+		}
+		return { UtfError::None, n };
+	}
+
+#if defined(CPU_X86)
+	// Keiser-Lemire lookup validation: every byte pair is classified with
+	// three nibble table lookups whose AND is non-zero only on an error.
+	CPU_TARGET("avx2") inline __m256i Utf8Prev(__m256i input, __m256i prev, int n) {
+		const __m256i shifted = _mm256_permute2x128_si256(prev, input, 0x21);
+		switch (n) {
+		case 1: return _mm256_alignr_epi8(input, shifted, 15);
+		case 2: return _mm256_alignr_epi8(input, shifted, 14);
+		default: return _mm256_alignr_epi8(input, shifted, 13);
+		}
+	}
+
+	CPU_TARGET("avx2") inline __m256i Utf8CheckBlock(__m256i input, __m256i prevInput) {
+		constexpr uint8_t TOO_SHORT = 1 << 0;
+		constexpr uint8_t TOO_LONG = 1 << 1;
+		constexpr uint8_t OVERLONG_3 = 1 << 2;
+		constexpr uint8_t TOO_LARGE = 1 << 3;
+		constexpr uint8_t SURROGATE = 1 << 4;
+		constexpr uint8_t OVERLONG_2 = 1 << 5;
+		constexpr uint8_t TOO_LARGE_1000 = 1 << 6;
+		constexpr uint8_t OVERLONG_4 = 1 << 6;
+		constexpr uint8_t TWO_CONTS = 1 << 7;
+		constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+		const __m256i byte1HighTable = _mm256_setr_epi8(
+			TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+			TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+			TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+			(char)(TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4),
+			TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+			TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+			TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+			(char)(TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4));
+		const __m256i byte1LowTable = _mm256_setr_epi8(
+			(char)(CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4), (char)(CARRY | OVERLONG_2), (char)CARRY, (char)CARRY,
+			(char)(CARRY | TOO_LARGE), (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+			(char)(CARRY | TOO_LARGE | TOO_LARGE_1000), (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+			(char)(CARRY | TOO_LARGE | TOO_LARGE_1000), (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+			(char)(CARRY | TOO_LARGE | TOO_LARGE_1000), (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+			(char)(CARRY | TOO_LARGE | TOO_LARGE_1000), (char)(CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE),
+			(char)(CARRY | TOO_LARGE | TOO_LARGE_1000), (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+			(char)(CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4), (char)(CARRY | OVERLONG_2), (char)CARRY, (char)CARRY,
+			(char)(CARRY | TOO_LARGE), (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+			(char)(CARRY | TOO_LARGE | TOO_LARGE_1000), (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+			(char)(CARRY | TOO_LARGE | TOO_LARGE_1000), (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+			(char)(CARRY | TOO_LARGE | TOO_LARGE_1000), (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+			(char)(CARRY | TOO_LARGE | TOO_LARGE_1000), (char)(CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE),
+			(char)(CARRY | TOO_LARGE | TOO_LARGE_1000), (char)(CARRY | TOO_LARGE | TOO_LARGE_1000));
+		const __m256i byte2HighTable = _mm256_setr_epi8(
+			TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+			(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4),
+			(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE),
+			(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE),
+			(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE),
+			TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+			TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+			(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4),
+			(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE),
+			(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE),
+			(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE),
+			TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+		const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+		const __m256i prev1 = Utf8Prev(input, prevInput, 1);
+		const __m256i byte1High = _mm256_shuffle_epi8(byte1HighTable, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), lowNibble));
+		const __m256i byte1Low = _mm256_shuffle_epi8(byte1LowTable, _mm256_and_si256(prev1, lowNibble));
+		const __m256i byte2High = _mm256_shuffle_epi8(byte2HighTable, _mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibble));
+		const __m256i special = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+
+		const __m256i prev2 = Utf8Prev(input, prevInput, 2);
+		const __m256i prev3 = Utf8Prev(input, prevInput, 3);
+		const __m256i isThird = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+		const __m256i isFourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+		const __m256i must23 = _mm256_and_si256(_mm256_or_si256(isThird, isFourth), _mm256_set1_epi8((char)0x80));
+		return _mm256_xor_si256(must23, special);
+	}
+
+	CPU_TARGET("avx2") bool IsAsciiAvx2(const uint8_t* s, size_t n) {
+		__m256i acc = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 32 <= n; i += 32)
+			acc = _mm256_or_si256(acc, _mm256_loadu_si256((const __m256i*)(s + i)));
+		uint8_t rest = 0;
+		for (; i < n; i++)
+			rest |= s[i];
+		return _mm256_movemask_epi8(acc) == 0 && rest < 0x80;
+	}
+
+	// Returns the offset of the 32-byte block in which an error was first
+	// detected, or SIZE_MAX when the whole input is valid.
+	CPU_TARGET("avx2") size_t FindUtf8ErrorAvx2(const uint8_t* s, size_t n) {
+		const __m256i incompleteMax = _mm256_setr_epi8(
+			-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+			(char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+		__m256i prevInput = _mm256_setzero_si256();
+		__m256i prevIncomplete = _mm256_setzero_si256();
+		size_t i = 0;
+		for (;; i += 32) {
+			__m256i input;
+			const bool last = i + 32 > n;
+			if (!last) {
+				input = _mm256_loadu_si256((const __m256i*)(s + i));
+			}
+			else {
+				uint8_t tail[32] = { 0 };
+				// s may be null when n is 0.
+				if (n > i)
+					std::memcpy(tail, s + i, n - i);
+				input = _mm256_loadu_si256((const __m256i*)tail);
+			}
+			__m256i error;
+			if (_mm256_movemask_epi8(input) == 0) {
+				error = prevIncomplete;
+				prevIncomplete = _mm256_setzero_si256();
+			}
+			else {
+				error = Utf8CheckBlock(input, prevInput);
+				prevIncomplete = _mm256_subs_epu8(input, incompleteMax);
+			}
+			if (!_mm256_testz_si256(error, error))
+				return i;
+			prevInput = input;
+			if (last)
+				return SIZE_MAX;
+		}
+	}
+#endif
+
+	// Mode 0 stops at the first unpaired surrogate, 1 assumes valid input and
+	// 2 substitutes U+FFFD. Returns the result with Count = bytes written.
+	template <int Mode>
+	UtfResult Utf16ToUtf8Impl(const char16_t* s, size_t n, char* out) {
+		char* o = out;
+		size_t i = 0;
+		while (i < n) {
+			char32_t cp = s[i];
+			if (cp < 0x80) {
+#if defined(CPU_X86)
+				if (i + 16 <= n) {
+					const __m128i a = _mm_loadu_si128((const __m128i*)(s + i));
+					const __m128i b = _mm_loadu_si128((const __m128i*)(s + i + 8));
+					const __m128i high = _mm_and_si128(_mm_or_si128(a, b), _mm_set1_epi16((short)0xFF80));
+					if (_mm_movemask_epi8(_mm_cmpeq_epi8(high, _mm_setzero_si128())) == 0xFFFF) {
+						_mm_storeu_si128((__m128i*)o, _mm_packus_epi16(a, b));
+						i += 16;
+						o += 16;
+						continue;
+					}
+				}
+#endif
+				*o++ = (char)cp;
+				i++;
+				continue;
+			}
+			if (cp >= 0xD800 && cp <= 0xDFFF) {
+				if (cp <= 0xDBFF && i + 1 < n && s[i + 1] >= 0xDC00 && s[i + 1] <= 0xDFFF) {
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (s[i + 1] - 0xDC00);
+					i++;
+				}
+				else if (Mode == 0) {
+					return { UtfError::Surrogate, i };
+				}
+				else if (Mode == 2) {
+					cp = ReplacementChar;
+				}
+			}
+			o = EncodeUtf8(o, cp);
+			i++;
+		}
+		return { UtfError::None, (size_t)(o - out) };
+	}
+
+	template <int Mode>
+	UtfResult Utf32ToUtf8Impl(const char32_t* s, size_t n, char* out) {
+		char* o = out;
+		for (size_t i = 0; i < n; i++) {
+			char32_t cp = s[i];
+			if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+				if (Mode == 0)
+					return { cp > 0x10FFFF ? UtfError::TooLarge : UtfError::Surrogate, i };
+				cp = ReplacementChar;
+			}
+			o = EncodeUtf8(o, cp);
+		}
+		return { UtfError::None, (size_t)(o - out) };
+	}
+}
+
+bool Utf::IsAscii(const char* input, size_t length) {
+	const uint8_t* s = (const uint8_t*)input;
+	size_t i = 0;
+#if defined(CPU_X86)
+	if (length >= 64 && CpuFeatures::AVX2())
+		return IsAsciiAvx2(s, length);
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 16 <= length; i += 16)
+		acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i*)(s + i)));
+	if (_mm_movemask_epi8(acc) != 0)
+		return false;
+#endif
+	uint8_t rest = 0;
+	for (; i < length; i++)
+		rest |= s[i];
+	return rest < 0x80;
+}
+bool Utf::IsAscii(const char16_t* input, size_t length) {
+	char16_t acc = 0;
+	for (size_t i = 0; i < length; i++)
+		acc |= input[i];
+	return acc < 0x80;
+}
+UtfResult Utf::ValidateUtf8(const char* input, size_t length) {
+	const uint8_t* s = (const uint8_t*)input;
+#if defined(CPU_X86)
+	if (CpuFeatures::AVX2()) {
+		size_t block = FindUtf8ErrorAvx2(s, length);
+		if (block == SIZE_MAX)
+			return { UtfError::None, length };
+		// The error may belong to a sequence that started in the previous
+		// block, so restart the scalar scan from the preceding lead byte.
+		size_t start = block < 3 ? 0 : block - 3;
+		while (start < block && (s[start] & 0xC0) == 0x80)
+			start++;
+		return ValidateUtf8Scalar(s, length, start);
+	}
+#endif
+	return ValidateUtf8Scalar(s, length, 0);
+}
+UtfResult Utf::ValidateUtf16(const char16_t* input, size_t length) {
+	size_t i = 0;
+	while (i < length) {
+#if defined(CPU_X86)
+		if (i + 8 <= length) {
+			const __m128i v = _mm_loadu_si128((const __m128i*)(input + i));
+			const __m128i sur = _mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short)0xF800)), _mm_set1_epi16((short)0xD800));
+			if (_mm_movemask_epi8(sur) == 0) {
+				i += 8;
+				continue;
+			}
+		}
+#endif
+		const char16_t c = input[i];
+		if (c >= 0xD800 && c <= 0xDFFF) {
+			if (c > 0xDBFF || i + 1 >= length || input[i + 1] < 0xDC00 || input[i + 1] > 0xDFFF)
+				return { UtfError::Surrogate, i };
+			i += 2;
+		}
+		else {
+			i++;
+		}
+	}
+	return { UtfError::None, length };
+}
+UtfResult Utf::ValidateUtf32(const char32_t* input, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		const char32_t c = input[i];
+		if (c > 0x10FFFF)
+			return { UtfError::TooLarge, i };
+		if (c >= 0xD800 && c <= 0xDFFF)
+			return { UtfError::Surrogate, i };
+	}
+	return { UtfError::None, length };
+}
+size_t Utf::Utf16LengthFromUtf8(const char* input, size_t length) {
+	const uint8_t* s = (const uint8_t*)input;
+	size_t count = 0;
+	size_t i = 0;
+#if defined(CPU_X86)
+	const __m128i contMax = _mm_set1_epi8(-65);
+	const __m128i fourByte = _mm_set1_epi8((char)0xF0);
+	for (; i + 16 <= length; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+		const int leads = _mm_movemask_epi8(_mm_cmpgt_epi8(v, contMax));
+		const int wide = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, fourByte), v));
+		count += PopCount((uint32_t)leads) + PopCount((uint32_t)wide);
+	}
+#endif
+	for (; i < length; i++) {
+		count += (int8_t)s[i] > -65;
+		count += s[i] >= 0xF0;
+	}
+	return count;
+}
+size_t Utf::Utf32LengthFromUtf8(const char* input, size_t length) {
+	const uint8_t* s = (const uint8_t*)input;
+	size_t count = 0;
+	size_t i = 0;
+#if defined(CPU_X86)
+	const __m128i contMax = _mm_set1_epi8(-65);
+	for (; i + 16 <= length; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+		count += PopCount((uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(v, contMax)));
+	}
+#endif
+	for (; i < length; i++)
+		count += (int8_t)s[i] > -65;
+	return count;
+}
+size_t Utf::Utf8LengthFromUtf16(const char16_t* input, size_t length) {
+	size_t count = 0;
+	size_t i = 0;
+#if defined(CPU_X86)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= length; i += 8) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(input + i));
+		const int ascii = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(v, _mm_set1_epi16(0x7F)), zero));
+		const int small = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(v, _mm_set1_epi16(0x7FF)), zero));
+		const int sur = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short)0xF800)), _mm_set1_epi16((short)0xD800)));
+		// 3 bytes per unit, minus one for each unit below 0x800 or 0x80,
+		// and each surrogate half contributes 2 bytes.
+		count += 24 - (size_t)(PopCount((uint32_t)ascii) + PopCount((uint32_t)small) + PopCount((uint32_t)sur)) / 2;
+	}
+#endif
+	for (; i < length; i++) {
+		const char16_t c = input[i];
+		if (c < 0x80)
+			count += 1;
+		else if (c < 0x800)
+			count += 2;
+		else if (c >= 0xD800 && c <= 0xDFFF)
+			count += 2;
+		else
+			count += 3;
+	}
+	return count;
+}
+size_t Utf::Utf32LengthFromUtf16(const char16_t* input, size_t length) {
+	size_t count = 0;
+	for (size_t i = 0; i < length; i++)
+		count += (input[i] & 0xFC00) != 0xDC00;
+	return count;
+}
+size_t Utf::Utf8LengthFromUtf32(const char32_t* input, size_t length) {
+	size_t count = 0;
+	for (size_t i = 0; i < length; i++) {
+		const char32_t c = input[i];
+		count += 1 + (c >= 0x80) + (c >= 0x800) + (c >= 0x10000);
+	}
+	return count;
+}
+size_t Utf::Utf16LengthFromUtf32(const char32_t* input, size_t length) {
+	size_t count = 0;
+	for (size_t i = 0; i < length; i++)
+		count += 1 + (input[i] >= 0x10000);
+	return count;
+}
+UtfResult Utf::Utf8ToUtf16(const char* input, size_t length, char16_t* output) {
+	const UtfResult valid = ValidateUtf8(input, length);
+	if (!valid.Ok())
+		return valid;
+	return { UtfError::None, ValidUtf8ToUtf16(input, length, output) };
+}
+UtfResult Utf::Utf8ToUtf32(const char* input, size_t length, char32_t* output) {
+	const UtfResult valid = ValidateUtf8(input, length);
+	if (!valid.Ok())
+		return valid;
+	return { UtfError::None, ValidUtf8ToUtf32(input, length, output) };
+}
+UtfResult Utf::Utf16ToUtf8(const char16_t* input, size_t length, char* output) {
+	return Utf16ToUtf8Impl<0>(input, length, output);
+}
+UtfResult Utf::Utf16ToUtf32(const char16_t* input, size_t length, char32_t* output) {
+	char32_t* o = output;
+	for (size_t i = 0; i < length; i++) {
+		char32_t cp = input[i];
+		if (cp >= 0xD800 && cp <= 0xDFFF) {
+			if (cp > 0xDBFF || i + 1 >= length || input[i + 1] < 0xDC00 || input[i + 1] > 0xDFFF)
+				return { UtfError::Surrogate, i };
+			cp = 0x10000 + ((cp - 0xD800) << 10) + (input[i + 1] - 0xDC00);
+			i++;
+		}
+		*o++ = cp;
+	}
+	return { UtfError::None, (size_t)(o - output) };
+}
+UtfResult Utf::Utf32ToUtf8(const char32_t* input, size_t length, char* output) {
+	return Utf32ToUtf8Impl<0>(input, length, output);
+}
+UtfResult Utf::Utf32ToUtf16(const char32_t* input, size_t length, char16_t* output) {
+	char16_t* o = output;
+	for (size_t i = 0; i < length; i++) {
+		const char32_t cp = input[i];
+		if (cp > 0x10FFFF)
+			return { UtfError::TooLarge, i };
+		if (cp >= 0xD800 && cp <= 0xDFFF)
+			return { UtfError::Surrogate, i };
+		o = PutCodePoint(o, cp);
+	}
+	return { UtfError::None, (size_t)(o - output) };
+}
+size_t Utf::ValidUtf8ToUtf16(const char* input, size_t length, char16_t* output) {
+	return DecodeUtf8Impl<char16_t, false>((const uint8_t*)input, length, output);
+}
+size_t Utf::ValidUtf8ToUtf32(const char* input, size_t length, char32_t* output) {
+	return DecodeUtf8Impl<char32_t, false>((const uint8_t*)input, length, output);
+}
+size_t Utf::ValidUtf16ToUtf8(const char16_t* input, size_t length, char* output) {
+	return Utf16ToUtf8Impl<1>(input, length, output).Count;
+}
+size_t Utf::Utf8ToUtf16Lossy(const char* input, size_t length, char16_t* output) {
+	return DecodeUtf8Impl<char16_t, true>((const uint8_t*)input, length, output);
+}
+size_t Utf::Utf8ToUtf32Lossy(const char* input, size_t length, char32_t* output) {
+	return DecodeUtf8Impl<char32_t, true>((const uint8_t*)input, length, output);
+}
+size_t Utf::Utf16ToUtf8Lossy(const char16_t* input, size_t length, char* output) {
+	return Utf16ToUtf8Impl<2>(input, length, output).Count;
+}
+size_t Utf::Utf32ToUtf8Lossy(const char32_t* input, size_t length, char* output) {
+	return Utf32ToUtf8Impl<2>(input, length, output).Count;
+}
@@ -0,0 +1,61 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+
+enum class UtfError {
+	None,
+	HeaderBits,
+	TooShort,
+	TooLong,
+	Overlong,
+	TooLarge,
+	Surrogate
+};
+
+// Error is None on success and Count is the number of code units written (or
+// validated). On failure Count is the offset of the first invalid input unit.
+struct UtfResult {
+	UtfError Error = UtfError::None;
+	size_t Count = 0;
+	bool Ok() const { return Error == UtfError::None; }
+};
+
+// Self-contained UTF-8/UTF-16/UTF-32 transcoder with SIMD fast paths.
+// Strings are treated as native-endian code unit arrays, no BOM handling.
+// The *LengthFrom* functions return the exact output size for valid input so
+// that callers can allocate once; the Valid* converters skip validation.
+class Utf {
+public:
+	static bool IsAscii(const char* input, size_t length);
+	static bool IsAscii(const char16_t* input, size_t length);
+
+	static UtfResult ValidateUtf8(const char* input, size_t length);
+	static UtfResult ValidateUtf16(const char16_t* input, size_t length);
+	static UtfResult ValidateUtf32(const char32_t* input, size_t length);
+
+	static size_t Utf16LengthFromUtf8(const char* input, size_t length);
+	static size_t Utf32LengthFromUtf8(const char* input, size_t length);
+	static size_t Utf8LengthFromUtf16(const char16_t* input, size_t length);
+	static size_t Utf32LengthFromUtf16(const char16_t* input, size_t length);
+	static size_t Utf8LengthFromUtf32(const char32_t* input, size_t length);
+	static size_t Utf16LengthFromUtf32(const char32_t* input, size_t length);
+
+	static UtfResult Utf8ToUtf16(const char* input, size_t length, char16_t* output);
+	static UtfResult Utf8ToUtf32(const char* input, size_t length, char32_t* output);
+	static UtfResult Utf16ToUtf8(const char16_t* input, size_t length, char* output);
+	static UtfResult Utf16ToUtf32(const char16_t* input, size_t length, char32_t* output);
+	static UtfResult Utf32ToUtf8(const char32_t* input, size_t length, char* output);
+	static UtfResult Utf32ToUtf16(const char32_t* input, size_t length, char16_t* output);
+
+	static size_t ValidUtf8ToUtf16(const char* input, size_t length, char16_t* output);
+	static size_t ValidUtf8ToUtf32(const char* input, size_t length, char32_t* output);
+	static size_t ValidUtf16ToUtf8(const char16_t* input, size_t length, char* output);
+
+	// Lossy variants replace every maximal invalid subsequence with U+FFFD.
+	// Output capacity must be length units for UTF-8 input, 3 * length for
+	// UTF-16 input and 4 * length for UTF-32 input.
+	static size_t Utf8ToUtf16Lossy(const char* input, size_t length, char16_t* output);
+	static size_t Utf8ToUtf32Lossy(const char* input, size_t length, char32_t* output);
+	static size_t Utf16ToUtf8Lossy(const char16_t* input, size_t length, char* output);
+	static size_t Utf32ToUtf8Lossy(const char32_t* input, size_t length, char* output);
+};
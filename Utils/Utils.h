@@ -8,17 +8,29 @@
 #include "StringBuilder.h"
 #include "Event.h"
 #include "List.h"
+#include "Span.h"
+#include "MemoryMappedFile.h"
 #include "File.h"
 #include "Guid.h"
 #include "Tuple.h"
 #include "Dialog.h"
 #include "Convert.h"
+#include "MerkleTree.h"
+#include "Checksum.h"
+#include "Utf.h"
 #include "Process.h"
 #include "CRandom.h"
 #include "FileInfo.h"
 #include "DateTime.h"
 #include "Registry.h"
 #include "FileStream.h"
+#include "BufferedFileWriter.h"
+#include "AsyncIO.h"
+#include "LineReader.h"
+#include "DirectoryWalker.h"
+#include "FileCopy.h"
+#include "FileSystemWatcher.h"
+#include "ContentChunker.h"
 #include "Dictionary.h"
 #include "HttpHelper.h"
 #include "Environment.h"
@@ -26,6 +38,10 @@
 #include "json.h"
 #include "Thread.h"
 #include "DataPack.h"
+#include "DataPackView.h"
+#include "DataPackStream.h"
+#include "DataPackContainer.h"
+#include "DataPackSchema.h"
 #include "Clipboard.h"
 #include "zlib/zlib.h"
 #include "Socket.h"
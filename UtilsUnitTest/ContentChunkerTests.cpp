@@ -0,0 +1,146 @@
+﻿#include "Test.h"
+#include "../Utils/ContentChunker.h"
+#include "../Utils/File.h"
+#include "../Utils/FileStream.h"
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+	std::vector<uint8_t> random_bytes(size_t size, uint64_t seed) {
+		std::vector<uint8_t> data(size);
+		for (uint8_t& byte : data) {
+			seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+			byte = (uint8_t)(seed >> 56);
+		}
+		return data;
+	}
+
+	SHA256::Digest digest_of(const uint8_t* data, size_t size) {
+		SHA256 sha;
+		sha.update(data, size);
+		sha.finalize();
+		return sha.rawdigest();
+	}
+
+	bool same_chunks(const std::vector<ContentChunk>& a, const std::vector<ContentChunk>& b) {
+		if (a.size() != b.size())
+			return false;
+		for (size_t i = 0; i < a.size(); i++) {
+			if (a[i].Offset != b[i].Offset || a[i].Length != b[i].Length || a[i].Hash != b[i].Hash)
+				return false;
+		}
+		return true;
+	}
+}
+
+TEST_CASE(ContentChunkerRejectsBadAverage) {
+	CHECK_THROWS(ContentChunker(0), std::invalid_argument);
+	CHECK_THROWS(ContentChunker(128), std::invalid_argument);
+	CHECK_THROWS(ContentChunker(1000), std::invalid_argument);
+	CHECK_THROWS(ContentChunker(8 << 20), std::invalid_argument);
+	ContentChunker chunker(256);
+	CHECK(chunker.MinSize() == 64);
+	CHECK(chunker.MaxSize() == 2048);
+}
+
+TEST_CASE(ContentChunkerCoversInput) {
+	const ContentChunker chunker(1024);
+	const std::vector<uint8_t> data = random_bytes(1 << 20, 1);
+	const std::vector<ContentChunk> chunks = chunker.Chunk(data.data(), data.size());
+	uint64_t offset = 0;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		CHECK(chunks[i].Offset == offset);
+		CHECK(chunks[i].Length <= chunker.MaxSize());
+		// Only the last chunk may be shorter than the minimum.
+		CHECK(chunks[i].Length >= chunker.MinSize() || i + 1 == chunks.size());
+		CHECK(chunks[i].Hash == digest_of(data.data() + offset, chunks[i].Length));
+		offset += chunks[i].Length;
+	}
+	CHECK(offset == data.size());
+	// Normalized chunking keeps the count near size / average.
+	CHECK(chunks.size() > data.size() / 1024 / 2 && chunks.size() < data.size() / 1024 * 2);
+
+	std::vector<uint64_t> offsets;
+	chunker.Split(data.data(), data.size(), [&](uint64_t at, size_t) { offsets.push_back(at); });
+	CHECK(offsets.size() == chunks.size());
+	for (size_t i = 0; i < offsets.size() && i < chunks.size(); i++)
+		CHECK(offsets[i] == chunks[i].Offset);
+
+	// No content to cut at: every chunk has the maximum size.
+	const std::vector<uint8_t> zeros(10000, 0);
+	const std::vector<ContentChunk> flat = chunker.Chunk(zeros.data(), zeros.size());
+	CHECK(flat.size() == 2);
+	CHECK(chunker.Chunk(zeros.data(), 0).empty());
+	CHECK(chunker.Chunk(zeros.data(), 10).size() == 1);
+}
+
+TEST_CASE(ContentChunkerBoundariesFollowContent) {
+	const ContentChunker chunker(1024);
+	const std::vector<uint8_t> original = random_bytes(256 * 1024, 2);
+	std::vector<uint8_t> edited = original;
+	const std::vector<uint8_t> inserted = random_bytes(100, 3);
+	edited.insert(edited.begin() + 100000, inserted.begin(), inserted.end());
+
+	ChunkIndex index;
+	index.Add(chunker.Chunk(original.data(), original.size()));
+	const std::vector<ContentChunk> chunks = chunker.Chunk(edited.data(), edited.size());
+	const std::vector<ContentChunk> missing = index.Missing(chunks);
+	CHECK(!missing.empty());
+	// Only the chunks around the insertion change.
+	CHECK(missing.size() <= 3);
+	uint64_t missingBytes = 0;
+	for (const ContentChunk& chunk : missing)
+		missingBytes += chunk.Length;
+	CHECK(missingBytes < 3 * chunker.MaxSize());
+}
+
+TEST_CASE(ContentChunkerFileAndStreamMatch) {
+	const ContentChunker chunker(256);
+	// Longer than one stream read, so chunks continue across refills.
+	const std::vector<uint8_t> data = random_bytes(9 << 20, 4);
+	const std::string path = TempPath("chunker.bin");
+	File::WriteAllBytes(path, data.data(), data.size());
+	const std::vector<ContentChunk> chunks = chunker.Chunk(data.data(), data.size());
+	CHECK(same_chunks(chunker.ChunkFile(path), chunks));
+	{
+		FileStream stream(path, FileMode::Read);
+		CHECK(same_chunks(chunker.ChunkStream(stream), chunks));
+	}
+	File::Delete(path);
+}
+
+TEST_CASE(ChunkIndexCountsDuplicates) {
+	const ContentChunker chunker(256);
+	const std::vector<uint8_t> block = random_bytes(64 * 1024, 5);
+	std::vector<uint8_t> twice = block;
+	twice.insert(twice.end(), block.begin(), block.end());
+	const std::vector<ContentChunk> chunks = chunker.Chunk(block.data(), block.size());
+
+	ChunkIndex index;
+	CHECK(index.DedupRatio() == 1.0);
+	CHECK(index.Add(chunks, 1) == block.size());
+	CHECK(index.Count() == chunks.size());
+	CHECK(index.Add(chunks, 2) == 0);
+	CHECK(index.TotalBytes() == 2 * block.size());
+	CHECK(index.UniqueBytes() == block.size());
+	CHECK(index.DedupRatio() == 2.0);
+
+	// The first copy is remembered.
+	const ChunkIndex::Location* location = index.Find(chunks[1].Hash);
+	CHECK(location && location->Source == 1 && location->Offset == chunks[1].Offset && location->Length == chunks[1].Length);
+	CHECK(!index.Find(digest_of(reinterpret_cast<const uint8_t*>("absent"), 6)));
+
+	// Everything after the first copy is already known.
+	const std::vector<ContentChunk> doubled = chunker.Chunk(twice.data(), twice.size());
+	ChunkIndex fresh;
+	const std::vector<ContentChunk> missing = fresh.Missing(doubled);
+	uint64_t missingBytes = 0;
+	for (const ContentChunk& chunk : missing)
+		missingBytes += chunk.Length;
+	CHECK(missingBytes < block.size() + 2 * chunker.MaxSize());
+
+	index.Clear();
+	CHECK(index.Count() == 0 && index.TotalBytes() == 0 && !index.Contains(chunks[0].Hash));
+}
@@ -0,0 +1,62 @@
+﻿#include "Test.h"
+#include "../Utils/Convert.h"
+#include <cmath>
+#include <limits>
+
+TEST_CASE(ConvertLegacyParsing) {
+	CHECK(Convert::ToInt32("  42abc") == 42);
+	CHECK(Convert::ToInt32("-17") == -17);
+	CHECK(Convert::ToInt32("abc") == 0);
+	CHECK(Convert::ToInt32("") == 0);
+	CHECK(Convert::ToInt32("99999999999") == std::numeric_limits<int>::max());
+	CHECK(Convert::ToInt64("\t-9223372036854775808") == std::numeric_limits<long long>::min());
+	CHECK(Convert::ToFloat(" 2.5e1x") == 25.0);
+	CHECK(Convert::ToFloat("1.5") == 1.5);
+	CHECK(Convert::ToFloat("x") == 0.0);
+}
+
+TEST_CASE(ConvertToFloatOutOfRange) {
+	// Same results as atof.
+	CHECK(Convert::ToFloat("1e400") == HUGE_VAL);
+	CHECK(Convert::ToFloat("-1e400") == -HUGE_VAL);
+	CHECK(Convert::ToFloat("1e-400") == 0.0);
+	CHECK(Convert::ToFloat("123456789012345678901234567890e300") == HUGE_VAL);
+}
+
+TEST_CASE(ConvertToFloatHex) {
+	CHECK(Convert::ToFloat("0x1p4") == 16.0);
+	CHECK(Convert::ToFloat(" -0X1.8p1") == -3.0);
+	CHECK(Convert::ToFloat("0x10") == 16.0);
+	CHECK(Convert::ToFloat("0") == 0.0);
+}
+
+TEST_CASE(ConvertTryParse) {
+	int i = 0;
+	CHECK(Convert::TryParse("123", i) && i == 123);
+	CHECK(Convert::TryParse("-2147483648", i) && i == std::numeric_limits<int>::min());
+	CHECK(Convert::TryParse("2147483648", i).Error == NumberError::OutOfRange);
+	CHECK(Convert::TryParse("", i).Error == NumberError::Empty);
+	CHECK(!Convert::TryParse("12a", i));
+	double d = 0;
+	CHECK(Convert::TryParse("0.1", d) && d == 0.1);
+	CHECK(Convert::TryParse("-1e-5", d) && d == -1e-5);
+	CHECK(!Convert::TryParse("1.5 ", d));
+}
+
+TEST_CASE(ConvertFormatRoundTrip) {
+	const double values[] = { 0.0, -0.0, 0.1, 1.0 / 3.0, 1e300, 5e-324, -123456.789 };
+	for (double value : values) {
+		char buffer[Convert::FormatBufferSize];
+		const size_t length = Convert::Format(value, buffer);
+		double parsed = 1;
+		CHECK(Convert::TryParse(std::string_view(buffer, length), parsed));
+		CHECK(parsed == value && std::signbit(parsed) == std::signbit(value));
+	}
+	const long long integers[] = { 0, -1, std::numeric_limits<long long>::min(), std::numeric_limits<long long>::max() };
+	for (long long value : integers) {
+		char buffer[Convert::FormatBufferSize];
+		const size_t length = Convert::Format(value, buffer);
+		long long parsed = 1;
+		CHECK(Convert::TryParse(std::string_view(buffer, length), parsed) && parsed == value);
+	}
+}
@@ -0,0 +1,124 @@
+﻿#include "Test.h"
+#include "../Utils/Checksum.h"
+#include "../Utils/DataPackContainer.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+	DataPack make_pack() {
+		DataPack pack("root");
+		pack = std::string("head value");
+		for (int i = 0; i < 500; i++) {
+			DataPack& child = pack.Add("child" + std::to_string(i), i);
+			child.Add("text", std::string(i % 50, 'a' + i % 26));
+		}
+		return pack;
+	}
+
+	void put_u32(uint8_t* p, uint32_t v) {
+		for (int i = 0; i < 4; i++)
+			p[i] = (uint8_t)(v >> (8 * i));
+	}
+	uint32_t get_u32(const uint8_t* p) {
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	// Rewrites a field of index entry number entry and fixes the index CRC,
+	// as a forger would.
+	std::vector<uint8_t> forge_entry(std::vector<uint8_t> bytes, size_t entry, size_t field, uint32_t value) {
+		const size_t indexOffset = (size_t)get_u32(bytes.data() + 8);
+		const uint32_t indexSize = get_u32(bytes.data() + 16);
+		put_u32(bytes.data() + indexOffset + entry * 32 + field, value);
+		put_u32(bytes.data() + indexOffset + indexSize, Crc32C::Compute(bytes.data() + indexOffset, indexSize));
+		return bytes;
+	}
+}
+
+TEST_CASE(DataPackContainerRoundTrip) {
+	const DataPack pack = make_pack();
+	const std::vector<uint8_t> plain = pack.GetBytes();
+	for (int level : { 0, 1, 9 }) {
+		DataPackContainerOptions options;
+		options.Level = level;
+		options.BlockSize = 4096;
+		const std::vector<uint8_t> bytes = DataPackContainer::Encode(pack, options);
+		DataPackContainer container(bytes.data(), bytes.size());
+		CHECK(container.Valid());
+		CHECK(container.Verify());
+		CHECK(container.ChildCount() == 500);
+		CHECK(container.BlockCount() > 2);
+		DataPack decoded;
+		CHECK(container.Decode(decoded));
+		CHECK(decoded.GetBytes() == plain);
+		DataPack child;
+		CHECK(container.ReadChild(321, child));
+		CHECK(child.Id == "child321" && child.convert<int>() == 321);
+		CHECK(!container.ReadChild(500, child));
+		CHECK(DataPack(bytes.data(), (int)bytes.size()).GetBytes() == plain);
+	}
+	// A root without children is a single block.
+	DataPack empty("alone");
+	const std::vector<uint8_t> bytes = DataPackContainer::Encode(empty);
+	DataPackContainer container(bytes.data(), bytes.size());
+	CHECK(container.BlockCount() == 1 && container.ChildCount() == 0);
+	CHECK(DataPack(bytes.data(), (int)bytes.size()).Id == "alone");
+	CHECK_THROWS(DataPackContainer::Encode(empty, DataPackContainerOptions{ 10 }), std::invalid_argument);
+}
+
+TEST_CASE(DataPackContainerForgedSizes) {
+	DataPackContainerOptions stored;
+	stored.Level = 0;
+	stored.BlockSize = 4096;
+	const std::vector<uint8_t> plain = DataPackContainer::Encode(make_pack(), stored);
+	DataPackContainerOptions compressed;
+	compressed.BlockSize = 4096;
+	const std::vector<uint8_t> zipped = DataPackContainer::Encode(make_pack(), compressed);
+	CHECK(DataPackContainer(plain.data(), plain.size()).Valid());
+	CHECK(DataPackContainer(zipped.data(), zipped.size()).Valid());
+
+	// Raw size fields: offset 12 in an entry. Child count: offset 20.
+	std::vector<uint8_t> forged = forge_entry(plain, 1, 12, get_u32(plain.data() + get_u32(plain.data() + 8) + 32 + 12) + 1);
+	CHECK(!DataPackContainer(forged.data(), forged.size()).Valid());
+	forged = forge_entry(zipped, 1, 12, 0xFFFFFFF0u);
+	CHECK(!DataPackContainer(forged.data(), forged.size()).Valid());
+	forged = forge_entry(zipped, 1, 20, 0x7FFFFFFFu);
+	CHECK(!DataPackContainer(forged.data(), forged.size()).Valid());
+	CHECK_THROWS(DataPack(forged.data(), (int)forged.size()), std::runtime_error);
+}
+
+TEST_CASE(DataPackContainerCorruptInput) {
+	const std::vector<uint8_t> bytes = DataPackContainer::Encode(make_pack());
+	// A flipped byte inside a block passes the index checks and fails on read.
+	std::vector<uint8_t> corrupt = bytes;
+	corrupt[40] ^= 0xFF;
+	DataPackContainer container(corrupt.data(), corrupt.size());
+	CHECK(container.Valid());
+	CHECK(!container.Verify());
+	DataPack decoded;
+	CHECK(!container.Decode(decoded));
+	CHECK_THROWS(DataPack(corrupt.data(), (int)corrupt.size()), std::runtime_error);
+
+	// Truncated anywhere: never valid.
+	for (size_t length = 0; length < bytes.size(); length += 61)
+		CHECK(!DataPackContainer(bytes.data(), length).Valid());
+}
+
+TEST_CASE(DataPackContainerOnlyAtTopLevel) {
+	// A child whose body is a container is malformed, not decoded.
+	DataPack inner("inner");
+	inner.Add("x", 1);
+	const std::vector<uint8_t> container = DataPackContainer::Encode(inner);
+	std::vector<uint8_t> bytes = { 0x81, 0, 0, 0, 0, 0xD4 };
+	uint8_t length[4];
+	put_u32(length, (uint32_t)container.size());
+	bytes.insert(bytes.end(), length, length + 4);
+	bytes.insert(bytes.end(), container.begin(), container.end());
+	bytes.push_back(0xD5);
+	bytes.push_back(0x98);
+	put_u32(bytes.data() + 1, (uint32_t)bytes.size());
+	const DataPack parsed(bytes.data(), (int)bytes.size());
+	CHECK(parsed.size() == 1);
+	CHECK(parsed.Child[0].Id.empty());
+	CHECK(parsed.Child[0].size() == 0);
+}
@@ -0,0 +1,104 @@
+﻿#include "Test.h"
+#include "../Utils/DataPackSchema.h"
+#include <string>
+#include <vector>
+
+namespace {
+	struct Endpoint {
+		std::string Host;
+		uint16_t Port = 0;
+		DATAPACK_FIELDS(Host, Port)
+	};
+
+	struct Route {
+		std::string Name;
+		std::vector<Endpoint> Hops;
+		std::vector<int> Weights;
+		DATAPACK_FIELDS(Name, Hops, Weights)
+	};
+
+	struct Network {
+		int Version = 0;
+		std::vector<Route> Routes;
+		Endpoint Gateway;
+		DATAPACK_FIELDS(Version, Routes, Gateway)
+	};
+
+	// Hops and weights sized so packs at each level need 1, 2 and 4 byte
+	// length prefixes.
+	Network make_network() {
+		Network network;
+		network.Version = 3;
+		network.Gateway = { "gateway", 1 };
+		for (int r = 0; r < 40; r++) {
+			Route route;
+			route.Name = "route" + std::to_string(r);
+			for (int h = 0; h < r * 10; h++)
+				route.Hops.push_back({ std::string(h % 7, 'h'), (uint16_t)h });
+			route.Weights.assign(r * 30, r);
+			network.Routes.push_back(route);
+		}
+		return network;
+	}
+
+	DataPack by_hand(const Network& network) {
+		DataPack pack("network");
+		pack["Version"] = network.Version;
+		DataPack& routes = pack["Routes"];
+		routes.Value.clear();
+		for (const Route& route : network.Routes) {
+			DataPack& r = routes.Child.emplace_back();
+			r["Name"] = route.Name;
+			DataPack& hops = r["Hops"];
+			hops.Value.clear();
+			for (const Endpoint& hop : route.Hops) {
+				DataPack& h = hops.Child.emplace_back();
+				h["Host"] = hop.Host;
+				h["Port"] = hop.Port;
+			}
+			r["Weights"] = route.Weights;
+		}
+		DataPack& gateway = pack["Gateway"];
+		gateway.Value.clear();
+		gateway["Host"] = network.Gateway.Host;
+		gateway["Port"] = network.Gateway.Port;
+		return pack;
+	}
+}
+
+TEST_CASE(DataPackSchemaMatchesGetBytes) {
+	const Network network = make_network();
+	const std::vector<uint8_t> bytes = DataPackSchema<Network>::GetBytes(network, "network");
+	CHECK(bytes.size() > 65536);
+	CHECK(bytes == by_hand(network).GetBytes());
+	CHECK(DataPackSchema<Network>::ToDataPack(network, "network").GetBytes() == bytes);
+	// Appends after existing output.
+	std::vector<uint8_t> out = { 1, 2, 3 };
+	DataPackSchema<Network>::WriteTo(network, out, "network");
+	CHECK(std::vector<uint8_t>(out.begin() + 3, out.end()) == bytes);
+}
+
+TEST_CASE(DataPackSchemaRoundTrip) {
+	const Network network = make_network();
+	const std::vector<uint8_t> bytes = DataPackSchema<Network>::GetBytes(network);
+	Network parsed;
+	CHECK(DataPackSchema<Network>::Parse(bytes.data(), bytes.size(), parsed));
+	CHECK(DataPackSchema<Network>::GetBytes(parsed) == bytes);
+	Network fromPack;
+	DataPackSchema<Network>::FromDataPack(DataPack(bytes.data(), (int)bytes.size()), fromPack);
+	CHECK(DataPackSchema<Network>::GetBytes(fromPack) == bytes);
+	CHECK(!DataPackSchema<Network>::Parse(bytes.data(), bytes.size() - 1, parsed));
+}
+
+TEST_CASE(DataPackSchemaReordered) {
+	const Network network = make_network();
+	DataPack pack = by_hand(network);
+	std::swap(pack.Child[0], pack.Child[2]);
+	pack.Child.insert(pack.Child.begin() + 1, DataPack("Extra", 5));
+	const std::vector<uint8_t> bytes = pack.GetBytes();
+	Network parsed;
+	CHECK(DataPackSchema<Network>::Parse(bytes.data(), bytes.size(), parsed));
+	CHECK(parsed.Version == 3);
+	CHECK(parsed.Gateway.Host == "gateway");
+	CHECK(parsed.Routes.size() == 40 && parsed.Routes[39].Hops.size() == 390);
+}
@@ -0,0 +1,122 @@
+﻿#include "Test.h"
+#include "../Utils/DataPackStream.h"
+#include "../Utils/FileStream.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+	DataPack make_pack() {
+		DataPack pack("root");
+		pack["int"] = 42;
+		pack["large"] = std::string(70000, 'v');
+		DataPack& nested = pack["nested"];
+		for (int i = 0; i < 300; i++)
+			nested.Add("item", i);
+		return pack;
+	}
+
+	void write_file(const std::string& path, const std::vector<uint8_t>& bytes) {
+		FileStream stream(path, FileMode::Write);
+		stream.Write(bytes.data(), bytes.size());
+	}
+
+	std::vector<uint8_t> read_file(const std::string& path) {
+		FileStream stream(path, FileMode::Read);
+		std::vector<uint8_t> bytes(stream.Length());
+		stream.Read(bytes.data(), bytes.size());
+		return bytes;
+	}
+
+	// Events until End or Error, reading every value whole.
+	DataPackEvent drain(DataPackReader& reader) {
+		for (;;) {
+			const DataPackEvent event = reader.Next();
+			if (event == DataPackEvent::Value)
+				reader.Value();
+			if (event == DataPackEvent::End || event == DataPackEvent::Error)
+				return event;
+		}
+	}
+}
+
+TEST_CASE(DataPackStreamRoundTrip) {
+	const std::string path = TempPath("stream_round_trip");
+	const DataPack pack = make_pack();
+	{
+		FileStream stream(path, FileMode::Write);
+		DataPackWriter writer(stream, pack.Id);
+		for (const DataPack& child : pack.Child)
+			writer.Add(child);
+		writer.BeginChild("streamed");
+		writer.Value(std::string("tail"));
+		writer.EndChild();
+		CHECK(writer.End());
+	}
+	DataPack expected = pack;
+	expected["streamed"] = "tail";
+	CHECK(read_file(path) == expected.GetBytes());
+
+	FileStream stream(path, FileMode::Read);
+	DataPackReader reader(stream);
+	CHECK(reader.Next() == DataPackEvent::BeginPack);
+	DataPack parsed;
+	CHECK(reader.ReadPack(parsed));
+	CHECK(parsed.GetBytes() == expected.GetBytes());
+	CHECK(reader.Next() == DataPackEvent::End);
+	stream.Close();
+	DeleteFileA(path.c_str());
+}
+
+TEST_CASE(DataPackStreamRejectsAppendMode) {
+	const std::string path = TempPath("stream_append");
+	write_file(path, { 1, 2, 3 });
+	{
+		FileStream stream(path, FileMode::Append);
+		CHECK_THROWS(DataPackWriter(stream, "root"), std::invalid_argument);
+	}
+	CHECK(read_file(path).size() == 3);
+	DeleteFileA(path.c_str());
+}
+
+TEST_CASE(DataPackStreamMalformedInput) {
+	const std::string path = TempPath("stream_malformed");
+	const std::vector<uint8_t> good = make_pack().GetBytes();
+
+	// Truncated at every few bytes: an Error, never a crash or a hang.
+	for (size_t length = 1; length < good.size(); length += 997) {
+		write_file(path, std::vector<uint8_t>(good.begin(), good.begin() + length));
+		FileStream stream(path, FileMode::Read);
+		DataPackReader reader(stream);
+		CHECK(drain(reader) == DataPackEvent::Error);
+	}
+
+	// Wrong leading marker.
+	std::vector<uint8_t> bad = good;
+	bad[0] = 0;
+	write_file(path, bad);
+	{
+		FileStream stream(path, FileMode::Read);
+		DataPackReader reader(stream);
+		CHECK(reader.Next() == DataPackEvent::Error);
+		CHECK(reader.Next() == DataPackEvent::Error);
+	}
+
+	// Root and value lengths claiming almost 4 GB over a few bytes of input.
+	const std::vector<uint8_t> forged = {
+		0x81, 0xFF, 0xFF, 0xFF, 0xFF,
+		0x55, 0x00, 0xFF, 0xFF, 0xFF,
+		'a', 'b', 'c'
+	};
+	write_file(path, forged);
+	{
+		FileStream stream(path, FileMode::Read);
+		DataPackReader reader(stream);
+		CHECK(reader.Next() == DataPackEvent::BeginPack);
+		CHECK(reader.Next() == DataPackEvent::Value);
+		CHECK(reader.ValueSize() == 0xFFFFFF00u);
+		CHECK(reader.Value().empty());
+		CHECK(reader.Next() == DataPackEvent::Error);
+	}
+	DeleteFileA(path.c_str());
+}
@@ -0,0 +1,138 @@
+﻿#include "Test.h"
+#include "../Utils/DataPack.h"
+#include "../Utils/FileStream.h"
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+	DataPack make_wide(size_t count) {
+		DataPack pack("root");
+		for (size_t i = 0; i < count; i++)
+			pack.Add("k" + std::to_string(i), (int)i);
+		return pack;
+	}
+}
+
+TEST_CASE(DataPackRoundTrip) {
+	DataPack pack("root");
+	pack["int"] = 42;
+	pack["text"] = std::string(300, 'x');
+	pack["nested"].Add("inner", 1.5);
+	pack["empty"];
+	const std::vector<uint8_t> bytes = pack.GetBytes();
+	DataPack parsed(bytes.data(), (int)bytes.size());
+	CHECK(parsed.Id == "root");
+	CHECK(parsed.size() == 4);
+	CHECK(parsed["int"].convert<int>() == 42);
+	CHECK(parsed["text"].Value.size() == 300);
+	CHECK(parsed["nested"]["inner"].convert<double>() == 1.5);
+	CHECK(parsed.GetBytes() == bytes);
+}
+
+TEST_CASE(DataPackKeyedLookup) {
+	DataPack pack = make_wide(100);
+	for (int i = 0; i < 100; i++)
+		CHECK(pack["k" + std::to_string(i)].convert<int>() == i);
+	CHECK(pack.size() == 100);
+	CHECK(!pack.ContainsKsy("missing"));
+	pack["missing"] = 7;
+	CHECK(pack.size() == 101);
+	pack.RemoveAt(10);
+	CHECK(!pack.ContainsKsy("k10"));
+	CHECK(pack["k11"].convert<int>() == 11);
+	const DataPack& constPack = pack;
+	CHECK(constPack.ContainsKsy("k99"));
+}
+
+TEST_CASE(DataPackKeyIndexSeesDirectEdits) {
+	DataPack pack = make_wide(40);
+	CHECK(pack.ContainsKsy("k5"));
+	// Renamed in place: the old Id is gone and the new one is found once.
+	pack.Child[5].Id = "renamed";
+	CHECK(!pack.ContainsKsy("k5"));
+	CHECK(pack["renamed"].convert<int>() == 5);
+	CHECK(pack.size() == 40);
+	// Swapped children.
+	std::swap(pack.Child[1], pack.Child[2]);
+	CHECK(&pack["k1"] == &pack.Child[2]);
+	CHECK(&pack["k2"] == &pack.Child[1]);
+	// Erased and inserted through Child, keeping the size.
+	pack.Child.erase(pack.Child.begin() + 20);
+	pack.Child.insert(pack.Child.begin() + 3, DataPack("k20", 20));
+	for (int i = 0; i < 40; i++) {
+		if (i == 5)
+			continue;
+		CHECK(pack["k" + std::to_string(i)].convert<int>() == i);
+	}
+	CHECK(pack.size() == 40);
+}
+
+TEST_CASE(DataPackKeyIndexFindsRenamedChild) {
+	DataPack pack = make_wide(40);
+	CHECK(pack.ContainsKsy("k0"));
+	// Only the new Id is looked up: nothing probes the old slot first.
+	pack.Child[7].Id = "x";
+	CHECK(&pack["x"] == &pack.Child[7]);
+	CHECK(pack.size() == 40);
+	const DataPack& constPack = pack;
+	pack.Child[8].Id = "y";
+	CHECK(constPack.ContainsKsy("y"));
+	CHECK(&pack["y"] == &pack.Child[8]);
+	CHECK(pack.size() == 40);
+}
+
+TEST_CASE(DataPackCopyKeepsLookups) {
+	DataPack pack = make_wide(30);
+	CHECK(pack.ContainsKsy("k29"));
+	DataPack copy = pack;
+	copy.Child[0].Id = "first";
+	CHECK(copy["first"].convert<int>() == 0);
+	CHECK(pack["k0"].convert<int>() == 0);
+	CHECK(pack.size() == 30 && copy.size() == 30);
+}
+
+TEST_CASE(DataPackWriteToStream) {
+	// Larger than one flush, so the root size is patched after seeking back.
+	DataPack pack = make_wide(20);
+	pack["large"] = std::string(3 << 20, 'v');
+	const std::vector<uint8_t> bytes = pack.GetBytes();
+	const std::string path = TempPath("datapack_stream");
+	{
+		FileStream stream(path, FileMode::Write);
+		CHECK(stream.Write(bytes.data(), 3));
+		CHECK(pack.WriteTo(stream));
+		CHECK(stream.Position() == 3 + bytes.size());
+	}
+	{
+		FileStream stream(path, FileMode::Read);
+		std::vector<uint8_t> written(stream.Length());
+		stream.Read(written.data(), written.size());
+		CHECK(written.size() == 3 + bytes.size());
+		if (written.size() > 3)
+			CHECK(std::vector<uint8_t>(written.begin() + 3, written.end()) == bytes);
+	}
+	// Append mode cannot seek back for the patch, so nothing is written.
+	{
+		FileStream stream(path, FileMode::Append);
+		CHECK_THROWS(pack.WriteTo(stream), std::invalid_argument);
+	}
+	CHECK(FileStream(path, FileMode::Read).Length() == 3 + bytes.size());
+	DeleteFileA(path.c_str());
+}
+
+TEST_CASE(DataPackArenaResetKeepsLargestChunk) {
+	DataPackArena arena(256);
+	// An oversized allocation gets its own chunk; a later one that does not
+	// fit next to it makes a newer, smaller chunk.
+	arena.Allocate(100000);
+	const size_t oversized = arena.Capacity();
+	arena.Allocate(40000);
+	CHECK(arena.Capacity() > oversized);
+	arena.Reset();
+	CHECK(arena.Capacity() == oversized);
+	// The same message again fits without allocating.
+	arena.Allocate(100000);
+	CHECK(arena.Capacity() == oversized);
+}
@@ -0,0 +1,129 @@
+﻿#include "Test.h"
+#include "../Utils/DateTime.h"
+#include <string>
+
+namespace {
+	std::string format(const DateTime& time, int fractionDigits = 3) {
+		char buffer[DateTime::FormatBufferSize];
+		return std::string(buffer, time.Format(buffer, fractionDigits));
+	}
+
+	bool parses_to(const char* input, const DateTime& expected) {
+		DateTime value;
+		return DateTime::TryParse(input, value) && value == expected;
+	}
+
+	bool rejects(const char* input) {
+		DateTime value(12345);
+		return !DateTime::TryParse(input, value) && value == DateTime(12345);
+	}
+}
+
+TEST_CASE(DateTimeCalendar) {
+	CHECK(DateTime(1601, 1, 1, 0, 0, 0, 0).GetData() == 0);
+	CHECK(DateTime(1601, 1, 1, 0, 0, 0, 0).Decompose().DayOfWeek == 1);
+	// 2000-01-01 was a Saturday.
+	const DateTimeParts parts = DateTime(2000, 1, 1, 12, 34, 56, 789).AddTicks(1234).Decompose();
+	CHECK(parts.Year == 2000 && parts.Month == 1 && parts.Day == 1);
+	CHECK(parts.Hour == 12 && parts.Minute == 34 && parts.Second == 56);
+	CHECK(parts.Millisecond == 789 && parts.Ticks == 1234 && parts.DayOfWeek == 6);
+
+	CHECK(DateTime::IsLeapYear(2000) && DateTime::IsLeapYear(2024));
+	CHECK(!DateTime::IsLeapYear(1900) && !DateTime::IsLeapYear(2023));
+	CHECK(DateTime::DaysInMonth(2024, 2) == 29 && DateTime::DaysInMonth(2100, 2) == 28);
+	CHECK(DateTime::DaysInMonth(2024, 13) == 0);
+	// Fields out of range give DateTime().
+	CHECK(DateTime(2023, 2, 29, 0, 0, 0, 0) == DateTime());
+	CHECK(DateTime(2024, 4, 31, 0, 0, 0, 0) == DateTime());
+	CHECK(DateTime(1600, 12, 31, 0, 0, 0, 0) == DateTime());
+	CHECK(DateTime(2024, 1, 1, 24, 0, 0, 0) == DateTime());
+
+	// Every day of a 400-year cycle decomposes back to itself.
+	DateTime day(2000, 3, 1, 0, 0, 0, 0);
+	bool roundTrips = true;
+	for (int i = 0; i < 146097 && roundTrips; i++, day = day.AddDays(1)) {
+		const DateTimeParts fields = day.Decompose();
+		roundTrips = DateTime(fields.Year, fields.Month, fields.Day, 0, 0, 0, 0) == day;
+	}
+	CHECK(roundTrips);
+}
+
+TEST_CASE(DateTimeAddMonthsClamps) {
+	const DateTime january31(2024, 1, 31, 8, 0, 0, 0);
+	CHECK(january31.AddMonths(1) == DateTime(2024, 2, 29, 8, 0, 0, 0));
+	CHECK(january31.AddMonths(13) == DateTime(2025, 2, 28, 8, 0, 0, 0));
+	CHECK(january31.AddMonths(3) == DateTime(2024, 4, 30, 8, 0, 0, 0));
+	CHECK(january31.AddMonths(-2) == DateTime(2023, 11, 30, 8, 0, 0, 0));
+	CHECK(DateTime(2024, 2, 29, 0, 0, 0, 0).AddYears(1) == DateTime(2025, 2, 28, 0, 0, 0, 0));
+	CHECK(DateTime(2024, 2, 29, 0, 0, 0, 0).AddYears(4) == DateTime(2028, 2, 29, 0, 0, 0, 0));
+	// Ticks below the millisecond survive.
+	CHECK(january31.AddTicks(7).AddMonths(1) == DateTime(2024, 2, 29, 8, 0, 0, 0).AddTicks(7));
+	// Before the start of the scale.
+	CHECK(DateTime(1601, 1, 1, 0, 0, 0, 0).AddMonths(-1) == DateTime());
+}
+
+TEST_CASE(DateTimeFormat) {
+	const DateTime time = DateTime(2024, 3, 5, 7, 8, 9, 12).AddTicks(3456);
+	CHECK(time.ToString() == "2024-03-05 07:08:09.012");
+	CHECK(format(time) == "2024-03-05T07:08:09.012Z");
+	CHECK(format(time, 0) == "2024-03-05T07:08:09Z");
+	CHECK(format(time, 7) == "2024-03-05T07:08:09.0123456Z");
+	CHECK(format(time, 9) == "2024-03-05T07:08:09.0123456Z");
+	CHECK(format(time, -1) == "2024-03-05T07:08:09Z");
+	// The cached date is only reused within the same second.
+	CHECK(format(time.AddMilliseconds(500)) == "2024-03-05T07:08:09.512Z");
+	CHECK(format(time.AddSeconds(1)) == "2024-03-05T07:08:10.012Z");
+	CHECK(format(time.AddDays(-1)) == "2024-03-04T07:08:09.012Z");
+	CHECK(format(DateTime()) == "1601-01-01T00:00:00.000Z");
+	CHECK(format(DateTime(30827, 12, 31, 23, 59, 59, 999)) == "30827-12-31T23:59:59.999Z");
+}
+
+TEST_CASE(DateTimeParse) {
+	const DateTime time(2024, 3, 5, 7, 8, 9, 0);
+	CHECK(parses_to("2024-03-05", DateTime(2024, 3, 5, 0, 0, 0, 0)));
+	CHECK(parses_to("2024-3-5", DateTime(2024, 3, 5, 0, 0, 0, 0)));
+	CHECK(parses_to("2024-03-05T07:08", DateTime(2024, 3, 5, 7, 8, 0, 0)));
+	CHECK(parses_to("2024-03-05 07:08:09", time));
+	CHECK(parses_to("2024-03-05t07:08:09z", time));
+	CHECK(parses_to("2024-03-05T07:08:09.5Z", time.AddMilliseconds(500)));
+	CHECK(parses_to("2024-03-05T07:08:09,0123456Z", time.AddTicks(123456)));
+	// Digits beyond the tick are dropped.
+	CHECK(parses_to("2024-03-05T07:08:09.012345678Z", time.AddTicks(123456)));
+	CHECK(parses_to("30827-12-31", DateTime(30827, 12, 31, 0, 0, 0, 0)));
+
+	// Offsets are converted to UTC.
+	CHECK(parses_to("2024-03-05T15:08:09+08:00", time));
+	CHECK(parses_to("2024-03-05T15:08:09+0800", time));
+	CHECK(parses_to("2024-03-05T15:08:09+08", time));
+	CHECK(parses_to("2024-03-05T01:38:09-05:30", time));
+	CHECK(parses_to("2024-03-01T00:00:00-01:00", DateTime(2024, 3, 1, 1, 0, 0, 0)));
+	CHECK(parses_to("2024-03-01T00:30:00+01:00", DateTime(2024, 2, 29, 23, 30, 0, 0)));
+
+	CHECK(rejects(""));
+	CHECK(rejects("2024"));
+	CHECK(rejects("2024-03"));
+	CHECK(rejects("2024/03/05"));
+	CHECK(rejects("2024-02-30"));
+	CHECK(rejects("2023-02-29"));
+	CHECK(rejects("1600-12-31"));
+	CHECK(rejects("2024-03-05T"));
+	CHECK(rejects("2024-03-05T07"));
+	CHECK(rejects("2024-03-05T24:00"));
+	CHECK(rejects("2024-03-05T07:60"));
+	CHECK(rejects("2024-03-05T07:08:60"));
+	CHECK(rejects("2024-03-05T07:08:09."));
+	CHECK(rejects("2024-03-05T07:08:09+8"));
+	CHECK(rejects("2024-03-05T07:08:09+08:"));
+	CHECK(rejects("2024-03-05T07:08:09+24:00"));
+	CHECK(rejects("2024-03-05T07:08:09+08:60"));
+	CHECK(rejects("2024-03-05T07:08:09Z "));
+	CHECK(rejects("1601-01-01T00:00:00+01:00"));
+	CHECK(DateTime::Parse("not a date") == DateTime());
+
+	// Format output parses back to the same tick.
+	const DateTime precise = time.AddTicks(1234567);
+	char buffer[DateTime::FormatBufferSize];
+	const size_t length = precise.Format(buffer, 7);
+	DateTime parsed;
+	CHECK(DateTime::TryParse(std::string_view(buffer, length), parsed) && parsed == precise);
+}
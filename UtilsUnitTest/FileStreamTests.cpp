@@ -0,0 +1,79 @@
+﻿#include "Test.h"
+#include "../Utils/FileStream.h"
+#include <string>
+#include <vector>
+
+namespace {
+	std::vector<uint8_t> pattern(size_t size, uint8_t seed) {
+		std::vector<uint8_t> bytes(size);
+		for (size_t i = 0; i < size; i++)
+			bytes[i] = (uint8_t)(i * 7 + seed);
+		return bytes;
+	}
+}
+
+TEST_CASE(FileStreamReadWrite) {
+	const std::string path = TempPath("filestream_rw");
+	const std::vector<uint8_t> data = pattern(200000, 1);
+	{
+		FileStream stream(path, FileMode::Write);
+		CHECK(stream.IsOpen());
+		// Small writes go through the buffer, the large one around it.
+		CHECK(stream.Write(data.data(), 10));
+		CHECK(stream.Write(data.data() + 10, 90));
+		CHECK(stream.Write(data.data() + 100, data.size() - 100));
+		CHECK(stream.Length() == data.size());
+	}
+	FileStream stream(path, FileMode::Read);
+	std::vector<uint8_t> read(data.size());
+	CHECK(stream.Read(read.data(), 5) == 5);
+	CHECK(stream.Read(read.data() + 5, read.size() - 5) == (long long)(read.size() - 5));
+	CHECK(read == data);
+	CHECK(stream.Read(read.data(), 1) == 0);
+	stream.Seek(1000);
+	uint8_t byte = 0;
+	CHECK(stream.Read(&byte) && byte == data[1000]);
+	CHECK(stream.Position() == 1001);
+	CHECK(stream.ReadAt(read.data(), 100, data.size() - 10) == 10);
+	stream.Close();
+	DeleteFileA(path.c_str());
+}
+
+TEST_CASE(FileStreamFlushDropsReadAhead) {
+	const std::string path = TempPath("filestream_flush");
+	{
+		FileStream stream(path, FileMode::Write);
+		const std::vector<uint8_t> zeros(8192, 0);
+		stream.Write(zeros.data(), zeros.size());
+	}
+	FileStream stream(path, FileMode::ReadWrite);
+	uint8_t byte = 1;
+	CHECK(stream.Read(&byte) && byte == 0);
+	// The rest of the first block is now read ahead; overwrite part of it.
+	const std::vector<uint8_t> update = pattern(100, 9);
+	CHECK(stream.WriteAt(update.data(), update.size(), 1));
+	CHECK(stream.Flush());
+	std::vector<uint8_t> read(update.size());
+	CHECK(stream.Read(read.data(), read.size()) == (long long)read.size());
+	CHECK(read == update);
+	stream.Close();
+	DeleteFileA(path.c_str());
+}
+
+TEST_CASE(FileStreamVectoredIo) {
+	const std::string path = TempPath("filestream_vectored");
+	const std::vector<uint8_t> a = pattern(3, 1), b = pattern(70000, 2), c = pattern(5, 3);
+	FileStream(path, FileMode::Write).Close();
+	FileStream stream(path, FileMode::ReadWrite);
+	const ByteSpan pieces[] = { ByteSpan(a.data(), a.size()), ByteSpan(b.data(), b.size()), ByteSpan(c.data(), c.size()) };
+	CHECK(stream.WriteV(Span<const ByteSpan>(pieces, 3), 10));
+	CHECK(stream.Length() == 10 + a.size() + b.size() + c.size());
+	std::vector<uint8_t> ra(a.size()), rb(b.size()), rc(c.size());
+	const MutableByteSpan targets[] = { MutableByteSpan(ra.data(), ra.size()), MutableByteSpan(rb.data(), rb.size()), MutableByteSpan(rc.data(), rc.size()) };
+	CHECK(stream.ReadV(Span<const MutableByteSpan>(targets, 3), 10) == (long long)(a.size() + b.size() + c.size()));
+	CHECK(ra == a && rb == b && rc == c);
+	CHECK(stream.SetLength(12));
+	CHECK(stream.Length() == 12);
+	stream.Close();
+	DeleteFileA(path.c_str());
+}
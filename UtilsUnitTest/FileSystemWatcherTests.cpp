@@ -0,0 +1,98 @@
+﻿#include "Test.h"
+#include "../Utils/File.h"
+#include "../Utils/FileSystemWatcher.h"
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	// A fresh directory and the batches a watcher on it delivers. Set the
+	// directory up before Start().
+	struct WatchedDirectory {
+		std::string path;
+		FileSystemWatcher watcher;
+		std::mutex lock;
+		std::vector<FileSystemEventArgs> events;
+
+		explicit WatchedDirectory(const char* name) : path(TempPath(name)), watcher(path, false) {
+			Directory::Create(path);
+			// Long enough that each test's changes arrive as one batch.
+			watcher.SetDebounce(std::chrono::milliseconds(500));
+			watcher.Batch += [this](FileSystemWatcher*, const std::vector<FileSystemEventArgs>& batch) {
+				std::lock_guard<std::mutex> guard(lock);
+				events.insert(events.end(), batch.begin(), batch.end());
+			};
+		}
+		~WatchedDirectory() {
+			watcher.Stop();
+			Directory::Delete(path, true);
+		}
+
+		std::string PathOf(const char* name) const { return path + "\\" + name; }
+
+		// Waits for the first batch, then stops the watcher.
+		std::vector<FileSystemEventArgs> Take() {
+			for (int i = 0; i < 100; i++) {
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					if (!events.empty())
+						break;
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			}
+			watcher.Stop();
+			return events;
+		}
+	};
+}
+
+TEST_CASE(FileSystemWatcherCoalescesPerPath) {
+	WatchedDirectory directory("watcher_coalesce");
+	directory.watcher.Start();
+	// A temporary file created and deleted again is nothing.
+	File::WriteAllText(directory.PathOf("scratch.tmp"), "x");
+	File::Delete(directory.PathOf("scratch.tmp"));
+	// Created and written is one Created.
+	File::WriteAllText(directory.PathOf("new.txt"), "a");
+	File::AppendAllText(directory.PathOf("new.txt"), "b");
+	const std::vector<FileSystemEventArgs> events = directory.Take();
+	CHECK(events.size() == 1);
+	if (events.size() == 1) {
+		CHECK(events[0].ChangeType == WatcherChangeTypes::Created);
+		CHECK(events[0].Name == "new.txt");
+	}
+}
+
+TEST_CASE(FileSystemWatcherBackupSave) {
+	WatchedDirectory directory("watcher_backup");
+	File::WriteAllText(directory.PathOf("doc.txt"), "old");
+	directory.watcher.Start();
+	// Editors that keep a backup: rename doc to doc~, write a new doc,
+	// then drop the backup. Only doc changed.
+	File::Move(directory.PathOf("doc.txt"), directory.PathOf("doc.txt~"));
+	File::WriteAllText(directory.PathOf("doc.txt"), "new");
+	File::Delete(directory.PathOf("doc.txt~"));
+	const std::vector<FileSystemEventArgs> events = directory.Take();
+	CHECK(events.size() == 1);
+	if (events.size() == 1) {
+		CHECK(events[0].ChangeType == WatcherChangeTypes::Changed);
+		CHECK(events[0].Name == "doc.txt");
+	}
+}
+
+TEST_CASE(FileSystemWatcherRenameThenDelete) {
+	WatchedDirectory directory("watcher_rename");
+	File::WriteAllText(directory.PathOf("a.txt"), "a");
+	directory.watcher.Start();
+	// Renamed and then deleted: the original name went away.
+	File::Move(directory.PathOf("a.txt"), directory.PathOf("b.txt"));
+	File::Delete(directory.PathOf("b.txt"));
+	const std::vector<FileSystemEventArgs> events = directory.Take();
+	CHECK(events.size() == 1);
+	if (events.size() == 1) {
+		CHECK(events[0].ChangeType == WatcherChangeTypes::Deleted);
+		CHECK(events[0].Name == "a.txt");
+	}
+}
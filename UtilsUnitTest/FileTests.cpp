@@ -0,0 +1,64 @@
+﻿#include "Test.h"
+#include "../Utils/BufferedFileWriter.h"
+#include "../Utils/File.h"
+#include "../Utils/FileInfo.h"
+#include <stdexcept>
+#include <string>
+
+TEST_CASE(FileWriteAllBytesAtomic) {
+	const std::string path = TempPath("file_atomic.txt");
+	CHECK(File::WriteAllTextAtomic(path, "first"));
+	CHECK(File::ReadAllText(path) == "first");
+	// Replacing an existing file keeps its attributes.
+	File::SetAttributes(path, FileAttributes::Hidden);
+	CHECK(File::WriteAllTextAtomic(path, "second, longer"));
+	CHECK(File::ReadAllText(path) == "second, longer");
+	CHECK(((int)File::GetAttributes(path) & (int)FileAttributes::Hidden) != 0);
+	File::SetAttributes(path, FileAttributes::Normal);
+	CHECK(File::WriteAllTextAtomic(path, ""));
+	CHECK(File::ReadAllText(path).empty());
+	DeleteFileA(path.c_str());
+	// A directory that does not exist: nothing is left behind.
+	CHECK(!File::WriteAllTextAtomic(TempPath("missing_dir\\file.txt"), "x"));
+}
+
+TEST_CASE(FileBufferedWriterCountsBytes) {
+	const std::string path = TempPath("file_buffered.txt");
+	{
+		BufferedFileWriter writer(path, FileMode::Write, 16);
+		CHECK(writer.Write(std::string_view("0123456789")));
+		CHECK(writer.WriteLine("abc"));
+		CHECK(writer.BytesWritten() == 14);
+		// Larger than the buffer: written straight through.
+		CHECK(writer.Write(std::string_view(std::string(40, 'x'))));
+		CHECK(writer.BytesWritten() == 54);
+		CHECK(writer.Flush());
+		writer.Close();
+		CHECK(!writer.Write(std::string_view("late")));
+		CHECK(writer.BytesWritten() == 54);
+	}
+	CHECK(File::ReadAllText(path) == "0123456789abc\n" + std::string(40, 'x'));
+	CHECK_THROWS(BufferedFileWriter(path, FileMode::Read), std::invalid_argument);
+	DeleteFileA(path.c_str());
+}
+
+TEST_CASE(FileCopyIntoDirectory) {
+	const std::string source = TempPath("file_copy_source.txt");
+	const std::string directory = TempPath("file_copy_dir");
+	File::WriteAllText(source, "content");
+	Directory::Create(directory);
+	// A directory destination receives the file under its own name.
+	const std::string copied = directory + "\\" + FileInfo(source).Name();
+	File::Copy(source, directory);
+	CHECK(File::ReadAllText(copied) == "content");
+	// File::Copy does not overwrite.
+	CHECK_THROWS(File::Copy(source, directory), std::runtime_error);
+	File::Delete(copied);
+	FileInfo(source).CopyTo(directory);
+	CHECK(File::ReadAllText(copied) == "content");
+	// A file destination is still the copy itself.
+	File::Copy(source, directory + "\\renamed.txt");
+	CHECK(File::ReadAllText(directory + "\\renamed.txt") == "content");
+	Directory::Delete(directory, true);
+	File::Delete(source);
+}
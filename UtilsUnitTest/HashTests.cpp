@@ -0,0 +1,59 @@
+﻿#include "Test.h"
+#include "../Utils/MD5.h"
+#include "../Utils/SHA256.h"
+#include <string>
+#include <vector>
+
+namespace {
+	// Messages of every length across the one- and two-block padding cases.
+	std::vector<std::string> make_messages() {
+		std::vector<std::string> messages;
+		for (size_t length = 0; length < 200; length++) {
+			std::string message(length, '\0');
+			for (size_t i = 0; i < length; i++)
+				message[i] = (char)(i * 31 + length);
+			messages.push_back(message);
+		}
+		return messages;
+	}
+
+	std::vector<ByteSpan> spans(const std::vector<std::string>& messages) {
+		std::vector<ByteSpan> result;
+		for (const std::string& message : messages)
+			result.push_back(ByteSpan(reinterpret_cast<const uint8_t*>(message.data()), message.size()));
+		return result;
+	}
+}
+
+TEST_CASE(HashKnownVectors) {
+	MD5 md5;
+	md5.update(reinterpret_cast<const uint8_t*>("abc"), 3);
+	md5.finalize();
+	CHECK(md5.hexdigest() == "900150983cd24fb0d6963f7d28e17f72");
+	SHA256 sha256;
+	sha256.update(reinterpret_cast<const uint8_t*>("abc"), 3);
+	sha256.finalize();
+	CHECK(sha256.hexdigest() == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
+
+TEST_CASE(HashBatchMatchesSingle) {
+	const std::vector<std::string> messages = make_messages();
+	const std::vector<ByteSpan> inputs = spans(messages);
+	// Every batch width from one message to more than two full AVX-512 rounds.
+	for (size_t count : { (size_t)1, (size_t)2, (size_t)7, (size_t)8, (size_t)9, (size_t)16, (size_t)33, inputs.size() }) {
+		std::vector<MD5::Digest> md5(count);
+		std::vector<SHA256::Digest> sha256(count);
+		MD5::hash_batch(inputs.data(), count, md5.data());
+		SHA256::hash_batch(inputs.data(), count, sha256.data());
+		for (size_t i = 0; i < count; i++) {
+			MD5 single;
+			single.update(inputs[i].data(), inputs[i].size());
+			single.finalize();
+			CHECK(md5[i] == single.rawdigest());
+			SHA256 singleSha;
+			singleSha.update(inputs[i].data(), inputs[i].size());
+			singleSha.finalize();
+			CHECK(sha256[i] == singleSha.rawdigest());
+		}
+	}
+}
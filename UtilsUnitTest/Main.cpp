@@ -0,0 +1,56 @@
+﻿#include "Test.h"
+#include "../Utils/defines.h"
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+namespace {
+	int failures = 0;
+}
+
+std::vector<TestCase>& TestRegistry() {
+	static std::vector<TestCase> registry;
+	return registry;
+}
+
+void ReportFailure(const char* file, int line, const char* expression) {
+	std::printf("  %s(%d): CHECK(%s) failed\n", file, line, expression);
+	failures++;
+}
+
+std::string TempPath(const char* name) {
+	char directory[MAX_PATH];
+	GetTempPathA(MAX_PATH, directory);
+	return std::string(directory) + "UtilsUnitTest_" + std::to_string(GetCurrentProcessId()) + "_" + name;
+}
+
+// Runs every test case, or those whose name contains the first argument.
+// Returns the number of failed test cases.
+int main(int argc, char** argv) {
+	const char* filter = argc > 1 ? argv[1] : nullptr;
+	int run = 0;
+	int failed = 0;
+	for (const TestCase& test : TestRegistry()) {
+		if (filter && !std::strstr(test.Name, filter))
+			continue;
+		const int before = failures;
+		try {
+			test.Body();
+		}
+		catch (const std::exception& e) {
+			std::printf("  unexpected exception: %s\n", e.what());
+			failures++;
+		}
+		catch (...) {
+			std::printf("  unexpected exception\n");
+			failures++;
+		}
+		run++;
+		if (failures != before) {
+			failed++;
+			std::printf("FAILED %s\n", test.Name);
+		}
+	}
+	std::printf("%d of %d test cases passed\n", run - failed, run);
+	return failed;
+}
@@ -0,0 +1,29 @@
+﻿#include "Test.h"
+#include "../Utils/Span.h"
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Named containers and other spans convert; temporary containers would dangle.
+static_assert(std::is_convertible_v<std::vector<uint8_t>&, ByteSpan>);
+static_assert(std::is_convertible_v<const std::vector<uint8_t>&, ByteSpan>);
+static_assert(std::is_convertible_v<std::array<uint8_t, 4>&, MutableByteSpan>);
+static_assert(!std::is_convertible_v<std::vector<uint8_t>&&, ByteSpan>);
+static_assert(!std::is_convertible_v<std::vector<uint8_t>, ByteSpan>);
+static_assert(!std::is_convertible_v<const std::vector<uint8_t>&, MutableByteSpan>);
+static_assert(std::is_convertible_v<MutableByteSpan, ByteSpan>);
+static_assert(!std::is_convertible_v<ByteSpan, MutableByteSpan>);
+
+TEST_CASE(SpanViews) {
+	std::vector<uint8_t> bytes = { 1, 2, 3, 4, 5 };
+	const ByteSpan all = bytes;
+	CHECK(all.data() == bytes.data() && all.size() == 5);
+	const ByteSpan fromMutable = MutableByteSpan(bytes);
+	CHECK(fromMutable.data() == bytes.data());
+	CHECK(all.first(2).size() == 2 && all.last(2)[0] == 4);
+	CHECK(all.subspan(1).size() == 4 && all.subspan(1, 2)[1] == 3);
+	uint8_t raw[3] = {};
+	CHECK(MutableByteSpan(raw).size() == 3);
+	CHECK(AsBytes("abc").size() == 3);
+}
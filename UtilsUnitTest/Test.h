@@ -0,0 +1,51 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+
+// Minimal self-registering test cases for the console test runner. CHECK
+// records a failure and carries on; an exception escaping a test case fails
+// it as well.
+//
+//     TEST_CASE(Utf8RoundTrip) {
+//         CHECK(Convert::Utf16ToUtf8(u"abc") == "abc");
+//     }
+struct TestCase {
+	const char* Name;
+	void (*Body)();
+};
+
+std::vector<TestCase>& TestRegistry();
+void ReportFailure(const char* file, int line, const char* expression);
+// A path in the temporary directory that no other test uses. The file is
+// not created.
+std::string TempPath(const char* name);
+
+struct TestRegistration {
+	TestRegistration(const char* name, void (*body)()) {
+		TestRegistry().push_back({ name, body });
+	}
+};
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static TestRegistration name##Registration(#name, name); \
+	static void name()
+
+#define CHECK(expression) \
+	do { \
+		if (!(expression)) \
+			ReportFailure(__FILE__, __LINE__, #expression); \
+	} while (0)
+
+#define CHECK_THROWS(expression, type) \
+	do { \
+		bool thrown = false; \
+		try { \
+			expression; \
+		} \
+		catch (const type&) { \
+			thrown = true; \
+		} \
+		if (!thrown) \
+			ReportFailure(__FILE__, __LINE__, #expression " throws " #type); \
+	} while (0)
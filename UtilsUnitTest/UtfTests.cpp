@@ -0,0 +1,50 @@
+﻿#include "Test.h"
+#include "../Utils/Convert.h"
+#include "../Utils/Utf.h"
+
+TEST_CASE(UtfEmptyInput) {
+	CHECK(Utf::IsAscii((const char*)nullptr, 0));
+	CHECK(Utf::ValidateUtf8(nullptr, 0).Ok());
+	CHECK(Utf::ValidateUtf16(nullptr, 0).Ok());
+	CHECK(Utf::Utf16LengthFromUtf8(nullptr, 0) == 0);
+	CHECK(Utf::Utf8ToUtf16(nullptr, 0, nullptr).Count == 0);
+	CHECK(Convert::Utf8ToUtf16("").empty());
+	CHECK(Convert::Utf16ToUtf8(u"").empty());
+}
+
+TEST_CASE(UtfBlockBoundaries) {
+	// Lengths around the 16 and 32 byte SIMD blocks, with the multi-byte
+	// character in the tail.
+	for (size_t length = 0; length <= 70; length++) {
+		std::string text(length, 'a');
+		text += "\xE4\xBD\xA0";
+		const std::u16string utf16 = Convert::Utf8ToUtf16(text);
+		CHECK(utf16.size() == length + 1);
+		CHECK(utf16.back() == u'\x4F60');
+		CHECK(Convert::Utf16ToUtf8(utf16) == text);
+		CHECK(Utf::ValidateUtf8(text.data(), length).Ok());
+	}
+}
+
+TEST_CASE(UtfRoundTrip) {
+	const std::string text = "A\xC3\xA9\xE4\xBD\xA0\xF0\x9F\x98\x80z";
+	const std::u32string utf32 = Convert::Utf8ToUtf32(text);
+	CHECK(utf32 == U"A\u00E9\u4F60\U0001F600z");
+	CHECK(Convert::Utf32ToUtf8(utf32) == text);
+	const std::u16string utf16 = Convert::Utf8ToUtf16(text);
+	CHECK(utf16.size() == 6);
+	CHECK(Convert::Utf16ToUtf8(utf16) == text);
+}
+
+TEST_CASE(UtfInvalidInput) {
+	const std::string truncated = std::string(40, 'a') + "\xE4\xBD";
+	const UtfResult result = Utf::ValidateUtf8(truncated.data(), truncated.size());
+	CHECK(!result.Ok());
+	CHECK(result.Count == 40);
+	CHECK(!Utf::ValidateUtf8("\xC0\x80", 2).Ok());
+	CHECK(!Utf::ValidateUtf8("\xED\xA0\x80", 3).Ok());
+	// Invalid sequences become U+FFFD.
+	CHECK(Convert::Utf8ToUtf16("a\xFF" "b") == u"a\xFFFD" u"b");
+	const char16_t lone[] = { u'x', 0xD800, u'y' };
+	CHECK(Convert::Utf16ToUtf8(std::u16string(lone, 3)) == "x\xEF\xBF\xBDy");
+}
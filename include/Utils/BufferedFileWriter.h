@@ -0,0 +1,65 @@
+﻿#pragma once
+#include "defines.h"
+#include "FileStream.h"
+#include "Span.h"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Collects small writes in memory and hands them to the file in large
+// batches, so thousands of records per second cost a few system calls
+// instead of an open, write and close each. Safe to share between threads;
+// each Write or WriteLine lands in the file whole.
+//
+//     BufferedFileWriter log("checkpoint.log");
+//     log.WriteLine(record);
+//     log.Flush();          // hand the batch to the system now
+class BufferedFileWriter {
+public:
+	static constexpr size_t DefaultBufferSize = 1 << 20;
+
+	// mode is FileMode::Append or FileMode::Write. Throws
+	// std::invalid_argument for other modes and std::runtime_error if the
+	// file cannot be opened.
+	explicit BufferedFileWriter(const std::string& path, FileMode mode = FileMode::Append, size_t bufferSize = DefaultBufferSize);
+	// Flushes whatever is still buffered.
+	~BufferedFileWriter();
+	BufferedFileWriter(const BufferedFileWriter&) = delete;
+	BufferedFileWriter& operator=(const BufferedFileWriter&) = delete;
+
+	// Return false if a batch could not be written.
+	bool Write(ByteSpan data);
+	bool Write(std::string_view text);
+	// text followed by "\n".
+	bool WriteLine(std::string_view text);
+
+	// Besides a full buffer, a write also flushes once the oldest buffered
+	// byte has waited this long. Zero, the default, waits for a full buffer.
+	// Nothing is flushed between writes; call Flush() when idle.
+	void SetFlushInterval(std::chrono::milliseconds interval);
+	// Hands buffered bytes to the system.
+	bool Flush();
+	// Flush, then waits until they are on disk.
+	bool Sync();
+	void Close();
+
+	// Bytes in the file or still buffered; a batch that failed to write is
+	// not counted.
+	uint64_t BytesWritten() const;
+	size_t BufferSize() const { return capacity; }
+
+private:
+	mutable std::mutex mutex;
+	FileStream stream;
+	std::vector<uint8_t> buffer;
+	size_t capacity;
+	uint64_t written = 0;
+	std::chrono::milliseconds interval{ 0 };
+	std::chrono::steady_clock::time_point oldest;
+
+	bool Append(const void* data, size_t size);
+	bool FlushBuffer();
+};
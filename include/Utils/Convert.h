@@ -1,7 +1,24 @@
 ﻿#pragma once
 #include <vector>
 #include <string>
+#include <string_view>
 #include <codecvt>
+#include <cstdint>
+#include "Span.h"
+enum class NumberError {
+	None,
+	Empty,
+	InvalidFormat,
+	OutOfRange
+};
+// Count is the number of characters consumed on success, or the offset of the
+// offending character on failure.
+struct NumberResult {
+	NumberError Error = NumberError::None;
+	size_t Count = 0;
+	bool Ok() const { return Error == NumberError::None; }
+	explicit operator bool() const { return Ok(); }
+};
 class Convert {
 public:
 	static std::string ToHex(const uint8_t input);
@@ -55,11 +72,28 @@ public:
 	static std::string CalcSHA256(const std::vector<uint8_t>& data);
 	static std::string CalcMD5(const std::string& data);
 	static std::string CalcSHA256(const std::string& data);
-	static int ToInt32(const std::string input);
-	static long long ToInt64(const std::string input);
-	static double ToFloat(const std::string input);
+	// Hashes many independent buffers at once on the multi-buffer SIMD engine.
+	static std::vector<std::string> CalcMD5Batch(Span<const ByteSpan> inputs);
+	static std::vector<std::string> CalcSHA256Batch(Span<const ByteSpan> inputs);
+	// Root of a SHA256 Merkle tree over leafSize byte leaves, hashed in parallel.
+	// See MerkleTree for the exact tree layout.
+	static std::string CalcTreeSHA256(const void* data, size_t size, size_t leafSize = 1 << 20);
+	static std::string CalcTreeSHA256File(const std::string& path, size_t leafSize = 1 << 20);
+	static int ToInt32(std::string_view input);
+	static long long ToInt64(std::string_view input);
+	static double ToFloat(std::string_view input);
 #define ToDouble ToFloat
 
+	// Locale-independent parsing without allocation. The whole input must be
+	// a number, with an optional leading sign. T: any integer type, float or double.
+	template<typename T>
+	static NumberResult TryParse(std::string_view input, T& value);
+	// Writes the shortest round-trip text for value without a terminator and
+	// returns the character count. out must hold FormatBufferSize chars.
+	static constexpr size_t FormatBufferSize = 32;
+	template<typename T>
+	static size_t Format(T value, char* out);
+
 private:
 	static std::wstring MultiByteToWide(const std::string& str, uint32_t codePage);
 	static std::string WideToMultiByte(const std::wstring& wstr, uint32_t codePage);
@@ -0,0 +1,75 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include "DataPack.h"
+#include "Span.h"
+
+struct DataPackContainerOptions {
+	// zlib level 1-9, or 0 to store blocks uncompressed. Blocks that do not
+	// shrink are stored either way.
+	int Level = 6;
+	// Root children are grouped into blocks of about this many bytes before
+	// compression; a larger child gets a block of its own.
+	size_t BlockSize = 256 * 1024;
+};
+
+// Compressed, checksummed container for a DataPack.
+//
+// Layout, little-endian:
+//   header   "DPKC", u16 version, u16 flags, u64 index offset,
+//            u32 index size, u32 block count, u32 CRC-32C of the above, u32 0
+//   blocks   block 0 holds the root without its children; every further
+//            block holds consecutive root children as encoded packs
+//   index    one 32-byte entry per block (u64 offset, u32 stored size,
+//            u32 raw size, u32 first child, u32 child count, u32 CRC-32C of
+//            the stored bytes, u8 codec, 3 reserved), then the CRC-32C of
+//            the entries
+//
+// Opening a container reads only the header and index, so one root child can
+// be decoded by inflating the single block that holds it. The first byte of
+// a plain DataPack is never 'D', so DataPack(const uint8_t*, int) accepts
+// either form for a whole buffer.
+class DataPackContainer {
+public:
+	static constexpr uint16_t Version = 1;
+
+	static std::vector<uint8_t> Encode(const DataPack& pack, const DataPackContainerOptions& options = DataPackContainerOptions());
+	static bool IsContainer(const uint8_t* data, size_t size);
+
+	DataPackContainer() = default;
+	// Checks the header and index; the blocks are read on demand and must
+	// stay valid, like the buffer behind a DataPackView.
+	DataPackContainer(const uint8_t* data, size_t size);
+	explicit DataPackContainer(ByteSpan data) : DataPackContainer(data.data(), data.size()) {}
+
+	bool Valid() const { return data != nullptr; }
+	size_t ChildCount() const { return childCount; }
+	size_t BlockCount() const { return blocks.size(); }
+
+	// Each returns false if a checksum fails or a block is malformed.
+	// The root's Id and Value, without children.
+	bool ReadHead(DataPack& pack) const;
+	// Root child number index; inflates only the block that holds it.
+	bool ReadChild(size_t index, DataPack& child) const;
+	bool Decode(DataPack& pack) const;
+	// Checks every block checksum without inflating anything.
+	bool Verify() const;
+
+private:
+	struct Block {
+		uint64_t offset;
+		uint32_t storedSize;
+		uint32_t rawSize;
+		uint32_t firstChild;
+		uint32_t childCount;
+		uint32_t checksum;
+		uint8_t codec;
+	};
+
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+	std::vector<Block> blocks;
+	size_t childCount = 0;
+
+	bool Load(const Block& block, std::vector<uint8_t>& raw) const;
+};
@@ -0,0 +1,467 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "DataPack.h"
+#include "DataPackView.h"
+#include "Span.h"
+
+// Field list of a bound struct. Filled in by DATAPACK_FIELDS inside the struct
+// or by DATAPACK_BINDING at global scope; left empty for unbound types.
+template<typename T, typename = void>
+struct DataPackFields {};
+
+template<typename T>
+struct DataPackFields<T, std::void_t<decltype(T::DataPackNames)>> {
+	static constexpr const std::string_view* Names = T::DataPackNames;
+	static constexpr size_t Count = std::size(T::DataPackNames);
+	template<typename Self, typename Visit>
+	static void Each(Self& self, Visit&& visit) { T::DataPackEach(self, visit); }
+};
+
+template<typename T, typename = void>
+struct IsDataPackBound : std::false_type {};
+template<typename T>
+struct IsDataPackBound<T, std::void_t<decltype(DataPackFields<T>::Count)>> : std::true_type {};
+
+#define DATAPACK_EXPAND(x) x
+#define DATAPACK_GET_MACRO(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, NAME, ...) NAME
+#define DATAPACK_PASTE(what, ...) DATAPACK_EXPAND(DATAPACK_GET_MACRO(__VA_ARGS__, DATAPACK_PASTE32, DATAPACK_PASTE31, DATAPACK_PASTE30, DATAPACK_PASTE29, DATAPACK_PASTE28, DATAPACK_PASTE27, DATAPACK_PASTE26, DATAPACK_PASTE25, DATAPACK_PASTE24, DATAPACK_PASTE23, DATAPACK_PASTE22, DATAPACK_PASTE21, DATAPACK_PASTE20, DATAPACK_PASTE19, DATAPACK_PASTE18, DATAPACK_PASTE17, DATAPACK_PASTE16, DATAPACK_PASTE15, DATAPACK_PASTE14, DATAPACK_PASTE13, DATAPACK_PASTE12, DATAPACK_PASTE11, DATAPACK_PASTE10, DATAPACK_PASTE9, DATAPACK_PASTE8, DATAPACK_PASTE7, DATAPACK_PASTE6, DATAPACK_PASTE5, DATAPACK_PASTE4, DATAPACK_PASTE3, DATAPACK_PASTE2, DATAPACK_PASTE1)(what, __VA_ARGS__))
+#define DATAPACK_PASTE1(what, x) what(x)
+#define DATAPACK_PASTE2(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE1(what, __VA_ARGS__))
+#define DATAPACK_PASTE3(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE2(what, __VA_ARGS__))
+#define DATAPACK_PASTE4(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE3(what, __VA_ARGS__))
+#define DATAPACK_PASTE5(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE4(what, __VA_ARGS__))
+#define DATAPACK_PASTE6(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE5(what, __VA_ARGS__))
+#define DATAPACK_PASTE7(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE6(what, __VA_ARGS__))
+#define DATAPACK_PASTE8(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE7(what, __VA_ARGS__))
+#define DATAPACK_PASTE9(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE8(what, __VA_ARGS__))
+#define DATAPACK_PASTE10(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE9(what, __VA_ARGS__))
+#define DATAPACK_PASTE11(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE10(what, __VA_ARGS__))
+#define DATAPACK_PASTE12(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE11(what, __VA_ARGS__))
+#define DATAPACK_PASTE13(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE12(what, __VA_ARGS__))
+#define DATAPACK_PASTE14(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE13(what, __VA_ARGS__))
+#define DATAPACK_PASTE15(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE14(what, __VA_ARGS__))
+#define DATAPACK_PASTE16(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE15(what, __VA_ARGS__))
+#define DATAPACK_PASTE17(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE16(what, __VA_ARGS__))
+#define DATAPACK_PASTE18(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE17(what, __VA_ARGS__))
+#define DATAPACK_PASTE19(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE18(what, __VA_ARGS__))
+#define DATAPACK_PASTE20(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE19(what, __VA_ARGS__))
+#define DATAPACK_PASTE21(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE20(what, __VA_ARGS__))
+#define DATAPACK_PASTE22(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE21(what, __VA_ARGS__))
+#define DATAPACK_PASTE23(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE22(what, __VA_ARGS__))
+#define DATAPACK_PASTE24(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE23(what, __VA_ARGS__))
+#define DATAPACK_PASTE25(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE24(what, __VA_ARGS__))
+#define DATAPACK_PASTE26(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE25(what, __VA_ARGS__))
+#define DATAPACK_PASTE27(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE26(what, __VA_ARGS__))
+#define DATAPACK_PASTE28(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE27(what, __VA_ARGS__))
+#define DATAPACK_PASTE29(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE28(what, __VA_ARGS__))
+#define DATAPACK_PASTE30(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE29(what, __VA_ARGS__))
+#define DATAPACK_PASTE31(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE30(what, __VA_ARGS__))
+#define DATAPACK_PASTE32(what, x, ...) what(x) DATAPACK_EXPAND(DATAPACK_PASTE31(what, __VA_ARGS__))
+#define DATAPACK_FIELD_NAME(field) #field,
+#define DATAPACK_FIELD_VISIT(field) visit(index++, self.field);
+
+// Binds up to 32 fields of the enclosing struct, in this order. Put it in a
+// public section; the fields themselves may be private.
+//
+//     struct Endpoint {
+//         std::string Host;
+//         uint16_t Port = 0;
+//         DATAPACK_FIELDS(Host, Port)
+//     };
+#define DATAPACK_FIELDS(...) \
+	static constexpr std::string_view DataPackNames[] = { DATAPACK_EXPAND(DATAPACK_PASTE(DATAPACK_FIELD_NAME, __VA_ARGS__)) }; \
+	template<typename Self, typename Visit> \
+	static void DataPackEach(Self& self, Visit&& visit) { \
+		size_t index = 0; \
+		DATAPACK_EXPAND(DATAPACK_PASTE(DATAPACK_FIELD_VISIT, __VA_ARGS__)) \
+	}
+
+// Binds the public fields of a struct that cannot be edited. Use it at global
+// scope, with the type's qualified name, before the type is first serialized.
+#define DATAPACK_BINDING(Type, ...) \
+	template<> \
+	struct DataPackFields<Type> { \
+		static constexpr std::string_view Names[] = { DATAPACK_EXPAND(DATAPACK_PASTE(DATAPACK_FIELD_NAME, __VA_ARGS__)) }; \
+		static constexpr size_t Count = std::size(Names); \
+		template<typename Self, typename Visit> \
+		static void Each(Self& self, Visit&& visit) { \
+			size_t index = 0; \
+			DATAPACK_EXPAND(DATAPACK_PASTE(DATAPACK_FIELD_VISIT, __VA_ARGS__)) \
+		} \
+	};
+
+// Serializer and deserializer for a struct bound with DATAPACK_FIELDS or
+// DATAPACK_BINDING. Every field becomes a child pack whose Id is the field
+// name, in declaration order, exactly as if it had been written by hand with
+// pack["field"] = value:
+//   trivially copyable   its bytes, read back like convert<T>()
+//   std::string/wstring  the characters
+//   std::vector<T>       the elements' bytes, for trivially copyable T;
+//                        otherwise one child with an empty Id per element
+//   bound struct         a child holding its own fields
+// The encoded size of every pack is computed in one bottom-up pass before
+// anything is written, so the output is produced in one pass with no length
+// back-patching, and is byte-for-byte what DataPack::GetBytes would give.
+// Reading walks the children positionally and only compares each Id with the
+// name expected at that position; a pack whose children were reordered,
+// dropped or extended still reads correctly through a slower scan. Fields
+// without a matching child keep their current value.
+//
+//     std::vector<uint8_t> bytes = DataPackSchema<Endpoint>::GetBytes(endpoint, "endpoint");
+//     Endpoint copy;
+//     DataPackSchema<Endpoint>::Parse(bytes.data(), bytes.size(), copy);
+template<typename T>
+class DataPackSchema {
+	static_assert(IsDataPackBound<T>::value, "T must be bound with DATAPACK_FIELDS or DATAPACK_BINDING");
+
+public:
+	// Appends value as a pack with the given Id.
+	static void WriteTo(const T& value, std::vector<uint8_t>& out, std::string_view id = {}) {
+		std::vector<size_t> sizes;
+		const size_t size = Measure(value, id.size(), sizes);
+		if (size > UINT32_MAX)
+			throw std::length_error("DataPack exceeds 4 GB");
+		const size_t start = out.size();
+		out.resize(start + size);
+		const size_t* next = sizes.data() + 1;
+		WritePack(out.data() + start, value, id, size, next);
+	}
+	static std::vector<uint8_t> GetBytes(const T& value, std::string_view id = {}) {
+		std::vector<uint8_t> out;
+		WriteTo(value, out, id);
+		return out;
+	}
+	static DataPack ToDataPack(const T& value, std::string_view id = {}) {
+		DataPack pack;
+		pack.Id = std::string(id);
+		Put(pack, value);
+		return pack;
+	}
+
+	static void FromDataPack(const DataPack& pack, T& value) { Get(pack, value); }
+	// Reads the first pack in data straight from its encoding. Returns false
+	// if a part it reads is malformed; value may then be partly filled.
+	static bool Parse(const uint8_t* data, size_t size, T& value) {
+		Node node;
+		return data != nullptr && Open(data, DataPackView::PackSize(data, size), node) && Get(node, value);
+	}
+	static bool Parse(ByteSpan data, T& value) { return Parse(data.data(), data.size(), value); }
+	static bool Read(const DataPackView& view, T& value) { return view.Valid() && Parse(view.Bytes(), value); }
+
+private:
+	template<typename F>
+	static constexpr bool IsStruct = IsDataPackBound<F>::value;
+	template<typename F>
+	static constexpr bool IsPlain = std::is_trivially_copyable_v<F> && !std::is_pointer_v<F> && !IsStruct<F>;
+	template<typename F>
+	struct Vector : std::false_type {};
+	template<typename E, typename A>
+	struct Vector<std::vector<E, A>> : std::true_type {
+		using Element = E;
+	};
+	template<typename F>
+	static constexpr bool IsString = std::is_same_v<F, std::string> || std::is_same_v<F, std::wstring>;
+	// Encoded as a Value, as opposed to children.
+	template<typename F>
+	static constexpr bool IsLeaf = [] {
+		if constexpr (Vector<F>::value)
+			return IsPlain<typename Vector<F>::Element>;
+		else
+			return IsPlain<F> || IsString<F>;
+	}();
+
+	template<typename F>
+	static void CheckField() {
+		if constexpr (Vector<F>::value) {
+			static_assert(!std::is_same_v<typename Vector<F>::Element, bool>, "std::vector<bool> has no contiguous storage");
+			CheckField<typename Vector<F>::Element>();
+		}
+		else {
+			static_assert(IsStruct<F> || IsPlain<F> || IsString<F>, "Unsupported DataPack field type");
+		}
+	}
+
+	template<typename F>
+	static ByteSpan LeafBytes(const F& value) {
+		if constexpr (Vector<F>::value || IsString<F>)
+			return ByteSpan((const uint8_t*)value.data(), value.size() * sizeof(typename F::value_type));
+		else
+			return ByteSpan((const uint8_t*)&value, sizeof(F));
+	}
+	template<typename F>
+	static void SetLeaf(F& value, ByteSpan bytes) {
+		if constexpr (Vector<F>::value || IsString<F>) {
+			using E = typename F::value_type;
+			value.resize(bytes.size() / sizeof(E));
+			if (!value.empty())
+				std::memcpy(value.data(), bytes.data(), value.size() * sizeof(E));
+		}
+		else if (bytes.size() >= sizeof(F)) {
+			std::memcpy(&value, bytes.data(), sizeof(F));
+		}
+		else if constexpr (std::is_array_v<F>) {
+			std::memset(&value, 0, sizeof(F));
+		}
+		else {
+			value = F{};
+		}
+	}
+
+	static size_t LengthWidth(size_t len) {
+		return len > UINT16_MAX ? 4 : len > UINT8_MAX ? 2 : 1;
+	}
+	// Marker, length prefix, payload and terminator.
+	static size_t EntrySize(size_t len) {
+		return 2 + LengthWidth(len) + len;
+	}
+	static void Store16(uint8_t* p, uint16_t v) {
+		p[0] = (uint8_t)v;
+		p[1] = (uint8_t)(v >> 8);
+	}
+	static void Store32(uint8_t* p, uint32_t v) {
+		for (int i = 0; i < 4; i++)
+			p[i] = (uint8_t)(v >> (8 * i));
+	}
+	static uint8_t* PutLength(uint8_t* p, DataPachKey wide, DataPachKey small, DataPachKey tiny, size_t len) {
+		switch (LengthWidth(len)) {
+		case 4: *p = (uint8_t)wide; Store32(p + 1, (uint32_t)len); return p + 5;
+		case 2: *p = (uint8_t)small; Store16(p + 1, (uint16_t)len); return p + 3;
+		default: *p = (uint8_t)tiny; p[1] = (uint8_t)len; return p + 2;
+		}
+	}
+
+	// Size of the whole pack holding a leaf under an Id of idSize bytes.
+	template<typename F>
+	static size_t LeafPackSize(const F& value, size_t idSize) {
+		const size_t len = LeafBytes(value).size();
+		return 6 + (idSize ? 4 + idSize : 0) + (len ? EntrySize(len) : 0);
+	}
+	// Size of the whole pack holding value under an Id of idSize bytes. The
+	// size of every pack with children is appended to sizes in the order
+	// WritePack meets them, parent before children, so each subtree is
+	// measured once rather than again at every level above it.
+	template<typename F>
+	static size_t Measure(const F& value, size_t idSize, std::vector<size_t>& sizes) {
+		CheckField<F>();
+		if constexpr (IsLeaf<F>) {
+			return LeafPackSize(value, idSize);
+		}
+		else {
+			const size_t slot = sizes.size();
+			sizes.push_back(0);
+			size_t size = 6 + (idSize ? 4 + idSize : 0);
+			if constexpr (IsStruct<F>) {
+				DataPackFields<F>::Each(value, [&](size_t i, const auto& field) {
+					size += EntrySize(Measure(field, DataPackFields<F>::Names[i].size(), sizes));
+				});
+			}
+			else {
+				for (const auto& element : value)
+					size += EntrySize(Measure(element, 0, sizes));
+			}
+			sizes[slot] = size;
+			return size;
+		}
+	}
+
+	// next points at the measured size of the next pack with children.
+	template<typename F>
+	static uint8_t* WriteChild(uint8_t* p, const F& value, std::string_view id, const size_t*& next) {
+		size_t size;
+		if constexpr (IsLeaf<F>)
+			size = LeafPackSize(value, id.size());
+		else
+			size = *next++;
+		p = PutLength(p, DataPachKey::ChildStart, DataPachKey::ChildStart_Small, DataPachKey::ChildStart_Small_X, size);
+		p = WritePack(p, value, id, size, next);
+		*p = (uint8_t)DataPachKey::ChildEnd;
+		return p + 1;
+	}
+
+	template<typename F>
+	static uint8_t* WritePack(uint8_t* p, const F& value, std::string_view id, size_t size, const size_t*& next) {
+		p[0] = (uint8_t)DataPachKey::FileStart;
+		Store32(p + 1, (uint32_t)size);
+		p += 5;
+		if (!id.empty()) {
+			p[0] = (uint8_t)DataPachKey::IdStart;
+			Store16(p + 1, (uint16_t)id.size());
+			std::memcpy(p + 3, id.data(), id.size());
+			p += 3 + id.size();
+			*p++ = (uint8_t)DataPachKey::IdEnd;
+		}
+		if constexpr (IsLeaf<F>) {
+			const ByteSpan bytes = LeafBytes(value);
+			if (!bytes.empty()) {
+				p = PutLength(p, DataPachKey::ValueStart, DataPachKey::ValueStart_Small, DataPachKey::ValueStart_Small_X, bytes.size());
+				std::memcpy(p, bytes.data(), bytes.size());
+				p += bytes.size();
+				*p++ = (uint8_t)DataPachKey::ValueEnd;
+			}
+		}
+		else if constexpr (IsStruct<F>) {
+			DataPackFields<F>::Each(value, [&](size_t i, const auto& field) {
+				p = WriteChild(p, field, DataPackFields<F>::Names[i], next);
+			});
+		}
+		else {
+			for (const auto& element : value)
+				p = WriteChild(p, element, {}, next);
+		}
+		*p = (uint8_t)DataPachKey::FileEnd;
+		return p + 1;
+	}
+
+	template<typename F>
+	static void Put(DataPack& node, const F& value) {
+		CheckField<F>();
+		if constexpr (IsLeaf<F>) {
+			const ByteSpan bytes = LeafBytes(value);
+			node.Value.assign(bytes.begin(), bytes.end());
+		}
+		else if constexpr (IsStruct<F>) {
+			node.Child.reserve(node.Child.size() + DataPackFields<F>::Count);
+			DataPackFields<F>::Each(value, [&](size_t i, const auto& field) {
+				DataPack& child = node.Child.emplace_back();
+				child.Id = std::string(DataPackFields<F>::Names[i]);
+				Put(child, field);
+			});
+		}
+		else {
+			node.Child.reserve(node.Child.size() + value.size());
+			for (const auto& element : value)
+				Put(node.Child.emplace_back(), element);
+		}
+	}
+
+	template<typename F>
+	static void Get(const DataPack& node, F& value) {
+		CheckField<F>();
+		if constexpr (IsLeaf<F>) {
+			SetLeaf(value, ByteSpan(node.Value.data(), node.Value.size()));
+		}
+		else if constexpr (IsStruct<F>) {
+			const std::vector<DataPack>& children = node.Child;
+			size_t next = 0;
+			DataPackFields<F>::Each(value, [&](size_t i, auto& field) {
+				const std::string_view name = DataPackFields<F>::Names[i];
+				size_t found = next;
+				if (found >= children.size() || children[found].Id != name) {
+					for (found = 0; found < children.size() && children[found].Id != name; found++);
+					if (found == children.size())
+						return;
+				}
+				Get(children[found], field);
+				next = found + 1;
+			});
+		}
+		else {
+			value.clear();
+			value.resize(node.Child.size());
+			for (size_t i = 0; i < node.Child.size(); i++)
+				Get(node.Child[i], value[i]);
+		}
+	}
+
+	// Top-level entries of one encoded pack, ending at its FileEnd marker, with
+	// its Id and Value. Later Id and Value entries override earlier ones, as
+	// in the DataPack parser.
+	struct Node {
+		const uint8_t* begin;
+		const uint8_t* end;
+		std::string_view id;
+		ByteSpan value;
+	};
+
+	// Checks the framing of the pack's own entries; children are checked when
+	// they are opened, so unbound subtrees are skipped unread.
+	static bool Open(const uint8_t* data, size_t size, Node& node) {
+		if (size == 0 || DataPackView::PackSize(data, size) != size)
+			return false;
+		node.begin = data + 5;
+		node.end = data + size - 1;
+		node.id = {};
+		node.value = {};
+		DataPackView::Entry e;
+		for (const uint8_t* p = node.begin; p < node.end; p = e.next) {
+			if (!DataPackView::ReadEntry(p, node.end, e))
+				return false;
+			if (e.key == DataPachKey::IdStart)
+				node.id = std::string_view((const char*)e.payload, e.length);
+			else if (e.key == DataPachKey::ValueStart || e.key == DataPachKey::ValueStart_Small || e.key == DataPachKey::ValueStart_Small_X)
+				node.value = ByteSpan(e.payload, e.length);
+		}
+		return true;
+	}
+
+	// Child entry at or after p, or nullptr; entries were checked by Open.
+	static const uint8_t* NextChild(const uint8_t* p, const Node& node, DataPackView::Entry& e) {
+		for (; p < node.end; p = e.next) {
+			DataPackView::ReadEntry(p, node.end, e);
+			if (e.key != DataPachKey::IdStart && e.key != DataPachKey::ValueStart &&
+				e.key != DataPachKey::ValueStart_Small && e.key != DataPachKey::ValueStart_Small_X)
+				return p;
+		}
+		return nullptr;
+	}
+
+	template<typename F>
+	static bool Get(const Node& node, F& value) {
+		CheckField<F>();
+		if constexpr (IsLeaf<F>) {
+			SetLeaf(value, node.value);
+			return true;
+		}
+		else if constexpr (IsStruct<F>) {
+			// Field i is looked for at the child after the one matched for
+			// field i - 1, so a pack in field order is read in one pass.
+			bool ok = true;
+			const uint8_t* next = node.begin;
+			DataPackFields<F>::Each(value, [&](size_t i, auto& field) {
+				if (!ok)
+					return;
+				const std::string_view name = DataPackFields<F>::Names[i];
+				DataPackView::Entry e;
+				Node child;
+				const uint8_t* p = NextChild(next, node, e);
+				if (p && !(ok = Open(e.payload, e.length, child)))
+					return;
+				if (!p || child.id != name) {
+					for (p = NextChild(node.begin, node, e); p; p = NextChild(e.next, node, e)) {
+						if (!(ok = Open(e.payload, e.length, child)))
+							return;
+						if (child.id == name)
+							break;
+					}
+					if (!p)
+						return;
+				}
+				ok = Get(child, field);
+				next = e.next;
+			});
+			return ok;
+		}
+		else {
+			DataPackView::Entry e;
+			size_t count = 0;
+			for (const uint8_t* p = NextChild(node.begin, node, e); p; p = NextChild(e.next, node, e))
+				count++;
+			value.clear();
+			value.resize(count);
+			size_t i = 0;
+			for (const uint8_t* p = NextChild(node.begin, node, e); p; p = NextChild(e.next, node, e)) {
+				Node child;
+				if (!Open(e.payload, e.length, child) || !Get(child, value[i++]))
+					return false;
+			}
+			return true;
+		}
+	}
+};
@@ -0,0 +1,106 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+#include "DataPack.h"
+#include "Span.h"
+
+// Read-only, zero-copy access to a serialized DataPack.
+// The root constructor validates the framing of the whole tree once; after
+// that Id(), Value() and child views point straight into the original buffer,
+// which must outlive every view taken from it (a file mapping works as well as
+// a vector). Unlike DataPack(const uint8_t*, int), a malformed buffer yields
+// an invalid view rather than a partially parsed one.
+class DataPackView {
+public:
+	class iterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = DataPackView;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const DataPackView*;
+		using reference = DataPackView;
+
+		DataPackView operator*() const;
+		iterator& operator++();
+		iterator operator++(int) { iterator old = *this; ++*this; return old; }
+		bool operator==(const iterator& other) const { return pos == other.pos; }
+		bool operator!=(const iterator& other) const { return pos != other.pos; }
+
+	private:
+		friend class DataPackView;
+		iterator(const uint8_t* pos, const uint8_t* end) : pos(pos), end(end) {}
+		// Start of the current child entry, or end once exhausted.
+		const uint8_t* pos;
+		const uint8_t* end;
+	};
+
+	DataPackView() = default;
+	DataPackView(const uint8_t* data, size_t size);
+	explicit DataPackView(ByteSpan data) : DataPackView(data.data(), data.size()) {}
+
+	bool Valid() const { return data != nullptr; }
+	explicit operator bool() const { return Valid(); }
+
+	std::string_view Id() const { return std::string_view((const char*)idData, idSize); }
+	ByteSpan Value() const { return ByteSpan(valueData, valueSize); }
+	// The encoded pack, header and trailer included.
+	ByteSpan Bytes() const { return ByteSpan(data, length); }
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	iterator begin() const { return iterator(firstChild, childrenEnd); }
+	iterator end() const { return iterator(childrenEnd, childrenEnd); }
+
+	// Walks the children, so O(index); prefer iteration for sequential access.
+	// Out-of-range indices and missing keys give an invalid view.
+	DataPackView operator[](size_t index) const;
+	DataPackView operator[](std::string_view id) const;
+	bool ContainsKey(std::string_view id) const { return (*this)[id].Valid(); }
+
+	template<typename T>
+	T convert() const {
+		static_assert(std::is_trivially_copyable_v<T>, "DataPack only supports trivially copyable types");
+		T output{};
+		if (valueSize >= sizeof(T))
+			std::memcpy(&output, valueData, sizeof(T));
+		return output;
+	}
+	std::string_view ValueString() const { return std::string_view((const char*)valueData, valueSize); }
+	// Copies the subtree into an owning DataPack.
+	DataPack ToDataPack() const;
+
+	// Low-level decoding, for readers that build their own structures.
+	struct Entry {
+		DataPachKey key;
+		const uint8_t* payload;
+		size_t length;
+		// Start of the following entry.
+		const uint8_t* next;
+	};
+	// Decodes the Id/Value/Child entry at p. end points at the enclosing
+	// pack's FileEnd marker. Returns false if the entry is malformed.
+	static bool ReadEntry(const uint8_t* p, const uint8_t* end, Entry& entry);
+	// Size of the pack at data according to its header, or 0 if the header
+	// or trailer is wrong or the pack overruns available.
+	static size_t PackSize(const uint8_t* data, size_t available);
+
+private:
+	struct Trusted {};
+	DataPackView(const uint8_t* data, Trusted);
+	void Index();
+
+	const uint8_t* data = nullptr;
+	size_t length = 0;
+	const uint8_t* idData = nullptr;
+	size_t idSize = 0;
+	const uint8_t* valueData = nullptr;
+	size_t valueSize = 0;
+	// Children are laid out between firstChild and childrenEnd, possibly
+	// interleaved with Id/Value entries.
+	const uint8_t* firstChild = nullptr;
+	const uint8_t* childrenEnd = nullptr;
+	size_t count = 0;
+};
@@ -1,6 +1,7 @@
 ﻿#pragma once
 #include "defines.h"
 #include <string>
+#include <string_view>
 #ifndef PROPERTY
 #define PROPERTY(t,n) __declspec( property (put = Set##n, get = Get##n)) t n
 #define READONLY_PROPERTY(t,n) __declspec( property (get = Get##n) ) t n
@@ -16,13 +17,40 @@
 #define typeof(x) decltype(x)
 #endif
 
+// All fields of a DateTime at once. DayOfWeek is 0 for Sunday, as in
+// SYSTEMTIME; Ticks are the 100 ns units below the millisecond.
+struct DateTimeParts {
+    int Year;
+    int Month;
+    int Day;
+    int Hour;
+    int Minute;
+    int Second;
+    int Millisecond;
+    int Ticks;
+    int DayOfWeek;
+};
+
+enum class ClockPrecision {
+    // The system time as of the last timer tick, 1 to 16 ms old; about as
+    // cheap as reading a variable.
+    Coarse,
+    // Interpolated to below a microsecond, at the cost of a performance
+    // counter read. Coarse on systems before Windows 8.
+    Fine
+};
+
+// 100 ns ticks since 1601-01-01 UTC, the FILETIME scale. Fields are computed
+// with integer calendar arithmetic instead of FileTimeToSystemTime, so reading
+// them and formatting cost a few multiplications.
 class DateTime {
 private:
     ULONGLONG dateData;
-    void GetSystemTime(SYSTEMTIME& sysTime) const;
-    void SetSystemTime(const SYSTEMTIME& sysTime);
 
 public:
+    // Format() writes at most this many characters.
+    static constexpr size_t FormatBufferSize = 32;
+
     DateTime();
     DateTime(UINT64 _timeData);
     DateTime(FILETIME fileTime);
@@ -38,7 +66,15 @@ public:
     DateTime AddMilliseconds(int milliseconds) const;
     DateTime AddTicks(ULONGLONG ticks) const;
     DateTime Add(int years, int months, int days, int hours, int minutes, int seconds, int milliseconds) const;
+    DateTimeParts Decompose() const;
+    // "yyyy-MM-dd HH:mm:ss.fff"
     std::string ToString() const;
+    // Writes ISO 8601 "yyyy-MM-ddTHH:mm:ss.fffZ" with fractionDigits (0 to 7)
+    // digits of the second and no terminator, and returns the character
+    // count. out must hold FormatBufferSize chars. Does not allocate; the
+    // date and time of the previous call on the thread are reused within the
+    // same second.
+    size_t Format(char* out, int fractionDigits = 3) const;
     bool operator==(const DateTime& other) const;
     bool operator!=(const DateTime& other) const;
     bool operator>(const DateTime& other) const;
@@ -65,8 +101,15 @@ public:
     READONLY_PROPERTY(ULONGLONG, Data);
     GET(ULONGLONG, Data);
 
-    static DateTime Now();
+    static DateTime Now(ClockPrecision precision = ClockPrecision::Coarse);
     static bool IsLeapYear(int year);
+    static int DaysInMonth(int year, int month);
+    // Returns DateTime() if str is not a date, see TryParse.
     static DateTime Parse(const std::string& str);
+    // Parses "yyyy-MM-dd", optionally followed by 'T' or a space and
+    // "HH:mm", ":ss" and a fraction of up to 7 digits, then 'Z' or an offset
+    // such as "+08:00" that is converted to UTC. Single-digit fields are
+    // accepted. The whole input must match. Does not allocate.
+    static bool TryParse(std::string_view input, DateTime& value);
 };
 
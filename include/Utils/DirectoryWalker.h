@@ -0,0 +1,78 @@
+﻿#pragma once
+#include "defines.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A file or directory found by DirectoryWalker. Size, attributes and times
+// come from the directory listing itself, so no file is opened or stat'ed.
+struct DirectoryEntry {
+	std::string Path;
+	uint64_t Length;
+	uint32_t Attributes;
+	FILETIME CreationTime;
+	FILETIME LastAccessTime;
+	FILETIME LastWriteTime;
+	// 0 for entries of the root, 1 for entries of its subdirectories, ...
+	int Depth;
+
+	bool IsDirectory() const { return (Attributes & FILE_ATTRIBUTE_DIRECTORY) != 0; }
+	bool IsReparsePoint() const { return (Attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0; }
+	// Last component of Path.
+	std::string_view Name() const;
+	// From the last '.' of Name(), like FileInfo::Extension(); empty if none.
+	std::string_view Extension() const;
+};
+
+struct WalkOptions {
+	// Descend into subdirectories; false lists the root only.
+	bool Recursive = true;
+	// Deepest level reported, -1 for no limit.
+	int MaxDepth = -1;
+	// Directories listed at once; 0 uses one per logical processor.
+	unsigned Threads = 1;
+	bool Files = true;
+	bool Directories = true;
+	// Leaves out hidden and system entries, and does not descend into them.
+	bool SkipHidden = false;
+	// Descends into junctions and directory symbolic links. Off by default,
+	// since they can form cycles.
+	bool FollowLinks = false;
+	// Wildcards a file name must match, such as "*.log"; '*' and '?' are
+	// supported and case is ignored. Empty matches every file. Directories
+	// are not matched against them.
+	std::vector<std::string> Patterns;
+	// Called for each directory before it is reported or entered; returning
+	// false skips it and everything beneath it.
+	std::function<bool(const DirectoryEntry&)> DirectoryFilter;
+};
+
+// Recursive directory enumeration over FindFirstFileEx with large fetches.
+// Filters are applied to the raw listing before a path is built, and with
+// several threads idle workers take the next pending directory from a shared
+// stack, so deep and wide trees both keep every thread busy.
+//
+//     WalkOptions options;
+//     options.Threads = 0;
+//     options.Patterns = { "*.log" };
+//     uint64_t total = 0;
+//     DirectoryWalker::Walk("D:\\logs", [&](const DirectoryEntry& entry) {
+//         total += entry.Length;
+//         return true;
+//     }, options);
+class DirectoryWalker {
+public:
+	// Calls visit for every entry that passes the options; returning false
+	// stops the walk. The entry is only valid during the call. With several
+	// threads visit runs concurrently and directories finish in no
+	// particular order. Subdirectories that cannot be listed are skipped.
+	// Throws std::runtime_error if root cannot be listed; the first
+	// exception thrown by visit is rethrown. Returns the entries visited.
+	static uint64_t Walk(const std::string& root, const std::function<bool(const DirectoryEntry&)>& visit, const WalkOptions& options = WalkOptions());
+	// Every entry that passes the options.
+	static std::vector<DirectoryEntry> List(const std::string& root, const WalkOptions& options = WalkOptions());
+	// Matches name against a wildcard as WalkOptions::Patterns does.
+	static bool MatchPattern(std::string_view name, std::string_view pattern);
+};
@@ -1,8 +1,11 @@
 ﻿#pragma once
 #include "defines.h"
 #include "FileInfo.h"
+#include "MemoryMappedFile.h"
+#include "Span.h"
 #include <vector>
 #include <string>
+#include <string_view>
 enum class FileAttributes {
     ReadOnly = 0x1,
     Hidden = 0x2,
@@ -30,14 +33,22 @@ public:
 	static void Create(const std::string path);
 	static std::string ReadAllText(const std::string path);
 	static std::vector<uint8_t> ReadAllBytes(const std::string path);
+	// Maps the file read-only instead of copying it; empty if it cannot be opened.
+	static MemoryMappedFile MapAllBytes(const std::string path);
 	static std::vector<std::string> ReadAllLines(const std::string path);
-    static void WriteAllText(const std::string path, const std::string content);
-    static void WriteAllBytes(const std::string path, const std::vector<uint8_t> content);
+    static void WriteAllText(const std::string path, std::string_view content);
+    static void WriteAllBytes(const std::string path, ByteSpan content);
     static void WriteAllBytes(const std::string path, const uint8_t* content,size_t size);
     static void WriteAllLines(const std::string path, const std::vector<std::string> content);
-    static void AppendAllText(const std::string path, const std::string content);
-    static void AppendAllBytes(const std::string path, const std::vector<uint8_t> content);
+    static void AppendAllText(const std::string path, std::string_view content);
+    static void AppendAllBytes(const std::string path, ByteSpan content);
     static void AppendAllLines(const std::string path, const std::vector<std::string> content);
+    // Writes a temporary file next to path, flushes it to disk and swaps it
+    // in for path, so readers and a crash leave either the old or the whole
+    // new content. An existing path keeps its ACL, attributes and alternate
+    // streams. Returns false on failure, with path untouched.
+    static bool WriteAllBytesAtomic(const std::string path, ByteSpan content);
+    static bool WriteAllTextAtomic(const std::string path, std::string_view content);
     static void SetAttributes(const std::string path, FileAttributes attributes);
     static FileAttributes GetAttributes(const std::string path);
     static void SetCreationTime(const std::string path, FILETIME time);
@@ -0,0 +1,106 @@
+﻿#pragma once
+#include "defines.h"
+#include "FileStream.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Bytes of a file that start at the beginning of a line.
+struct LineRange {
+	uint64_t Offset;
+	uint64_t Length;
+};
+
+// Streams the lines of a file, or of text in memory, as string_views without
+// allocating per line. The file is read in large blocks and newlines are
+// located 64 bytes at a time with SSE2 or AVX2. A line ends at "\n", which is
+// not part of it, and a "\r" right before it is dropped too; the last line
+// need not end in a newline.
+//
+//     LineReader reader("app.log");
+//     for (std::string_view line : reader) { ... }
+class LineReader {
+public:
+	static constexpr size_t DefaultBlockSize = 1 << 20;
+
+	// Reads length bytes of the file from offset, which should be a line start
+	// (see Partition). Throws std::runtime_error if the file cannot be opened.
+	explicit LineReader(const std::string& path, uint64_t offset = 0, uint64_t length = UINT64_MAX, size_t blockSize = DefaultBlockSize);
+	// Lines of text that outlives the reader; nothing is copied.
+	static LineReader FromText(std::string_view text);
+	LineReader(LineReader&&) noexcept = default;
+	LineReader& operator=(LineReader&&) noexcept = default;
+	LineReader(const LineReader&) = delete;
+	LineReader& operator=(const LineReader&) = delete;
+
+	// The next line, valid until the following call. Returns false at the end
+	// of the input or when a read fails (see Failed()).
+	bool Next(std::string_view& line);
+	// Lines returned so far.
+	uint64_t LineNumber() const { return lines; }
+	bool Failed() const { return failed; }
+
+	class Iterator {
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = std::string_view;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const std::string_view*;
+		using reference = const std::string_view&;
+
+		Iterator() = default;
+		explicit Iterator(LineReader* reader) : reader(reader) { ++*this; }
+		reference operator*() const { return line; }
+		pointer operator->() const { return &line; }
+		Iterator& operator++() {
+			if (!reader->Next(line))
+				reader = nullptr;
+			return *this;
+		}
+		bool operator==(const Iterator& other) const { return reader == other.reader; }
+		bool operator!=(const Iterator& other) const { return reader != other.reader; }
+
+	private:
+		LineReader* reader = nullptr;
+		std::string_view line;
+	};
+	Iterator begin() { return Iterator(this); }
+	Iterator end() { return Iterator(); }
+
+	// Splits the file into at most parts ranges of about equal size, each
+	// starting at a line start, so that they can be read independently.
+	static std::vector<LineRange> Partition(const std::string& path, size_t parts);
+	// Calls body for every line of the file, reading several parts on
+	// threads at once. Lines of one part arrive in order on one thread; part
+	// is the index of that part, in file order. threads 0 uses one per
+	// logical processor. The first exception thrown by body is rethrown.
+	static void ParallelForEach(const std::string& path, const std::function<void(size_t part, std::string_view line)>& body, unsigned threads = 0);
+
+private:
+	LineReader() = default;
+
+	std::unique_ptr<FileStream> file;
+	// File offset of the next block and the bytes of the range left to read.
+	uint64_t fileOffset = 0;
+	uint64_t remaining = 0;
+	std::vector<char> buffer;
+	// Text read so far and not yet returned starts at position.
+	const char* data = nullptr;
+	size_t size = 0;
+	size_t position = 0;
+	// Newlines not yet returned in the 64 bytes at chunk, one bit each;
+	// scanned is where the next 64 bytes start.
+	uint64_t mask = 0;
+	size_t chunk = 0;
+	size_t scanned = 0;
+	uint64_t lines = 0;
+	bool failed = false;
+
+	bool Fill();
+	void Emit(size_t end, std::string_view& line);
+};
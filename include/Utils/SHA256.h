@@ -3,17 +3,39 @@
 #include <iomanip>
 #include <cstring>
 #include <cstdint>
+#include <array>
+#include <string>
+#include <vector>
+#include "Span.h"
 
 class SHA256 {
 public:
+    using Digest = std::array<uint8_t, 32>;
+
     SHA256() { init(); }
     void update(const uint8_t* input, size_t length);
     void finalize();
     std::string hexdigest() const;
+    Digest rawdigest() const;
+
+    static std::string hexdigest(const Digest& digest);
+
+    // Hashes independent messages. With the SHA extensions they are hashed
+    // one after another on them; otherwise side by side, one per SIMD lane:
+    // 16 with AVX-512 and 8 with AVX2, and single messages use the scalar code.
+    static void hash_batch(const ByteSpan* inputs, size_t count, Digest* output);
+    static std::vector<Digest> hash_batch(Span<const ByteSpan> inputs);
 
 private:
+    using LaneKernel = void (*)(uint32_t* state, const uint8_t* const* blocks);
+
     void init();
     void transform(const uint8_t block[64]);
+    void transform_blocks(const uint8_t* data, size_t blocks);
+    static void transform_shani(uint32_t state[8], const uint8_t* data, size_t blocks);
+    static void hash_lanes(size_t lanes, LaneKernel kernel, const ByteSpan* inputs, size_t count, Digest* output);
+    static void transform_x8(uint32_t* state, const uint8_t* const* blocks);
+    static void transform_x16(uint32_t* state, const uint8_t* const* blocks);
     void encode(uint8_t* output, const uint32_t* input, size_t length);
     void decode(uint32_t* output, const uint8_t* input, size_t length);
 